@@ -590,6 +590,223 @@ void DPS_SetNodeSubscriptionUpdateDelay(DPS_Node* node, uint32_t subsRateMsecs);
  */
 void DPS_SetNodeLinkLossTimeout(DPS_Node* node, uint32_t linkLossMsecs);
 
+/**
+ * What to do when a publication is received and the queue of
+ * subscription handler calls is full
+ */
+typedef enum {
+    DPS_HANDLER_QUEUE_BLOCK,       /**< Wait for a handler call to be taken off the queue */
+    DPS_HANDLER_QUEUE_DROP_NEWEST, /**< Drop the handler call being queued */
+    DPS_HANDLER_QUEUE_DROP_OLDEST  /**< Drop the oldest queued handler call */
+} DPS_HandlerQueuePolicy;
+
+/**
+ * Call the subscription handlers of a node on a pool of worker
+ * threads instead of on the node's thread.
+ *
+ * By default subscription handlers are called on the node's thread
+ * so a slow handler delays the node's network processing. When
+ * worker threads are configured handler calls are queued instead.
+ * The handler calls for any one subscription are made in the order
+ * the publications were received and are never concurrent. Handler
+ * calls for different subscriptions may be concurrent.
+ *
+ * Blocking when the queue is full holds up the node's thread before
+ * it processes more input until there is room. This throttles the
+ * node rather than dropping publications, the queue may briefly hold
+ * more than the maximum number of handler calls.
+ *
+ * This must be called before the node is started.
+ *
+ * @param node        The node
+ * @param numThreads  The number of worker threads, 0 to call handlers on the node's thread
+ * @param maxQueued   The maximum number of queued handler calls
+ * @param policy      What to do when the queue is full
+ *
+ * @return
+ * - DPS_OK if the configuration was set
+ * - DPS_ERR_NULL if the node is NULL
+ * - DPS_ERR_ARGS if numThreads is not 0 and maxQueued is 0
+ * - DPS_ERR_INVALID if the node has already been started
+ */
+DPS_Status DPS_SetNodeHandlerThreads(DPS_Node* node, size_t numThreads, size_t maxQueued,
+                                     DPS_HandlerQueuePolicy policy);
+
+/**
+ * Run the encryption, signing, decryption and verification of
+ * publications on the libuv thread pool instead of on the node's
+ * thread or the publishing thread.
+ *
+ * Publications are still sent, forwarded, and delivered to the
+ * subscription handlers in sequence number order. The size of the
+ * thread pool is set by the UV_THREADPOOL_SIZE environment variable.
+ *
+ * When enabled the key store handlers may be called concurrently
+ * from several threads.
+ *
+ * This must be called before the node is started.
+ *
+ * @param node     The node
+ * @param offload  DPS_TRUE to offload COSE operations, DPS_FALSE to run them inline
+ *
+ * @return
+ * - DPS_OK if the configuration was set
+ * - DPS_ERR_NULL if the node is NULL
+ * - DPS_ERR_INVALID if the node has already been started
+ */
+DPS_Status DPS_SetNodeCryptoOffload(DPS_Node* node, int offload);
+
+/**
+ * Receive on several threads, each with its own socket bound to the
+ * listening port, and let the kernel spread incoming datagrams across
+ * them.
+ *
+ * The receive threads decode publication headers and bloom filters,
+ * drop stale publications, and check for candidate subscriptions,
+ * then hand off the publication to the node's thread which updates
+ * the node state. Other messages are handed off to the node's thread
+ * for decoding. Datagrams from the same sender are always received on
+ * the same socket so they are processed in the order received.
+ *
+ * Only the UDP transport on platforms that support SO_REUSEPORT
+ * receives on multiple threads, otherwise this setting is ignored.
+ *
+ * This must be called before the node is started.
+ *
+ * @param node        The node
+ * @param numThreads  The number of receive threads in addition to the node's thread, 0 to only receive on the node's thread
+ *
+ * @return
+ * - DPS_OK if the configuration was set
+ * - DPS_ERR_NULL if the node is NULL
+ * - DPS_ERR_INVALID if the node has already been started
+ */
+DPS_Status DPS_SetNodeReceiveThreads(DPS_Node* node, size_t numThreads);
+
+/**
+ * Statistics of the receive threads of a node
+ */
+typedef struct _DPS_ReceiveThreadStats {
+    size_t numThreads;          /**< Number of receive threads running */
+    uint64_t received;          /**< Number of datagrams handed off to the node's thread */
+    uint64_t decoded;           /**< Number of publications decoded on the receive threads */
+    uint64_t dropped;           /**< Number of stale publications dropped on the receive threads */
+} DPS_ReceiveThreadStats;
+
+/**
+ * Get the statistics of the receive threads of a node
+ *
+ * The receive threads update the counts while they run so the
+ * statistics are a snapshot.
+ *
+ * @param node   The node
+ * @param stats  Returns the statistics, all zero if the node has no receive threads
+ *
+ * @return
+ * - DPS_OK if the statistics were returned
+ * - DPS_ERR_NULL if the node or stats is NULL
+ * - DPS_ERR_NOT_STARTED if the node has not been started
+ */
+DPS_Status DPS_GetNodeReceiveThreadStats(DPS_Node* node, DPS_ReceiveThreadStats* stats);
+
+/**
+ * Set the maximum number of publications kept in the publication
+ * history of a node.
+ *
+ * The history records the publications a node has recently received
+ * or sent so that duplicates are dropped and acknowledgements can be
+ * routed back to the publisher. When the history is full the least
+ * recently updated record is evicted. The default is 65536.
+ *
+ * This must be called before the node is started.
+ *
+ * @param node      The node
+ * @param maxCount  The maximum number of publications in the history
+ *
+ * @return
+ * - DPS_OK if the configuration was set
+ * - DPS_ERR_NULL if the node is NULL
+ * - DPS_ERR_ARGS if maxCount is 0
+ * - DPS_ERR_INVALID if the node has already been started
+ */
+DPS_Status DPS_SetNodeHistorySize(DPS_Node* node, size_t maxCount);
+
+/**
+ * Statistics of the publication history of a node
+ */
+typedef struct _DPS_HistoryStats {
+    size_t count;               /**< Number of publications in the history */
+    size_t maxCount;            /**< Maximum number of publications in the history */
+    uint64_t inserted;          /**< Number of publications added to the history */
+    uint64_t expired;           /**< Number of publications removed when their lifetime ended */
+    uint64_t evicted;           /**< Number of publications removed to keep the history within maxCount */
+} DPS_HistoryStats;
+
+/**
+ * Get the statistics of the publication history of a node
+ *
+ * @param node   The node
+ * @param stats  Returns the statistics
+ *
+ * @return
+ * - DPS_OK if the statistics were returned
+ * - DPS_ERR_NULL if the node or stats is NULL
+ * - DPS_ERR_NOT_STARTED if the node has not been started
+ */
+DPS_Status DPS_GetNodeHistoryStats(DPS_Node* node, DPS_HistoryStats* stats);
+
+/**
+ * The default ceiling (in bytes) of the pool a node allocates receive
+ * buffers from
+ */
+#define DPS_RX_BUFFER_POOL_MAX_BYTES (8 * 1024 * 1024)
+
+/**
+ * Set the ceiling of the pool a node allocates receive buffers from.
+ *
+ * Received messages are held in buffers from power of two size classes
+ * that are reused once the message is released. Each thread that
+ * receives keeps a small cache of free buffers so the pool is rarely
+ * locked. The buffers held by the pool, in use or free, never exceed
+ * the ceiling. Messages that do not fit within the ceiling or are
+ * larger than the largest size class fall back to a heap allocation.
+ * The default is DPS_RX_BUFFER_POOL_MAX_BYTES.
+ *
+ * This must be called before the node is started.
+ *
+ * @param node      The node
+ * @param maxBytes  The ceiling in bytes, 0 to allocate all receive buffers from the heap
+ *
+ * @return
+ * - DPS_OK if the configuration was set
+ * - DPS_ERR_NULL if the node is NULL
+ * - DPS_ERR_INVALID if the node has already been started
+ */
+DPS_Status DPS_SetNodeRxBufferPool(DPS_Node* node, size_t maxBytes);
+
+/**
+ * Statistics of the receive buffer pool of a node
+ */
+typedef struct _DPS_RxBufferPoolStats {
+    size_t bytes;               /**< Bytes of buffers held by the pool, in use or free */
+    size_t maxBytes;            /**< The ceiling of the pool */
+    size_t highWater;           /**< Largest number of bytes held by the pool */
+    uint64_t fallbacks;         /**< Number of buffers allocated from the heap instead of the pool */
+} DPS_RxBufferPoolStats;
+
+/**
+ * Get the statistics of the receive buffer pool of a node
+ *
+ * @param node   The node
+ * @param stats  Returns the statistics, all zero if the pool is disabled
+ *
+ * @return
+ * - DPS_OK if the statistics were returned
+ * - DPS_ERR_NULL if the node or stats is NULL
+ * - DPS_ERR_NOT_STARTED if the node has not been started
+ */
+DPS_Status DPS_GetNodeRxBufferPoolStats(DPS_Node* node, DPS_RxBufferPoolStats* stats);
+
 /**
  * Get the address this node is listening for connections on
  *
@@ -616,7 +833,9 @@ const char* DPS_GetListenAddressString(DPS_Node* node);
  * @param addr   The address of the remote node that was linked
  * @param status Indicates if the link completed or failed.  A status
  *               of DPS_ERR_EXISTS indicates the remote node is already
- *               linked.
+ *               linked. A status of DPS_ERR_INCOMPATIBLE indicates the
+ *               remote node refused the link because it is configured
+ *               with a different Bloom filter hash.
  * @param data   Application data passed in the call to DPS_Link()
  */
 typedef void (*DPS_OnLinkComplete)(DPS_Node* node, const DPS_NodeAddress* addr, DPS_Status status, void* data);
@@ -942,6 +1161,53 @@ typedef void (*DPS_PublishBufsComplete)(DPS_Publication* pub, const DPS_Buffer*
 DPS_Status DPS_PublishBufs(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs, int16_t ttl,
                            DPS_PublishBufsComplete cb, void* data);
 
+/**
+ * An entry in a batch of publications passed to DPS_PublishBatch().
+ */
+typedef struct _DPS_PublishBatchEntry {
+    DPS_Publication* pub;       /**< The publication to send */
+    const DPS_Buffer* bufs;     /**< Optional payload buffers */
+    size_t numBufs;             /**< The number of buffers */
+    int16_t ttl;                /**< Time to live in seconds - maximum TTL is about 9 hours */
+    DPS_Status status;          /**< The status of the publish of this entry */
+} DPS_PublishBatchEntry;
+
+/**
+ * Called when all of the entries in a batch passed to DPS_PublishBatch() have completed.
+ *
+ * @param entries    The entries passed to DPS_PublishBatch() with the status of each entry set
+ * @param numEntries The number of entries
+ * @param data       Application data passed to DPS_PublishBatch()
+ */
+typedef void (*DPS_PublishBatchComplete)(DPS_PublishBatchEntry* entries, size_t numEntries, void* data);
+
+/**
+ * Publish a batch of publications. This is equivalent to calling DPS_PublishBufs() for each
+ * entry in the batch but the entries are queued together and the node is woken up once for the
+ * whole batch. Entries for the same publication are sent in the order they appear in the batch.
+ *
+ * The status of each entry is set before this function returns for entries that could not be
+ * queued and when the entry completes for entries that were queued.
+ *
+ * @note When the ttl of an entry is greater than zero, the callback function will not be called
+ * until the publication expires, is replaced by a subsequent publish, is canceled, or is
+ * destroyed.
+ *
+ * @param entries      The entries to publish - the entries and the payload buffers must remain valid
+ *                     until the callback function is called. The publications must all belong to
+ *                     the same node.
+ * @param numEntries   The number of entries
+ * @param cb           Optional callback function called when all the queued entries are complete
+ * @param data         Data to be passed to the callback function
+ *
+ * @return
+ * - DPS_OK if at least one entry was queued, the callback will be called
+ * - The status of the first entry if none of the entries could be queued, the callback will not be called
+ * - Other error if the arguments are invalid, none of the entries are queued
+ */
+DPS_Status DPS_PublishBatch(DPS_PublishBatchEntry* entries, size_t numEntries, DPS_PublishBatchComplete cb,
+                            void* data);
+
 /**
  * Function prototype for callback function called when a publication is destroyed.
  *
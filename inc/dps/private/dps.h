@@ -60,6 +60,7 @@ extern "C" {
 #define DPS_CBOR_KEY_ACK_SEQ_NUM   13   /**< uint */
 #define DPS_CBOR_KEY_PATH          14   /**< tstr */
 #define DPS_CBOR_KEY_HOP_COUNT     15   /**< uint */
+#define DPS_CBOR_KEY_BLOOM_HASH    16   /**< uint */
 
 /**
  * Convert seconds to milliseconds
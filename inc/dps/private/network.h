@@ -71,13 +71,20 @@ typedef struct _DPS_MulticastReceiver DPS_MulticastReceiver;
  */
 void DPS_NetFreeBufs(uv_buf_t* bufs, size_t numBufs);
 
+/**
+ * Opaque type for a pool of receive buffers
+ */
+typedef struct _DPS_NetRxBufferPool DPS_NetRxBufferPool;
+
 /**
  * A reference counted receive buffer
  */
 typedef struct _DPS_NetRxBuffer {
     DPS_RxBuffer rx;            /**< The receive buffer */
     void* userData;             /**< Custom allocator data */
-    uint32_t refCount;          /**< The reference count */
+    uint32_t refCount;          /**< The reference count, updated atomically */
+    uint32_t sizeClass;         /**< The size class of a pooled buffer */
+    DPS_NetRxBufferPool* pool;  /**< The pool to return the buffer to, NULL if not pooled */
     uint8_t data[1];            /**< The buffer data */
 } DPS_NetRxBuffer;
 
@@ -93,6 +100,83 @@ typedef struct _DPS_NetRxBuffer {
  */
 DPS_NetRxBuffer* DPS_CreateNetRxBuffer(size_t len);
 
+/**
+ * Number of size classes of pooled receive buffers
+ */
+#define DPS_NET_RX_POOL_CLASSES 8
+
+/**
+ * A cache of free pooled buffers used by a single thread, see
+ * DPS_AttachNetRxBufferCache()
+ */
+typedef struct _DPS_NetRxBufferCache {
+    DPS_NetRxBufferPool* pool;                      /**< The pool the cache is attached to */
+    DPS_NetRxBuffer* free[DPS_NET_RX_POOL_CLASSES]; /**< Free buffers of each size class */
+    uint32_t numFree[DPS_NET_RX_POOL_CLASSES];      /**< Number of free buffers of each size class */
+} DPS_NetRxBufferCache;
+
+/**
+ * Create a pool of receive buffers.
+ *
+ * Pooled buffers come from power of two size classes and are returned
+ * to the pool for reuse when the last reference is released. The pool
+ * may be used from any thread.
+ *
+ * @param maxBytes  The ceiling of the memory held by the pool
+ *
+ * @return The pool or NULL if the allocation failed
+ */
+DPS_NetRxBufferPool* DPS_CreateNetRxBufferPool(size_t maxBytes);
+
+/**
+ * Release the creator's reference to a pool. The pool is freed once
+ * all of the buffers allocated from it are freed and all of the
+ * caches are detached.
+ *
+ * @param pool The pool, may be NULL
+ */
+void DPS_DestroyNetRxBufferPool(DPS_NetRxBufferPool* pool);
+
+/**
+ * Allocate a buffer for receiving data from a pool.
+ *
+ * The buffer is created with a reference count of 1.
+ * DPS_NetRxBufferDecRef() must be called to return it to the pool.
+ *
+ * @param pool The pool, if NULL the buffer is allocated with DPS_CreateNetRxBuffer()
+ * @param len  The desired length
+ *
+ * @return The created buffer or NULL if the allocation failed
+ */
+DPS_NetRxBuffer* DPS_CreatePooledNetRxBuffer(DPS_NetRxBufferPool* pool, size_t len);
+
+/**
+ * Attach a cache to the calling thread. Buffers of the pool are
+ * allocated from and freed to the cache without locking the pool
+ * while it is attached.
+ *
+ * @param pool   The pool, if NULL no cache is attached
+ * @param cache  The cache, owned by the caller until it is detached
+ */
+void DPS_AttachNetRxBufferCache(DPS_NetRxBufferPool* pool, DPS_NetRxBufferCache* cache);
+
+/**
+ * Return the free buffers of a cache to its pool and detach it from
+ * the calling thread. This must be called on the thread the cache
+ * was attached to.
+ *
+ * @param cache  The cache
+ */
+void DPS_DetachNetRxBufferCache(DPS_NetRxBufferCache* cache);
+
+/**
+ * Get the statistics of a pool
+ *
+ * @param pool   The pool, if NULL the statistics are all zero
+ * @param stats  Returns the statistics
+ */
+void DPS_GetNetRxBufferPoolStats(DPS_NetRxBufferPool* pool, DPS_RxBufferPoolStats* stats);
+
 /**
  * Increment the reference count of a buffer.
  *
@@ -101,7 +185,9 @@ DPS_NetRxBuffer* DPS_CreateNetRxBuffer(size_t len);
 void DPS_NetRxBufferIncRef(DPS_NetRxBuffer* buf);
 
 /**
- * Decrement the reference count of a buffer.
+ * Decrement the reference count of a buffer. May be called from any
+ * thread, the buffer is freed or returned to its pool on the thread
+ * that releases the last reference.
  *
  * @param buf The buffer
  */
@@ -279,6 +365,14 @@ DPS_NetContext* DPS_NetStart(DPS_Node* node, const DPS_NodeAddress* addr, DPS_On
  */
 DPS_NodeAddress* DPS_NetGetListenAddress(DPS_NodeAddress* addr, DPS_NetContext* netCtx);
 
+/**
+ * Get the statistics of the threads receiving for the netCtx
+ *
+ * @param netCtx  Pointer to an opaque data structure that holds the state of the netCtx.
+ * @param stats   Returns the statistics, all zero if the transport does not receive on other threads
+ */
+void DPS_NetGetReceiveThreadStats(DPS_NetContext* netCtx, DPS_ReceiveThreadStats* stats);
+
 /**
  * Stop listening for data
  *
@@ -322,6 +416,30 @@ typedef void (*DPS_NetSendComplete)(DPS_Node* node, void* appCtx, DPS_NetEndpoin
 DPS_Status DPS_NetSend(DPS_Node* node, void* appCtx, DPS_NetEndpoint* endpoint,
                        uv_buf_t* bufs, size_t numBufs, DPS_NetSendComplete sendCompleteCB);
 
+/**
+ * Send the same data to a number of endpoints.
+ *
+ * The send complete callback is called once for each endpoint. It
+ * may be called before this function returns for an endpoint the
+ * send could not be started to.
+ *
+ * @param node            Pointer to the DPS node
+ * @param appCtx          An application context to be passed to the send
+ *                        complete callback
+ * @param endpoints       The endpoints to send to - note these may be updated
+ *                        with connection state information.
+ * @param numEndpoints    Number of endpoints to send to
+ * @param bufs            Data buffers to send, the data in the buffers must be
+ *                        live until the send to every endpoint completes.
+ * @param numBufs         Number of buffers to send
+ * @param sendCompleteCB  Function called when the send to an endpoint is complete
+ *
+ * @return DPS_OK if the sends were started, an error otherwise. The
+ *         send complete callback is not called if an error is returned.
+ */
+DPS_Status DPS_NetSendMany(DPS_Node* node, void* appCtx, DPS_NetEndpoint** endpoints, size_t numEndpoints,
+                           uv_buf_t* bufs, size_t numBufs, DPS_NetSendComplete sendCompleteCB);
+
 /**
  * Increment the reference count to potentially keeping a underlying connection alive. This is only
  * meaningful for connection-oriented transports.
@@ -391,6 +509,17 @@ DPS_NodeAddress* DPS_NetSetAddr(DPS_NodeAddress* addr, DPS_NodeAddressType type,
   */
 int DPS_CmpAddr(const DPS_NodeAddress* addr1, const DPS_NodeAddress* addr2);
 
+/**
+ * Hash an address. For IP the address is mapped if needed to IpV6 form
+ * before being hashed so addresses that are the same according to
+ * DPS_SameAddr() have the same hash.
+ *
+ * @param  addr  The address to hash
+ *
+ * @return  The hash of the address
+ */
+uint32_t DPS_HashAddr(const DPS_NodeAddress* addr);
+
 /**
  * Maps the supplied address to a v6 address if needed.
  *
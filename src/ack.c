@@ -123,7 +123,6 @@ DPS_Status DPS_SendAcknowledgement(PublicationAck* ack, DPS_NetEndpoint* ep)
     DPS_Node* node = ack->pub->node;
     uv_buf_t uvBufs[NUM_INTERNAL_ACK_BUFS + DPS_BUFS_MAX];
     int loopback = DPS_FALSE;
-    DPS_Publication* pub;
     DPS_Status ret;
     size_t i;
 
@@ -137,11 +136,8 @@ DPS_Status DPS_SendAcknowledgement(PublicationAck* ack, DPS_NetEndpoint* ep)
     /*
      * See if this is an ACK for a local publication
      */
-    for (pub = node->publications; pub != NULL; pub = pub->next) {
-        if ((pub->flags & PUB_FLAG_LOCAL) && (DPS_UUIDCompare(&pub->pubId, &ack->pub->pubId) == 0)) {
-            loopback = DPS_TRUE;
-            break;
-        }
+    if (DPS_FindPublication(node, &ack->pub->pubId, PUB_FLAG_LOCAL, PUB_FLAG_LOCAL)) {
+        loopback = DPS_TRUE;
     }
 
     if (loopback) {
@@ -261,8 +257,10 @@ static DPS_Status SerializeAck(const DPS_Publication* pub, PublicationAck* ack,
 
         DPS_RxBufferInit(&aadBuf, aadPos, ack->bufs[0].txPos - aadPos);
         if (pub->recipientsCount) {
+            uv_mutex_lock(&node->pubLock);
             ret = DPS_MakeNonce(&ack->pub->pubId, ack->sequenceNum, DPS_MSG_TYPE_ACK,
                                 pub->recipients[0].alg, node->rbg, nonce);
+            uv_mutex_unlock(&node->pubLock);
             if (ret == DPS_OK) {
                 ret = COSE_Encrypt(COSE_ALG_A256GCM, nonce, node->signer.alg ? &node->signer : NULL,
                                    pub->recipients, pub->recipientsCount, &aadBuf, &ack->bufs[1],
@@ -23,8 +23,10 @@
 #include <assert.h>
 #include <safe_lib.h>
 #include <stdlib.h>
+#include <string.h>
 #include <dps/dbg.h>
 #include <dps/private/cbor.h>
+#include <uv.h>
 #include "bitvec.h"
 #include "compat.h"
 #include "sha2.h"
@@ -54,6 +56,28 @@ DPS_DEBUG_CONTROL(DPS_DEBUG_OFF);
 #error "Default DPS_CONFIG_HASHES must be in range 1..16"
 #endif
 
+#ifndef DPS_CONFIG_BLOOM_HASH
+#define DPS_CONFIG_BLOOM_HASH DPS_BloomHashSha2
+#endif
+
+/*
+ * Number of entries in the Bloom filter hash cache, 0 disables the cache
+ */
+#ifndef DPS_BLOOM_CACHE_ENTRIES
+#define DPS_BLOOM_CACHE_ENTRIES 1024
+#endif
+
+/*
+ * Longest data that is cached, longer data is always hashed
+ */
+#ifndef DPS_BLOOM_CACHE_KEY_LEN
+#define DPS_BLOOM_CACHE_KEY_LEN 96
+#endif
+
+#if DPS_BLOOM_CACHE_KEY_LEN > 255
+#error "DPS_BLOOM_CACHE_KEY_LEN must be less than 256"
+#endif
+
 /*
  * Flag that indicates if serialized bit vector was rle encode or sent raw
  */
@@ -82,7 +106,17 @@ typedef uint16_t count_t;
 #define CV_MAX UINT16_MAX
 #endif
 
+#ifdef DPS_BIT_SLICED_COUNTER
+/*
+ * The counts for the 64 bits of a chunk are stored vertically, each
+ * chunk in the counter holds one bit of all 64 counts. This allows the
+ * counts to be updated and compared 64 at a time using word operations.
+ */
+#define COUNTER_BITS (8 * sizeof(count_t))
+typedef chunk_t counter_t[COUNTER_BITS];
+#else
 typedef count_t counter_t[CHUNK_SIZE];
+#endif
 
 #define SET_BIT(a, b)  (a)[(b) >> 6] |= (1ull << ((b) & 0x3F))
 #define TEST_BIT(a, b) ((a)[(b) >> 6] & (1ull << ((b) & 0x3F)))
@@ -125,6 +159,7 @@ static inline uint32_t COUNT_TZ(uint64_t n)
 
 struct _DPS_BitVector {
     int32_t popCount;
+    uint8_t sparse;    /* TRUE if the set bits are held in the index array */
     size_t len;
     chunk_t bits[1];
 };
@@ -132,145 +167,1423 @@ struct _DPS_BitVector {
 struct _DPS_CountVector {
     size_t entries;
     size_t len;
+    uint32_t revision;
     DPS_BitVector* bvUnion;
+    DPS_BitVector* bvIntersection;
+    int intersectionStale;
+    uint32_t* chunkRevisions;  /* Revision at which each chunk of the counts last changed */
     counter_t counts[1];
 };
 
 typedef struct {
     size_t bitLen;
     uint8_t numHashes;
+    DPS_BloomHash bloomHash;
 } Configuration;
 
 /*
  * Compile time defaults for the configuration parameters
  */
-static Configuration config = { DPS_CONFIG_BIT_LEN, (uint8_t)DPS_CONFIG_HASHES };
+static Configuration config = { DPS_CONFIG_BIT_LEN, (uint8_t)DPS_CONFIG_HASHES, DPS_CONFIG_BLOOM_HASH };
 
 #define NUM_CHUNKS(bv)  ((bv)->len / CHUNK_SIZE)
 
 #define FH_BITVECTOR_LEN  (4 * CHUNK_SIZE)
 
-#ifdef DPS_DEBUG
 /*
- * This is a compressed bit dump - it groups bits to keep
- * the total output readable. This is usually more useful
- * than dumping raw 8K long bit vectors.
+ * Bit vectors with only a few bits set, such as the bloom filter of a
+ * publication with a handful of topics, are held as a sorted array of
+ * the indices of the set bits. The index array is stored after the
+ * chunks and has room for one index per chunk so an operation on a
+ * sparse bit vector never costs more than on a dense one. The chunks
+ * are stale while a bit vector is sparse and the population count is
+ * always known.
+ *
+ * Bit vectors outside of the range below are always dense.
  */
-static void CompressedBitDump(const chunk_t* data, size_t bits)
+#define SPARSE_MIN_LEN  1024
+#define SPARSE_MAX_LEN  65536
+
+#define INDICES(bv)  ((uint16_t*)((bv)->bits + NUM_CHUNKS(bv)))
+
+/*
+ * The data-parallel bit vector operations are dispatched through a
+ * table of kernels. The generic kernels process one chunk at a time
+ * and are always available, vectorized kernels are selected at
+ * runtime according to the capabilities of the CPU. Defining
+ * DPS_NO_SIMD at build time restricts the selection to the generic
+ * kernels.
+ *
+ * The vectorized kernels hand any chunks that do not fill a complete
+ * vector register over to the generic kernels.
+ */
+typedef struct {
+    const char* name;
+    int (*includes)(const chunk_t* b1, const chunk_t* b2, size_t n);
+    int (*intersection)(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n);
+    int (*exclusiveOr)(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n);
+    void (*unite)(chunk_t* out, const chunk_t* b, size_t n);
+    int (*equals)(const chunk_t* b1, const chunk_t* b2, size_t n);
+    uint32_t (*popCount)(const chunk_t* b, size_t n);
+    int (*isClear)(const chunk_t* b, size_t n);
+    uint32_t (*squash)(const chunk_t* b, size_t n, chunk_t* s);
+} Kernels;
+
+/*
+ * Inclusion test for the remaining chunks, b1un is the union of
+ * the chunks of b1 that have already been tested.
+ */
+static int IncludesRemainder(const chunk_t* b1, const chunk_t* b2, size_t n, chunk_t b1un)
 {
-    size_t stride = bits < 128 ? 1 : bits / 128;
     size_t i;
-    for (i = 0; i < bits; i += stride) {
-        int bit = 0;
-        size_t j;
-        for (j = 0; j < stride; ++j) {
-            if (TEST_BIT(data, i + j)) {
-                bit = 1;
-                break;
-            }
+
+    for (i = 0; i < n; ++i) {
+        if ((b1[i] & b2[i]) != b2[i]) {
+            return DPS_FALSE;
         }
-        putc(bit ? '1' : '0', stderr);
+        b1un |= b1[i];
     }
-    putc('\n', stderr);
+    return b1un != 0;
+}
+
+static int IncludesGeneric(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    return IncludesRemainder(b1, b2, n, 0);
+}
+
+static int IntersectionGeneric(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    chunk_t nz = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        nz |= (out[i] = b1[i] & b2[i]);
+    }
+    return nz != 0;
+}
+
+static int XorGeneric(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    chunk_t diff = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        diff |= (out[i] = b1[i] ^ b2[i]);
+    }
+    return diff != 0;
+}
+
+static void UnionGeneric(chunk_t* out, const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        out[i] |= b[i];
+    }
+}
+
+static int EqualsGeneric(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (b1[i] != b2[i]) {
+            return DPS_FALSE;
+        }
+    }
+    return DPS_TRUE;
+}
+
+static uint32_t PopCountGeneric(const chunk_t* b, size_t n)
+{
+    uint32_t popCount = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        popCount += POPCOUNT(b[i]);
+    }
+    return popCount;
+}
+
+static int IsClearGeneric(const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (b[i]) {
+            return DPS_FALSE;
+        }
+    }
+    return DPS_TRUE;
+}
+
+/*
+ * Squash the chunks into a single chunk and return the population count
+ */
+static uint32_t SquashGeneric(const chunk_t* b, size_t n, chunk_t* s)
+{
+    uint32_t popCount = 0;
+    chunk_t sq = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        popCount += POPCOUNT(b[i]);
+        sq |= b[i];
+    }
+    *s = sq;
+    return popCount;
 }
+
+static const Kernels GenericKernels = {
+    "generic",
+    IncludesGeneric,
+    IntersectionGeneric,
+    XorGeneric,
+    UnionGeneric,
+    EqualsGeneric,
+    PopCountGeneric,
+    IsClearGeneric,
+    SquashGeneric
+};
+
+#if !defined(DPS_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define USE_X86_KERNELS
+
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define TARGET_SSE42   __attribute__((target("sse4.2,popcnt")))
+#define TARGET_AVX2    __attribute__((target("avx2,popcnt")))
+#define TARGET_AVX512  __attribute__((target("avx512f,avx2,popcnt")))
+#else
+#include <intrin.h>
+#define TARGET_SSE42
+#define TARGET_AVX2
+#define TARGET_AVX512
 #endif
 
-#define MIN_HASHES    1
-#define MAX_HASHES    8
+/*
+ * SSE4.2 kernels - 2 chunks per iteration
+ */
+static TARGET_SSE42 int IncludesSSE42(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m128i un = _mm_setzero_si128();
+    size_t i;
 
-DPS_Status DPS_Configure(size_t bitLen, size_t numHashes)
+    for (i = 0; (i + 2) <= n; i += 2) {
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(b1 + i));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(b2 + i));
+        /*
+         * The carry flag is set when all bits of v2 are also set in v1
+         */
+        if (!_mm_testc_si128(v1, v2)) {
+            return DPS_FALSE;
+        }
+        un = _mm_or_si128(un, v1);
+    }
+    return IncludesRemainder(b1 + i, b2 + i, n - i, !_mm_testz_si128(un, un));
+}
+
+static TARGET_SSE42 int IntersectionSSE42(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
 {
-    if (bitLen & 63) {
-        DPS_ERRPRINT("Bit length must be a multiple of 64\n");
-        return DPS_ERR_ARGS;
+    __m128i nz = _mm_setzero_si128();
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(b1 + i)),
+                                  _mm_loadu_si128((const __m128i*)(b2 + i)));
+        _mm_storeu_si128((__m128i*)(out + i), v);
+        nz = _mm_or_si128(nz, v);
     }
-    if (numHashes < MIN_HASHES || numHashes > MAX_HASHES) {
-        DPS_ERRPRINT("Number of hashes must be in the range 1..16\n");
-        return DPS_ERR_ARGS;
+    return IntersectionGeneric(out + i, b1 + i, b2 + i, n - i) | !_mm_testz_si128(nz, nz);
+}
+
+static TARGET_SSE42 int XorSSE42(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m128i diff = _mm_setzero_si128();
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(b1 + i)),
+                                  _mm_loadu_si128((const __m128i*)(b2 + i)));
+        _mm_storeu_si128((__m128i*)(out + i), v);
+        diff = _mm_or_si128(diff, v);
     }
-    config.bitLen = bitLen;
-    config.numHashes = (uint8_t)numHashes;
-    return DPS_ERR_OK;
+    return XorGeneric(out + i, b1 + i, b2 + i, n - i) | !_mm_testz_si128(diff, diff);
 }
 
-static DPS_BitVector* AllocBV(size_t sz)
+static TARGET_SSE42 void UnionSSE42(chunk_t* out, const chunk_t* b, size_t n)
 {
-    DPS_BitVector* bv;
+    size_t i;
 
-    assert((sz % 64) == 0);
-    bv = calloc(1, sizeof(DPS_BitVector) + ((sz / CHUNK_SIZE) - 1) * sizeof(chunk_t));
-    if (bv) {
-        bv->len = sz;
-        INVALIDATE_POPCOUNT(bv);
+    for (i = 0; (i + 2) <= n; i += 2) {
+        __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i*)(out + i)),
+                                 _mm_loadu_si128((const __m128i*)(b + i)));
+        _mm_storeu_si128((__m128i*)(out + i), v);
     }
-    return bv;
+    UnionGeneric(out + i, b + i, n - i);
 }
 
-DPS_BitVector* DPS_BitVectorAlloc()
+static TARGET_SSE42 int EqualsSSE42(const chunk_t* b1, const chunk_t* b2, size_t n)
 {
-    return AllocBV(config.bitLen);
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(b1 + i)),
+                                  _mm_loadu_si128((const __m128i*)(b2 + i)));
+        if (!_mm_testz_si128(v, v)) {
+            return DPS_FALSE;
+        }
+    }
+    return EqualsGeneric(b1 + i, b2 + i, n - i);
 }
 
-DPS_BitVector* DPS_BitVectorAllocFH()
+static TARGET_SSE42 uint32_t PopCountSSE42(const chunk_t* b, size_t n)
 {
-    return AllocBV(FH_BITVECTOR_LEN);
+    uint64_t popCount = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        popCount += _mm_popcnt_u64(b[i]);
+    }
+    return (uint32_t)popCount;
 }
 
-int DPS_BitVectorIsClear(DPS_BitVector* bv)
+static TARGET_SSE42 int IsClearSSE42(const chunk_t* b, size_t n)
 {
-    if (UNKNOWN_POPCOUNT(bv)) {
-        size_t i;
-        for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-            if (bv->bits[i]) {
-                return DPS_FALSE;
-            }
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(b + i));
+        if (!_mm_testz_si128(v, v)) {
+            return DPS_FALSE;
+        }
+    }
+    return IsClearGeneric(b + i, n - i);
+}
+
+static TARGET_SSE42 uint32_t SquashSSE42(const chunk_t* b, size_t n, chunk_t* s)
+{
+    uint64_t popCount = 0;
+    chunk_t sq = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        popCount += _mm_popcnt_u64(b[i]);
+        sq |= b[i];
+    }
+    *s = sq;
+    return (uint32_t)popCount;
+}
+
+static const Kernels SSE42Kernels = {
+    "sse4.2",
+    IncludesSSE42,
+    IntersectionSSE42,
+    XorSSE42,
+    UnionSSE42,
+    EqualsSSE42,
+    PopCountSSE42,
+    IsClearSSE42,
+    SquashSSE42
+};
+
+/*
+ * AVX2 kernels - 4 chunks per iteration
+ */
+static TARGET_AVX2 int IncludesAVX2(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m256i un = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(b1 + i));
+        __m256i v2 = _mm256_loadu_si256((const __m256i*)(b2 + i));
+        if (!_mm256_testc_si256(v1, v2)) {
+            return DPS_FALSE;
+        }
+        un = _mm256_or_si256(un, v1);
+    }
+    return IncludesRemainder(b1 + i, b2 + i, n - i, !_mm256_testz_si256(un, un));
+}
+
+static TARGET_AVX2 int IntersectionAVX2(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m256i nz = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(b1 + i)),
+                                     _mm256_loadu_si256((const __m256i*)(b2 + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+        nz = _mm256_or_si256(nz, v);
+    }
+    return IntersectionGeneric(out + i, b1 + i, b2 + i, n - i) | !_mm256_testz_si256(nz, nz);
+}
+
+static TARGET_AVX2 int XorAVX2(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m256i diff = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(b1 + i)),
+                                     _mm256_loadu_si256((const __m256i*)(b2 + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+        diff = _mm256_or_si256(diff, v);
+    }
+    return XorGeneric(out + i, b1 + i, b2 + i, n - i) | !_mm256_testz_si256(diff, diff);
+}
+
+static TARGET_AVX2 void UnionAVX2(chunk_t* out, const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(out + i)),
+                                    _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+    }
+    UnionGeneric(out + i, b + i, n - i);
+}
+
+static TARGET_AVX2 int EqualsAVX2(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(b1 + i)),
+                                     _mm256_loadu_si256((const __m256i*)(b2 + i)));
+        if (!_mm256_testz_si256(v, v)) {
+            return DPS_FALSE;
+        }
+    }
+    return EqualsGeneric(b1 + i, b2 + i, n - i);
+}
+
+/*
+ * Per-byte population count using a nibble lookup table, the bytes
+ * are then summed into four 64 bit lanes.
+ */
+static TARGET_AVX2 __m256i PopCount256(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+static TARGET_AVX2 uint32_t SumLanes256(__m256i v)
+{
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return (uint32_t)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+static TARGET_AVX2 uint32_t PopCountAVX2(const chunk_t* b, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        acc = _mm256_add_epi64(acc, PopCount256(_mm256_loadu_si256((const __m256i*)(b + i))));
+    }
+    return SumLanes256(acc) + PopCountSSE42(b + i, n - i);
+}
+
+static TARGET_AVX2 int IsClearAVX2(const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(b + i));
+        if (!_mm256_testz_si256(v, v)) {
+            return DPS_FALSE;
+        }
+    }
+    return IsClearGeneric(b + i, n - i);
+}
+
+static TARGET_AVX2 uint32_t SquashAVX2(const chunk_t* b, size_t n, chunk_t* s)
+{
+    __m256i acc = _mm256_setzero_si256();
+    __m256i sq = _mm256_setzero_si256();
+    __m128i sq128;
+    uint32_t popCount;
+    chunk_t rem;
+    size_t i;
+
+    for (i = 0; (i + 4) <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(b + i));
+        acc = _mm256_add_epi64(acc, PopCount256(v));
+        sq = _mm256_or_si256(sq, v);
+    }
+    popCount = SumLanes256(acc) + SquashSSE42(b + i, n - i, &rem);
+    sq128 = _mm_or_si128(_mm256_castsi256_si128(sq), _mm256_extracti128_si256(sq, 1));
+    *s = rem | (chunk_t)_mm_cvtsi128_si64(sq128) | (chunk_t)_mm_extract_epi64(sq128, 1);
+    return popCount;
+}
+
+static const Kernels AVX2Kernels = {
+    "avx2",
+    IncludesAVX2,
+    IntersectionAVX2,
+    XorAVX2,
+    UnionAVX2,
+    EqualsAVX2,
+    PopCountAVX2,
+    IsClearAVX2,
+    SquashAVX2
+};
+
+/*
+ * AVX-512 kernels - 8 chunks per iteration. The population count
+ * kernels are shared with AVX2, AVX-512F does not have a vector
+ * population count instruction.
+ */
+static TARGET_AVX512 int IncludesAVX512(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m512i un = _mm512_setzero_si512();
+    size_t i;
+
+    for (i = 0; (i + 8) <= n; i += 8) {
+        __m512i v1 = _mm512_loadu_si512((const void*)(b1 + i));
+        __m512i v2 = _mm512_loadu_si512((const void*)(b2 + i));
+        __m512i missing = _mm512_andnot_si512(v1, v2);
+        if (_mm512_test_epi64_mask(missing, missing)) {
+            return DPS_FALSE;
+        }
+        un = _mm512_or_si512(un, v1);
+    }
+    return IncludesRemainder(b1 + i, b2 + i, n - i, _mm512_test_epi64_mask(un, un) != 0);
+}
+
+static TARGET_AVX512 int IntersectionAVX512(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m512i nz = _mm512_setzero_si512();
+    size_t i;
+
+    for (i = 0; (i + 8) <= n; i += 8) {
+        __m512i v = _mm512_and_si512(_mm512_loadu_si512((const void*)(b1 + i)),
+                                     _mm512_loadu_si512((const void*)(b2 + i)));
+        _mm512_storeu_si512((void*)(out + i), v);
+        nz = _mm512_or_si512(nz, v);
+    }
+    return IntersectionAVX2(out + i, b1 + i, b2 + i, n - i) | (_mm512_test_epi64_mask(nz, nz) != 0);
+}
+
+static TARGET_AVX512 int XorAVX512(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    __m512i diff = _mm512_setzero_si512();
+    size_t i;
+
+    for (i = 0; (i + 8) <= n; i += 8) {
+        __m512i v = _mm512_xor_si512(_mm512_loadu_si512((const void*)(b1 + i)),
+                                     _mm512_loadu_si512((const void*)(b2 + i)));
+        _mm512_storeu_si512((void*)(out + i), v);
+        diff = _mm512_or_si512(diff, v);
+    }
+    return XorAVX2(out + i, b1 + i, b2 + i, n - i) | (_mm512_test_epi64_mask(diff, diff) != 0);
+}
+
+static TARGET_AVX512 void UnionAVX512(chunk_t* out, const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 8) <= n; i += 8) {
+        __m512i v = _mm512_or_si512(_mm512_loadu_si512((const void*)(out + i)),
+                                    _mm512_loadu_si512((const void*)(b + i)));
+        _mm512_storeu_si512((void*)(out + i), v);
+    }
+    UnionAVX2(out + i, b + i, n - i);
+}
+
+static TARGET_AVX512 int EqualsAVX512(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 8) <= n; i += 8) {
+        if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512((const void*)(b1 + i)),
+                                     _mm512_loadu_si512((const void*)(b2 + i)))) {
+            return DPS_FALSE;
+        }
+    }
+    return EqualsAVX2(b1 + i, b2 + i, n - i);
+}
+
+static TARGET_AVX512 int IsClearAVX512(const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 8) <= n; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void*)(b + i));
+        if (_mm512_test_epi64_mask(v, v)) {
+            return DPS_FALSE;
+        }
+    }
+    return IsClearAVX2(b + i, n - i);
+}
+
+static const Kernels AVX512Kernels = {
+    "avx512",
+    IncludesAVX512,
+    IntersectionAVX512,
+    XorAVX512,
+    UnionAVX512,
+    EqualsAVX512,
+    PopCountAVX2,
+    IsClearAVX512,
+    SquashAVX2
+};
+
+#if defined(__GNUC__)
+#define CPU_HAS_SSE42()   (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+#define CPU_HAS_AVX2()    __builtin_cpu_supports("avx2")
+#define CPU_HAS_AVX512()  __builtin_cpu_supports("avx512f")
+#else
+/*
+ * Check the CPUID feature bits and that the OS saves the extended
+ * register state (XCR0) required by the AVX kernels
+ */
+static int CpuHas(int leaf, int reg, int bit, uint64_t xcr0)
+{
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < leaf) {
+        return DPS_FALSE;
+    }
+    __cpuidex(info, leaf, 0);
+    if (!((info[reg] >> bit) & 1)) {
+        return DPS_FALSE;
+    }
+    if (xcr0) {
+        __cpuid(info, 1);
+        if (!((info[2] >> 27) & 1) || ((_xgetbv(0) & xcr0) != xcr0)) {
+            return DPS_FALSE;
+        }
+    }
+    return DPS_TRUE;
+}
+#define CPU_HAS_SSE42()   (CpuHas(1, 2, 20, 0) && CpuHas(1, 2, 23, 0))
+#define CPU_HAS_AVX2()    CpuHas(7, 1, 5, 0x06)
+#define CPU_HAS_AVX512()  CpuHas(7, 1, 16, 0xE6)
+#endif
+
+#elif !defined(DPS_NO_SIMD) && defined(__aarch64__)
+#define USE_NEON_KERNELS
+
+#include <arm_neon.h>
+
+/*
+ * NEON kernels - 2 chunks per iteration. NEON is mandatory on
+ * AArch64 so no runtime check is required.
+ */
+static int IncludesNEON(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    uint64x2_t un = vdupq_n_u64(0);
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        uint64x2_t v1 = vld1q_u64(b1 + i);
+        uint64x2_t v2 = vld1q_u64(b2 + i);
+        if (vmaxvq_u32(vreinterpretq_u32_u64(vbicq_u64(v2, v1)))) {
+            return DPS_FALSE;
+        }
+        un = vorrq_u64(un, v1);
+    }
+    return IncludesRemainder(b1 + i, b2 + i, n - i, vgetq_lane_u64(un, 0) | vgetq_lane_u64(un, 1));
+}
+
+static int IntersectionNEON(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    uint64x2_t nz = vdupq_n_u64(0);
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        uint64x2_t v = vandq_u64(vld1q_u64(b1 + i), vld1q_u64(b2 + i));
+        vst1q_u64(out + i, v);
+        nz = vorrq_u64(nz, v);
+    }
+    return IntersectionGeneric(out + i, b1 + i, b2 + i, n - i) |
+        ((vgetq_lane_u64(nz, 0) | vgetq_lane_u64(nz, 1)) != 0);
+}
+
+static int XorNEON(chunk_t* out, const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    uint64x2_t diff = vdupq_n_u64(0);
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        uint64x2_t v = veorq_u64(vld1q_u64(b1 + i), vld1q_u64(b2 + i));
+        vst1q_u64(out + i, v);
+        diff = vorrq_u64(diff, v);
+    }
+    return XorGeneric(out + i, b1 + i, b2 + i, n - i) |
+        ((vgetq_lane_u64(diff, 0) | vgetq_lane_u64(diff, 1)) != 0);
+}
+
+static void UnionNEON(chunk_t* out, const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        vst1q_u64(out + i, vorrq_u64(vld1q_u64(out + i), vld1q_u64(b + i)));
+    }
+    UnionGeneric(out + i, b + i, n - i);
+}
+
+static int EqualsNEON(const chunk_t* b1, const chunk_t* b2, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        uint64x2_t v = veorq_u64(vld1q_u64(b1 + i), vld1q_u64(b2 + i));
+        if (vmaxvq_u32(vreinterpretq_u32_u64(v))) {
+            return DPS_FALSE;
+        }
+    }
+    return EqualsGeneric(b1 + i, b2 + i, n - i);
+}
+
+static uint32_t PopCountNEON(const chunk_t* b, size_t n)
+{
+    uint32_t popCount = 0;
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        popCount += vaddlvq_u8(vcntq_u8(vreinterpretq_u8_u64(vld1q_u64(b + i))));
+    }
+    return popCount + PopCountGeneric(b + i, n - i);
+}
+
+static int IsClearNEON(const chunk_t* b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        if (vmaxvq_u32(vreinterpretq_u32_u64(vld1q_u64(b + i)))) {
+            return DPS_FALSE;
+        }
+    }
+    return IsClearGeneric(b + i, n - i);
+}
+
+static uint32_t SquashNEON(const chunk_t* b, size_t n, chunk_t* s)
+{
+    uint64x2_t sq = vdupq_n_u64(0);
+    uint32_t popCount = 0;
+    chunk_t rem;
+    size_t i;
+
+    for (i = 0; (i + 2) <= n; i += 2) {
+        uint64x2_t v = vld1q_u64(b + i);
+        popCount += vaddlvq_u8(vcntq_u8(vreinterpretq_u8_u64(v)));
+        sq = vorrq_u64(sq, v);
+    }
+    popCount += SquashGeneric(b + i, n - i, &rem);
+    *s = rem | vgetq_lane_u64(sq, 0) | vgetq_lane_u64(sq, 1);
+    return popCount;
+}
+
+static const Kernels NEONKernels = {
+    "neon",
+    IncludesNEON,
+    IntersectionNEON,
+    XorNEON,
+    UnionNEON,
+    EqualsNEON,
+    PopCountNEON,
+    IsClearNEON,
+    SquashNEON
+};
+#endif
+
+/*
+ * The compiled kernels from narrowest to widest
+ */
+static const Kernels* const AllKernels[] = {
+    &GenericKernels,
+#if defined(USE_X86_KERNELS)
+    &SSE42Kernels,
+    &AVX2Kernels,
+    &AVX512Kernels,
+#elif defined(USE_NEON_KERNELS)
+    &NEONKernels,
+#endif
+};
+
+#define NUM_KERNELS  (sizeof(AllKernels) / sizeof(AllKernels[0]))
+
+static const Kernels* kernels = &GenericKernels;
+static uv_once_t kernelsOnce = UV_ONCE_INIT;
+
+static int KernelsSupported(const Kernels* k)
+{
+#if defined(USE_X86_KERNELS)
+    if (k == &AVX512Kernels) {
+        return CPU_HAS_AVX512();
+    }
+    if (k == &AVX2Kernels) {
+        return CPU_HAS_AVX2();
+    }
+    if (k == &SSE42Kernels) {
+        return CPU_HAS_SSE42();
+    }
+#endif
+    return DPS_TRUE;
+}
+
+/*
+ * Pick the widest kernels supported by the CPU, called once before
+ * the first bit vector is allocated
+ */
+static void SelectKernels(void)
+{
+    size_t i = NUM_KERNELS;
+
+#if defined(USE_X86_KERNELS) && defined(__GNUC__)
+    __builtin_cpu_init();
+#endif
+    while (!KernelsSupported(AllKernels[--i])) {
+    }
+    kernels = AllKernels[i];
+    DPS_DBGPRINT("Using %s bit vector kernels\n", kernels->name);
+}
+
+const char* DPS_BitVectorKernelsName(size_t index)
+{
+    return (index < NUM_KERNELS) ? AllKernels[index]->name : NULL;
+}
+
+DPS_Status DPS_BitVectorUseKernels(const char* name)
+{
+    size_t i;
+
+    uv_once(&kernelsOnce, SelectKernels);
+    for (i = 0; i < NUM_KERNELS; ++i) {
+        if (!strcmp(AllKernels[i]->name, name)) {
+            if (!KernelsSupported(AllKernels[i])) {
+                return DPS_ERR_NOT_IMPLEMENTED;
+            }
+            kernels = AllKernels[i];
+            return DPS_OK;
+        }
+    }
+    return DPS_ERR_MISSING;
+}
+
+#ifdef DPS_DEBUG
+/*
+ * This is a compressed bit dump - it groups bits to keep
+ * the total output readable. This is usually more useful
+ * than dumping raw 8K long bit vectors.
+ */
+static void CompressedBitDump(const chunk_t* data, size_t bits)
+{
+    size_t stride = bits < 128 ? 1 : bits / 128;
+    size_t i;
+    for (i = 0; i < bits; i += stride) {
+        int bit = 0;
+        size_t j;
+        for (j = 0; j < stride; ++j) {
+            if (TEST_BIT(data, i + j)) {
+                bit = 1;
+                break;
+            }
+        }
+        putc(bit ? '1' : '0', stderr);
+    }
+    putc('\n', stderr);
+}
+#endif
+
+#define MIN_HASHES    1
+#define MAX_HASHES    8
+
+DPS_Status DPS_Configure(size_t bitLen, size_t numHashes)
+{
+    if (bitLen & 63) {
+        DPS_ERRPRINT("Bit length must be a multiple of 64\n");
+        return DPS_ERR_ARGS;
+    }
+    if (numHashes < MIN_HASHES || numHashes > MAX_HASHES) {
+        DPS_ERRPRINT("Number of hashes must be in the range 1..16\n");
+        return DPS_ERR_ARGS;
+    }
+    config.bitLen = bitLen;
+    config.numHashes = (uint8_t)numHashes;
+    return DPS_ERR_OK;
+}
+
+DPS_Status DPS_ConfigureBloomHash(DPS_BloomHash hash)
+{
+    if (hash != DPS_BloomHashSha2 && hash != DPS_BloomHashFast) {
+        DPS_ERRPRINT("Unsupported Bloom filter hash %d\n", hash);
+        return DPS_ERR_ARGS;
+    }
+    config.bloomHash = hash;
+    return DPS_OK;
+}
+
+DPS_BloomHash DPS_GetBloomHash(void)
+{
+    return config.bloomHash;
+}
+
+static uint64_t GetLE64(const uint8_t* p, size_t n)
+{
+    uint64_t v = 0;
+
+    while (n--) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+static uint64_t FMix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+/*
+ * MurmurHash3 x64 128 bit variant, the Bloom filter indices are
+ * derived from the two halves by double hashing. The indices are
+ * stored in the same byte order as the SHA-256 digest words.
+ */
+static void FastHash(uint32_t* hashes, const uint8_t* data, size_t len)
+{
+    static const uint64_t c1 = 0x87c37b91114253d5ull;
+    static const uint64_t c2 = 0x4cf5ad432745937full;
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    uint64_t k1;
+    uint64_t k2;
+    size_t i;
+    size_t tail;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        k1 = GetLE64(data + i, 8);
+        k2 = GetLE64(data + i + 8, 8);
+        k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = ROTL64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = ROTL64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    tail = len - i;
+    if (tail > 8) {
+        k2 = GetLE64(data + i + 8, tail - 8);
+        k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (tail) {
+        k1 = GetLE64(data + i, tail > 8 ? 8 : tail);
+        k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+    h1 ^= (uint64_t)len;
+    h2 ^= (uint64_t)len;
+    h1 += h2;
+    h2 += h1;
+    h1 = FMix64(h1);
+    h2 = FMix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    for (i = 0; i < MAX_HASHES; ++i) {
+        uint32_t h = (uint32_t)((h1 + i * h2) >> 32);
+#ifdef ENDIAN_SWAP
+        hashes[i] = BSWAP_32(h);
+#else
+        hashes[i] = h;
+#endif
+    }
+}
+
+static void ComputeBloomHash(DPS_BloomHash hash, uint32_t* hashes, const uint8_t* data, size_t len)
+{
+    if (hash == DPS_BloomHashFast) {
+        FastHash(hashes, data, len);
+    } else {
+        DPS_Sha2((uint8_t*)hashes, data, len);
+    }
+}
+
+static size_t SparseCapacity(size_t len)
+{
+    if (len >= SPARSE_MIN_LEN && len <= SPARSE_MAX_LEN) {
+        return len / CHUNK_SIZE;
+    } else {
+        return 0;
+    }
+}
+
+static size_t SizeofBV(size_t len)
+{
+    return sizeof(DPS_BitVector) + ((len / CHUNK_SIZE) - 1) * sizeof(chunk_t) + SparseCapacity(len) * sizeof(uint16_t);
+}
+
+/*
+ * Returns the position of the first index in a sparse bit vector that is not less than bit
+ */
+static size_t SparseLowerBound(const DPS_BitVector* bv, size_t bit)
+{
+    const uint16_t* idx = INDICES(bv);
+    size_t lo = 0;
+    size_t hi = bv->popCount;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (idx[mid] < bit) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int TestBit(const DPS_BitVector* bv, size_t bit)
+{
+    if (bv->sparse) {
+        size_t pos = SparseLowerBound(bv, bit);
+        return (pos < (size_t)bv->popCount) && (INDICES(bv)[pos] == bit);
+    } else {
+        return TEST_BIT(bv->bits, bit) != 0;
+    }
+}
+
+/*
+ * Returns chunk i of a bit vector. For sparse bit vectors pos is the
+ * position in the index array and the chunks must be visited in order.
+ */
+static chunk_t GetChunk(const DPS_BitVector* bv, size_t i, size_t* pos)
+{
+    if (bv->sparse) {
+        const uint16_t* idx = INDICES(bv);
+        chunk_t chunk = 0;
+        while ((*pos < (size_t)bv->popCount) && ((idx[*pos] / CHUNK_SIZE) == i)) {
+            chunk |= 1ull << (idx[*pos] % CHUNK_SIZE);
+            ++(*pos);
+        }
+        return chunk;
+    } else {
+        return bv->bits[i];
+    }
+}
+
+/*
+ * Inserts a bit into a sparse bit vector, returns DPS_FALSE if the
+ * index array is full.
+ */
+static int SparseInsert(DPS_BitVector* bv, size_t bit)
+{
+    uint16_t* idx = INDICES(bv);
+    size_t pos = SparseLowerBound(bv, bit);
+
+    if ((pos < (size_t)bv->popCount) && (idx[pos] == bit)) {
+        return DPS_TRUE;
+    }
+    if ((size_t)bv->popCount == SparseCapacity(bv->len)) {
+        return DPS_FALSE;
+    }
+    memmove(&idx[pos + 1], &idx[pos], (bv->popCount - pos) * sizeof(uint16_t));
+    idx[pos] = (uint16_t)bit;
+    ++bv->popCount;
+    return DPS_TRUE;
+}
+
+static void ToDense(DPS_BitVector* bv)
+{
+    if (bv->sparse) {
+        const uint16_t* idx = INDICES(bv);
+        int32_t i;
+
+        memzero_s(bv->bits, bv->len / 8);
+        for (i = 0; i < bv->popCount; ++i) {
+            SET_BIT(bv->bits, idx[i]);
+        }
+        bv->sparse = DPS_FALSE;
+    }
+}
+
+static void ToSparse(DPS_BitVector* bv)
+{
+    size_t cap = SparseCapacity(bv->len);
+
+    if (cap && !bv->sparse && (DPS_BitVectorPopCount(bv) <= cap)) {
+        uint16_t* idx = INDICES(bv);
+        size_t n = 0;
+        size_t i;
+
+        for (i = 0; n < (size_t)bv->popCount; ++i) {
+            chunk_t chunk = bv->bits[i];
+            while (chunk) {
+                idx[n++] = (uint16_t)(i * CHUNK_SIZE + COUNT_TZ(chunk));
+                chunk &= chunk - 1;
+            }
+        }
+        bv->sparse = DPS_TRUE;
+    }
+}
+
+/*
+ * Clears a bit vector leaving it dense
+ */
+static void ClearDense(DPS_BitVector* bv)
+{
+    if (bv->sparse || (bv->popCount != 0)) {
+        memzero_s(bv->bits, bv->len / 8);
+    }
+    bv->sparse = DPS_FALSE;
+    bv->popCount = 0;
+}
+
+/*
+ * Merges the indices of sparse bit vector bv into sparse bit vector
+ * bvOut, returns DPS_FALSE and leaves bvOut unchanged if the index
+ * array of bvOut does not have room for the union.
+ */
+static int SparseUnion(DPS_BitVector* bvOut, const DPS_BitVector* bv)
+{
+    uint16_t* out = INDICES(bvOut);
+    const uint16_t* idx = INDICES(bv);
+    size_t i = 0;
+    size_t j = 0;
+    size_t n = 0;
+
+    while ((i < (size_t)bvOut->popCount) && (j < (size_t)bv->popCount)) {
+        if (out[i] < idx[j]) {
+            ++i;
+        } else if (out[i] > idx[j]) {
+            ++j;
+        } else {
+            ++i;
+            ++j;
+        }
+        ++n;
+    }
+    n += (bvOut->popCount - i) + (bv->popCount - j);
+    if (n > SparseCapacity(bvOut->len)) {
+        return DPS_FALSE;
+    }
+    /*
+     * Merge from the end so the indices of bvOut are moved before
+     * they are overwritten
+     */
+    i = bvOut->popCount;
+    j = bv->popCount;
+    bvOut->popCount = (int32_t)n;
+    while (j) {
+        if (i && (out[i - 1] >= idx[j - 1])) {
+            if (out[i - 1] == idx[j - 1]) {
+                --j;
+            }
+            out[--n] = out[--i];
+        } else {
+            out[--n] = idx[--j];
+        }
+    }
+    return DPS_TRUE;
+}
+
+/*
+ * Intersection of sparse bit vector bv1 with bv2, bvOut may be
+ * either of the operands.
+ */
+static void SparseIntersection(DPS_BitVector* bvOut, const DPS_BitVector* bv1, const DPS_BitVector* bv2)
+{
+    const uint16_t* idx1 = INDICES(bv1);
+    uint16_t* out = INDICES(bvOut);
+    size_t n1 = bv1->popCount;
+    size_t n = 0;
+    size_t i;
+
+    if (bv2->sparse) {
+        const uint16_t* idx2 = INDICES(bv2);
+        size_t n2 = bv2->popCount;
+        size_t j = 0;
+
+        i = 0;
+        while ((i < n1) && (j < n2)) {
+            if (idx1[i] < idx2[j]) {
+                ++i;
+            } else if (idx1[i] > idx2[j]) {
+                ++j;
+            } else {
+                out[n++] = idx1[i];
+                ++i;
+                ++j;
+            }
+        }
+    } else {
+        for (i = 0; i < n1; ++i) {
+            if (TEST_BIT(bv2->bits, idx1[i])) {
+                out[n++] = idx1[i];
+            }
+        }
+    }
+    bvOut->sparse = DPS_TRUE;
+    bvOut->popCount = (int32_t)n;
+}
+
+static DPS_BitVector* AllocBV(size_t sz)
+{
+    DPS_BitVector* bv;
+
+    assert((sz % 64) == 0);
+    uv_once(&kernelsOnce, SelectKernels);
+    bv = calloc(1, SizeofBV(sz));
+    if (bv) {
+        bv->len = sz;
+        INVALIDATE_POPCOUNT(bv);
+    }
+    return bv;
+}
+
+DPS_BitVector* DPS_BitVectorAlloc()
+{
+    DPS_BitVector* bv = AllocBV(config.bitLen);
+    if (bv) {
+        DPS_BitVectorClear(bv);
+    }
+    return bv;
+}
+
+DPS_BitVector* DPS_BitVectorAllocFH()
+{
+    return AllocBV(FH_BITVECTOR_LEN);
+}
+
+int DPS_BitVectorIsClear(DPS_BitVector* bv)
+{
+    if (UNKNOWN_POPCOUNT(bv)) {
+        if (!kernels->isClear(bv->bits, NUM_CHUNKS(bv))) {
+            return DPS_FALSE;
+        }
+        bv->popCount = 0;
+        return DPS_TRUE;
+    } else {
+        return bv->popCount == 0;
+    }
+}
+
+size_t DPS_BitVectorPopCount(DPS_BitVector* bv)
+{
+    if (UNKNOWN_POPCOUNT(bv)) {
+        bv->popCount = kernels->popCount(bv->bits, NUM_CHUNKS(bv));
+    }
+    return bv->popCount;
+}
+
+size_t DPS_BitVectorLen(const DPS_BitVector* bv)
+{
+    return bv->len;
+}
+
+size_t DPS_BitVectorNextSetBit(const DPS_BitVector* bv, size_t bit)
+{
+    size_t i = bit / CHUNK_SIZE;
+    chunk_t chunk;
+
+    if (bit >= bv->len) {
+        return bv->len;
+    }
+    if (bv->sparse) {
+        size_t pos = SparseLowerBound(bv, bit);
+        return (pos < (size_t)bv->popCount) ? INDICES(bv)[pos] : bv->len;
+    }
+    chunk = bv->bits[i] & (~(chunk_t)0 << (bit % CHUNK_SIZE));
+    while (!chunk) {
+        if (++i == NUM_CHUNKS(bv)) {
+            return bv->len;
+        }
+        chunk = bv->bits[i];
+    }
+    return i * CHUNK_SIZE + COUNT_TZ(chunk);
+}
+
+void DPS_BitVectorDup(DPS_BitVector* dst, DPS_BitVector* src)
+{
+    assert(dst->len == src->len);
+    if (dst != src) {
+        if (src->sparse) {
+            if (src->popCount) {
+                memcpy_s(INDICES(dst), SparseCapacity(dst->len) * sizeof(uint16_t), INDICES(src), src->popCount * sizeof(uint16_t));
+            }
+        } else {
+            memcpy_s(dst->bits, src->len / 8, src->bits, src->len / 8);
+        }
+        dst->sparse = src->sparse;
+        dst->popCount = src->popCount;
+    }
+}
+
+DPS_BitVector* DPS_BitVectorClone(DPS_BitVector* bv)
+{
+    DPS_BitVector* clone = malloc(SizeofBV(bv->len));
+    if (clone) {
+        clone->len = bv->len;
+        DPS_BitVectorDup(clone, bv);
+    }
+    return clone;
+}
+
+void DPS_BitVectorFree(DPS_BitVector* bv)
+{
+    if (bv) {
+        free(bv);
+    }
+}
+
+#if DPS_BLOOM_CACHE_ENTRIES > 0
+
+/*
+ * The cache is split into stripes each protected by its own lock
+ */
+#define BLOOM_CACHE_STRIPES 16
+
+/*
+ * The cache is set associative
+ */
+#define BLOOM_CACHE_WAYS    4
+#define BLOOM_CACHE_SETS    ((DPS_BLOOM_CACHE_ENTRIES + BLOOM_CACHE_WAYS - 1) / BLOOM_CACHE_WAYS)
+
+typedef struct _BloomCacheEntry {
+    uint32_t hashes[MAX_HASHES];
+    uint8_t valid;  /* Zero if unused, otherwise a saturating use count */
+    uint8_t hash;   /* The hash function the hashes were computed with */
+    uint8_t len;
+    uint8_t data[DPS_BLOOM_CACHE_KEY_LEN];
+} BloomCacheEntry;
+
+typedef struct _BloomCacheStripe {
+    uv_mutex_t lock;
+    uint64_t hits;
+    uint64_t misses;
+} BloomCacheStripe;
+
+static uv_once_t bloomCacheOnce = UV_ONCE_INIT;
+static BloomCacheStripe bloomCacheStripes[BLOOM_CACHE_STRIPES];
+static BloomCacheEntry* bloomCache = NULL;
+
+/*
+ * The cache is disabled, leaving bloomCache NULL, if it cannot be
+ * fully initialized. The stripe locks are only valid when it is not.
+ */
+static void InitBloomCache(void)
+{
+    size_t i;
+
+    for (i = 0; i < BLOOM_CACHE_STRIPES; ++i) {
+        if (uv_mutex_init(&bloomCacheStripes[i].lock)) {
+            break;
+        }
+    }
+    if (i == BLOOM_CACHE_STRIPES) {
+        bloomCache = calloc(BLOOM_CACHE_SETS * BLOOM_CACHE_WAYS, sizeof(BloomCacheEntry));
+    }
+    if (!bloomCache) {
+        DPS_ERRPRINT("Bloom filter hash cache is disabled\n");
+        while (i) {
+            uv_mutex_destroy(&bloomCacheStripes[--i].lock);
         }
-        bv->popCount = 0;
-        return DPS_TRUE;
-    } else {
-        return bv->popCount == 0;
     }
 }
 
-size_t DPS_BitVectorPopCount(DPS_BitVector* bv)
+static void BloomHash(uint32_t* hashes, const uint8_t* data, size_t len)
 {
-    if (UNKNOWN_POPCOUNT(bv)) {
-        uint32_t popCount = 0;
-        size_t i;
-        for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-            popCount += POPCOUNT(bv->bits[i]);
+    DPS_BloomHash hash = config.bloomHash;
+    BloomCacheStripe* stripe;
+    BloomCacheEntry* set;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    uv_once(&bloomCacheOnce, InitBloomCache);
+    if (!bloomCache || len > DPS_BLOOM_CACHE_KEY_LEN) {
+        ComputeBloomHash(hash, hashes, data, len);
+        return;
+    }
+    /*
+     * FNV-1a is much cheaper than the SHA-256 it is saving
+     */
+    for (i = 0; i < len; ++i) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    h %= BLOOM_CACHE_SETS;
+    set = &bloomCache[h * BLOOM_CACHE_WAYS];
+    stripe = &bloomCacheStripes[h % BLOOM_CACHE_STRIPES];
+
+    uv_mutex_lock(&stripe->lock);
+    for (i = 0; i < BLOOM_CACHE_WAYS; ++i) {
+        if (set[i].valid && set[i].hash == hash && set[i].len == len && memcmp(set[i].data, data, len) == 0) {
+            memcpy(hashes, set[i].hashes, sizeof(set[i].hashes));
+            set[i].valid += (set[i].valid < UINT8_MAX);
+            ++stripe->hits;
+            uv_mutex_unlock(&stripe->lock);
+            return;
         }
-        bv->popCount = popCount;
     }
-    return bv->popCount;
-}
+    ++stripe->misses;
+    uv_mutex_unlock(&stripe->lock);
 
-void DPS_BitVectorDup(DPS_BitVector* dst, DPS_BitVector* src)
-{
-    assert(dst->len == src->len);
-    if (dst != src) {
-        memcpy_s(dst->bits, src->len / 8, src->bits, src->len / 8);
-        dst->popCount = src->popCount;
+    ComputeBloomHash(hash, hashes, data, len);
+
+    uv_mutex_lock(&stripe->lock);
+    /*
+     * Replace the least used entry in the set and age the others
+     */
+    for (i = 1, h = 0; i < BLOOM_CACHE_WAYS; ++i) {
+        if (set[i].valid < set[h].valid) {
+            h = (uint32_t)i;
+        }
+    }
+    for (i = 0; i < BLOOM_CACHE_WAYS; ++i) {
+        set[i].valid -= (set[i].valid > 1);
     }
+    memcpy(set[h].hashes, hashes, sizeof(set[h].hashes));
+    memcpy(set[h].data, data, len);
+    set[h].hash = (uint8_t)hash;
+    set[h].len = (uint8_t)len;
+    set[h].valid = 1;
+    uv_mutex_unlock(&stripe->lock);
 }
 
-DPS_BitVector* DPS_BitVectorClone(DPS_BitVector* bv)
+void DPS_BloomCacheStats(uint64_t* hits, uint64_t* misses)
 {
-    size_t sz = sizeof(DPS_BitVector) + ((bv->len / CHUNK_SIZE) - 1) * sizeof(chunk_t);
-    DPS_BitVector* clone = malloc(sz);
-    if (clone) {
-        memcpy_s(clone, sz, bv, sz);
+    size_t i;
+
+    uv_once(&bloomCacheOnce, InitBloomCache);
+    *hits = 0;
+    *misses = 0;
+    if (!bloomCache) {
+        return;
+    }
+    for (i = 0; i < BLOOM_CACHE_STRIPES; ++i) {
+        uv_mutex_lock(&bloomCacheStripes[i].lock);
+        *hits += bloomCacheStripes[i].hits;
+        *misses += bloomCacheStripes[i].misses;
+        uv_mutex_unlock(&bloomCacheStripes[i].lock);
     }
-    return clone;
 }
 
-void DPS_BitVectorFree(DPS_BitVector* bv)
+#else
+
+#define BloomHash(hashes, data, len)  ComputeBloomHash(config.bloomHash, (hashes), (data), (len))
+
+void DPS_BloomCacheStats(uint64_t* hits, uint64_t* misses)
 {
-    if (bv) {
-        free(bv);
-    }
+    *hits = 0;
+    *misses = 0;
 }
 
+#endif
+
 void DPS_BitVectorBloomInsert(DPS_BitVector* bv, const uint8_t* data, size_t len)
 {
     uint8_t h;
@@ -279,7 +1592,7 @@ void DPS_BitVectorBloomInsert(DPS_BitVector* bv, const uint8_t* data, size_t len
 
     assert(sizeof(hashes) == DPS_SHA2_DIGEST_LEN);
 
-    DPS_Sha2((uint8_t*)hashes, data, len);
+    BloomHash(hashes, data, len);
 #if 0
     DPS_PRINT("%.*s   (%zu)\n", (int)len, data, len);
 #endif
@@ -289,9 +1602,14 @@ void DPS_BitVectorBloomInsert(DPS_BitVector* bv, const uint8_t* data, size_t len
 #else
         index = hashes[h] % bv->len;
 #endif
-        SET_BIT(bv->bits, index);
+        if (!bv->sparse || !SparseInsert(bv, index)) {
+            ToDense(bv);
+            SET_BIT(bv->bits, index);
+        }
+    }
+    if (!bv->sparse) {
+        INVALIDATE_POPCOUNT(bv);
     }
-    INVALIDATE_POPCOUNT(bv);
 }
 
 int DPS_BitVectorBloomTest(const DPS_BitVector* bv, const uint8_t* data, size_t len)
@@ -300,14 +1618,14 @@ int DPS_BitVectorBloomTest(const DPS_BitVector* bv, const uint8_t* data, size_t
     uint32_t hashes[MAX_HASHES];
     uint32_t index;
 
-    DPS_Sha2((uint8_t*)hashes, data, len);
+    BloomHash(hashes, data, len);
     for (h = 0; h < config.numHashes; ++h) {
 #ifdef ENDIAN_SWAP
         index = BSWAP_32(hashes[h]) % bv->len;
 #else
         index = hashes[h] % bv->len;
 #endif
-        if (!TEST_BIT(bv->bits, index)) {
+        if (!TestBit(bv, index)) {
             return DPS_FALSE;
         }
     }
@@ -321,33 +1639,32 @@ float DPS_BitVectorLoadFactor(DPS_BitVector* bv)
 
 int DPS_BitVectorEquals(const DPS_BitVector* bv1, const DPS_BitVector* bv2)
 {
-    size_t i;
-    const chunk_t* b1;
-    const chunk_t* b2;
-
     if (!bv1 || !bv2) {
         return DPS_FALSE;
     }
     if (bv1->len != bv2->len) {
         return DPS_FALSE;
     }
-    b1 = bv1->bits;
-    b2 = bv2->bits;
-    for (i = 0; i < NUM_CHUNKS(bv1); ++i, ++b1, ++b2) {
-        if (*b1 != *b2) {
-            return DPS_FALSE;
+    if (bv1->sparse && bv2->sparse) {
+        return (bv1->popCount == bv2->popCount) &&
+            (memcmp(INDICES(bv1), INDICES(bv2), bv1->popCount * sizeof(uint16_t)) == 0);
+    }
+    if (bv1->sparse || bv2->sparse) {
+        size_t pos1 = 0;
+        size_t pos2 = 0;
+        size_t i;
+        for (i = 0; i < NUM_CHUNKS(bv1); ++i) {
+            if (GetChunk(bv1, i, &pos1) != GetChunk(bv2, i, &pos2)) {
+                return DPS_FALSE;
+            }
         }
+        return DPS_TRUE;
     }
-    return DPS_TRUE;
+    return kernels->equals(bv1->bits, bv2->bits, NUM_CHUNKS(bv1));
 }
 
 int DPS_BitVectorIncludes(const DPS_BitVector* bv1, const DPS_BitVector* bv2)
 {
-    size_t i;
-    const chunk_t* b1;
-    const chunk_t* b2;
-    chunk_t b1un = 0;
-
     if (!bv1 || !bv2) {
         return DPS_FALSE;
     }
@@ -355,20 +1672,37 @@ int DPS_BitVectorIncludes(const DPS_BitVector* bv1, const DPS_BitVector* bv2)
     if (bv1->popCount == 0) {
         return DPS_FALSE;
     }
-    b1 = bv1->bits;
-    b2 = bv2->bits;
-    for (i = 0; i < NUM_CHUNKS(bv1); ++i, ++b1, ++b2) {
-        if ((*b1 & *b2) != *b2) {
+    if (bv2->sparse) {
+        /*
+         * Only the bits set in bv2 need to be tested
+         */
+        const uint16_t* idx = INDICES(bv2);
+        int32_t i;
+        for (i = 0; i < bv2->popCount; ++i) {
+            if (!TestBit(bv1, idx[i])) {
+                return DPS_FALSE;
+            }
+        }
+        return DPS_TRUE;
+    }
+    if (bv1->sparse) {
+        size_t pos = 0;
+        size_t i;
+        if (!UNKNOWN_POPCOUNT(bv2) && (bv2->popCount > bv1->popCount)) {
             return DPS_FALSE;
         }
-        b1un |= *b1;
+        for (i = 0; i < NUM_CHUNKS(bv2); ++i) {
+            if (bv2->bits[i] & ~GetChunk(bv1, i, &pos)) {
+                return DPS_FALSE;
+            }
+        }
+        return DPS_TRUE;
     }
-    return b1un != 0;
+    return kernels->includes(bv1->bits, bv2->bits, NUM_CHUNKS(bv1));
 }
 
 DPS_Status DPS_BitVectorFuzzyHash(DPS_BitVector* hash, DPS_BitVector* bv)
 {
-    size_t i;
     chunk_t s = 0;
     chunk_t p;
     uint32_t popCount = 0;
@@ -377,19 +1711,20 @@ DPS_Status DPS_BitVectorFuzzyHash(DPS_BitVector* hash, DPS_BitVector* bv)
         return DPS_ERR_NULL;
     }
     assert(hash->len == FH_BITVECTOR_LEN);
-    if (bv->popCount != 0) {
+    if (bv->sparse) {
+        const uint16_t* idx = INDICES(bv);
+        for (popCount = 0; popCount < (uint32_t)bv->popCount; ++popCount) {
+            s |= 1ull << (idx[popCount] % CHUNK_SIZE);
+        }
+    } else if (bv->popCount != 0) {
         /*
          * Squash the bit vector into 64 bits
          */
-        for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-            chunk_t n = bv->bits[i];
-            popCount += POPCOUNT(n);
-            s |= n;
-        }
+        popCount = kernels->squash(bv->bits, NUM_CHUNKS(bv), &s);
         bv->popCount = popCount;
     }
     if (popCount == 0) {
-        DPS_BitVectorClear(hash);
+        ClearDense(hash);
         return DPS_OK;
     }
     p = s;
@@ -418,13 +1753,28 @@ DPS_Status DPS_BitVectorFuzzyHash(DPS_BitVector* hash, DPS_BitVector* bv)
 
 DPS_Status DPS_BitVectorUnion(DPS_BitVector* bvOut, DPS_BitVector* bv)
 {
-    size_t i;
     if (!bvOut || !bv) {
         return DPS_ERR_NULL;
     }
     assert(bvOut->len == bv->len);
-    for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-        bvOut->bits[i] |= bv->bits[i];
+    if (bvOut == bv) {
+        return DPS_OK;
+    }
+    if (bv->sparse) {
+        const uint16_t* idx = INDICES(bv);
+        int32_t i;
+        if (bvOut->sparse) {
+            if (SparseUnion(bvOut, bv)) {
+                return DPS_OK;
+            }
+            ToDense(bvOut);
+        }
+        for (i = 0; i < bv->popCount; ++i) {
+            SET_BIT(bvOut->bits, idx[i]);
+        }
+    } else {
+        ToDense(bvOut);
+        kernels->unite(bvOut->bits, bv->bits, NUM_CHUNKS(bv));
     }
     INVALIDATE_POPCOUNT(bvOut);
     return DPS_OK;
@@ -436,20 +1786,26 @@ DPS_Status DPS_BitVectorIntersection(DPS_BitVector* bvOut, DPS_BitVector* bv1, D
         return DPS_ERR_NULL;
     }
     assert(bvOut->len == bv1->len && bvOut->len == bv2->len);
-    if ((bv1->popCount && bv2->popCount)) {
-        size_t i;
-        int nz = 0;
-        assert(bvOut->len == bv1->len && bvOut->len == bv2->len);
-        for (i = 0; i < NUM_CHUNKS(bv1); ++i) {
-            nz |= ((bvOut->bits[i] = bv1->bits[i] & bv2->bits[i]) != 0);
+    if (!bv1->popCount || !bv2->popCount) {
+        DPS_BitVectorClear(bvOut);
+    } else if (bv1->sparse || bv2->sparse) {
+        /*
+         * The intersection has no more bits set than the sparse
+         * operand so it is sparse too
+         */
+        if (!bv1->sparse || (bv2->sparse && (bv2->popCount < bv1->popCount))) {
+            DPS_BitVector* tmp = bv1;
+            bv1 = bv2;
+            bv2 = tmp;
         }
-        if (nz) {
+        SparseIntersection(bvOut, bv1, bv2);
+    } else {
+        if (kernels->intersection(bvOut->bits, bv1->bits, bv2->bits, NUM_CHUNKS(bv1))) {
             INVALIDATE_POPCOUNT(bvOut);
         } else {
             bvOut->popCount = 0;
         }
-    } else {
-        DPS_BitVectorClear(bvOut);
+        bvOut->sparse = DPS_FALSE;
     }
     return DPS_OK;
 }
@@ -471,16 +1827,34 @@ DPS_Status DPS_BitVectorXor(DPS_BitVector* bvOut, DPS_BitVector* bv1, DPS_BitVec
             *equal = DPS_TRUE;
         }
         DPS_BitVectorDup(bvOut, bv1);
-    } else {
+    } else if (bv1->sparse || bv2->sparse) {
+        /*
+         * The sparse operands are read from the index arrays so the
+         * dense chunks of bvOut can be written even if it is one of
+         * the operands.
+         */
+        size_t pos1 = 0;
+        size_t pos2 = 0;
+        chunk_t diff = 0;
         size_t i;
-        int diff = 0;
 
-        for (i = 0; i < NUM_CHUNKS(bv1); ++i) {
-            diff |= ((bvOut->bits[i] = bv1->bits[i] ^ bv2->bits[i]) != 0ull);
+        for (i = 0; i < NUM_CHUNKS(bvOut); ++i) {
+            chunk_t chunk = GetChunk(bv1, i, &pos1) ^ GetChunk(bv2, i, &pos2);
+            bvOut->bits[i] = chunk;
+            diff |= chunk;
+        }
+        if (equal) {
+            *equal = !diff;
         }
+        bvOut->sparse = DPS_FALSE;
+        INVALIDATE_POPCOUNT(bvOut);
+    } else {
+        int diff = kernels->exclusiveOr(bvOut->bits, bv1->bits, bv2->bits, NUM_CHUNKS(bv1));
+
         if (equal) {
             *equal = !diff;
         }
+        bvOut->sparse = DPS_FALSE;
         INVALIDATE_POPCOUNT(bvOut);
     }
     return DPS_OK;
@@ -558,6 +1932,7 @@ static uint32_t Ceil_Log2(uint16_t n)
 static DPS_Status RunLengthEncode(DPS_BitVector* bv, DPS_TxBuffer* buffer, uint8_t flags)
 {
     size_t i;
+    size_t pos = 0;
     size_t rleSize = 0;
     size_t sz;
     uint32_t num0 = 0;
@@ -583,7 +1958,7 @@ static DPS_Status RunLengthEncode(DPS_BitVector* bv, DPS_TxBuffer* buffer, uint8
 
     for (i = 0; i < NUM_CHUNKS(bv); ++i) {
         uint32_t rem0;
-        chunk_t chunk = bv->bits[i] ^ complement;
+        chunk_t chunk = GetChunk(bv, i, &pos) ^ complement;
         if (!chunk) {
             num0 += CHUNK_SIZE;
             continue;
@@ -756,7 +2131,8 @@ DPS_Status DPS_BitVectorSerialize(DPS_BitVector* bv, DPS_TxBuffer* buffer)
                 if (ret == DPS_OK) {
                     ret = CBOR_EndWrapBytes(buffer, wrapPos);
                 }
-            } else if (ret == DPS_ERR_OVERFLOW) {
+            }
+            if (ret == DPS_ERR_OVERFLOW) {
                 /*
                  * Reset buffer and use raw encoding
                  */
@@ -765,6 +2141,7 @@ DPS_Status DPS_BitVectorSerialize(DPS_BitVector* bv, DPS_TxBuffer* buffer)
                 continue;
             }
         } else {
+            ToDense(bv);
 #ifdef ENDIAN_SWAP
 #error(TODO bit vector endian swapping not implemented)
 #else
@@ -836,6 +2213,8 @@ DPS_Status DPS_BitVectorDeserialize(DPS_BitVector* bv, DPS_RxBuffer* buffer)
     if (ret != DPS_OK) {
         return ret;
     }
+    bv->sparse = DPS_FALSE;
+    INVALIDATE_POPCOUNT(bv);
     if (flags & FLAG_RLE_ENCODED) {
         ret = RunLengthDecode(data, size, bv->bits, bv->len);
         if ((ret == DPS_OK) && (flags & FLAG_RLE_COMPLEMENT)) {
@@ -847,6 +2226,9 @@ DPS_Status DPS_BitVectorDeserialize(DPS_BitVector* bv, DPS_RxBuffer* buffer)
         DPS_ERRPRINT("Deserialized bloom filter has wrong length\n");
         ret = DPS_ERR_INVALID;
     }
+    if (ret == DPS_OK) {
+        ToSparse(bv);
+    }
     return ret;
 }
 
@@ -855,25 +2237,30 @@ void DPS_BitVectorFill(DPS_BitVector* bv)
     if (bv) {
         /* Don't use memset_s it has a bug for values other than 0 */
         memset(bv->bits, 0xFF, bv->len / 8);
+        bv->sparse = DPS_FALSE;
         bv->popCount = (uint32_t)bv->len;
     }
 }
 
 void DPS_BitVectorClear(DPS_BitVector* bv)
 {
-    if (bv->popCount != 0) {
-        memzero_s(bv->bits, bv->len / 8);
+    if (SparseCapacity(bv->len)) {
+        bv->sparse = DPS_TRUE;
         bv->popCount = 0;
+    } else {
+        ClearDense(bv);
     }
 }
 
 void DPS_BitVectorComplement(DPS_BitVector* bv)
 {
     size_t i;
+
+    ToDense(bv);
     for (i = 0; i < NUM_CHUNKS(bv); ++i) {
         bv->bits[i] = ~bv->bits[i];
     }
-    if (bv->popCount) {
+    if (!UNKNOWN_POPCOUNT(bv)) {
         bv->popCount = (uint32_t)bv->len - bv->popCount;
     }
 }
@@ -881,6 +2268,7 @@ void DPS_BitVectorComplement(DPS_BitVector* bv)
 static size_t RLE_Size(DPS_BitVector* bv)
 {
     size_t i;
+    size_t pos = 0;
     size_t rleSize = 0;
     uint32_t num0 = 0;
     chunk_t complement = 0;
@@ -896,7 +2284,7 @@ static size_t RLE_Size(DPS_BitVector* bv)
 
     for (i = 0; i < NUM_CHUNKS(bv); ++i) {
         uint32_t rem0;
-        chunk_t chunk = bv->bits[i] ^ complement;
+        chunk_t chunk = GetChunk(bv, i, &pos) ^ complement;
         if (!chunk) {
             num0 += CHUNK_SIZE;
             continue;
@@ -924,6 +2312,7 @@ DPS_Status DPS_BitVectorSet(DPS_BitVector* bv, uint8_t* data, size_t len)
         return DPS_ERR_ARGS;
     } else {
         memcpy_s(bv->bits, len, data, len);
+        bv->sparse = DPS_FALSE;
         INVALIDATE_POPCOUNT(bv);
         return DPS_OK;
     }
@@ -938,6 +2327,7 @@ void DPS_BitVectorDump(DPS_BitVector* bv, int dumpBits)
         DPS_PRINT("Loading = %.2f%%\n", DPS_BitVectorLoadFactor((DPS_BitVector*)bv));
 #ifdef DPS_DEBUG
         if (dumpBits) {
+            ToDense(bv);
             CompressedBitDump(bv->bits, bv->len);
         }
 #endif
@@ -952,6 +2342,12 @@ static DPS_CountVector* AllocCV(size_t sz)
     cv = calloc(1, sizeof(DPS_CountVector) + ((sz / CHUNK_SIZE) - 1) * sizeof(counter_t));
     if (cv) {
         cv->len = sz;
+        cv->bvIntersection = AllocBV(sz);
+        if (!cv->bvIntersection) {
+            free(cv);
+            return NULL;
+        }
+        cv->bvIntersection->popCount = 0;
     }
     return cv;
 }
@@ -961,8 +2357,9 @@ DPS_CountVector* DPS_CountVectorAlloc()
     DPS_CountVector* cv = AllocCV(config.bitLen);
     if (cv) {
         cv->bvUnion = AllocBV(config.bitLen);
-        if (!cv->bvUnion) {
-            free(cv);
+        cv->chunkRevisions = calloc(config.bitLen / CHUNK_SIZE, sizeof(uint32_t));
+        if (!cv->bvUnion || !cv->chunkRevisions) {
+            DPS_CountVectorFree(cv);
             cv = NULL;
         }
     }
@@ -980,10 +2377,139 @@ void DPS_CountVectorFree(DPS_CountVector* cv)
         if (cv->bvUnion) {
             free(cv->bvUnion);
         }
+        if (cv->bvIntersection) {
+            free(cv->bvIntersection);
+        }
+        if (cv->chunkRevisions) {
+            free(cv->chunkRevisions);
+        }
         free(cv);
     }
 }
 
+#ifdef DPS_BIT_SLICED_COUNTER
+
+/*
+ * Add one to the counts for the bits set in chunk
+ */
+static void CounterAdd(counter_t counter, chunk_t chunk)
+{
+    chunk_t carry = chunk;
+    size_t k;
+
+    for (k = 0; carry && (k < COUNTER_BITS); ++k) {
+        chunk_t c = counter[k] & carry;
+        counter[k] ^= carry;
+        carry = c;
+    }
+    assert(!carry);
+}
+
+/*
+ * Subtract one from the counts for the bits set in chunk and return the
+ * bits that have a count of zero after the subtraction.
+ */
+static chunk_t CounterDel(counter_t counter, chunk_t chunk)
+{
+    chunk_t borrow = chunk;
+    chunk_t nz = 0;
+    size_t k;
+
+    for (k = 0; borrow && (k < COUNTER_BITS); ++k) {
+        chunk_t b = ~counter[k] & borrow;
+        counter[k] ^= borrow;
+        borrow = b;
+    }
+    assert(!borrow);
+    for (k = 0; k < COUNTER_BITS; ++k) {
+        nz |= counter[k];
+    }
+    return chunk & ~nz;
+}
+
+/*
+ * Returns the bits in mask that have a count equal to n
+ */
+static chunk_t CounterEquals(const counter_t counter, size_t n, chunk_t mask)
+{
+    size_t k;
+
+    for (k = 0; mask && (k < COUNTER_BITS); ++k) {
+        if ((n >> k) & 1) {
+            mask &= counter[k];
+        } else {
+            mask &= ~counter[k];
+        }
+    }
+    return mask;
+}
+
+static size_t CounterGet(const counter_t counter, size_t bit)
+{
+    size_t count = 0;
+    size_t k;
+
+    for (k = 0; k < COUNTER_BITS; ++k) {
+        count |= (size_t)((counter[k] >> bit) & 1) << k;
+    }
+    return count;
+}
+
+#else
+
+static void CounterAdd(counter_t counter, chunk_t chunk)
+{
+    count_t* count = counter;
+
+    do {
+        if (chunk & 1) {
+            ++(*count);
+        }
+        chunk >>= 1;
+        ++count;
+    } while (chunk);
+}
+
+static chunk_t CounterDel(counter_t counter, chunk_t chunk)
+{
+    count_t* count = counter;
+    chunk_t bit = 1;
+    chunk_t clear = 0;
+
+    do {
+        if (chunk & 1) {
+            if (--(*count) == 0) {
+                clear |= bit;
+            }
+        }
+        bit <<= 1;
+        chunk >>= 1;
+        ++count;
+    } while (chunk);
+    return clear;
+}
+
+static chunk_t CounterEquals(const counter_t counter, size_t n, chunk_t mask)
+{
+    chunk_t eq = 0;
+
+    while (mask) {
+        uint32_t tz = COUNT_TZ(mask);
+        if (counter[tz] == n) {
+            eq |= (1ull << tz);
+        }
+        mask &= mask - 1;
+    }
+    return eq;
+}
+
+static size_t CounterGet(const counter_t counter, size_t bit)
+{
+    return counter[bit];
+}
+
+#endif
+
 DPS_Status DPS_CountVectorAdd(DPS_CountVector* cv, DPS_BitVector* bv)
 {
     size_t i;
@@ -995,30 +2521,96 @@ DPS_Status DPS_CountVectorAdd(DPS_CountVector* cv, DPS_BitVector* bv)
         return DPS_ERR_RESOURCES;
     }
     if (bv->popCount != 0) {
+        size_t pos = 0;
         for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-            chunk_t chunk = bv->bits[i];
+            chunk_t chunk = GetChunk(bv, i, &pos);
             if (chunk) {
-                count_t* count = cv->counts[i];
                 if (cv->bvUnion) {
                     cv->bvUnion->bits[i] |= chunk;
                 }
-                do {
-                    if (chunk & 1) {
-                        ++(*count);
-                    }
-                    chunk >>= 1;
-                    ++count;
-                } while (chunk);
+                if (cv->chunkRevisions) {
+                    cv->chunkRevisions[i] = cv->revision + 1;
+                }
+                CounterAdd(cv->counts[i], chunk);
             }
         }
         if (cv->bvUnion) {
             INVALIDATE_POPCOUNT(cv->bvUnion);
         }
     }
+    /*
+     * The bits with a count equal to the number of entries after the
+     * add are the bits of the current intersection also set in bv
+     */
+    if (cv->entries == 0) {
+        DPS_BitVectorDup(cv->bvIntersection, bv);
+        cv->intersectionStale = DPS_FALSE;
+    } else if (!cv->intersectionStale) {
+        DPS_BitVectorIntersection(cv->bvIntersection, cv->bvIntersection, bv);
+    }
     ++cv->entries;
+    ++cv->revision;
     return DPS_OK;
 }
 
+/*
+ * Recomputes the cached intersection of all the entries from the
+ * counters, a bit is in the intersection when its counter equals the
+ * number of entries. Only the chunks with bits in the union are checked.
+ */
+static void RefreshIntersection(DPS_CountVector* cv)
+{
+    DPS_BitVector* bv = cv->bvIntersection;
+    size_t i;
+
+    ClearDense(bv);
+    if (cv->entries) {
+        for (i = 0; i < NUM_CHUNKS(bv); ++i) {
+            if (!cv->bvUnion || cv->bvUnion->bits[i]) {
+                bv->bits[i] = CounterEquals(cv->counts[i], cv->entries, ~0ull);
+            }
+        }
+        INVALIDATE_POPCOUNT(bv);
+    }
+    cv->intersectionStale = DPS_FALSE;
+}
+
+/*
+ * Computes the intersection of the count vector entries other than bv,
+ * entries is the number of other entries. Every bit in the intersection
+ * of all the entries is set in bv so the bits of the current intersection
+ * that are set in bv are kept and the counters only need to be checked for
+ * the bits that are not set in bv.
+ */
+static void IntersectionExcludingEntries(DPS_CountVector* cv, DPS_BitVector* bv, size_t entries, DPS_BitVector* bvOut)
+{
+    size_t pos = 0;
+    size_t ipos = 0;
+    size_t i;
+
+    if (!entries) {
+        DPS_BitVectorClear(bvOut);
+        return;
+    }
+    if (cv->intersectionStale) {
+        RefreshIntersection(cv);
+    }
+    /*
+     * The intersection and bv may be sparse
+     */
+    for (i = 0; i < NUM_CHUNKS(bvOut); ++i) {
+        chunk_t own = GetChunk(bv, i, &pos);
+        chunk_t mask = cv->bvUnion ? cv->bvUnion->bits[i] & ~own : ~own;
+        chunk_t chunk = GetChunk(cv->bvIntersection, i, &ipos) & own;
+        if (mask) {
+            chunk |= CounterEquals(cv->counts[i], entries, mask);
+        }
+        bvOut->bits[i] = chunk;
+    }
+    bvOut->sparse = DPS_FALSE;
+    INVALIDATE_POPCOUNT(bvOut);
+}
+
 DPS_Status DPS_CountVectorDel(DPS_CountVector* cv, DPS_BitVector* bv)
 {
     size_t i;
@@ -1030,25 +2622,17 @@ DPS_Status DPS_CountVectorDel(DPS_CountVector* cv, DPS_BitVector* bv)
         return DPS_ERR_ARGS;
     }
     if (bv->popCount != 0) {
+        size_t pos = 0;
         for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-            chunk_t chunk = bv->bits[i];
+            chunk_t chunk = GetChunk(bv, i, &pos);
             if (chunk) {
-                count_t* count = cv->counts[i];
-                chunk_t bit = 1;
-                chunk_t clear = 0;
-                do {
-                    if (chunk & 1) {
-                        if (--(*count) == 0) {
-                            clear |= bit;
-                        }
-                    }
-                    bit <<= 1;
-                    chunk >>= 1;
-                    ++count;
-                } while (chunk);
+                chunk_t clear = CounterDel(cv->counts[i], chunk);
                 if (cv->bvUnion) {
                     cv->bvUnion->bits[i] ^= clear;
                 }
+                if (cv->chunkRevisions) {
+                    cv->chunkRevisions[i] = cv->revision + 1;
+                }
             }
         }
         if (cv->bvUnion) {
@@ -1056,6 +2640,13 @@ DPS_Status DPS_CountVectorDel(DPS_CountVector* cv, DPS_BitVector* bv)
         }
     }
     --cv->entries;
+    ++cv->revision;
+    /*
+     * Bits can join the intersection when an entry is deleted and finding
+     * them requires checking the counters so this is deferred until the
+     * intersection is needed.
+     */
+    cv->intersectionStale = DPS_TRUE;
     return DPS_OK;
 }
 
@@ -1070,25 +2661,104 @@ DPS_BitVector* DPS_CountVectorToUnion(DPS_CountVector* cv)
 
 DPS_BitVector* DPS_CountVectorToIntersection(DPS_CountVector* cv)
 {
-    DPS_BitVector* bv = AllocBV(cv->len);
-    if (bv && cv->entries) {
+    if (!cv) {
+        return NULL;
+    }
+    if (cv->intersectionStale) {
+        RefreshIntersection(cv);
+    }
+    return DPS_BitVectorClone(cv->bvIntersection);
+}
+
+DPS_BitVector* DPS_CountVectorToUnionExcluding(DPS_CountVector* cv, DPS_BitVector* bv)
+{
+    DPS_BitVector* bvOut;
+
+    if (!cv || !cv->bvUnion || !bv) {
+        return NULL;
+    }
+    assert(cv->len == bv->len);
+    bvOut = DPS_BitVectorClone(cv->bvUnion);
+    if (bvOut && bv->popCount != 0) {
+        size_t pos = 0;
         size_t i;
+        /*
+         * A bit survives the exclusion if it has a count greater than one
+         * or the excluded bit vector did not contribute to the count. So
+         * only the bits set in the excluded bit vector need to be checked.
+         */
         for (i = 0; i < NUM_CHUNKS(bv); ++i) {
-            if (!cv->bvUnion || cv->bvUnion->bits[i]) {
-                chunk_t b = 1;
-                count_t* count = cv->counts[i];
-                chunk_t chunk = 0;
-                while (b) {
-                    if (*count++ == cv->entries) {
-                        chunk |= b;
-                    }
-                    b <<= 1;
-                }
-                bv->bits[i] = chunk;
+            chunk_t chunk = GetChunk(bv, i, &pos);
+            if (chunk) {
+                bvOut->bits[i] &= ~CounterEquals(cv->counts[i], 1, chunk);
             }
         }
+        INVALIDATE_POPCOUNT(bvOut);
     }
-    return bv;
+    return bvOut;
+}
+
+/*
+ * The union excluding bv can only differ from bvOut in the chunks where
+ * the counts changed since bvOut was computed. The excluded bit vector
+ * is itself added to and deleted from the count vector so a change to it
+ * also shows up as a change to the counts.
+ */
+DPS_Status DPS_CountVectorUpdateUnionExcluding(DPS_CountVector* cv, DPS_BitVector* bv, uint32_t revision,
+                                               DPS_BitVector* bvOut, DPS_BitVector* delta, int* same)
+{
+    size_t pos = 0;
+    chunk_t diff = 0;
+    size_t i;
+
+    if (!cv || !cv->chunkRevisions || !bvOut || !delta) {
+        return DPS_ERR_NULL;
+    }
+    assert(cv->len == bvOut->len && cv->len == delta->len);
+    assert(!bv || cv->len == bv->len);
+    ToDense(bvOut);
+    ClearDense(delta);
+    for (i = 0; i < NUM_CHUNKS(bvOut); ++i) {
+        chunk_t own = bv ? GetChunk(bv, i, &pos) : 0;
+        if ((int32_t)(cv->chunkRevisions[i] - revision) > 0) {
+            chunk_t chunk = cv->bvUnion->bits[i];
+            if (own) {
+                chunk &= ~CounterEquals(cv->counts[i], 1, own);
+            }
+            delta->bits[i] = bvOut->bits[i] ^ chunk;
+            bvOut->bits[i] = chunk;
+            diff |= delta->bits[i];
+        }
+    }
+    if (diff) {
+        INVALIDATE_POPCOUNT(bvOut);
+        INVALIDATE_POPCOUNT(delta);
+    }
+    if (same) {
+        *same = !diff;
+    }
+    return DPS_OK;
+}
+
+DPS_BitVector* DPS_CountVectorToIntersectionExcluding(DPS_CountVector* cv, DPS_BitVector* bv)
+{
+    DPS_BitVector* bvOut;
+
+    if (!cv || !bv) {
+        return NULL;
+    }
+    assert(cv->len == bv->len);
+    assert(cv->entries > 0);
+    bvOut = AllocBV(cv->len);
+    if (bvOut) {
+        IntersectionExcludingEntries(cv, bv, cv->entries - 1, bvOut);
+    }
+    return bvOut;
+}
+
+uint32_t DPS_CountVectorRevision(DPS_CountVector* cv)
+{
+    return cv->revision;
 }
 
 void DPS_CountVectorDump(DPS_CountVector* cv)
@@ -1098,7 +2768,7 @@ void DPS_CountVectorDump(DPS_CountVector* cv)
     for (i = 0; i < NUM_CHUNKS(cv); ++i) {
         size_t j;
         for (j = 0; j < CHUNK_SIZE; ++j) {
-            DPS_PRINT("%d ", cv->counts[i][j]);
+            DPS_PRINT("%zu ", CounterGet(cv->counts[i], j));
         }
         DPS_PRINT("\n");
     }
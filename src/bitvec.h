@@ -61,6 +61,36 @@ typedef struct _DPS_CountVector DPS_CountVector;
  */
 DPS_Status DPS_Configure(size_t bitLen, size_t numHashes);
 
+/**
+ * Hash functions for deriving the Bloom filter bit indices
+ *
+ * DPS_BloomHashSha2 derives the indices from a SHA-256 digest
+ * DPS_BloomHashFast derives the indices from a non-cryptographic 128 bit hash
+ */
+typedef enum { DPS_BloomHashSha2, DPS_BloomHashFast } DPS_BloomHash;
+
+/**
+ * Select the hash function for Bloom filter operations. Like the
+ * parameters set by DPS_Configure() this is a system wide setting;
+ * it must be selected before any nodes are created and nodes using
+ * different hash functions cannot communicate with each other. A link
+ * between such nodes is refused and fails with DPS_ERR_INCOMPATIBLE.
+ *
+ * @param hash  The hash function
+ *
+ * @return
+ * - DPS_OK if the hash function is supported.
+ * - DPS_ERR_ARGS if the hash function is not supported.
+ */
+DPS_Status DPS_ConfigureBloomHash(DPS_BloomHash hash);
+
+/**
+ * Get the hash function selected for Bloom filter operations
+ *
+ * @return The hash function
+ */
+DPS_BloomHash DPS_GetBloomHash(void);
+
 /**
  * Bloom Filter insertion operation.
  *
@@ -70,6 +100,17 @@ DPS_Status DPS_Configure(size_t bitLen, size_t numHashes);
  */
 void DPS_BitVectorBloomInsert(DPS_BitVector* bv, const uint8_t* data, size_t len);
 
+/**
+ * Get the counters for the cache of Bloom filter hashes. The hashes
+ * for recently inserted or tested data are cached so adding the same
+ * topics again does not recompute them. The counters are zero if the
+ * cache is disabled.
+ *
+ * @param hits      Returns the number of lookups found in the cache
+ * @param misses    Returns the number of lookups that were hashed
+ */
+void DPS_BloomCacheStats(uint64_t* hits, uint64_t* misses);
+
 /**
  * Bloom Filter existence check operation.
  *
@@ -130,6 +171,27 @@ void DPS_BitVectorFree(DPS_BitVector* bv);
  */
 float DPS_BitVectorLoadFactor(DPS_BitVector* bv);
 
+/**
+ * Get the length of a bit vector.
+ *
+ * @param bv   An initialized bit vector
+ *
+ * @return the length in bits
+ */
+size_t DPS_BitVectorLen(const DPS_BitVector* bv);
+
+/**
+ * Find the next bit that is set in a bit vector.
+ *
+ * @param bv   An initialized bit vector
+ * @param bit  The position to start searching from
+ *
+ * @return the index of the first set bit at or after the start
+ *         position, or the bit vector length if there are no more
+ *         bits set
+ */
+size_t DPS_BitVectorNextSetBit(const DPS_BitVector* bv, size_t bit);
+
 /**
  * Compute the population count (number of bits set) of the bit vector.
  *
@@ -328,6 +390,30 @@ DPS_Status DPS_BitVectorSet(DPS_BitVector* bv, uint8_t* data, size_t len);
  */
 void DPS_BitVectorDump(DPS_BitVector* bv, int bits);
 
+/**
+ * Get the name of a set of compiled bit vector kernels, for testing
+ * the kernels
+ *
+ * @param index  Index of the kernels, the generic kernels are at index 0
+ *
+ * @return  The name of the kernels or NULL if index is past the last kernels
+ */
+const char* DPS_BitVectorKernelsName(size_t index);
+
+/**
+ * Use a set of bit vector kernels in place of the ones selected for
+ * the CPU, for testing the kernels. This must not be called while
+ * bit vector operations are in progress on other threads.
+ *
+ * @param name  The name of the kernels
+ *
+ * @return
+ * - DPS_OK if the kernels will be used
+ * - DPS_ERR_MISSING if there are no kernels with the name
+ * - DPS_ERR_NOT_IMPLEMENTED if the CPU does not support the kernels
+ */
+DPS_Status DPS_BitVectorUseKernels(const char* name);
+
 /**
  * Allocates a count vector using the default values set by DPS_Configure()
  *
@@ -392,6 +478,62 @@ DPS_BitVector* DPS_CountVectorToUnion(DPS_CountVector* cv);
  */
 DPS_BitVector* DPS_CountVectorToIntersection(DPS_CountVector* cv);
 
+/**
+ * Allocates and returns a bit vector that represents the union of the
+ * bit vectors added to the count vector excluding one of them. This is
+ * equivalent to deleting the excluded bit vector, taking the union, and
+ * adding the excluded bit vector back but the count vector is not
+ * modified.
+ *
+ * @param cv An initialized count vector
+ * @param bv A bit vector that was previously added to the count vector
+ *
+ * @return  A bit vector or NULL if the resource could not be allocated
+ */
+DPS_BitVector* DPS_CountVectorToUnionExcluding(DPS_CountVector* cv, DPS_BitVector* bv);
+
+/**
+ * Updates a bit vector previously computed by DPS_CountVectorToUnionExcluding()
+ * or DPS_CountVectorToUnion() to the current union of the bit vectors added to
+ * the count vector excluding one of them. Only the chunks of the count vector
+ * that changed since the bit vector was computed are recalculated.
+ *
+ * @param cv       An initialized count vector allocated by DPS_CountVectorAlloc()
+ * @param bv       The excluded bit vector or NULL to exclude nothing
+ * @param revision The count vector revision when bvOut was computed
+ * @param bvOut    The bit vector to update
+ * @param delta    Returns the bits that changed in bvOut
+ * @param same     Returns DPS_TRUE if bvOut did not change
+ *
+ * @return DPS_OK if the bit vector was updated
+ */
+DPS_Status DPS_CountVectorUpdateUnionExcluding(DPS_CountVector* cv, DPS_BitVector* bv, uint32_t revision,
+                                               DPS_BitVector* bvOut, DPS_BitVector* delta, int* same);
+
+/**
+ * Allocates and returns a bit vector that represents the intersection of the
+ * bit vectors added to the count vector excluding one of them. This is
+ * equivalent to deleting the excluded bit vector, taking the intersection,
+ * and adding the excluded bit vector back but the count vector is not
+ * modified.
+ *
+ * @param cv An initialized count vector
+ * @param bv A bit vector that was previously added to the count vector
+ *
+ * @return  A bit vector or NULL if the resource could not be allocated
+ */
+DPS_BitVector* DPS_CountVectorToIntersectionExcluding(DPS_CountVector* cv, DPS_BitVector* bv);
+
+/**
+ * Returns the revision of a count vector. The revision changes each
+ * time a bit vector is added to or deleted from the count vector.
+ *
+ * @param cv An initialized count vector
+ *
+ * @return The count vector revision
+ */
+uint32_t DPS_CountVectorRevision(DPS_CountVector* cv);
+
 /**
  * Print a count vector.
  *
@@ -39,10 +39,25 @@ extern "C" {
 #define THREAD __thread
 #define BSWAP_32(n)  __builtin_bswap32(n)
 #define BSWAP_64(n)  __builtin_bswap64(n)
+#define ATOMIC_LOAD_PTR(p)           __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_CAS_PTR(p, old, new)  __sync_val_compare_and_swap((p), (old), (new))
+#define ATOMIC_XCHG_PTR(p, v)        __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_LOAD_32(p)            __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_XCHG_32(p, v)         __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_INC_32(p)             __atomic_add_fetch((p), 1, __ATOMIC_ACQ_REL)
+#define ATOMIC_DEC_32(p)             __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
 #elif defined(_MSC_VER)
+#include <intrin.h>
 #define THREAD __declspec(thread)
 #define BSWAP_32(n)  _byteswap_ulong(n)
 #define BSWAP_64(n)  _byteswap_uint64(n)
+#define ATOMIC_LOAD_PTR(p)           (*(void* volatile*)(p))
+#define ATOMIC_CAS_PTR(p, old, new)  _InterlockedCompareExchangePointer((void* volatile*)(p), (new), (old))
+#define ATOMIC_XCHG_PTR(p, v)        _InterlockedExchangePointer((void* volatile*)(p), (v))
+#define ATOMIC_LOAD_32(p)            ((uint32_t)(*(volatile long*)(p)))
+#define ATOMIC_XCHG_32(p, v)         ((uint32_t)_InterlockedExchange((volatile long*)(p), (long)(v)))
+#define ATOMIC_INC_32(p)             ((uint32_t)_InterlockedIncrement((volatile long*)(p)))
+#define ATOMIC_DEC_32(p)             ((uint32_t)_InterlockedDecrement((volatile long*)(p)))
 #endif
 
 #if defined(_WIN32)
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <math.h>
 #include <safe_lib.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dps/dbg.h>
@@ -57,6 +58,8 @@ DPS_DEBUG_CONTROL(DPS_DEBUG_ON);
 
 #define DESCRIBE(n)  DPS_NodeAddrToString(&(n)->ep.addr)
 
+#define PUB_FROM_READY(q)  ((DPS_Publication*)((uint8_t*)(q) - offsetof(DPS_Publication, ready)))
+
 #define _MIN_(x, y)  (((x) < (y)) ? (x) : (y))
 
 typedef enum { NO_REQ, SUB_REQ, PUB_REQ, ACK_REQ } RequestType;
@@ -335,6 +338,7 @@ DPS_Status DPS_ClearOutboundInterests(RemoteNode* remote)
      * We are clearing the interests this is not a delta
      */
     remote->outbound.deltaInd = DPS_FALSE;
+    remote->outbound.current = DPS_FALSE;
     if (!remote->outbound.interests || !remote->outbound.needs) {
         FreeOutboundInterests(remote);
         return DPS_ERR_RESOURCES;
@@ -361,15 +365,70 @@ void DPS_ClearInboundInterests(DPS_Node* node, RemoteNode* remote)
     }
 }
 
-static void InsertRemoteNode(DPS_Node* node, RemoteNode* remote)
+#define REMOTE_TABLE_MIN_BUCKETS 16
+
+static DPS_Status GrowRemoteTable(DPS_Node* node)
+{
+    size_t numBuckets = node->remoteTable.numBuckets ? 2 * node->remoteTable.numBuckets : REMOTE_TABLE_MIN_BUCKETS;
+    RemoteNode** buckets = calloc(numBuckets, sizeof(RemoteNode*));
+    RemoteNode* remote;
+    size_t i;
+
+    if (!buckets) {
+        return DPS_ERR_RESOURCES;
+    }
+    for (i = 0; i < node->remoteTable.numBuckets; ++i) {
+        while (node->remoteTable.buckets[i]) {
+            remote = node->remoteTable.buckets[i];
+            node->remoteTable.buckets[i] = remote->hashNext;
+            remote->hashNext = buckets[remote->hash & (numBuckets - 1)];
+            buckets[remote->hash & (numBuckets - 1)] = remote;
+        }
+    }
+    free(node->remoteTable.buckets);
+    node->remoteTable.buckets = buckets;
+    node->remoteTable.numBuckets = numBuckets;
+    return DPS_OK;
+}
+
+static DPS_Status InsertRemoteNode(DPS_Node* node, RemoteNode* remote)
 {
+    size_t i;
+
+    /*
+     * The table still works if it cannot be grown, the chains are
+     * just longer
+     */
+    if (node->remoteTable.numRemotes >= node->remoteTable.numBuckets) {
+        if ((GrowRemoteTable(node) != DPS_OK) && !node->remoteTable.numBuckets) {
+            return DPS_ERR_RESOURCES;
+        }
+    }
+    remote->hash = DPS_HashAddr(&remote->ep.addr);
+    i = remote->hash & (node->remoteTable.numBuckets - 1);
+    remote->hashNext = node->remoteTable.buckets[i];
+    node->remoteTable.buckets[i] = remote;
+    ++node->remoteTable.numRemotes;
+
     remote->next = node->remoteNodes;
     node->remoteNodes = remote;
+    ++node->remotesGeneration;
+    return DPS_OK;
 }
 
 static void RemoveRemoteNode(DPS_Node* node, RemoteNode* remote)
 {
+    RemoteNode** r = &node->remoteTable.buckets[remote->hash & (node->remoteTable.numBuckets - 1)];
     RemoteNode* prev = node->remoteNodes;
+
+    while (*r != remote) {
+        r = &(*r)->hashNext;
+        assert(*r);
+    }
+    *r = remote->hashNext;
+    remote->hashNext = NULL;
+    --node->remoteTable.numRemotes;
+
     if (prev == remote) {
         node->remoteNodes = remote->next;
     } else {
@@ -380,6 +439,7 @@ static void RemoveRemoteNode(DPS_Node* node, RemoteNode* remote)
         prev->next = remote->next;
     }
     remote->next = NULL;
+    ++node->remotesGeneration;
 }
 
 void DPS_DeleteRemoteNode(DPS_Node* node, RemoteNode* remote)
@@ -443,71 +503,94 @@ DPS_Status DPS_UpdateOutboundInterests(DPS_Node* node, RemoteNode* destNode, uin
         return DPS_OK;
     }
     *changes = DPS_FALSE;
-    /*
-     * Inbound interests from the node we are updating are excluded from the
-     * recalculation of outbound interests
-     */
-    if (destNode->inbound.interests) {
-        ret = DPS_CountVectorDel(node->interests, destNode->inbound.interests);
-        if (ret != DPS_OK) {
-            goto ErrExit;
-        }
-        newInterests = DPS_CountVectorToUnion(node->interests);
-        ret = DPS_CountVectorAdd(node->interests, destNode->inbound.interests);
-        if (ret != DPS_OK) {
-            goto ErrExit;
-        }
-        ret = DPS_CountVectorDel(node->needs, destNode->inbound.needs);
-        if (ret != DPS_OK) {
-            goto ErrExit;
-        }
-        newNeeds = DPS_CountVectorToIntersection(node->needs);
-        ret = DPS_CountVectorAdd(node->needs, destNode->inbound.needs);
-        if (ret != DPS_OK) {
+    if (!destNode->outbound.delta) {
+        destNode->outbound.delta = DPS_BitVectorAlloc();
+        if (!destNode->outbound.delta) {
+            ret = DPS_ERR_RESOURCES;
             goto ErrExit;
         }
-    } else {
-        assert(!destNode->inbound.needs);
-        newInterests = DPS_CountVectorToUnion(node->interests);
-        newNeeds = DPS_CountVectorToIntersection(node->needs);
-    }
-    if (!newNeeds || !newInterests) {
-        ret = DPS_ERR_RESOURCES;
-        goto ErrExit;
     }
     /*
-     * Send a delta if we have previously sent interests. The needs vector
-     * is small and typically dense so it is not worth computing a delta.
+     * Once outbound interests have been sent they are brought up to date
+     * in place, only the parts of the node interests that changed since
+     * they were computed are recalculated. The inbound interests from the
+     * node we are updating are excluded.
      */
-    if (destNode->outbound.interests) {
+    if (destNode->outbound.interests && destNode->outbound.current) {
         int same = DPS_FALSE;
-        if (!destNode->outbound.delta) {
-            destNode->outbound.delta = DPS_BitVectorAlloc();
-            if (!destNode->outbound.delta) {
+        /*
+         * The needs vector is small and typically dense so it is simply
+         * recomputed when it has changed.
+         */
+        if (destNode->outbound.needsRevision != DPS_CountVectorRevision(node->needs)) {
+            if (destNode->inbound.needs) {
+                newNeeds = DPS_CountVectorToIntersectionExcluding(node->needs, destNode->inbound.needs);
+            } else {
+                newNeeds = DPS_CountVectorToIntersection(node->needs);
+            }
+            if (!newNeeds) {
                 ret = DPS_ERR_RESOURCES;
                 goto ErrExit;
             }
         }
-        DPS_BitVectorXor(destNode->outbound.delta, destNode->outbound.interests, newInterests, &same);
-        if (same) {
-            if (!DPS_BitVectorEquals(destNode->outbound.needs, newNeeds)) {
+        ret = DPS_CountVectorUpdateUnionExcluding(node->interests, destNode->inbound.interests,
+                                                  destNode->outbound.interestsRevision,
+                                                  destNode->outbound.interests, destNode->outbound.delta, &same);
+        if (ret != DPS_OK) {
+            goto ErrExit;
+        }
+        if (newNeeds) {
+            if (same && !DPS_BitVectorEquals(destNode->outbound.needs, newNeeds)) {
                 DPS_ERRPRINT("Inconsistency between interests and needs for %s\n", DESCRIBE(destNode));
                 assert(DPS_BitVectorEquals(destNode->outbound.needs, newNeeds));
             }
-        } else {
-            *changes = DPS_TRUE;
+            DPS_BitVectorFree(destNode->outbound.needs);
+            destNode->outbound.needs = newNeeds;
         }
         destNode->outbound.deltaInd = DPS_TRUE;
+        *changes = !same;
     } else {
+        if (destNode->inbound.interests) {
+            newInterests = DPS_CountVectorToUnionExcluding(node->interests, destNode->inbound.interests);
+            newNeeds = DPS_CountVectorToIntersectionExcluding(node->needs, destNode->inbound.needs);
+        } else {
+            assert(!destNode->inbound.needs);
+            newInterests = DPS_CountVectorToUnion(node->interests);
+            newNeeds = DPS_CountVectorToIntersection(node->needs);
+        }
+        if (!newNeeds || !newInterests) {
+            ret = DPS_ERR_RESOURCES;
+            goto ErrExit;
+        }
         /*
-         * This is not a delta
+         * Send a delta if we have previously sent interests
          */
-        destNode->outbound.deltaInd = DPS_FALSE;
-        *changes = DPS_TRUE;
+        if (destNode->outbound.interests) {
+            int same = DPS_FALSE;
+            DPS_BitVectorXor(destNode->outbound.delta, destNode->outbound.interests, newInterests, &same);
+            if (same) {
+                if (!DPS_BitVectorEquals(destNode->outbound.needs, newNeeds)) {
+                    DPS_ERRPRINT("Inconsistency between interests and needs for %s\n", DESCRIBE(destNode));
+                    assert(DPS_BitVectorEquals(destNode->outbound.needs, newNeeds));
+                }
+            } else {
+                *changes = DPS_TRUE;
+            }
+            destNode->outbound.deltaInd = DPS_TRUE;
+        } else {
+            /*
+             * This is not a delta
+             */
+            destNode->outbound.deltaInd = DPS_FALSE;
+            *changes = DPS_TRUE;
+        }
+        FreeOutboundInterests(destNode);
+        destNode->outbound.interests = newInterests;
+        destNode->outbound.needs = newNeeds;
     }
-    FreeOutboundInterests(destNode);
-    destNode->outbound.interests = newInterests;
-    destNode->outbound.needs = newNeeds;
+    destNode->outbound.interestsRevision = DPS_CountVectorRevision(node->interests);
+    destNode->outbound.needsRevision = DPS_CountVectorRevision(node->needs);
+    destNode->outbound.current = DPS_TRUE;
 
     /*
      * Increment the revision number if there were changes
@@ -585,12 +668,15 @@ DPS_Status DPS_UnmuteRemoteNode(DPS_Node* node, RemoteNode* remote)
 RemoteNode* DPS_LookupRemoteNode(DPS_Node* node, const DPS_NodeAddress* addr)
 {
     RemoteNode* remote;
+    uint32_t hash;
 
-    if (!addr) {
+    if (!addr || !node->remoteTable.numRemotes) {
         return NULL;
     }
-    for (remote = node->remoteNodes; remote != NULL; remote = remote->next) {
-        if (DPS_SameAddr(&remote->ep.addr, addr)) {
+    hash = DPS_HashAddr(addr);
+    for (remote = node->remoteTable.buckets[hash & (node->remoteTable.numBuckets - 1)]; remote;
+         remote = remote->hashNext) {
+        if ((remote->hash == hash) && DPS_SameAddr(&remote->ep.addr, addr)) {
             return remote;
         }
     }
@@ -642,7 +728,12 @@ DPS_Status DPS_AddRemoteNode(DPS_Node* node, const DPS_NodeAddress* addr, DPS_Ne
         /*
          * Add remote node to the remote node list
          */
-        InsertRemoteNode(node, remote);
+        if (InsertRemoteNode(node, remote) != DPS_OK) {
+            DPS_NetConnectionDecRef(cn);
+            free(remote);
+            *remoteOut = NULL;
+            return DPS_ERR_RESOURCES;
+        }
     }
     *remoteOut = remote;
     return ret;
@@ -739,33 +830,102 @@ static void PublishCompletion(DPS_PublishRequest* req)
     }
 }
 
+/*
+ * Update the state of a local publication when a publish request is
+ * taken off the send queue
+ */
+static void UpdateLocalPub(DPS_Publication* pub, DPS_PublishRequest* req)
+{
+    if (req->expire) {
+        pub->flags |= PUB_FLAG_EXPIRED;
+    } else if (req->ttl == 0) {
+        pub->flags &= ~PUB_FLAG_RETAINED;
+        pub->flags &= ~PUB_FLAG_EXPIRED;
+    } else {
+        pub->flags |= PUB_FLAG_RETAINED;
+        pub->flags &= ~PUB_FLAG_EXPIRED;
+    }
+    pub->ttl = req->ttl;
+}
+
+static int GrowFanOut(DPS_Node* node)
+{
+    size_t cap = node->fanOut.cap ? 2 * node->fanOut.cap : 64;
+    DPS_NetEndpoint** eps = realloc(node->fanOut.eps, cap * sizeof(DPS_NetEndpoint*));
+
+    if (!eps) {
+        return DPS_FALSE;
+    }
+    node->fanOut.eps = eps;
+    node->fanOut.cap = cap;
+    return DPS_TRUE;
+}
+
 static void SendPubs(DPS_Node* node)
 {
     DPS_Publication* pub;
-    DPS_Publication* nextPub;
-    DPS_Subscription* sub;
     RemoteNode* remote;
     RemoteNode* nextRemote;
+    size_t pos;
     DPS_Status ret = DPS_OK;
     DPS_PublishRequest* req;
     DPS_PublishRequest* expired;
+    DPS_Queue ready;
     uint64_t now;
-    uint64_t reschedule = UINT64_MAX;
+    uint64_t reschedule;
+    size_t numEps;
 
     DPS_LockNode(node);
+    DPS_QueuePublishRequests(node);
     now = uv_now(node->loop);
+    /*
+     * Publications with expired retained requests are visited along
+     * with the publications that have requests to send
+     */
+    while ((pub = DPS_PopExpiredPub(node, now)) != NULL) {
+        DPS_ReadyPub(node, pub);
+    }
+    /*
+     * Take the ready publications off the node's queue so publications
+     * that are still waiting for serialization are not visited again
+     */
+    DPS_QueueInit(&ready);
+    while (!DPS_QueueEmpty(&node->readyPubs)) {
+        DPS_Queue* link = DPS_QueueFront(&node->readyPubs);
+        DPS_QueueRemove(link);
+        DPS_QueuePushBack(&ready, link);
+    }
     /*
      * Check if any local or retained publications need to be forwarded to this subscriber
      */
-    for (pub = node->publications; pub != NULL; pub = nextPub) {
-        nextPub = pub->next;
+    while (!DPS_QueueEmpty(&ready)) {
+        pub = PUB_FROM_READY(DPS_QueueFront(&ready));
+        DPS_QueueRemove(&pub->ready);
+        pub->isReady = DPS_FALSE;
         DPS_PublicationIncRef(pub);
         expired = NULL;
+        DPS_StartPubCrypto(pub);
         while (!DPS_QueueEmpty(&pub->sendQueue)) {
             req = (DPS_PublishRequest*)DPS_QueueFront(&pub->sendQueue);
+            /*
+             * Requests are sent in order so stop at the first one
+             * that is still being protected
+             */
+            ret = DPS_PublishRequestReady(req);
+            if (ret == DPS_ERR_BUSY) {
+                break;
+            }
             DPS_QueueRemove(&req->queue);
+            if ((ret == DPS_OK) && (pub->flags & PUB_FLAG_LOCAL)) {
+                UpdateLocalPub(pub, req);
+            }
             assert(req->refCount > 0);
             --req->refCount;
+            if (ret != DPS_OK) {
+                req->status = ret;
+                DPS_PublishCompletion(req);
+                continue;
+            }
             if (!req->expires) {
                 req->expires = now + DPS_SECS_TO_MS(req->ttl);
             }
@@ -774,13 +934,10 @@ static void SendPubs(DPS_Node* node)
                  * Loopback publication if there is a matching subscriber candidate on
                  * this node
                  */
-                for (sub = node->subscriptions; sub != NULL; sub = sub->next) {
-                    if (DPS_BitVectorIncludes(pub->bf, sub->bf)) {
-                        ret = DPS_SendPublication(req, pub, DPS_LoopbackNode);
-                        if (ret != DPS_OK) {
-                            DPS_ERRPRINT("SendPublication (loopback) returned %s\n", DPS_ErrTxt(ret));
-                        }
-                        break;
+                if (DPS_HasSubscriptionCandidate(node, pub->bf)) {
+                    ret = DPS_SendPublication(req, pub, DPS_LoopbackNode);
+                    if (ret != DPS_OK) {
+                        DPS_ERRPRINT("SendPublication (loopback) returned %s\n", DPS_ErrTxt(ret));
                     }
                 }
                 /*
@@ -793,7 +950,8 @@ static void SendPubs(DPS_Node* node)
                     }
                 }
             }
-            for (remote = node->remoteNodes; remote != NULL; remote = nextRemote) {
+            numEps = 0;
+            for (remote = node->remoteNodes, pos = 0; remote != NULL; remote = nextRemote, ++pos) {
                 nextRemote = remote->next;
                 DPS_DBGPRINT("%s %s interests=%p\n", DESCRIBE(remote), RemoteStateTxt(remote), remote->inbound.interests);
                 if (remote->state != REMOTE_ACTIVE || !remote->inbound.interests) {
@@ -808,12 +966,7 @@ static void SendPubs(DPS_Node* node)
                         continue;
                     }
                 }
-                /*
-                 * This is the pub/sub matching code
-                 */
-                DPS_BitVectorIntersection(node->scratch.interests, pub->bf, remote->inbound.interests);
-                DPS_BitVectorFuzzyHash(node->scratch.needs, node->scratch.interests);
-                if (!DPS_BitVectorIncludes(node->scratch.needs, remote->inbound.needs)) {
+                if (!DPS_PublicationMatchesRemote(node, pub, remote, pos)) {
                     DPS_DBGPRINT("Rejected pub %s(%d) for %s: %s\n", DPS_UUIDToString(&pub->pubId),
                                  req->sequenceNum, DESCRIBE(remote),
                                  DPS_DumpMatchingTopics(remote->inbound.interests));
@@ -821,11 +974,34 @@ static void SendPubs(DPS_Node* node)
                 }
                 DPS_DBGPRINT("Sending pub %s(%d) to %s\n", DPS_UUIDToString(&pub->pubId),
                              req->sequenceNum, DESCRIBE(remote));
-                ret = DPS_SendPublication(req, pub, remote);
-                if (ret != DPS_OK) {
-                    DPS_DeleteRemoteNode(node, remote);
-                    DPS_ERRPRINT("SendPublication (unicast) returned %s\n", DPS_ErrTxt(ret));
+                if (numEps == node->fanOut.cap && !GrowFanOut(node)) {
+                    /*
+                     * Send to the remote nodes collected so far and start
+                     * over, or send to this remote node on its own if
+                     * nothing could be collected
+                     */
+                    if (!numEps) {
+                        ret = DPS_SendPublication(req, pub, remote);
+                        if (ret != DPS_OK) {
+                            DPS_ERRPRINT("SendPublication (unicast) returned %s\n", DPS_ErrTxt(ret));
+                        }
+                        continue;
+                    }
+                    ret = DPS_SendPublicationMany(req, pub, node->fanOut.eps, numEps);
+                    if (ret != DPS_OK) {
+                        DPS_ERRPRINT("SendPublication (unicast) returned %s\n", DPS_ErrTxt(ret));
+                    }
+                    numEps = 0;
                 }
+                node->fanOut.eps[numEps++] = &remote->ep;
+            }
+            /*
+             * The transport reports a failed send to a remote node
+             * through the send complete callback
+             */
+            ret = DPS_SendPublicationMany(req, pub, node->fanOut.eps, numEps);
+            if (ret != DPS_OK) {
+                DPS_ERRPRINT("SendPublication (unicast) returned %s\n", DPS_ErrTxt(ret));
             }
             if (!DPS_QueueEmpty(&pub->retainedQueue)) {
                 PublishCompletion(expired);
@@ -835,10 +1011,12 @@ static void SendPubs(DPS_Node* node)
             if (now < req->expires) {
                 DPS_QueuePushBack(&pub->retainedQueue, &req->queue);
                 ++req->refCount;
-                reschedule = (req->expires < reschedule) ? req->expires : reschedule;
             }
             DPS_PublishCompletion(req);
         }
+        if (!DPS_QueueEmpty(&pub->sendQueue)) {
+            DPS_ReadyPub(node, pub);
+        }
         if (!DPS_QueueEmpty(&pub->retainedQueue)) {
             DPS_PublishRequest* retained = (DPS_PublishRequest*)DPS_QueueFront(&pub->retainedQueue);
             if (retained->expires <= now) {
@@ -855,14 +1033,24 @@ static void SendPubs(DPS_Node* node)
             }
             DPS_ExpirePub(node, pub);
         }
+        /*
+         * The retained queue has its final state for this pass so the
+         * expiry is only updated once
+         */
+        DPS_ScheduleExpiry(node, pub);
         PublishCompletion(expired);
         DPS_PublicationDecRef(pub);
     }
     DPS_DumpPubs(node);
+    reschedule = DPS_NextExpiry(node);
     if (reschedule < UINT64_MAX) {
         uv_timer_start(&node->pubsTimer, SendPubsTimer, (reschedule < now) ? 0 : (reschedule - now), 0);
     }
     DPS_UnlockNode(node);
+    /*
+     * Loopback publications may have queued subscription handler calls
+     */
+    DPS_ExecutorWaitForSpace(node->handlerExecutor);
 }
 
 static void SendPubsTask(uv_async_t* handle)
@@ -1052,16 +1240,22 @@ void DPS_UpdatePubs(DPS_Node* node)
         return;
     }
     for (pub = node->publications; pub != NULL; pub = nextPub) {
+        int sending;
+
         nextPub = pub->next;
-        if (!DPS_QueueEmpty(&pub->sendQueue)) {
-            ++count;
-        } else if (DPS_QueueEmpty(&pub->retainedQueue)) {
-            DPS_ExpirePub(node, pub);
-        } else if (node->remoteNodes || node->mcastSender) {
+        sending = !DPS_QueueEmpty(&pub->sendQueue) || !DPS_QueueEmpty(&pub->reorderQueue);
+        if (!sending && !DPS_QueueEmpty(&pub->retainedQueue) && (node->remoteNodes || node->mcastSender)) {
             req = (DPS_PublishRequest*)DPS_QueueFront(&pub->retainedQueue);
             DPS_QueueRemove(&req->queue);
             DPS_QueuePushBack(&pub->sendQueue, &req->queue);
+            DPS_ScheduleExpiry(node, pub);
+            DPS_ReadyPub(node, pub);
+            sending = DPS_TRUE;
+        }
+        if (sending) {
             ++count;
+        } else if (DPS_QueueEmpty(&pub->retainedQueue)) {
+            DPS_ExpirePub(node, pub);
         }
     }
     if (count) {
@@ -1095,21 +1289,12 @@ void DPS_QueuePublicationAck(DPS_Node* node, PublicationAck* ack)
     DPS_UnlockNode(node);
 }
 
-static DPS_Status DecodeRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buf, int multicast)
+static DPS_Status DecodeMessageType(DPS_Node* node, DPS_RxBuffer* rxBuf, uint8_t* msgType)
 {
-    DPS_RxBuffer* rxBuf = (DPS_RxBuffer*)buf;
     DPS_Status ret;
     uint8_t msgVersion;
-    uint8_t msgType;
     size_t len;
 
-    if (node->state == DPS_NODE_PAUSED) {
-        return DPS_OK;
-    }
-    DPS_DBGTRACEA("node=%p,ep={addr=%s,cn=%p},buf=%p,multicast=%d\n",
-            node, DPS_NodeAddrToString(&ep->addr), ep->cn, buf, multicast);
-
-    CBOR_Dump("Request in", rxBuf->rxPos, DPS_RxBufferAvail(rxBuf));
     ret = CBOR_DecodeArray(rxBuf, &len);
     if (ret != DPS_OK || (len != 5)) {
         DPS_ERRPRINT("Expected a CBOR array of 5 elements\n");
@@ -1124,11 +1309,39 @@ static DPS_Status DecodeRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBu
         DPS_ERRPRINT("Expected message version %d, received %d\n", DPS_MSG_VERSION, msgVersion);
         return DPS_ERR_NOT_IMPLEMENTED;
     }
-    ret = CBOR_DecodeUint8(rxBuf, &msgType);
+    ret = CBOR_DecodeUint8(rxBuf, msgType);
     if (ret != DPS_OK) {
         DPS_ERRPRINT("Expected a message type\n");
         return ret;
     }
+    return DPS_OK;
+}
+
+static DPS_Status DecodeRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buf, int multicast,
+                                DPS_PubHeader* hdr)
+{
+    DPS_RxBuffer* rxBuf = (DPS_RxBuffer*)buf;
+    DPS_Status ret;
+    uint8_t msgType;
+
+    if (node->state == DPS_NODE_PAUSED) {
+        return DPS_OK;
+    }
+    DPS_DBGTRACEA("node=%p,ep={addr=%s,cn=%p},buf=%p,multicast=%d\n",
+            node, DPS_NodeAddrToString(&ep->addr), ep->cn, buf, multicast);
+
+    if (hdr) {
+        /*
+         * A publication that was partially decoded on a receive thread
+         */
+        msgType = DPS_MSG_TYPE_PUB;
+    } else {
+        CBOR_Dump("Request in", rxBuf->rxPos, DPS_RxBufferAvail(rxBuf));
+        ret = DecodeMessageType(node, rxBuf, &msgType);
+        if (ret != DPS_OK) {
+            return ret;
+        }
+    }
     ret = DPS_ERR_INVALID;
     switch (msgType) {
     case DPS_MSG_TYPE_SUB:
@@ -1138,7 +1351,7 @@ static DPS_Status DecodeRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBu
         }
         break;
     case DPS_MSG_TYPE_PUB:
-        ret = DPS_DecodePublication(node, ep, buf, multicast);
+        ret = DPS_DecodePublication(node, ep, buf, multicast, hdr);
         if (ret != DPS_OK) {
             DPS_DBGPRINT("DecodePublication returned %s\n", DPS_ErrTxt(ret));
         }
@@ -1169,6 +1382,27 @@ static DPS_Status DecodeRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBu
     return ret;
 }
 
+DPS_Status DPS_PreDecodeRequest(DPS_Node* node, DPS_NetRxBuffer* buf, DPS_PubHeader* hdr)
+{
+    DPS_RxBuffer rxBuf = buf->rx;
+    uint8_t msgType;
+    DPS_Status ret;
+
+    /*
+     * Decode from a copy of the buffer so the request can be decoded
+     * again from the start by DecodeRequest(). Malformed requests are
+     * reported by DecodeRequest().
+     */
+    ret = DecodeMessageType(node, &rxBuf, &msgType);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    if (msgType != DPS_MSG_TYPE_PUB) {
+        return DPS_ERR_INVALID;
+    }
+    return DPS_PreDecodePublication(node, &rxBuf, hdr);
+}
+
 /*
  * Using CoAP packetization for receiving multicast subscription requests
  */
@@ -1204,13 +1438,14 @@ static DPS_Status OnMulticastReceive(DPS_Node* node, DPS_NetEndpoint* ep, DPS_St
         ret = DPS_ERR_INVALID;
         goto Exit;
     }
-    ret = DecodeRequest(node, ep, buf, DPS_TRUE);
+    ret = DecodeRequest(node, ep, buf, DPS_TRUE, NULL);
 Exit:
     CoAP_Free(&coap);
     return ret;
 }
 
-static DPS_Status OnNetReceive(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Status status, DPS_NetRxBuffer* buf)
+static DPS_Status ReceiveRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Status status, DPS_NetRxBuffer* buf,
+                                 DPS_PubHeader* hdr)
 {
     DPS_DBGTRACEA("node=%p,ep={addr=%s,cn=%p},status=%s,buf=%p\n", node, DPS_NodeAddrToString(&ep->addr),
             ep->cn, DPS_ErrTxt(status), buf);
@@ -1224,6 +1459,11 @@ static DPS_Status OnNetReceive(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Status s
         return DPS_ERR_FAILURE;
     }
     DPS_UnlockNode(node);
+    /*
+     * Apply backpressure if the subscription handlers are not keeping
+     * up with the input
+     */
+    DPS_ExecutorWaitForSpace(node->handlerExecutor);
     /*
      * Delete the remote node if the receive failed
      */
@@ -1237,7 +1477,24 @@ static DPS_Status OnNetReceive(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Status s
         DPS_UnlockNode(node);
         return status;
     }
-    return DecodeRequest(node, ep, buf, DPS_FALSE);
+    return DecodeRequest(node, ep, buf, DPS_FALSE, hdr);
+}
+
+static DPS_Status OnNetReceive(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Status status, DPS_NetRxBuffer* buf)
+{
+    return ReceiveRequest(node, ep, status, buf, NULL);
+}
+
+DPS_Status DPS_ReceiveDecodedRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buf,
+                                     DPS_PubHeader* hdr)
+{
+    DPS_Status ret;
+
+    ret = ReceiveRequest(node, ep, DPS_OK, buf, hdr);
+    if (hdr) {
+        DPS_ReleasePubHeader(hdr);
+    }
+    return ret;
 }
 
 DPS_Status DPS_LoopbackSend(DPS_Node* node, uv_buf_t* bufs, size_t numBufs)
@@ -1261,7 +1518,7 @@ DPS_Status DPS_LoopbackSend(DPS_Node* node, uv_buf_t* bufs, size_t numBufs)
     for (i = 0; i < numBufs; ++i) {
         len += bufs[i].len;
     }
-    buf = DPS_CreateNetRxBuffer(len);
+    buf = DPS_CreatePooledNetRxBuffer(node->rxPool, len);
     if (!buf) {
         ret = DPS_ERR_RESOURCES;
         DPS_ERRPRINT("DPS_TxBufferInit failed - %s\n", DPS_ErrTxt(ret));
@@ -1274,7 +1531,7 @@ DPS_Status DPS_LoopbackSend(DPS_Node* node, uv_buf_t* bufs, size_t numBufs)
         }
     }
     buf->rx.rxPos = buf->rx.base;
-    ret = DecodeRequest(node, &ep, buf, DPS_FALSE);
+    ret = DecodeRequest(node, &ep, buf, DPS_FALSE, NULL);
 
 Exit:
     DPS_NetRxBufferDecRef(buf);
@@ -1298,7 +1555,7 @@ static void FreeTask(uv_async_t* handle)
     }
     pub = &node->freePubs;
     while (*pub) {
-        if ((*pub)->refCount == 0) {
+        if (DPS_PublicationCanRelease(*pub)) {
             *pub = DPS_FreePublication(*pub);
         } else {
             pub = &(*pub)->next;
@@ -1367,11 +1624,24 @@ static void StopNode(DPS_Node* node)
     /*
      * Cleanup any unresolved requests
      */
+    DPS_MpscQueueDrain(&node->newRequests, &node->requestQueue);
     while (!DPS_QueueEmpty(&node->requestQueue)) {
         request = (NodeRequest*)DPS_QueueFront(&node->requestQueue);
         DPS_QueueRemove(&request->queue);
         request->cb(request);
     }
+    /*
+     * Stop the handler worker threads, the node lock is released
+     * because the handler calls running on the workers need it to
+     * complete
+     */
+    if (node->handlerExecutor) {
+        DPS_Executor* executor = node->handlerExecutor;
+        node->handlerExecutor = NULL;
+        DPS_UnlockNode(node);
+        DPS_DestroyExecutor(executor);
+        DPS_LockNode(node);
+    }
     /*
      * Cleanup any subscriptions or publications that may have a
      * destroyed callback
@@ -1398,12 +1668,16 @@ static void StopNode(DPS_Node* node)
     DPS_CountVectorFree(node->needs);
     DPS_BitVectorFree(node->scratch.interests);
     DPS_BitVectorFree(node->scratch.needs);
+    DPS_FreeSubscriptionIndex(node);
+    DPS_TopicTrieFree(node->topicTrie);
     DPS_HistoryFree(&node->history);
     /*
      * Cleanup mutexes etc.
      */
     uv_mutex_destroy(&node->condMutex);
+    uv_mutex_destroy(&node->pubLock);
     uv_mutex_destroy(&node->history.lock);
+    uv_rwlock_destroy(&node->subIndex.lock);
 
     assert(!uv_loop_alive(node->loop));
 
@@ -1416,6 +1690,12 @@ static void FreeNode(DPS_Node* node)
 {
     DPS_ClearKeyId(&node->signer.kid);
     DPS_DestroyRBG(node->rbg);
+    free(node->remoteTable.buckets);
+    DPS_UUIDTableFree(&node->pubIndex);
+    free(node->expiry.pubs);
+    free(node->fanOut.eps);
+    DPS_SlabDestroy(&node->pubSends);
+    DPS_DestroyNetRxBufferPool(node->rxPool);
     free(node);
 }
 
@@ -1425,12 +1705,14 @@ static void NodeRun(void* arg)
     DPS_Node* node = (DPS_Node*)arg;
     uv_thread_t thisThread = node->thread;
 
+    DPS_AttachNetRxBufferCache(node->rxPool, &node->rxCache);
     uv_run(node->loop, UV_RUN_DEFAULT);
 
     DPS_DBGPRINT("Stopping node\n");
 
     DPS_LockNode(node);
     StopNode(node);
+    DPS_DetachNetRxBufferCache(&node->rxCache);
     /*
      * If we got here before the application called DPS_DestroyNode() we cannot free the node now,
      * it will be freed when DPS_DestroyNode() is called.
@@ -1567,12 +1849,17 @@ DPS_Node* DPS_CreateNode(const char* separators, DPS_KeyStore* keyStore, const D
     strncpy_s(node->separators, sizeof(node->separators), separators, sizeof(node->separators) - 1);
     node->keyStore = keyStore;
     DPS_QueueInit(&node->ackQueue);
+    DPS_QueueInit(&node->readyPubs);
     DPS_QueueInit(&node->requestQueue);
+    DPS_MpscQueueInit(&node->newRequests);
+    DPS_MpscQueueInit(&node->publishQueue);
+    DPS_SlabInit(&node->pubSends, sizeof(DPS_PubSend), PUB_SENDS_PER_BLOCK);
     /*
      * Set default keep alive and subscription rate parameters
      */
     node->subsRate = DPS_SUBSCRIPTION_UPDATE_RATE;
     node->linkLossTimeout = DPS_LINK_LOSS_TIMEOUT;
+    node->rxPoolMaxBytes = DPS_RX_BUFFER_POOL_MAX_BYTES;
     return node;
 }
 
@@ -1605,9 +1892,14 @@ static void RunRequestsTask(uv_async_t* handle)
     NodeRequest* request;
 
     DPS_LockNode(node);
+    DPS_MpscQueueDrain(&node->newRequests, &node->requestQueue);
     while (!DPS_QueueEmpty(&node->requestQueue)) {
         request = (NodeRequest*)DPS_QueueFront(&node->requestQueue);
         DPS_QueueRemove(&request->queue);
+        /*
+         * Canceling a request that has already run is a no-op
+         */
+        DPS_QueueInit(&request->queue);
         DPS_UnlockNode(node);
         request->cb(request);
         DPS_LockNode(node);
@@ -1690,10 +1982,15 @@ DPS_Status DPS_StartNode(DPS_Node* node, int mcast, DPS_NodeAddress* listenAddr)
      */
     r = uv_mutex_init(&node->condMutex);
     assert(!r);
+    r = uv_mutex_init(&node->pubLock);
+    assert(!r);
     r = uv_mutex_init_recursive(&node->nodeMutex);
     assert(!r);
     r = uv_mutex_init(&node->history.lock);
     assert(!r);
+    r = uv_rwlock_init(&node->subIndex.lock);
+    assert(!r);
+    DPS_HistoryInit(&node->history);
 
     DPS_GenerateUUID(&node->meshId);
     DPS_DBGPRINT("Node mesh id is: %s\n", DPS_UUIDToString(&node->meshId));
@@ -1706,6 +2003,24 @@ DPS_Status DPS_StartNode(DPS_Node* node, int mcast, DPS_NodeAddress* listenAddr)
         goto ErrExit;
     }
 
+    if (node->handlerConfig.numThreads) {
+        node->handlerExecutor = DPS_CreateExecutor(node->handlerConfig.numThreads,
+                                                   node->handlerConfig.maxQueued,
+                                                   node->handlerConfig.policy);
+        if (!node->handlerExecutor) {
+            ret = DPS_ERR_RESOURCES;
+            goto ErrExit;
+        }
+    }
+
+    if (node->rxPoolMaxBytes) {
+        node->rxPool = DPS_CreateNetRxBufferPool(node->rxPoolMaxBytes);
+        if (!node->rxPool) {
+            ret = DPS_ERR_RESOURCES;
+            goto ErrExit;
+        }
+    }
+
     DPS_NodeRequestInit(node, &node->onShutdownReq, OnShutdownRequest);
     node->onShutdownReq.data = node;
 
@@ -1809,6 +2124,133 @@ void DPS_SetNodeLinkLossTimeout(DPS_Node* node, uint32_t linkLossMsecs)
     node->linkLossTimeout = linkLossMsecs;
 }
 
+DPS_Status DPS_SetNodeHandlerThreads(DPS_Node* node, size_t numThreads, size_t maxQueued,
+                                     DPS_HandlerQueuePolicy policy)
+{
+    DPS_DBGTRACE();
+
+    if (!node) {
+        return DPS_ERR_NULL;
+    }
+    if (numThreads && !maxQueued) {
+        return DPS_ERR_ARGS;
+    }
+    if ((policy != DPS_HANDLER_QUEUE_BLOCK) && (policy != DPS_HANDLER_QUEUE_DROP_NEWEST) &&
+        (policy != DPS_HANDLER_QUEUE_DROP_OLDEST)) {
+        return DPS_ERR_ARGS;
+    }
+    if (node->state != DPS_NODE_CREATED) {
+        return DPS_ERR_INVALID;
+    }
+    node->handlerConfig.numThreads = numThreads;
+    node->handlerConfig.maxQueued = maxQueued;
+    node->handlerConfig.policy = policy;
+    return DPS_OK;
+}
+
+DPS_Status DPS_SetNodeReceiveThreads(DPS_Node* node, size_t numThreads)
+{
+    DPS_DBGTRACE();
+
+    if (!node) {
+        return DPS_ERR_NULL;
+    }
+    if (node->state != DPS_NODE_CREATED) {
+        return DPS_ERR_INVALID;
+    }
+    node->rxThreads = numThreads;
+    return DPS_OK;
+}
+
+DPS_Status DPS_GetNodeReceiveThreadStats(DPS_Node* node, DPS_ReceiveThreadStats* stats)
+{
+    DPS_DBGTRACE();
+
+    if (!node || !stats) {
+        return DPS_ERR_NULL;
+    }
+    if (node->state == DPS_NODE_CREATED) {
+        return DPS_ERR_NOT_STARTED;
+    }
+    DPS_LockNode(node);
+    DPS_NetGetReceiveThreadStats(node->netCtx, stats);
+    DPS_UnlockNode(node);
+    return DPS_OK;
+}
+
+DPS_Status DPS_SetNodeRxBufferPool(DPS_Node* node, size_t maxBytes)
+{
+    DPS_DBGTRACE();
+
+    if (!node) {
+        return DPS_ERR_NULL;
+    }
+    if (node->state != DPS_NODE_CREATED) {
+        return DPS_ERR_INVALID;
+    }
+    node->rxPoolMaxBytes = maxBytes;
+    return DPS_OK;
+}
+
+DPS_Status DPS_GetNodeRxBufferPoolStats(DPS_Node* node, DPS_RxBufferPoolStats* stats)
+{
+    DPS_DBGTRACE();
+
+    if (!node || !stats) {
+        return DPS_ERR_NULL;
+    }
+    if (node->state == DPS_NODE_CREATED) {
+        return DPS_ERR_NOT_STARTED;
+    }
+    DPS_GetNetRxBufferPoolStats(node->rxPool, stats);
+    return DPS_OK;
+}
+
+DPS_Status DPS_SetNodeHistorySize(DPS_Node* node, size_t maxCount)
+{
+    DPS_DBGTRACE();
+
+    if (!node) {
+        return DPS_ERR_NULL;
+    }
+    if (!maxCount || (maxCount > UINT32_MAX)) {
+        return DPS_ERR_ARGS;
+    }
+    if (node->state != DPS_NODE_CREATED) {
+        return DPS_ERR_INVALID;
+    }
+    node->history.maxCount = (uint32_t)maxCount;
+    return DPS_OK;
+}
+
+DPS_Status DPS_GetNodeHistoryStats(DPS_Node* node, DPS_HistoryStats* stats)
+{
+    DPS_DBGTRACE();
+
+    if (!node || !stats) {
+        return DPS_ERR_NULL;
+    }
+    if (node->state == DPS_NODE_CREATED) {
+        return DPS_ERR_NOT_STARTED;
+    }
+    DPS_HistoryGetStats(&node->history, stats);
+    return DPS_OK;
+}
+
+DPS_Status DPS_SetNodeCryptoOffload(DPS_Node* node, int offload)
+{
+    DPS_DBGTRACE();
+
+    if (!node) {
+        return DPS_ERR_NULL;
+    }
+    if (node->state != DPS_NODE_CREATED) {
+        return DPS_ERR_INVALID;
+    }
+    node->cryptoOffload = offload ? DPS_TRUE : DPS_FALSE;
+    return DPS_OK;
+}
+
 static void LinkExists(NodeRequest* req)
 {
     DPS_Status status = DPS_OK;
@@ -2193,16 +2635,18 @@ DPS_Status DPS_NodeRequestSchedule(NodeRequest* req)
     }
     node = req->node;
 
-    DPS_LockNode(node);
-    DPS_QueuePushBack(&node->requestQueue, &req->queue);
-    err = uv_async_send(&node->requestAsync);
-    if (err) {
-        DPS_ERRPRINT("uv_async_send failed - %s\n", uv_strerror(err));
-        ret = DPS_ERR_FAILURE;
-        DPS_QueueRemove(&req->queue);
-        free(req);
+    /*
+     * The node lock is not acquired here, the request is moved to the
+     * request queue on the node thread
+     */
+    if (DPS_MpscQueuePush(&node->newRequests, &req->queue)) {
+        err = uv_async_send(&node->requestAsync);
+        if (err) {
+            DPS_ERRPRINT("uv_async_send failed - %s\n", uv_strerror(err));
+            ret = DPS_ERR_FAILURE;
+            DPS_NodeRequestCancel(req);
+        }
     }
-    DPS_UnlockNode(node);
     return ret;
 }
 
@@ -2210,7 +2654,9 @@ void DPS_NodeRequestCancel(NodeRequest* req)
 {
     if (req) {
         DPS_LockNode(req->node);
+        DPS_MpscQueueDrain(&req->node->newRequests, &req->node->requestQueue);
         DPS_QueueRemove(&req->queue);
+        DPS_QueueInit(&req->queue);
         DPS_UnlockNode(req->node);
     }
 }
@@ -2235,17 +2681,12 @@ static void DumpHistory(DPS_PubHistory* ph)
 {
     DPS_NodeAddressList* addr;
 
-    if (!ph) {
-        return;
-    }
-    DumpHistory(ph->left);
     DPS_PRINT("  %s(%d)%s %"PRIu64" [", DPS_UUIDToString(&ph->id), ph->sn, ph->ackRequested ? " ACK" : "",
             ph->expiration);
     for (addr = ph->addrs; addr; addr = addr->next) {
         DPS_PRINT("%s%s(%d,%d)", addr != ph->addrs ? "," : "", DPS_NodeAddrToString(&addr->addr), addr->sn, addr->hopCount);
     }
     DPS_PRINT("]\n");
-    DumpHistory(ph->right);
 }
 
 static void DumpNode(uv_signal_t* handle, int signum)
@@ -2254,6 +2695,7 @@ static void DumpNode(uv_signal_t* handle, int signum)
     DPS_Publication* pub;
     DPS_Subscription* sub;
     RemoteNode* remote;
+    DPS_Queue* q;
     size_t i;
 
     DPS_LockNode(node);
@@ -2276,7 +2718,11 @@ static void DumpNode(uv_signal_t* handle, int signum)
                   RemoteStateTxt(remote), DPS_DumpMatchingTopics(remote->inbound.interests));
     }
     DPS_PRINT("history\n");
-    DumpHistory(node->history.root);
+    uv_mutex_lock(&node->history.lock);
+    for (q = DPS_QueueFront(&node->history.lru); q != &node->history.lru; q = q->next) {
+        DumpHistory((DPS_PubHistory*)q);
+    }
+    uv_mutex_unlock(&node->history.lock);
     DPS_UnlockNode(node);
 }
 
@@ -1329,7 +1329,7 @@ static void TLSRecv(DPS_NetConnection* cn)
      */
     DPS_NetConnectionIncRef(cn);
 
-    buf = DPS_CreateNetRxBuffer(MAX_READ_LEN);
+    buf = DPS_CreatePooledNetRxBuffer(netCtx->node->rxPool, MAX_READ_LEN);
     if (!buf) {
         DPS_ERRPRINT("Create buffer failed: %s\n", DPS_ErrTxt(DPS_ERR_RESOURCES));
         goto Exit;
@@ -1676,6 +1676,11 @@ DPS_NodeAddress* DPS_NetGetListenAddress(DPS_NodeAddress* addr, DPS_NetContext*
     return addr;
 }
 
+void DPS_NetGetReceiveThreadStats(DPS_NetContext* netCtx, DPS_ReceiveThreadStats* stats)
+{
+    memzero_s(stats, sizeof(DPS_ReceiveThreadStats));
+}
+
 void DPS_NetStop(DPS_NetContext* netCtx)
 {
     DPS_NetConnection* cns;
@@ -1780,6 +1785,24 @@ DPS_Status DPS_NetSend(DPS_Node* node, void* appCtx, DPS_NetEndpoint* ep, uv_buf
     return DPS_ERR_NETWORK;
 }
 
+DPS_Status DPS_NetSendMany(DPS_Node* node, void* appCtx, DPS_NetEndpoint** eps, size_t numEps,
+                           uv_buf_t* bufs, size_t numBufs, DPS_NetSendComplete sendCompleteCB)
+{
+    DPS_Status ret;
+    size_t i;
+
+    /*
+     * Each endpoint has its own session so the sends are made one at a time
+     */
+    for (i = 0; i < numEps; ++i) {
+        ret = DPS_NetSend(node, appCtx, eps[i], bufs, numBufs, sendCompleteCB);
+        if (ret != DPS_OK) {
+            sendCompleteCB(node, appCtx, eps[i], bufs, numBufs, ret);
+        }
+    }
+    return DPS_OK;
+}
+
 void DPS_NetConnectionIncRef(DPS_NetConnection* cn)
 {
     if (cn) {
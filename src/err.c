@@ -61,6 +61,7 @@ const char* DPS_ErrTxt(DPS_Status s)
         ERR_CASE(DPS_ERR_LOST_PRECISION);
         ERR_CASE(DPS_ERR_NOT_COSE);
         ERR_CASE(DPS_ERR_NONCE_OVERFLOW);
+        ERR_CASE(DPS_ERR_INCOMPATIBLE);
     default:
         snprintf(buf, sizeof(buf), "ERR%d", s);
         return buf;
@@ -0,0 +1,259 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <safe_lib.h>
+#include <uv.h>
+#include <dps/dbg.h>
+#include "executor.h"
+
+/*
+ * Debug control for this module
+ */
+DPS_DEBUG_CONTROL(DPS_DEBUG_OFF);
+
+struct _DPS_Executor {
+    uv_mutex_t mutex;
+    uv_cond_t readyCond;            /* Signaled when a strand is ready to run or the executor is stopping */
+    uv_cond_t spaceCond;            /* Signaled when a work item is taken off the queue */
+    DPS_Queue ready;                /* Strands with pending work items that are not running */
+    DPS_Queue order;                /* All pending work items oldest first */
+    size_t numQueued;
+    size_t maxQueued;
+    DPS_HandlerQueuePolicy policy;
+    uint64_t dropped;
+    int stopping;
+    size_t numThreads;
+    uv_thread_t threads[1];
+};
+
+#define WORK_FROM_ORDER(q)  ((DPS_ExecutorWork*)((uint8_t*)(q) - offsetof(DPS_ExecutorWork, order)))
+
+void DPS_ExecutorStrandInit(DPS_ExecutorStrand* strand)
+{
+    DPS_QueueInit(&strand->ready);
+    DPS_QueueInit(&strand->pending);
+    strand->isReady = DPS_FALSE;
+    strand->isRunning = DPS_FALSE;
+}
+
+/*
+ * Must be called holding the executor mutex
+ */
+static void RemoveWork(DPS_Executor* executor, DPS_ExecutorWork* work)
+{
+    DPS_ExecutorStrand* strand = work->strand;
+
+    DPS_QueueRemove(&work->pending);
+    DPS_QueueRemove(&work->order);
+    --executor->numQueued;
+    if (strand->isReady && DPS_QueueEmpty(&strand->pending)) {
+        DPS_QueueRemove(&strand->ready);
+        strand->isReady = DPS_FALSE;
+    }
+    uv_cond_signal(&executor->spaceCond);
+}
+
+/*
+ * Must be called holding the executor mutex
+ */
+static void ScheduleStrand(DPS_Executor* executor, DPS_ExecutorStrand* strand)
+{
+    if (!strand->isReady && !strand->isRunning && !DPS_QueueEmpty(&strand->pending)) {
+        DPS_QueuePushBack(&executor->ready, &strand->ready);
+        strand->isReady = DPS_TRUE;
+        uv_cond_signal(&executor->readyCond);
+    }
+}
+
+static void WorkerThread(void* arg)
+{
+    DPS_Executor* executor = arg;
+
+    uv_mutex_lock(&executor->mutex);
+    while (!executor->stopping) {
+        DPS_ExecutorStrand* strand;
+        DPS_ExecutorWork* work;
+
+        if (DPS_QueueEmpty(&executor->ready)) {
+            uv_cond_wait(&executor->readyCond, &executor->mutex);
+            continue;
+        }
+        strand = (DPS_ExecutorStrand*)DPS_QueueFront(&executor->ready);
+        work = (DPS_ExecutorWork*)DPS_QueueFront(&strand->pending);
+        RemoveWork(executor, work);
+        if (strand->isReady) {
+            DPS_QueueRemove(&strand->ready);
+            strand->isReady = DPS_FALSE;
+        }
+        strand->isRunning = DPS_TRUE;
+        uv_mutex_unlock(&executor->mutex);
+
+        work->run(work);
+
+        uv_mutex_lock(&executor->mutex);
+        strand->isRunning = DPS_FALSE;
+        ScheduleStrand(executor, strand);
+        /*
+         * The strand may be freed by the done function once there
+         * are no more work items queued on it
+         */
+        uv_mutex_unlock(&executor->mutex);
+        work->done(work);
+        uv_mutex_lock(&executor->mutex);
+    }
+    uv_mutex_unlock(&executor->mutex);
+}
+
+DPS_Executor* DPS_CreateExecutor(size_t numThreads, size_t maxQueued, DPS_HandlerQueuePolicy policy)
+{
+    DPS_Executor* executor;
+    size_t i;
+
+    DPS_DBGTRACE();
+
+    if (!numThreads || !maxQueued) {
+        return NULL;
+    }
+    executor = calloc(1, sizeof(DPS_Executor) + (numThreads - 1) * sizeof(uv_thread_t));
+    if (!executor) {
+        return NULL;
+    }
+    if (uv_mutex_init(&executor->mutex)) {
+        free(executor);
+        return NULL;
+    }
+    uv_cond_init(&executor->readyCond);
+    uv_cond_init(&executor->spaceCond);
+    DPS_QueueInit(&executor->ready);
+    DPS_QueueInit(&executor->order);
+    executor->maxQueued = maxQueued;
+    executor->policy = policy;
+    for (i = 0; i < numThreads; ++i) {
+        if (uv_thread_create(&executor->threads[i], WorkerThread, executor)) {
+            DPS_ERRPRINT("Failed to create worker thread\n");
+            break;
+        }
+        ++executor->numThreads;
+    }
+    if (executor->numThreads != numThreads) {
+        DPS_DestroyExecutor(executor);
+        executor = NULL;
+    }
+    return executor;
+}
+
+DPS_Status DPS_ExecutorQueue(DPS_Executor* executor, DPS_ExecutorStrand* strand, DPS_ExecutorWork* work)
+{
+    DPS_ExecutorWork* dropped = NULL;
+    DPS_Status ret = DPS_OK;
+
+    uv_mutex_lock(&executor->mutex);
+    if (executor->stopping) {
+        ret = DPS_ERR_INVALID;
+    } else if (executor->numQueued >= executor->maxQueued) {
+        /*
+         * With the block policy the work item is queued anyway, the
+         * caller applies backpressure with DPS_ExecutorWaitForSpace()
+         */
+        if (executor->policy == DPS_HANDLER_QUEUE_DROP_OLDEST) {
+            dropped = WORK_FROM_ORDER(DPS_QueueFront(&executor->order));
+            RemoveWork(executor, dropped);
+            ++executor->dropped;
+        } else if (executor->policy == DPS_HANDLER_QUEUE_DROP_NEWEST) {
+            ++executor->dropped;
+            ret = DPS_ERR_RESOURCES;
+        }
+    }
+    if (ret == DPS_OK) {
+        work->strand = strand;
+        DPS_QueuePushBack(&strand->pending, &work->pending);
+        DPS_QueuePushBack(&executor->order, &work->order);
+        ++executor->numQueued;
+        ScheduleStrand(executor, strand);
+    }
+    uv_mutex_unlock(&executor->mutex);
+    /*
+     * The done function is called outside of the mutex because it
+     * may acquire other locks
+     */
+    if (dropped) {
+        DPS_DBGPRINT("Dropped oldest work item\n");
+        dropped->done(dropped);
+    }
+    return ret;
+}
+
+void DPS_ExecutorWaitForSpace(DPS_Executor* executor)
+{
+    if (!executor || (executor->policy != DPS_HANDLER_QUEUE_BLOCK)) {
+        return;
+    }
+    uv_mutex_lock(&executor->mutex);
+    while (!executor->stopping && (executor->numQueued >= executor->maxQueued)) {
+        uv_cond_wait(&executor->spaceCond, &executor->mutex);
+    }
+    uv_mutex_unlock(&executor->mutex);
+}
+
+uint64_t DPS_ExecutorDropped(DPS_Executor* executor)
+{
+    uint64_t dropped;
+
+    uv_mutex_lock(&executor->mutex);
+    dropped = executor->dropped;
+    uv_mutex_unlock(&executor->mutex);
+    return dropped;
+}
+
+void DPS_DestroyExecutor(DPS_Executor* executor)
+{
+    size_t i;
+
+    DPS_DBGTRACE();
+
+    if (!executor) {
+        return;
+    }
+    uv_mutex_lock(&executor->mutex);
+    executor->stopping = DPS_TRUE;
+    uv_cond_broadcast(&executor->readyCond);
+    uv_cond_broadcast(&executor->spaceCond);
+    uv_mutex_unlock(&executor->mutex);
+    for (i = 0; i < executor->numThreads; ++i) {
+        uv_thread_join(&executor->threads[i]);
+    }
+    /*
+     * The worker threads are gone so the mutex is no longer needed to
+     * take the pending work items off the queue
+     */
+    while (!DPS_QueueEmpty(&executor->order)) {
+        DPS_ExecutorWork* work = WORK_FROM_ORDER(DPS_QueueFront(&executor->order));
+        RemoveWork(executor, work);
+        work->done(work);
+    }
+    uv_cond_destroy(&executor->readyCond);
+    uv_cond_destroy(&executor->spaceCond);
+    uv_mutex_destroy(&executor->mutex);
+    free(executor);
+}
@@ -0,0 +1,156 @@
+/**
+ * @file
+ * Pool of worker threads for running application callbacks
+ */
+
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#ifndef _EXECUTOR_H
+#define _EXECUTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <dps/dps.h>
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opaque type for an executor
+ */
+typedef struct _DPS_Executor DPS_Executor;
+
+/**
+ * A sequence of work items that are run one at a time in the order
+ * they were queued. Work items in different strands may run
+ * concurrently.
+ */
+typedef struct _DPS_ExecutorStrand {
+    DPS_Queue ready;                /**< Link in the executor's queue of strands ready to run, must be first */
+    DPS_Queue pending;              /**< Work items queued on this strand */
+    uint8_t isReady;                /**< TRUE if the strand is in the executor's ready queue */
+    uint8_t isRunning;              /**< TRUE if a work item of this strand is running */
+} DPS_ExecutorStrand;
+
+/**
+ * A work item
+ */
+typedef struct _DPS_ExecutorWork DPS_ExecutorWork;
+
+/**
+ * Function prototype for running a work item
+ *
+ * @param work  The work item
+ */
+typedef void (*DPS_ExecutorWorkFn)(DPS_ExecutorWork* work);
+
+/**
+ * A work item
+ */
+struct _DPS_ExecutorWork {
+    DPS_Queue pending;              /**< Link in the strand's pending queue, must be first */
+    DPS_Queue order;                /**< Link in the executor's queue of all pending work items */
+    DPS_ExecutorStrand* strand;     /**< The strand the work item was queued on */
+    DPS_ExecutorWorkFn run;         /**< Called on a worker thread to run the work item */
+    DPS_ExecutorWorkFn done;        /**< Called after run, or instead of run if the work item is dropped */
+};
+
+/**
+ * Initialize a strand
+ *
+ * @param strand  The strand
+ */
+void DPS_ExecutorStrandInit(DPS_ExecutorStrand* strand);
+
+/**
+ * Create an executor and start the worker threads
+ *
+ * @param numThreads  The number of worker threads
+ * @param maxQueued   The maximum number of work items queued and not yet running
+ * @param policy      What to do when a work item is queued and the queue is full
+ *
+ * @return The executor or NULL if the executor could not be created
+ */
+DPS_Executor* DPS_CreateExecutor(size_t numThreads, size_t maxQueued, DPS_HandlerQueuePolicy policy);
+
+/**
+ * Queue a work item on a strand.
+ *
+ * The strand must remain valid until the done function of the work
+ * item is called. This function does not block. If the queue is full
+ * and the policy is DPS_HANDLER_QUEUE_BLOCK the work item is queued
+ * anyway and the caller is expected to call
+ * DPS_ExecutorWaitForSpace() once it is safe to block.
+ *
+ * @param executor  The executor
+ * @param strand    The strand
+ * @param work      The work item
+ *
+ * @return
+ * - DPS_OK if the work item was queued
+ * - DPS_ERR_RESOURCES if the queue was full and the work item was dropped
+ * - DPS_ERR_INVALID if the executor is being destroyed
+ *
+ * The done function is not called for a work item that was not queued.
+ */
+DPS_Status DPS_ExecutorQueue(DPS_Executor* executor, DPS_ExecutorStrand* strand, DPS_ExecutorWork* work);
+
+/**
+ * Block until the queue is no longer full. This does nothing unless
+ * the policy is DPS_HANDLER_QUEUE_BLOCK.
+ *
+ * This function must not be called while holding a lock that a work
+ * item may acquire.
+ *
+ * @param executor  The executor, may be NULL
+ */
+void DPS_ExecutorWaitForSpace(DPS_Executor* executor);
+
+/**
+ * Get the number of work items that were dropped because the queue was full
+ *
+ * @param executor  The executor
+ *
+ * @return The number of dropped work items
+ */
+uint64_t DPS_ExecutorDropped(DPS_Executor* executor);
+
+/**
+ * Stop the worker threads and destroy an executor. Work items that
+ * are running are allowed to complete, the done function is called
+ * for work items that had not started running.
+ *
+ * This function must not be called from a worker thread or while
+ * holding a lock that a work item may acquire.
+ *
+ * @param executor  The executor
+ */
+void DPS_DestroyExecutor(DPS_Executor* executor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -75,6 +75,11 @@ DPS_NodeAddress* DPS_NetGetListenAddress(DPS_NodeAddress* addr, DPS_NetContext*
     return addr;
 }
 
+void DPS_NetGetReceiveThreadStats(DPS_NetContext* netCtx, DPS_ReceiveThreadStats* stats)
+{
+    memzero_s(stats, sizeof(DPS_ReceiveThreadStats));
+}
+
 DPS_Status DPS_NetSend(DPS_Node* node, void* appCtx, DPS_NetEndpoint* endpoint,
                        uv_buf_t* bufs, size_t numBufs,
                        DPS_NetSendComplete sendCompleteCB)
@@ -82,6 +87,12 @@ DPS_Status DPS_NetSend(DPS_Node* node, void* appCtx, DPS_NetEndpoint* endpoint,
     return DPS_ERR_NOT_IMPLEMENTED;
 }
 
+DPS_Status DPS_NetSendMany(DPS_Node* node, void* appCtx, DPS_NetEndpoint** endpoints, size_t numEndpoints,
+                           uv_buf_t* bufs, size_t numBufs, DPS_NetSendComplete sendCompleteCB)
+{
+    return DPS_ERR_NOT_IMPLEMENTED;
+}
+
 void DPS_NetConnectionIncRef(DPS_NetConnection* cn)
 {
 }
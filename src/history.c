@@ -21,7 +21,9 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
 #include <safe_lib.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dps/dbg.h>
@@ -38,10 +40,23 @@ DPS_DEBUG_CONTROL(DPS_DEBUG_OFF);
 #define HISTORY_THRESHOLD   10
 
 /*
- * How long to keep publication history (in nanoseconds)
+ * How long to keep publication history (in milliseconds)
  */
 #define PUB_HISTORY_LIFETIME   DPS_SECS_TO_MS(10)
 
+/*
+ * Resolution of the timer wheel (in milliseconds)
+ */
+#define HISTORY_WHEEL_TICK     1000
+
+/*
+ * Number of histories and addresses allocated at a time
+ */
+#define HISTORY_SLAB_ITEMS     256
+#define ADDRS_SLAB_ITEMS       64
+
+#define HISTORY_FROM_WHEEL(q)  ((DPS_PubHistory*)((uint8_t*)(q) - offsetof(DPS_PubHistory, wheel)))
+
 #ifndef MAX
 #define MAX(a,b) (((a)>(b))?(a):(b))
 #endif
@@ -51,202 +66,111 @@ DPS_DEBUG_CONTROL(DPS_DEBUG_OFF);
 
 static DPS_PubHistory* Find(const DPS_History* history, const DPS_UUID* pubId)
 {
-    DPS_PubHistory* curr = history->root;
-    while (curr) {
-        int cmp = DPS_UUIDCompare(pubId, &curr->id);
-        if (cmp == 0) {
-            break;
-        }
-        if (cmp < 0) {
-            curr = curr->left;
-        } else {
-            curr = curr->right;
+    uint32_t hash = DPS_UUIDHash(pubId);
+    DPS_PubHistory* ph;
+    size_t pos;
+
+    for (ph = DPS_UUIDTableFirst(&history->table, hash, &pos); ph; ph = DPS_UUIDTableNext(&history->table, hash, &pos)) {
+        if (DPS_UUIDCompare(pubId, &ph->id) == 0) {
+            return ph;
         }
     }
-    return curr;
+    return NULL;
 }
 
-static void DumpHistory(DPS_PubHistory* ph, int indent, const char* tag)
+static void DumpHistory(DPS_PubHistory* ph)
 {
-    static const char spaces[] = "                                                          ";
-    if (ph) {
-        DPS_PRINT("%.*s%s%s\n", indent, spaces, tag, DPS_UUIDToString(&ph->id));
-        DumpHistory(ph->left, indent + 2, "L->");
-        DumpHistory(ph->right, indent + 2, "R->");
-        if (indent) {
-            assert(ph == ph->parent->left || ph == ph->parent->right);
-        }
-    }
+    DPS_PRINT("%s(%d) %"PRIu64"\n", DPS_UUIDToString(&ph->id), ph->sn, ph->expiration);
 }
 
 void DPS_DumpHistory(DPS_History* history)
 {
-    DumpHistory(history->root, 0, "");
-}
+    DPS_Queue* q;
 
-/*
- * Adds a new node or returns an existing node
- *
- * UUIDs are random so statistically we expect the tree will be pretty balanced
- */
-static DPS_PubHistory* Insert(DPS_History* history, DPS_PubHistory* add)
-{
-    DPS_PubHistory* curr = history->root;
-    DPS_PubHistory* parent = NULL;
-    int cmp = 0;
-
-    while (curr) {
-        cmp = DPS_UUIDCompare(&add->id, &curr->id);
-        if (cmp == 0) {
-            break;
-        }
-        parent = curr;
-        if (cmp < 0) {
-            curr = curr->left;
-        } else {
-            curr = curr->right;
-        }
-    }
-    if (curr) {
-        return curr;
+    for (q = DPS_QueueFront(&history->lru); q != &history->lru; q = q->next) {
+        DumpHistory((DPS_PubHistory*)q);
     }
-    if (parent) {
-        if (cmp < 0) {
-            parent->left = add;
-        } else {
-            parent->right = add;
-        }
-        add->parent = parent;
-    } else {
-        history->root = add;
-    }
-    return add;
 }
 
-static void Remove(DPS_History* history, DPS_PubHistory* ph)
+void DPS_HistoryInit(DPS_History* history)
 {
-    DPS_PubHistory* repl;
+    size_t i;
 
-    if (ph->left && ph->right) {
-        /*
-         * Get element that will replace ph in the tree
-         *
-         * LSB of the UUID does not correlate with the location in the tree
-         * so it effectively become a random selection to go left or right
-         */
-        if (ph->id.val[15] & 1) {
-            repl = ph->left;
-            while (repl->right) {
-                repl = repl->right;
-            }
-        } else {
-            repl = ph->right;
-            while (repl->left) {
-                repl = repl->left;
-            }
-        }
-        /*
-         * Remove the replacement element from the tree
-         */
-        Remove(history, repl);
-        repl->left = ph->left;
-        repl->right = ph->right;
-        if (repl->left) {
-            repl->left->parent = repl;
-        }
-        if (repl->right) {
-            repl->right->parent = repl;
-        }
-    } else {
-        repl = ph->left ? ph->left : ph->right;
-    }
-    /*
-     * Fix up parent pointers
-     */
-    if (repl) {
-        repl->parent = ph->parent;
-    }
-    if (ph->parent) {
-        if (ph->parent->left == ph) {
-            ph->parent->left = repl;
-        } else {
-            ph->parent->right = repl;
-        }
-    } else {
-        history->root = repl;
+    DPS_UUIDTableInit(&history->table);
+    DPS_QueueInit(&history->lru);
+    for (i = 0; i < DPS_HISTORY_WHEEL_SLOTS; ++i) {
+        DPS_QueueInit(&history->wheel[i]);
     }
+    history->wheelTick = 0;
+    DPS_SlabInit(&history->histories, sizeof(DPS_PubHistory), HISTORY_SLAB_ITEMS);
+    DPS_SlabInit(&history->addrs, sizeof(DPS_NodeAddressList), ADDRS_SLAB_ITEMS);
+    history->inserted = 0;
+    history->expired = 0;
+    history->evicted = 0;
+}
+
+static size_t MaxCount(const DPS_History* history)
+{
+    return history->maxCount ? history->maxCount : DPS_HISTORY_DEFAULT_MAX_COUNT;
 }
 
 /*
- * Link in according to expiration
+ * Link into the timer wheel slot for the expiration
  */
 static void LinkPub(DPS_History* history, DPS_PubHistory* ph)
 {
-    assert(!ph->next && !ph->prev);
-
-    if (history->count == 0) {
-        assert(!history->latest);
-        history->soonest = history->latest = ph;
-        history->count = 1;
-        return;
-    }
-    /*
-     * Quick check in case this is the soonest
-     */
-    if (ph->expiration <= history->soonest->expiration) {
-        ph->next = history->soonest;
-        history->soonest->prev = ph;
-        history->soonest = ph;
-    } else {
-        DPS_PubHistory* h = history->latest;
-        /*
-         * Work back from latest
-         */
-        while (ph->expiration < h->expiration) {
-            h = h->prev;
-        }
-        ph->prev = h;
-        ph->next = h->next;
-        if (h->next) {
-            h->next->prev = ph;
-        }
-        h->next = ph;
-        if (h == history->latest) {
-            history->latest = ph;
-        }
-    }
-    ++history->count;
-}
+    size_t slot = (size_t)(ph->expiration / HISTORY_WHEEL_TICK) & (DPS_HISTORY_WHEEL_SLOTS - 1);
 
-static DPS_PubHistory* UnlinkPub(DPS_History* history, DPS_PubHistory* ph)
-{
-    if (ph->prev) {
-        ph->prev->next = ph->next;
-    } else {
-        assert(ph == history->soonest);
-        history->soonest = ph->next;
-    }
-    if (ph->next) {
-        ph->next->prev = ph->prev;
-    } else {
-        assert(ph == history->latest);
-        history->latest = ph->prev;
-    }
-    ph->next = NULL;
-    ph->prev = NULL;
-    --history->count;
-    return ph;
+    DPS_QueuePushBack(&history->wheel[slot], &ph->wheel);
 }
 
-static void FreePubHistory(DPS_PubHistory* ph)
+static void FreePubHistory(DPS_History* history, DPS_PubHistory* ph)
 {
     DPS_NodeAddressList* addr;
     DPS_NodeAddressList* nextAddr;
+
+    DPS_QueueRemove(&ph->lru);
+    DPS_QueueRemove(&ph->wheel);
+    DPS_UUIDTableRemove(&history->table, ph->hash, ph);
     for (addr = ph->addrs; addr; addr = nextAddr) {
         nextAddr = addr->next;
-        free(addr);
+        DPS_SlabFree(&history->addrs, addr);
+    }
+    DPS_SlabFree(&history->histories, ph);
+}
+
+/*
+ * Delete the histories in the timer wheel slots that have been passed
+ */
+static void Expire(DPS_History* history, uint64_t now)
+{
+    uint64_t tick = now / HISTORY_WHEEL_TICK;
+    DPS_Queue* slot;
+    DPS_PubHistory* ph;
+    DPS_Queue* q;
+    DPS_Queue* next;
+
+    /*
+     * Visit each slot at most once however long it has been
+     */
+    if ((tick - history->wheelTick) > DPS_HISTORY_WHEEL_SLOTS) {
+        history->wheelTick = tick - DPS_HISTORY_WHEEL_SLOTS;
+    }
+    while (history->wheelTick < tick) {
+        slot = &history->wheel[history->wheelTick & (DPS_HISTORY_WHEEL_SLOTS - 1)];
+        for (q = DPS_QueueFront(slot); q != slot; q = next) {
+            next = q->next;
+            ph = HISTORY_FROM_WHEEL(q);
+            /*
+             * Histories that expire on a later turn of the wheel stay
+             */
+            if (now >= ph->expiration) {
+                FreePubHistory(history, ph);
+                ++history->expired;
+            }
+        }
+        ++history->wheelTick;
     }
-    free(ph);
 }
 
 DPS_Status DPS_DeletePubHistory(DPS_History* history, DPS_UUID* pubId)
@@ -260,9 +184,7 @@ DPS_Status DPS_DeletePubHistory(DPS_History* history, DPS_UUID* pubId)
         return DPS_ERR_MISSING;
     }
     assert(memcmp(&ph->id, pubId, sizeof(DPS_UUID)) == 0);
-    UnlinkPub(history, ph);
-    Remove(history, ph);
-    FreePubHistory(ph);
+    FreePubHistory(history, ph);
     return DPS_OK;
 }
 
@@ -271,25 +193,9 @@ void DPS_FreshenHistory(DPS_History* history)
     DPS_DBGTRACE();
 
     uv_mutex_lock(&history->lock);
-    if (history->count > HISTORY_THRESHOLD) {
-        uint64_t now;
-
+    if (history->table.count > HISTORY_THRESHOLD) {
         uv_update_time(history->loop);
-        now = uv_now(history->loop);
-        while (history->soonest) {
-            DPS_PubHistory* ph = history->soonest;
-            assert(ph->prev == NULL);
-            /*
-             * Delete expired history records
-             */
-            if (now >= ph->expiration) {
-                UnlinkPub(history, ph);
-                Remove(history, ph);
-                FreePubHistory(ph);
-            } else {
-                break;
-            }
-        }
+        Expire(history, uv_now(history->loop));
     }
     uv_mutex_unlock(&history->lock);
 }
@@ -298,24 +204,40 @@ DPS_Status DPS_UpdatePubHistory(DPS_History* history, DPS_UUID* pubId, uint32_t
                                 uint8_t ackRequested, uint16_t ttl, uint16_t hopCount, DPS_NodeAddress* addr)
 {
     uint64_t now = uv_now(history->loop);
-    DPS_PubHistory* phNew = calloc(1, sizeof(DPS_PubHistory));
     DPS_PubHistory* ph;
 
     DPS_DBGTRACE();
 
-    if (!phNew) {
-        return DPS_ERR_RESOURCES;
-    }
-    phNew->id = *pubId;
-
     uv_mutex_lock(&history->lock);
-    ph = Insert(history, phNew);
-    if (ph != phNew) {
+    Expire(history, now);
+    ph = Find(history, pubId);
+    if (ph) {
         /*
          * Updates existing history
          */
-        FreePubHistory(phNew);
-        UnlinkPub(history, ph);
+        DPS_QueueRemove(&ph->lru);
+        DPS_QueueRemove(&ph->wheel);
+    } else {
+        /*
+         * Make room by evicting the least recently updated history
+         */
+        if ((history->table.count >= MaxCount(history)) && !DPS_QueueEmpty(&history->lru)) {
+            FreePubHistory(history, (DPS_PubHistory*)DPS_QueueFront(&history->lru));
+            ++history->evicted;
+        }
+        ph = DPS_SlabAlloc(&history->histories);
+        if (!ph) {
+            uv_mutex_unlock(&history->lock);
+            return DPS_ERR_RESOURCES;
+        }
+        ph->id = *pubId;
+        ph->hash = DPS_UUIDHash(pubId);
+        if (DPS_UUIDTableInsert(&history->table, ph->hash, ph) != DPS_OK) {
+            DPS_SlabFree(&history->histories, ph);
+            uv_mutex_unlock(&history->lock);
+            return DPS_ERR_RESOURCES;
+        }
+        ++history->inserted;
     }
     ph->sn = MAX(ph->sn, sequenceNum);
     ph->ackRequested = ackRequested;
@@ -330,7 +252,7 @@ DPS_Status DPS_UpdatePubHistory(DPS_History* history, DPS_UUID* pubId, uint32_t
             }
         }
         if (!(*phAddr)) {
-            (*phAddr) = calloc(1, sizeof(DPS_NodeAddressList));
+            (*phAddr) = DPS_SlabAlloc(&history->addrs);
             if ((*phAddr)) {
                 (*phAddr)->addr = *addr;
                 (*phAddr)->hopCount = hopCount;
@@ -345,6 +267,7 @@ DPS_Status DPS_UpdatePubHistory(DPS_History* history, DPS_UUID* pubId, uint32_t
     }
     ph->expiration = now + DPS_SECS_TO_MS(ttl) + PUB_HISTORY_LIFETIME;
     LinkPub(history, ph);
+    DPS_QueuePushBack(&history->lru, &ph->lru);
     uv_mutex_unlock(&history->lock);
     return DPS_OK;
 }
@@ -367,19 +290,26 @@ int DPS_PublicationIsStale(DPS_History* history, DPS_UUID* pubId, uint32_t seque
 
 void DPS_HistoryFree(DPS_History* history)
 {
-    DPS_PubHistory* ph;
-
     DPS_DBGTRACE();
 
-    ph = history->soonest;
-    while (ph) {
-        DPS_PubHistory* next = ph->next;
-        FreePubHistory(ph);
-        ph = next;
-    }
-    history->latest = NULL;
-    history->soonest = NULL;
-    history->count = 0;
+    /*
+     * The history records are all in the slabs
+     */
+    DPS_SlabDestroy(&history->histories);
+    DPS_SlabDestroy(&history->addrs);
+    DPS_UUIDTableFree(&history->table);
+    DPS_HistoryInit(history);
+}
+
+void DPS_HistoryGetStats(DPS_History* history, DPS_HistoryStats* stats)
+{
+    uv_mutex_lock(&history->lock);
+    stats->count = (uint32_t)history->table.count;
+    stats->maxCount = MaxCount(history);
+    stats->inserted = history->inserted;
+    stats->expired = history->expired;
+    stats->evicted = history->evicted;
+    uv_mutex_unlock(&history->lock);
 }
 
 DPS_Status DPS_LookupPublisherForAck(DPS_History* history, const DPS_UUID* pubId, uint32_t* sequenceNum, DPS_NodeAddress** addr)
@@ -416,6 +346,13 @@ DPS_Status DPS_LookupPublisherForAck(DPS_History* history, const DPS_UUID* pubId
     return ret;
 }
 
+/*
+ * The history of the publication is found through the hash table. The
+ * address list is still searched linearly, it only has an entry for
+ * each neighbor the publication was received from, which is bounded by
+ * the number of links and is usually one or two, so an index would cost
+ * more to maintain than the search.
+ */
 int DPS_PublicationReceivedFrom(DPS_History* history, DPS_UUID* pubId, uint32_t sequenceNum, DPS_NodeAddress* source, DPS_NodeAddress* destination)
 {
     DPS_PubHistory* ph;
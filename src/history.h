@@ -31,13 +31,27 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <uv.h>
+#include <dps/dps.h>
 #include <dps/uuid.h>
 #include <dps/private/dps.h>
+#include "queue.h"
+#include "slab.h"
+#include "uuidtable.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Number of slots in the timer wheel used to expire histories
+ */
+#define DPS_HISTORY_WHEEL_SLOTS 64
+
+/**
+ * Default maximum number of histories
+ */
+#define DPS_HISTORY_DEFAULT_MAX_COUNT 65536
+
 /**
  * A list of node addresses and sequence numbers
  */
@@ -52,33 +66,54 @@ typedef struct _DPS_NodeAddressList {
  * A publication history
  */
 typedef struct _DPS_PubHistory {
+    DPS_Queue lru;              /**< Link in the least recently updated list, must be first */
+    DPS_Queue wheel;            /**< Link in the timer wheel slot for the expiration */
     DPS_UUID id;                /**< The UUID for the publication */
     uint32_t sn;                /**< The sequence number for the publication */
+    uint32_t hash;              /**< Hash of the UUID */
     uint8_t ackRequested;       /**< DPS_TRUE if publisher has requested an acknowledgement */
     DPS_NodeAddressList* addrs; /**< Addresses of nodes that sent or forwarded this publication */
-    uint64_t expiration;    /**< Time when the history record can be deleted */
-
-    struct _DPS_PubHistory* left; /**< Left child in publication history binary tree */
-    struct _DPS_PubHistory* right; /**< Right child in publication history binary tree  */
-    struct _DPS_PubHistory* parent; /**< Parent in publication history binary tree */
-
-    struct _DPS_PubHistory* prev; /**< Previous history in expiration-sorted list */
-    struct _DPS_PubHistory* next; /**< Next history in expiration-sorted list */
+    uint64_t expiration;        /**< Time when the history record can be deleted */
 } DPS_PubHistory;
 
 /**
- * Publication histories are stored in a binary tree and as a doubly linked
- * list sorted by expiration.
+ * Publication histories are stored in an open addressing hash table
+ * keyed on the publication UUID. Each history is also linked into a
+ * timer wheel slot for its expiration and into a list ordered by
+ * when it was last updated so the least recently updated history can
+ * be evicted when the history is full.
  */
 typedef struct {
-   uv_loop_t* loop;         /**< same loop as the node loop */
-   uv_mutex_t lock;         /**< mutex to protect the history struct */
-   DPS_PubHistory* root;    /**< Root of binary tree */
-   DPS_PubHistory* latest;  /**< Latest publication to expire */
-   DPS_PubHistory* soonest; /**< Soonest publication to expire */
-   uint32_t count;          /**< Number of histories stored */
+   uv_loop_t* loop;             /**< same loop as the node loop */
+   uv_mutex_t lock;             /**< mutex to protect the history struct */
+   DPS_UUIDTable table;         /**< Hash table of the histories */
+   uint32_t maxCount;           /**< Maximum number of histories stored, 0 for the default */
+   DPS_Queue lru;               /**< Histories ordered from least to most recently updated */
+   DPS_Queue wheel[DPS_HISTORY_WHEEL_SLOTS]; /**< Histories by expiration time */
+   uint64_t wheelTick;          /**< The next timer wheel tick to expire */
+   DPS_Slab histories;          /**< Allocator for the histories */
+   DPS_Slab addrs;              /**< Allocator for the address lists */
+   uint64_t inserted;           /**< Number of histories added */
+   uint64_t expired;            /**< Number of histories removed when they expired */
+   uint64_t evicted;            /**< Number of histories removed because the history was full */
 } DPS_History;
 
+/**
+ * Initialize the history records. The loop, lock, and maxCount are
+ * set up by the caller.
+ *
+ * @param history       The history from a local node
+ */
+void DPS_HistoryInit(DPS_History* history);
+
+/**
+ * Get the history statistics
+ *
+ * @param history       The history from a local node
+ * @param stats         Returns the statistics
+ */
+void DPS_HistoryGetStats(DPS_History* history, DPS_HistoryStats* stats);
+
 /**
  * Discards stale history information
  *
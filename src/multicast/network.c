@@ -76,7 +76,8 @@ static int UseInterface(uint8_t ipVersions, uv_interface_address_t* ifn)
 
 static void AllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* uvBuf)
 {
-    DPS_NetRxBuffer* buf = DPS_CreateNetRxBuffer(suggestedSize);
+    DPS_MulticastReceiver* receiver = (DPS_MulticastReceiver*)handle->data;
+    DPS_NetRxBuffer* buf = DPS_CreatePooledNetRxBuffer(receiver->node->rxPool, suggestedSize);
     if (buf) {
         uvBuf->base = (char*)buf->rx.base;
         uvBuf->len = DPS_RxBufferAvail(&buf->rx);
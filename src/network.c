@@ -31,6 +31,7 @@
 #endif
 
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <dps/dbg.h>
@@ -172,6 +173,52 @@ int DPS_CmpAddr(const DPS_NodeAddress* addr1, const DPS_NodeAddress* addr2)
     return -1;
 }
 
+uint32_t DPS_HashAddr(const DPS_NodeAddress* addr)
+{
+    const struct sockaddr* sa = (const struct sockaddr*)&addr->u.inaddr;
+    uint8_t key[18];
+    const uint8_t* data = key;
+    size_t len = 0;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    switch (addr->type) {
+    case DPS_DTLS:
+    case DPS_TCP:
+    case DPS_UDP:
+        /*
+         * The key is the IPv6 form of the address followed by the port
+         */
+        if (sa->sa_family == AF_INET6) {
+            const struct sockaddr_in6* ip6 = (const struct sockaddr_in6*)sa;
+            memcpy_s(key, sizeof(key), &ip6->sin6_addr, 16);
+            memcpy_s(key + 16, sizeof(key) - 16, &ip6->sin6_port, 2);
+            len = sizeof(key);
+        } else if (sa->sa_family == AF_INET) {
+            const struct sockaddr_in* ip = (const struct sockaddr_in*)sa;
+            memcpy_s(key, sizeof(key), IP4as6, 12);
+            memcpy_s(key + 12, sizeof(key) - 12, &ip->sin_addr.s_addr, 4);
+            memcpy_s(key + 16, sizeof(key) - 16, &ip->sin_port, 2);
+            len = sizeof(key);
+        }
+        break;
+    case DPS_PIPE:
+        data = (const uint8_t*)addr->u.path;
+        len = strnlen_s(addr->u.path, sizeof(addr->u.path));
+        break;
+    default:
+        break;
+    }
+    /*
+     * FNV-1a over the type and the key
+     */
+    hash = (hash ^ (uint8_t)addr->type) * 16777619u;
+    for (i = 0; i < len; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
 int DPS_SameAddr(const DPS_NodeAddress* addr1, const DPS_NodeAddress* addr2)
 {
     return DPS_CmpAddr(addr1, addr2) == 0;
@@ -508,22 +555,323 @@ DPS_NetRxBuffer* DPS_CreateNetRxBuffer(size_t len)
     }
     DPS_RxBufferInit(&buf->rx, buf->data, len);
     buf->refCount = 1;
+    buf->pool = NULL;
+    return buf;
+}
+
+/*
+ * Pooled buffers are allocated in power of two size classes from
+ * 512 bytes to 64K bytes, larger buffers are not pooled
+ */
+#define POOL_MIN_SHIFT      9
+
+#define POOL_CLASS_SIZE(c)  ((size_t)1 << (POOL_MIN_SHIFT + (c)))
+#define POOL_NEXT_FREE(b)   (*(DPS_NetRxBuffer**)(b)->data)
+
+/*
+ * Number of buffers moved between a cache and its pool at a time
+ */
+#define CACHE_BATCH         8
+
+/*
+ * Maximum number of free buffers a cache keeps in each size class
+ */
+#define CACHE_MAX_FREE      (2 * CACHE_BATCH)
+
+struct _DPS_NetRxBufferPool {
+    uv_mutex_t lock;
+    uint32_t refCount;          /* The creator, attached caches, and buffers that are not on the free lists */
+    size_t maxBytes;
+    size_t bytes;               /* Bytes of the buffers allocated from the heap by the pool */
+    size_t highWater;
+    uint64_t fallbacks;
+    DPS_NetRxBuffer* free[DPS_NET_RX_POOL_CLASSES];
+};
+
+/*
+ * The cache attached to the calling thread
+ */
+static THREAD DPS_NetRxBufferCache* threadCache = NULL;
+
+DPS_NetRxBufferPool* DPS_CreateNetRxBufferPool(size_t maxBytes)
+{
+    DPS_NetRxBufferPool* pool;
+
+    pool = calloc(1, sizeof(DPS_NetRxBufferPool));
+    if (!pool) {
+        return NULL;
+    }
+    if (uv_mutex_init(&pool->lock)) {
+        free(pool);
+        return NULL;
+    }
+    pool->refCount = 1;
+    pool->maxBytes = maxBytes;
+    return pool;
+}
+
+/*
+ * Called with the pool lock held, returns the number of bytes released
+ */
+static size_t PoolRelease(DPS_NetRxBufferPool* pool, size_t needed)
+{
+    DPS_NetRxBuffer* buf;
+    size_t released = 0;
+    size_t c;
+
+    for (c = 0; (c < DPS_NET_RX_POOL_CLASSES) && (released < needed); ++c) {
+        while (((buf = pool->free[c]) != NULL) && (released < needed)) {
+            pool->free[c] = POOL_NEXT_FREE(buf);
+            freeNetRxBufferHandler(buf);
+            released += POOL_CLASS_SIZE(c);
+        }
+    }
+    pool->bytes -= released;
+    return released;
+}
+
+/*
+ * Called with the pool lock held, the lock is released
+ */
+static void PoolDecRef(DPS_NetRxBufferPool* pool, uint32_t n)
+{
+    pool->refCount -= n;
+    if (pool->refCount) {
+        uv_mutex_unlock(&pool->lock);
+        return;
+    }
+    PoolRelease(pool, SIZE_MAX);
+    uv_mutex_unlock(&pool->lock);
+    uv_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void DPS_DestroyNetRxBufferPool(DPS_NetRxBufferPool* pool)
+{
+    if (pool) {
+        uv_mutex_lock(&pool->lock);
+        /*
+         * Free buffers are not needed once the creator is done with the pool
+         */
+        PoolRelease(pool, SIZE_MAX);
+        PoolDecRef(pool, 1);
+    }
+}
+
+void DPS_AttachNetRxBufferCache(DPS_NetRxBufferPool* pool, DPS_NetRxBufferCache* cache)
+{
+    memset(cache, 0, sizeof(DPS_NetRxBufferCache));
+    if (pool) {
+        uv_mutex_lock(&pool->lock);
+        ++pool->refCount;
+        uv_mutex_unlock(&pool->lock);
+        cache->pool = pool;
+        threadCache = cache;
+    }
+}
+
+/*
+ * Moves up to n free buffers of a size class from a cache to its pool,
+ * the pool lock must be held
+ */
+static uint32_t CacheFlush(DPS_NetRxBufferCache* cache, uint32_t c, uint32_t n)
+{
+    DPS_NetRxBufferPool* pool = cache->pool;
+    DPS_NetRxBuffer* buf;
+    uint32_t moved;
+
+    for (moved = 0; (moved < n) && ((buf = cache->free[c]) != NULL); ++moved) {
+        cache->free[c] = POOL_NEXT_FREE(buf);
+        POOL_NEXT_FREE(buf) = pool->free[c];
+        pool->free[c] = buf;
+    }
+    cache->numFree[c] -= moved;
+    return moved;
+}
+
+void DPS_DetachNetRxBufferCache(DPS_NetRxBufferCache* cache)
+{
+    DPS_NetRxBufferPool* pool = cache->pool;
+    uint32_t moved = 0;
+    uint32_t c;
+
+    if (!pool) {
+        return;
+    }
+    if (threadCache == cache) {
+        threadCache = NULL;
+    }
+    uv_mutex_lock(&pool->lock);
+    for (c = 0; c < DPS_NET_RX_POOL_CLASSES; ++c) {
+        moved += CacheFlush(cache, c, UINT32_MAX);
+    }
+    cache->pool = NULL;
+    /*
+     * Release the cache's reference along with the buffers
+     */
+    PoolDecRef(pool, moved + 1);
+}
+
+/*
+ * Returns a free buffer or a new one if the ceiling allows it
+ */
+static DPS_NetRxBuffer* PoolAlloc(DPS_NetRxBufferPool* pool, DPS_NetRxBufferCache* cache, uint32_t c)
+{
+    DPS_NetRxBuffer* buf = NULL;
+    size_t size = POOL_CLASS_SIZE(c);
+    uint32_t n;
+
+    uv_mutex_lock(&pool->lock);
+    /*
+     * Refill the cache so the next allocations do not need the lock
+     */
+    if (cache) {
+        for (n = 0; (n < CACHE_BATCH) && ((buf = pool->free[c]) != NULL); ++n) {
+            pool->free[c] = POOL_NEXT_FREE(buf);
+            POOL_NEXT_FREE(buf) = cache->free[c];
+            cache->free[c] = buf;
+            ++cache->numFree[c];
+            ++pool->refCount;
+        }
+        buf = cache->free[c];
+        if (buf) {
+            cache->free[c] = POOL_NEXT_FREE(buf);
+            --cache->numFree[c];
+            uv_mutex_unlock(&pool->lock);
+            return buf;
+        }
+    } else {
+        buf = pool->free[c];
+        if (buf) {
+            pool->free[c] = POOL_NEXT_FREE(buf);
+            ++pool->refCount;
+            uv_mutex_unlock(&pool->lock);
+            return buf;
+        }
+    }
+    /*
+     * Free buffers of other size classes are released to make room
+     * for a new buffer
+     */
+    if (pool->bytes + size > pool->maxBytes) {
+        PoolRelease(pool, pool->bytes + size - pool->maxBytes);
+        if (pool->bytes + size > pool->maxBytes) {
+            ++pool->fallbacks;
+            uv_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+    }
+    pool->bytes += size;
+    if (pool->bytes > pool->highWater) {
+        pool->highWater = pool->bytes;
+    }
+    ++pool->refCount;
+    uv_mutex_unlock(&pool->lock);
+
+    buf = allocNetRxBufferHandler(sizeof(DPS_NetRxBuffer) + size - 1);
+    if (!buf) {
+        uv_mutex_lock(&pool->lock);
+        pool->bytes -= size;
+        PoolDecRef(pool, 1);
+    }
+    return buf;
+}
+
+DPS_NetRxBuffer* DPS_CreatePooledNetRxBuffer(DPS_NetRxBufferPool* pool, size_t len)
+{
+    DPS_NetRxBufferCache* cache = threadCache;
+    DPS_NetRxBuffer* buf = NULL;
+    uint32_t c;
+
+    if (!pool) {
+        return DPS_CreateNetRxBuffer(len);
+    }
+    for (c = 0; c < DPS_NET_RX_POOL_CLASSES; ++c) {
+        if (len <= POOL_CLASS_SIZE(c)) {
+            break;
+        }
+    }
+    if (c == DPS_NET_RX_POOL_CLASSES) {
+        uv_mutex_lock(&pool->lock);
+        ++pool->fallbacks;
+        uv_mutex_unlock(&pool->lock);
+        return DPS_CreateNetRxBuffer(len);
+    }
+    if (!cache || (cache->pool != pool)) {
+        cache = NULL;
+    } else if (cache->free[c]) {
+        buf = cache->free[c];
+        cache->free[c] = POOL_NEXT_FREE(buf);
+        --cache->numFree[c];
+    }
+    if (!buf) {
+        buf = PoolAlloc(pool, cache, c);
+        if (!buf) {
+            return DPS_CreateNetRxBuffer(len);
+        }
+    }
+    DPS_RxBufferInit(&buf->rx, buf->data, len);
+    buf->refCount = 1;
+    buf->sizeClass = c;
+    buf->pool = pool;
     return buf;
 }
 
+static void FreePooledNetRxBuffer(DPS_NetRxBuffer* buf)
+{
+    DPS_NetRxBufferCache* cache = threadCache;
+    DPS_NetRxBufferPool* pool = buf->pool;
+    uint32_t c = buf->sizeClass;
+
+    if (cache && (cache->pool == pool)) {
+        POOL_NEXT_FREE(buf) = cache->free[c];
+        cache->free[c] = buf;
+        if (++cache->numFree[c] > CACHE_MAX_FREE) {
+            uv_mutex_lock(&pool->lock);
+            PoolDecRef(pool, CacheFlush(cache, c, CACHE_BATCH));
+        }
+    } else {
+        uv_mutex_lock(&pool->lock);
+        POOL_NEXT_FREE(buf) = pool->free[c];
+        pool->free[c] = buf;
+        PoolDecRef(pool, 1);
+    }
+}
+
+void DPS_GetNetRxBufferPoolStats(DPS_NetRxBufferPool* pool, DPS_RxBufferPoolStats* stats)
+{
+    memset(stats, 0, sizeof(DPS_RxBufferPoolStats));
+    if (pool) {
+        uv_mutex_lock(&pool->lock);
+        stats->bytes = pool->bytes;
+        stats->maxBytes = pool->maxBytes;
+        stats->highWater = pool->highWater;
+        stats->fallbacks = pool->fallbacks;
+        uv_mutex_unlock(&pool->lock);
+    }
+}
+
 void DPS_NetRxBufferIncRef(DPS_NetRxBuffer* buf)
 {
     if (buf) {
-        ++buf->refCount;
+        ATOMIC_INC_32(&buf->refCount);
     }
 }
 
 void DPS_NetRxBufferDecRef(DPS_NetRxBuffer* buf)
 {
     if (buf) {
-        assert(buf->refCount > 0);
-        if (--buf->refCount == 0) {
-            freeNetRxBufferHandler(buf);
+        assert(ATOMIC_LOAD_32(&buf->refCount) > 0);
+        /*
+         * References are released on the node thread, the receive
+         * threads and the handler threads without a common lock
+         */
+        if (ATOMIC_DEC_32(&buf->refCount) == 0) {
+            if (buf->pool) {
+                FreePooledNetRxBuffer(buf);
+            } else {
+                freeNetRxBufferHandler(buf);
+            }
         }
     }
 }
@@ -33,8 +33,12 @@
 #include <uv.h>
 #include "bitvec.h"
 #include "cose.h"
+#include "executor.h"
 #include "history.h"
 #include "queue.h"
+#include "slab.h"
+#include "topics.h"
+#include "uuidtable.h"
 
 #if UV_VERSION_MAJOR < 1 || UV_VERSION_MINOR < 15
 #error libuv version 1.15 or higher is required
@@ -63,6 +67,7 @@ extern "C" {
 #if !defined(DOXYGEN_SKIP_FORWARD_DECLARATION)
 typedef struct _RemoteNode RemoteNode;
 typedef struct _PublicationAck PublicationAck;
+typedef struct _DPS_PubHeader DPS_PubHeader;
 #endif
 
 /**
@@ -128,6 +133,27 @@ typedef enum {
     SubsThrottled      /**< Pending subscriptions will be sent after a delay */
 } SubsPendingState;
 
+/**
+ * Inverted index of the local subscriptions.
+ *
+ * Each subscription is keyed on one of the bits set in its bloom
+ * filter. A publication can only match a subscription if the key bit
+ * is also set in the publication bloom filter so only the buckets for
+ * the bits set in the publication need to be checked.
+ *
+ * The index is modified holding both the node lock and the index lock
+ * so the receive threads can check for candidates holding only the
+ * index lock.
+ */
+typedef struct _SubscriptionIndex {
+    DPS_Subscription** buckets;           /**< Subscriptions keyed on each bit */
+    uint32_t* counts;                     /**< Number of subscriptions in each bucket */
+    size_t len;                           /**< Number of buckets */
+    DPS_Subscription* unkeyed;            /**< Subscriptions with an empty bloom filter */
+    uint32_t sequence;                    /**< Sequence number of the last subscription indexed */
+    uv_rwlock_t lock;                     /**< Held for writing while the index is modified */
+} SubscriptionIndex;
+
 /**
  * A local node
  */
@@ -149,6 +175,16 @@ typedef struct _DPS_Node {
     uv_loop_t* loop;                      /**< uv lib event loop */
     uv_mutex_t nodeMutex;                 /**< Mutex to protect this node */
     uv_mutex_t condMutex;                 /**< Mutex for use with condition variables */
+    /**
+     * Mutex to protect the publish path so that application threads
+     * publishing do not contend with the node thread for the node
+     * mutex. It protects the publication list and the random bit
+     * generator. The publication list is only modified holding both
+     * mutexes. When both are held the node mutex must be acquired
+     * first.
+     */
+    uv_mutex_t pubLock;
+    DPS_MpscQueue publishQueue;           /**< Publish requests submitted by application threads */
 
     uv_async_t acksAsync;                 /**< Async for sending acks */
     uv_async_t pubsAsync;                 /**< Async for sending publications */
@@ -158,11 +194,30 @@ typedef struct _DPS_Node {
 
     uint32_t subsRate;                    /**< Specifies time delay (in msecs) between subscription updates */
     uint32_t linkLossTimeout;             /**< Specifies the keep alive timeout period */
+    struct {
+        size_t numThreads;                /**< Number of worker threads, 0 to call handlers on the node thread */
+        size_t maxQueued;                 /**< Maximum number of queued handler calls */
+        DPS_HandlerQueuePolicy policy;    /**< What to do when the queue is full */
+    } handlerConfig;                      /**< Configuration of the subscription handler executor */
+    DPS_Executor* handlerExecutor;        /**< Executor for calling subscription handlers */
+    uint8_t cryptoOffload;                /**< TRUE to run publication COSE operations on the libuv thread pool */
+    size_t rxThreads;                     /**< Number of additional threads receiving on the listening port */
+    size_t rxPoolMaxBytes;                /**< Ceiling of the receive buffer pool, 0 to disable the pool */
+    DPS_NetRxBufferPool* rxPool;          /**< Pool the receive buffers are allocated from */
+    DPS_NetRxBufferCache rxCache;         /**< Receive buffer cache of the node's thread */
     uv_timer_t subsTimer;                 /**< Timer for sending subscriptions */
 
     DPS_Queue ackQueue;                   /**< Queued acknowledgement packets */
 
     RemoteNode* remoteNodes;              /**< Linked list of remote nodes */
+    struct {
+        RemoteNode** buckets;             /**< Hash table of the remote nodes keyed on address */
+        size_t numBuckets;                /**< Number of buckets, a power of two */
+        size_t numRemotes;                /**< Number of remote nodes in the hash table */
+    } remoteTable;                        /**< Index of the remote node list for address lookups */
+    uint32_t remotesGeneration;           /**< Incremented when remote nodes are added, removed, or reordered */
+    uint64_t remoteMatchHits;             /**< Publication matches against remote nodes found in the cache */
+    uint64_t remoteMatchMisses;           /**< Publication matches against remote nodes that were computed */
 
     struct {
         DPS_BitVector* needs;             /**< Preallocated needs bit vector */
@@ -175,7 +230,21 @@ typedef struct _DPS_Node {
     DPS_History history;                  /**< History of recently sent publications */
 
     DPS_Publication* publications;        /**< Linked list of local and retained publications */
+    DPS_UUIDTable pubIndex;               /**< Index of the publication list for pubId lookups */
+    DPS_Queue readyPubs;                  /**< Publications with requests on their send queues */
+    struct {
+        DPS_Publication** pubs;           /**< Binary min-heap of the publications with a retained request */
+        size_t count;                     /**< Number of publications in the heap */
+        size_t cap;                       /**< Capacity of the heap */
+    } expiry;                             /**< Retained publications ordered by expiry time */
+    struct {
+        DPS_NetEndpoint** eps;            /**< Endpoints of the remote nodes to send to */
+        size_t cap;                       /**< Capacity of the endpoints array */
+    } fanOut;                             /**< Remote nodes a publication request is sent to */
+    DPS_Slab pubSends;                    /**< Unprotected maps of the publications being sent */
     DPS_Subscription* subscriptions;      /**< Linked list of local subscriptions */
+    SubscriptionIndex subIndex;           /**< Index of local subscriptions */
+    DPS_TopicTrie* topicTrie;             /**< Topics of local subscriptions */
 
     DPS_MulticastReceiver* mcastReceiver; /**< Multicast receiver context */
     DPS_MulticastSender* mcastSender;     /**< Multicast sender context */
@@ -197,6 +266,7 @@ typedef struct _DPS_Node {
 
     uv_async_t requestAsync;              /**< Async for running requests on the node thread */
     DPS_Queue requestQueue;               /**< Queue of requests */
+    DPS_MpscQueue newRequests;            /**< Requests scheduled from any thread, moved to requestQueue holding the node lock */
     uv_async_t freeAsync;                 /**< Async for freeing subscriptions and publications */
     DPS_Publication* freePubs;            /**< Linked list of freed publications */
     DPS_Subscription* freeSubs;           /**< Linked list of freed subscriptions */
@@ -255,13 +325,18 @@ typedef struct _RemoteNode {
         uint8_t sendInterests;         /**< TRUE to include interests etc in a SAK */
         uint8_t sakPending;            /**< TRUE when waiting to receive a SAK from this remote node */
         uint8_t lastSubMsgType;        /**< Indicates if last subscription message was a SUB or a SAK */
+        uint8_t current;               /**< TRUE if the outbound interests were computed at the count vector revisions below */
         uint32_t revision;             /**< Revision number of last subscription sent to this node */
+        uint32_t interestsRevision;    /**< Revision of the node interests count vector the outbound interests were computed from */
+        uint32_t needsRevision;        /**< Revision of the node needs count vector the outbound needs were computed from */
         DPS_BitVector* needs;          /**< Needs bit vector sent outbound to this remote node */
         DPS_BitVector* interests;      /**< Full outbound interests bit vector to this remote node */
         DPS_BitVector* delta;          /**< Delta outbound bit vector sent to this remote node */
     } outbound;
     DPS_NetEndpoint ep;                /**< The endpoint of the remote */
     RemoteNode* next;                  /**< Remotes are a linked list attached to the local node */
+    RemoteNode* hashNext;              /**< Next remote in the same bucket of the node's remote table */
+    uint32_t hash;                     /**< Hash of the endpoint address */
 } RemoteNode;
 
 /**
@@ -288,6 +363,44 @@ void DPS_UpdateSubs(DPS_Node* node, SubsPendingState pending);
  */
 void DPS_QueuePublicationAck(DPS_Node* node, PublicationAck* ack);
 
+/**
+ * Decode the parts of a received request that do not change the node
+ * state. For a publication this decodes the header and the bloom
+ * filter, checks the publication history, and checks for candidate
+ * subscriptions.
+ *
+ * This does not acquire the node lock and may be called from any
+ * thread while the node is running.
+ *
+ * @param node    The node
+ * @param buf     The received request
+ * @param hdr     Returns the decoded publication header, must be
+ *                released with DPS_ReceiveDecodedRequest()
+ *
+ * @return
+ * - DPS_OK if the request is a publication and the header was decoded
+ * - DPS_ERR_STALE if the request is a stale publication that can be dropped
+ * - Other error codes if the request must be decoded on the node's thread,
+ *   the buffer is not modified and nothing is returned in the header
+ */
+DPS_Status DPS_PreDecodeRequest(DPS_Node* node, DPS_NetRxBuffer* buf, DPS_PubHeader* hdr);
+
+/**
+ * Process a received request on the node's thread, the same as the
+ * receive callback passed to the transport.
+ *
+ * @param node    The node
+ * @param ep      The endpoint the request was received on
+ * @param buf     The received request
+ * @param hdr     The header returned from DPS_PreDecodeRequest() or NULL
+ *                if the request was not pre-decoded. The header is
+ *                released.
+ *
+ * @return DPS_OK or an error status
+ */
+DPS_Status DPS_ReceiveDecodedRequest(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buf,
+                                     DPS_PubHeader* hdr);
+
 /**
  * Callback function called when a subscription send operation completes
  *
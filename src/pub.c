@@ -196,26 +196,126 @@ static void FreeTopics(DPS_Publication* pub)
     }
 }
 
+#define PUB_CRYPTO_PENDING  0 /* Waiting to be started */
+#define PUB_CRYPTO_RUNNING  1 /* Running on the thread pool */
+#define PUB_CRYPTO_DONE     2 /* Finished, the status is valid */
+
+/*
+ * COSE serialization of a publish request or decryption of a received
+ * publication offloaded to the libuv thread pool
+ */
+typedef struct _PubCrypto {
+    uv_work_t work;
+    DPS_PublishRequest* req;
+    uint8_t state;
+    uint8_t decrypt;                /* TRUE if a received publication is being decrypted */
+    DPS_Status status;
+    /*
+     * Serialization
+     */
+    uint8_t nonce[COSE_NONCE_LEN];
+    /*
+     * Decryption
+     */
+    COSE_Entity recipient;
+    COSE_Entity sender;
+    DPS_TxBuffer plainTextBuf;
+    DPS_RxBuffer encryptedBuf;
+    int aliased;
+    /*
+     * Received fields that are applied to the publication in sequence
+     * number order once the decryption is done
+     */
+    DPS_BitVector* bf;
+    int16_t ttl;
+    int ackRequested;
+    DPS_NodeAddress senderAddr;
+} PubCrypto;
+
+static void RunPubCrypto(uv_work_t* work);
+static void PubCryptoDone(uv_work_t* work, int status);
+static void ReleasePubSend(DPS_Node* node, DPS_PubSend* send);
+
+static void FreePubCrypto(PubCrypto* crypto)
+{
+    if (crypto) {
+        DPS_TxBufferFree(&crypto->plainTextBuf);
+        DPS_BitVectorFree(crypto->bf);
+        free(crypto);
+    }
+}
+
+/*
+ * Maximum number of completed requests a publication keeps for reuse
+ */
+#define PUB_MAX_FREE_REQUESTS 4
+
+/*
+ * Free a serialized field unless it is stored in the request
+ */
+static void FreeReqBuf(DPS_PublishRequest* req, DPS_TxBuffer* buf)
+{
+    uint8_t* arena = (uint8_t*)&req->bufs[req->maxBufs];
+
+    if ((buf->base >= arena) && (buf->base < (arena + req->arenaSize))) {
+        DPS_TxBufferClear(buf);
+    } else {
+        DPS_TxBufferFree(buf);
+    }
+}
+
+static void FreeSerializedBufs(DPS_PublishRequest* req)
+{
+    FreeReqBuf(req, &req->bufs[0]);
+    FreeReqBuf(req, &req->bufs[1]);
+    FreeReqBuf(req, &req->bufs[2]);
+    /*
+     * Request buffers [3, req->numBufs - 1) belong to the application
+     */
+    FreeReqBuf(req, &req->bufs[req->numBufs - 1]);
+}
+
 void DPS_DestroyPublishRequest(DPS_PublishRequest* req)
 {
+    DPS_Publication* pub;
+    DPS_Node* node;
+
     if (req) {
+        FreePubCrypto(req->crypto);
+        req->crypto = NULL;
+        if (req->send) {
+            /*
+             * A request that was sent is destroyed on the node thread
+             * holding the node lock
+             */
+            ReleasePubSend(req->pub->node, req->send);
+            req->send = NULL;
+        }
         if (req->rxBuf) {
             /*
              * The request buffers are aliased to the received message buffer.
              */
             DPS_NetRxBufferDecRef(req->rxBuf);
+            req->rxBuf = NULL;
         } else {
             /*
              * The request buffers are not aliased.
              */
-            DPS_TxBufferFree(&req->bufs[0]);
-            DPS_TxBufferFree(&req->bufs[1]);
-            DPS_TxBufferFree(&req->bufs[2]);
-            /*
-             * Request buffers [3, req->numBufs - 1) belong to the application
-             */
-            DPS_TxBufferFree(&req->bufs[req->numBufs - 1]);
+            FreeSerializedBufs(req);
+        }
+        /*
+         * Keep the request for the next publish unless the publication
+         * is being freed
+         */
+        pub = req->pub;
+        node = pub->node;
+        uv_mutex_lock(&node->pubLock);
+        if (!(pub->flags & PUB_FLAG_WAS_FREED) && (pub->numFreeRequests < PUB_MAX_FREE_REQUESTS)) {
+            DPS_QueuePushBack(&pub->freeRequests, &req->queue);
+            ++pub->numFreeRequests;
+            req = NULL;
         }
+        uv_mutex_unlock(&node->pubLock);
         free(req);
     }
 }
@@ -233,13 +333,86 @@ DPS_Publication* DPS_FreePublication(DPS_Publication* pub)
         DPS_BitVectorFree(pub->bf);
         DPS_TxBufferFree(&pub->bfBuf);
         DPS_TxBufferFree(&pub->topicsBuf);
+        uv_mutex_lock(&pub->node->pubLock);
+        while (!DPS_QueueEmpty(&pub->freeRequests)) {
+            DPS_PublishRequest* req = (DPS_PublishRequest*)DPS_QueueFront(&pub->freeRequests);
+            DPS_QueueRemove(&req->queue);
+            free(req);
+        }
+        pub->numFreeRequests = 0;
+        uv_mutex_unlock(&pub->node->pubLock);
     }
     FreeRecipients(pub);
     FreeTopics(pub);
+    free(pub->remoteMatch.entries);
     free(pub);
     return next;
 }
 
+void DPS_ClearRemoteMatches(DPS_Publication* pub)
+{
+    if (pub->remoteMatch.entries) {
+        memzero_s(pub->remoteMatch.entries, pub->remoteMatch.cap * sizeof(RemoteMatch));
+    }
+}
+
+int DPS_PublicationMatchesRemote(DPS_Node* node, DPS_Publication* pub, RemoteNode* remote, size_t pos)
+{
+    RemoteMatch* entry = NULL;
+    int match;
+
+    assert(remote->inbound.interests);
+    if (pub->remoteMatch.generation != node->remotesGeneration) {
+        RemoteNode* r;
+        size_t num = 0;
+
+        for (r = node->remoteNodes; r != NULL; r = r->next) {
+            ++num;
+        }
+        if (num > pub->remoteMatch.cap) {
+            RemoteMatch* entries = realloc(pub->remoteMatch.entries, num * sizeof(RemoteMatch));
+            if (entries) {
+                pub->remoteMatch.entries = entries;
+                pub->remoteMatch.cap = num;
+            }
+        }
+        DPS_ClearRemoteMatches(pub);
+        pub->remoteMatch.generation = node->remotesGeneration;
+    }
+    /*
+     * The remote pointer is checked because the remote node list may
+     * change while the caller is iterating over it
+     */
+    if (pos < pub->remoteMatch.cap) {
+        entry = &pub->remoteMatch.entries[pos];
+        if ((entry->remote == remote) && (entry->revision == remote->inbound.revision)) {
+            ++node->remoteMatchHits;
+            return entry->match;
+        }
+    }
+    ++node->remoteMatchMisses;
+    /*
+     * This is the pub/sub matching code
+     */
+    DPS_BitVectorIntersection(node->scratch.interests, pub->bf, remote->inbound.interests);
+    DPS_BitVectorFuzzyHash(node->scratch.needs, node->scratch.interests);
+    match = DPS_BitVectorIncludes(node->scratch.needs, remote->inbound.needs);
+    if (entry) {
+        entry->remote = remote;
+        entry->revision = remote->inbound.revision;
+        entry->match = match;
+    }
+    return match;
+}
+
+void DPS_RemoteMatchStats(DPS_Node* node, uint64_t* hits, uint64_t* misses)
+{
+    DPS_LockNode(node);
+    *hits = node->remoteMatchHits;
+    *misses = node->remoteMatchMisses;
+    DPS_UnlockNode(node);
+}
+
 static void FreeCopy(DPS_Publication* copy)
 {
     DPS_Node* node;
@@ -258,6 +431,198 @@ static void FreeCopy(DPS_Publication* copy)
     }
 }
 
+/*
+ * The publication index is a hash table keyed on the pubId. A local
+ * publication and a remote publication can have the same pubId so a
+ * key may appear more than once. The index is only modified holding
+ * both the node lock and the pubLock, the same as the publication list.
+ */
+static DPS_Status PubIndexInsert(DPS_Node* node, DPS_Publication* pub)
+{
+    return DPS_UUIDTableInsert(&node->pubIndex, DPS_UUIDHash(&pub->pubId), pub);
+}
+
+static void PubIndexRemove(DPS_Node* node, DPS_Publication* pub)
+{
+    DPS_UUIDTableRemove(&node->pubIndex, DPS_UUIDHash(&pub->pubId), pub);
+}
+
+DPS_Publication* DPS_FindPublication(DPS_Node* node, const DPS_UUID* pubId, uint8_t mask, uint8_t flags)
+{
+    uint32_t hash = DPS_UUIDHash(pubId);
+    DPS_Publication* pub;
+    size_t pos;
+
+    for (pub = DPS_UUIDTableFirst(&node->pubIndex, hash, &pos); pub; pub = DPS_UUIDTableNext(&node->pubIndex, hash, &pos)) {
+        if (((pub->flags & mask) == flags) && (DPS_UUIDCompare(&pub->pubId, pubId) == 0)) {
+            return pub;
+        }
+    }
+    return NULL;
+}
+
+#define EXPIRY_MIN_CAP 64
+
+/*
+ * Publications with a retained request are kept in a binary min-heap
+ * ordered by the expiry time of the request. A publication has at
+ * most one retained request so the heap capacity is reserved when the
+ * publication is linked in and inserting into the heap cannot fail.
+ *
+ * The expiry time is copied into the publication when it is scheduled
+ * so the heap stays ordered while the retained queue is being changed.
+ */
+static uint64_t RetainedExpires(const DPS_Publication* pub)
+{
+    return pub->expiryTime;
+}
+
+static void ExpirySet(DPS_Node* node, size_t i, DPS_Publication* pub)
+{
+    node->expiry.pubs[i] = pub;
+    pub->expiryIndex = i + 1;
+}
+
+static void ExpirySiftUp(DPS_Node* node, size_t i)
+{
+    DPS_Publication* pub = node->expiry.pubs[i];
+    uint64_t expires = RetainedExpires(pub);
+    size_t parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (RetainedExpires(node->expiry.pubs[parent]) <= expires) {
+            break;
+        }
+        ExpirySet(node, i, node->expiry.pubs[parent]);
+        i = parent;
+    }
+    ExpirySet(node, i, pub);
+}
+
+static void ExpirySiftDown(DPS_Node* node, size_t i)
+{
+    DPS_Publication* pub = node->expiry.pubs[i];
+    uint64_t expires = RetainedExpires(pub);
+    size_t child;
+
+    while ((child = 2 * i + 1) < node->expiry.count) {
+        if (((child + 1) < node->expiry.count) &&
+            (RetainedExpires(node->expiry.pubs[child + 1]) < RetainedExpires(node->expiry.pubs[child]))) {
+            ++child;
+        }
+        if (expires <= RetainedExpires(node->expiry.pubs[child])) {
+            break;
+        }
+        ExpirySet(node, i, node->expiry.pubs[child]);
+        i = child;
+    }
+    ExpirySet(node, i, pub);
+}
+
+static void ExpiryRemove(DPS_Node* node, DPS_Publication* pub)
+{
+    size_t i = pub->expiryIndex - 1;
+
+    pub->expiryIndex = 0;
+    if (i != --node->expiry.count) {
+        node->expiry.pubs[i] = node->expiry.pubs[node->expiry.count];
+        ExpirySiftUp(node, i);
+        ExpirySiftDown(node, node->expiry.pubs[i]->expiryIndex - 1);
+    }
+}
+
+static DPS_Status ExpiryReserve(DPS_Node* node, size_t count)
+{
+    DPS_Publication** pubs;
+    size_t cap;
+
+    if (count <= node->expiry.cap) {
+        return DPS_OK;
+    }
+    cap = node->expiry.cap ? 2 * node->expiry.cap : EXPIRY_MIN_CAP;
+    pubs = realloc(node->expiry.pubs, cap * sizeof(DPS_Publication*));
+    if (!pubs) {
+        return DPS_ERR_RESOURCES;
+    }
+    node->expiry.pubs = pubs;
+    node->expiry.cap = cap;
+    return DPS_OK;
+}
+
+void DPS_ScheduleExpiry(DPS_Node* node, DPS_Publication* pub)
+{
+    uint64_t expires;
+
+    if (DPS_QueueEmpty(&pub->retainedQueue) || (pub->flags & PUB_FLAG_WAS_FREED)) {
+        if (pub->expiryIndex) {
+            ExpiryRemove(node, pub);
+        }
+        return;
+    }
+    expires = ((DPS_PublishRequest*)DPS_QueueFront(&pub->retainedQueue))->expires;
+    if (pub->expiryIndex && (pub->expiryTime == expires)) {
+        return;
+    }
+    pub->expiryTime = expires;
+    if (!pub->expiryIndex) {
+        assert(node->expiry.count < node->expiry.cap);
+        ExpirySet(node, node->expiry.count++, pub);
+    }
+    ExpirySiftUp(node, pub->expiryIndex - 1);
+    ExpirySiftDown(node, pub->expiryIndex - 1);
+}
+
+DPS_Publication* DPS_PopExpiredPub(DPS_Node* node, uint64_t now)
+{
+    DPS_Publication* pub;
+
+    if (!node->expiry.count) {
+        return NULL;
+    }
+    pub = node->expiry.pubs[0];
+    if (RetainedExpires(pub) > now) {
+        return NULL;
+    }
+    ExpiryRemove(node, pub);
+    return pub;
+}
+
+uint64_t DPS_NextExpiry(DPS_Node* node)
+{
+    return node->expiry.count ? RetainedExpires(node->expiry.pubs[0]) : UINT64_MAX;
+}
+
+void DPS_ReadyPub(DPS_Node* node, DPS_Publication* pub)
+{
+    if (!pub->isReady && !(pub->flags & PUB_FLAG_WAS_FREED)) {
+        DPS_QueuePushBack(&node->readyPubs, &pub->ready);
+        pub->isReady = DPS_TRUE;
+    }
+}
+
+/*
+ * Link a publication into the publication list and index. Must be
+ * called holding the node lock.
+ */
+static DPS_Status LinkPublication(DPS_Node* node, DPS_Publication* pub)
+{
+    DPS_Status ret;
+
+    ret = ExpiryReserve(node, node->pubIndex.count + 1);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    uv_mutex_lock(&node->pubLock);
+    ret = PubIndexInsert(node, pub);
+    if (ret == DPS_OK) {
+        pub->next = node->publications;
+        node->publications = pub;
+    }
+    uv_mutex_unlock(&node->pubLock);
+    return ret;
+}
+
 static DPS_Publication* FreePublication(DPS_Node* node, DPS_Publication* pub)
 {
     DPS_Publication* next = pub->next;
@@ -269,6 +634,7 @@ static DPS_Publication* FreePublication(DPS_Node* node, DPS_Publication* pub)
     }
 
     if (!(pub->flags & PUB_FLAG_WAS_FREED)) {
+        uv_mutex_lock(&node->pubLock);
         if (node->publications == pub) {
             node->publications = next;
         } else {
@@ -280,9 +646,16 @@ static DPS_Publication* FreePublication(DPS_Node* node, DPS_Publication* pub)
                 prev->next = next;
             }
         }
+        PubIndexRemove(node, pub);
+        pub->flags = PUB_FLAG_WAS_FREED;
+        uv_mutex_unlock(&node->pubLock);
+        if (pub->isReady) {
+            DPS_QueueRemove(&pub->ready);
+            pub->isReady = DPS_FALSE;
+        }
+        DPS_ScheduleExpiry(node, pub);
         pub->next = node->freePubs;
         node->freePubs = pub;
-        pub->flags = PUB_FLAG_WAS_FREED;
     }
     /*
      * If the ref count is non zero the publication buffers are being referenced
@@ -291,6 +664,11 @@ static DPS_Publication* FreePublication(DPS_Node* node, DPS_Publication* pub)
      * count goes to zero.
      */
     if (pub->refCount == 0) {
+        /*
+         * Pick up any requests that were submitted before the
+         * publication was freed
+         */
+        DPS_QueuePublishRequests(node);
         while (!DPS_QueueEmpty(&pub->sendQueue)) {
             req = (DPS_PublishRequest*)DPS_QueueFront(&pub->sendQueue);
             DPS_QueueRemove(&req->queue);
@@ -299,6 +677,14 @@ static DPS_Publication* FreePublication(DPS_Node* node, DPS_Publication* pub)
             req->status = DPS_ERR_WRITE;
             DPS_PublishCompletion(req);
         }
+        while (!DPS_QueueEmpty(&pub->reorderQueue)) {
+            req = (DPS_PublishRequest*)DPS_QueueFront(&pub->reorderQueue);
+            DPS_QueueRemove(&req->queue);
+            if (!req->discard) {
+                req->status = DPS_ERR_WRITE;
+            }
+            DPS_PublishCompletion(req);
+        }
         while (!DPS_QueueEmpty(&pub->retainedQueue)) {
             req = (DPS_PublishRequest*)DPS_QueueFront(&pub->retainedQueue);
             DPS_QueueRemove(&req->queue);
@@ -327,8 +713,11 @@ void DPS_PublicationDecRef(DPS_Publication* pub)
 
 void DPS_FreePublications(DPS_Node* node)
 {
+    /*
+     * FreePublication() removes the publication from the list
+     */
     while (node->publications) {
-        node->publications = FreePublication(node, node->publications);
+        FreePublication(node, node->publications);
     }
 }
 
@@ -341,16 +730,64 @@ static int IsValidPub(const DPS_Publication* pub)
         return DPS_FALSE;
     }
     node = pub->node;
-    DPS_LockNode(node);
+    uv_mutex_lock(&node->pubLock);
     for (pubList = node->publications; pubList; pubList = pubList->next) {
         if (pub == pubList) {
             break;
         }
     }
-    DPS_UnlockNode(node);
+    uv_mutex_unlock(&node->pubLock);
     return pubList != NULL;
 }
 
+/*
+ * Checks the publication is listed and local and counts the caller as
+ * a publisher. The publication is not released until the publisher
+ * has been removed, either by ReleasePublisher() or when the node
+ * thread takes the publisher's request off the publish queue.
+ *
+ * Called holding the node's pubLock
+ */
+static int AddPublisher(DPS_Publication* pub)
+{
+    DPS_Publication* pubList;
+
+    for (pubList = pub->node->publications; pubList; pubList = pubList->next) {
+        if (pub == pubList) {
+            break;
+        }
+    }
+    if (!pubList || !(pub->flags & PUB_FLAG_LOCAL)) {
+        return DPS_FALSE;
+    }
+    ++pub->numPublishers;
+    return DPS_TRUE;
+}
+
+static void ReleasePublisher(DPS_Publication* pub)
+{
+    DPS_Node* node = pub->node;
+    int wasFreed;
+
+    uv_mutex_lock(&node->pubLock);
+    assert(pub->numPublishers > 0);
+    wasFreed = (--pub->numPublishers == 0) && (pub->flags & PUB_FLAG_WAS_FREED);
+    uv_mutex_unlock(&node->pubLock);
+    if (wasFreed) {
+        uv_async_send(&node->freeAsync);
+    }
+}
+
+int DPS_PublicationCanRelease(DPS_Publication* pub)
+{
+    int canRelease;
+
+    uv_mutex_lock(&pub->node->pubLock);
+    canRelease = (pub->refCount == 0) && (pub->numPublishers == 0);
+    uv_mutex_unlock(&pub->node->pubLock);
+    return canRelease;
+}
+
 const DPS_UUID* DPS_PublicationGetUUID(const DPS_Publication* pub)
 {
     if (IsValidPub(pub) || (pub && (pub->flags & PUB_FLAG_IS_COPY))) {
@@ -363,7 +800,7 @@ const DPS_UUID* DPS_PublicationGetUUID(const DPS_Publication* pub)
 uint32_t DPS_PublicationGetSequenceNum(const DPS_Publication* pub)
 {
     if (IsValidPub(pub) || (pub && (pub->flags & PUB_FLAG_IS_COPY))) {
-        return pub->sequenceNum;
+        return ATOMIC_LOAD_32(&pub->sequenceNum);
     } else {
         return 0;
     }
@@ -470,34 +907,34 @@ static DPS_Status UpdatePubHistory(DPS_PublishRequest* req)
 }
 
 /*
- * @param pub the request to decrypt
+ * Decrypt or verify a received publication. This does not modify the
+ * publication so it may be called on any thread.
+ *
+ * @param req the request to decrypt
+ * @param keyStore the key store for the decryption keys
+ * @param recipient returns the recipient if the publication was decrypted
+ * @param sender returns the sender of the publication
  * @param plainTextBuf the storage for decrypted.  The caller needs to
  *                     call DPS_TxBufferFree when finished with the
  *                     decrypted data.
- * @param data pointer to decrypted data.  This is only valid during
- *             the lifetime of the plainTextBuf and the publication.
- * @param dataLen the length of the decrypted data.
+ * @param encryptedBuf returns the buffer containing the encrypted fields
+ * @param aliased returns DPS_TRUE if the encrypted fields are in the
+ *                receive buffer of the request, DPS_FALSE if they
+ *                were decrypted into plainTextBuf
  *
  * @return
- * - DPS_OK - message decrypted and parsed succesfully
+ * - DPS_OK - message decrypted succesfully
  * - DPS_ERR_SECURITY - message failed to decrypt
- * - Other error - message failed to parse correctly
  */
-static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plainTextBuf, uint8_t** data,
-                                     size_t* dataLen)
+static DPS_Status DecryptPub(DPS_PublishRequest* req, DPS_KeyStore* keyStore, COSE_Entity* recipient,
+                             COSE_Entity* sender, DPS_TxBuffer* plainTextBuf, DPS_RxBuffer* encryptedBuf,
+                             int* aliased)
 {
-    static const int32_t EncryptedKeys[] = { DPS_CBOR_KEY_TOPICS, DPS_CBOR_KEY_DATA };
-    DPS_Publication* pub = req->pub;
-    DPS_KeyStore* keyStore = pub->node->keyStore;
     DPS_RxBuffer aadBuf;
     DPS_RxBuffer cipherTextBuf;
-    COSE_Entity recipient;
-    DPS_RxBuffer encryptedBuf;
-    CBOR_MapState mapState;
     uint8_t type;
     uint64_t tag;
     DPS_Status ret;
-    size_t i;
 
     /*
      * Try to decrypt the publication
@@ -505,61 +942,23 @@ static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plai
     DPS_TxBufferToRx(&req->bufs[0], &aadBuf);
     DPS_TxBufferToRx(&req->bufs[1], &cipherTextBuf);
     DPS_TxBufferClear(plainTextBuf);
+    *aliased = DPS_TRUE;
     ret = CBOR_Peek(&cipherTextBuf, &type, &tag);
     if (ret == DPS_OK) {
         if (type == CBOR_TAG) {
             if ((tag == COSE_TAG_ENCRYPT0) || (tag == COSE_TAG_ENCRYPT)) {
-                ret = COSE_Decrypt(&recipient, &aadBuf, &cipherTextBuf, keyStore, &pub->sender,
-                                   plainTextBuf);
+                ret = COSE_Decrypt(recipient, &aadBuf, &cipherTextBuf, keyStore, sender, plainTextBuf);
                 if (ret == DPS_OK) {
                     DPS_DBGPRINT("Publication was decrypted\n");
                     CBOR_Dump("plaintext", plainTextBuf->base, DPS_TxBufferUsed(plainTextBuf));
-                    DPS_TxBufferToRx(plainTextBuf, &encryptedBuf);
-                    /*
-                     * We will use the same key id when we encrypt the acknowledgement
-                     */
-                    if (pub->ackRequested) {
-                        /*
-                         * Symmetric keys can use the recipient directly.
-                         * Asymmetric keys must use the sender info if provided.
-                         */
-                        switch (recipient.alg) {
-                        case COSE_ALG_RESERVED:
-                            /*
-                             * Recipient is implicit or not present.
-                             */
-                            ret = DPS_OK;
-                            break;
-                        case COSE_ALG_DIRECT:
-                        case COSE_ALG_A256KW:
-                            if (AddRecipient(pub, recipient.alg, &recipient.kid)) {
-                                ret = DPS_OK;
-                            } else {
-                                ret = DPS_ERR_RESOURCES;
-                            }
-                            break;
-                        case COSE_ALG_ECDH_ES_A256KW:
-                            if (AddRecipient(pub, recipient.alg, &pub->sender.kid)) {
-                                ret = DPS_OK;
-                            } else {
-                                ret = DPS_ERR_RESOURCES;
-                            }
-                            break;
-                        default:
-                            ret = DPS_ERR_MISSING;
-                            break;
-                        }
-                        if (ret != DPS_OK) {
-                            DPS_WARNPRINT("Ack requested, but missing sender ID\n");
-                        }
-                    }
+                    DPS_TxBufferToRx(plainTextBuf, encryptedBuf);
+                    *aliased = DPS_FALSE;
                 }
             } else if (tag == COSE_TAG_SIGN1) {
-                ret = COSE_Verify(&aadBuf, &cipherTextBuf, keyStore, &pub->sender);
+                ret = COSE_Verify(&aadBuf, &cipherTextBuf, keyStore, sender);
                 if (ret == DPS_OK) {
                     DPS_DBGPRINT("Publication was verified\n");
-                    encryptedBuf = cipherTextBuf;
-                    pub->rxBuf = req->rxBuf;
+                    *encryptedBuf = cipherTextBuf;
                 }
             } else {
                 ret = DPS_ERR_INVALID;
@@ -569,8 +968,7 @@ static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plai
             /*
              * The payload was not encrypted
              */
-            DPS_TxBufferToRx(&req->bufs[1], &encryptedBuf);
-            pub->rxBuf = req->rxBuf;
+            DPS_TxBufferToRx(&req->bufs[1], encryptedBuf);
             ret = DPS_OK;
         }
     }
@@ -578,38 +976,108 @@ static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plai
         DPS_WARNPRINT("Failed to deserialize publication - %s\n", DPS_ErrTxt(DPS_ERR_SECURITY));
         return DPS_ERR_SECURITY;
     }
-    ret = DPS_ParseMapInit(&mapState, &encryptedBuf, EncryptedKeys, A_SIZEOF(EncryptedKeys), NULL, 0);
-    if (ret != DPS_OK) {
-        return ret;
-    }
-    while (!DPS_ParseMapDone(&mapState)) {
-        int32_t key;
-        ret = DPS_ParseMapNext(&mapState, &key);
-        if (ret != DPS_OK) {
-            return ret;
-        }
-        switch (key) {
-        case DPS_CBOR_KEY_TOPICS:
-            /*
-             * Deserialize the topic strings
-             */
-            ret = CBOR_DecodeArray(&encryptedBuf, &pub->numTopics);
-            if (ret != DPS_OK) {
-                break;
-            }
-            if (pub->numTopics == 0) {
-                ret = DPS_ERR_INVALID;
-                break;
-            }
-            pub->topics = calloc(pub->numTopics, sizeof(char*));
-            if (!pub->topics) {
-                ret = DPS_ERR_RESOURCES;
-                break;
-            }
-            for (i = 0; i < pub->numTopics; ++i) {
-                char* str;
-                size_t sz;
-                ret = CBOR_DecodeString(&encryptedBuf, &str, &sz);
+    return DPS_OK;
+}
+
+/*
+ * Parse the decrypted fields of a received publication into the
+ * publication.
+ *
+ * @param req the request that was decrypted
+ * @param recipient the recipient if the publication was decrypted
+ * @param aliased DPS_TRUE if the encrypted fields are in the receive buffer
+ * @param encryptedBuf the buffer containing the encrypted fields
+ * @param data pointer to decrypted data.  This is only valid during
+ *             the lifetime of the plain text buffer and the publication.
+ * @param dataLen the length of the decrypted data.
+ *
+ * @return
+ * - DPS_OK - message parsed succesfully
+ * - DPS_ERR_SECURITY - the acknowledgement recipient is missing
+ * - Other error - message failed to parse correctly
+ */
+static DPS_Status ParsePub(DPS_PublishRequest* req, const COSE_Entity* recipient, int aliased,
+                           DPS_RxBuffer* encryptedBuf, uint8_t** data, size_t* dataLen)
+{
+    static const int32_t EncryptedKeys[] = { DPS_CBOR_KEY_TOPICS, DPS_CBOR_KEY_DATA };
+    DPS_Publication* pub = req->pub;
+    CBOR_MapState mapState;
+    DPS_Status ret = DPS_OK;
+    size_t i;
+
+    if (aliased) {
+        pub->rxBuf = req->rxBuf;
+    } else if (pub->ackRequested) {
+        /*
+         * We will use the same key id when we encrypt the acknowledgement
+         *
+         * Symmetric keys can use the recipient directly.
+         * Asymmetric keys must use the sender info if provided.
+         */
+        switch (recipient->alg) {
+        case COSE_ALG_RESERVED:
+            /*
+             * Recipient is implicit or not present.
+             */
+            ret = DPS_OK;
+            break;
+        case COSE_ALG_DIRECT:
+        case COSE_ALG_A256KW:
+            if (AddRecipient(pub, recipient->alg, &recipient->kid)) {
+                ret = DPS_OK;
+            } else {
+                ret = DPS_ERR_RESOURCES;
+            }
+            break;
+        case COSE_ALG_ECDH_ES_A256KW:
+            if (AddRecipient(pub, recipient->alg, &pub->sender.kid)) {
+                ret = DPS_OK;
+            } else {
+                ret = DPS_ERR_RESOURCES;
+            }
+            break;
+        default:
+            ret = DPS_ERR_MISSING;
+            break;
+        }
+        if (ret != DPS_OK) {
+            DPS_WARNPRINT("Ack requested, but missing sender ID\n");
+            DPS_WARNPRINT("Failed to deserialize publication - %s\n", DPS_ErrTxt(DPS_ERR_SECURITY));
+            return DPS_ERR_SECURITY;
+        }
+    }
+    ret = DPS_ParseMapInit(&mapState, encryptedBuf, EncryptedKeys, A_SIZEOF(EncryptedKeys), NULL, 0);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    while (!DPS_ParseMapDone(&mapState)) {
+        int32_t key;
+        ret = DPS_ParseMapNext(&mapState, &key);
+        if (ret != DPS_OK) {
+            return ret;
+        }
+        switch (key) {
+        case DPS_CBOR_KEY_TOPICS:
+            /*
+             * Deserialize the topic strings
+             */
+            ret = CBOR_DecodeArray(encryptedBuf, &pub->numTopics);
+            if (ret != DPS_OK) {
+                break;
+            }
+            if (pub->numTopics == 0) {
+                ret = DPS_ERR_INVALID;
+                break;
+            }
+            pub->topics = calloc(pub->numTopics, sizeof(char*));
+            if (!pub->topics) {
+                ret = DPS_ERR_RESOURCES;
+                break;
+            }
+            for (i = 0; i < pub->numTopics; ++i) {
+                char* str;
+                size_t sz;
+                ret = CBOR_DecodeString(encryptedBuf, &str, &sz);
                 if (ret != DPS_OK) {
                     break;
                 }
@@ -624,7 +1092,7 @@ static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plai
             /*
              * Get the pointer to the publication data
              */
-            ret = CBOR_DecodeBytes(&encryptedBuf, data, dataLen);
+            ret = CBOR_DecodeBytes(encryptedBuf, data, dataLen);
             break;
         }
         if (ret != DPS_OK) {
@@ -634,15 +1102,176 @@ static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plai
     return ret;
 }
 
+/*
+ * @param pub the request to decrypt
+ * @param plainTextBuf the storage for decrypted.  The caller needs to
+ *                     call DPS_TxBufferFree when finished with the
+ *                     decrypted data.
+ * @param data pointer to decrypted data.  This is only valid during
+ *             the lifetime of the plainTextBuf and the publication.
+ * @param dataLen the length of the decrypted data.
+ *
+ * @return
+ * - DPS_OK - message decrypted and parsed succesfully
+ * - DPS_ERR_SECURITY - message failed to decrypt
+ * - Other error - message failed to parse correctly
+ */
+static DPS_Status DecryptAndParsePub(DPS_PublishRequest* req, DPS_TxBuffer* plainTextBuf, uint8_t** data,
+                                     size_t* dataLen)
+{
+    DPS_Publication* pub = req->pub;
+    PubCrypto* crypto = req->crypto;
+    COSE_Entity recipient;
+    DPS_RxBuffer encryptedBuf;
+    int aliased;
+    DPS_Status ret;
+
+    if (crypto && crypto->decrypt && (crypto->state == PUB_CRYPTO_DONE)) {
+        /*
+         * The publication was decrypted on the thread pool
+         */
+        if (crypto->status != DPS_OK) {
+            return crypto->status;
+        }
+        pub->sender = crypto->sender;
+        encryptedBuf = crypto->encryptedBuf;
+        return ParsePub(req, &crypto->recipient, crypto->aliased, &encryptedBuf, data, dataLen);
+    }
+    ret = DecryptPub(req, pub->node->keyStore, &recipient, &pub->sender, plainTextBuf, &encryptedBuf,
+                     &aliased);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    return ParsePub(req, &recipient, aliased, &encryptedBuf, data, dataLen);
+}
+
+/*
+ * A subscription handler call queued on the node's handler executor
+ */
+typedef struct _HandlerCall {
+    DPS_ExecutorWork work;          /* Must be first */
+    DPS_Subscription* sub;
+    DPS_Publication* copy;
+    size_t len;
+    uint8_t data[1];
+} HandlerCall;
+
+static void RunHandlerCall(DPS_ExecutorWork* work)
+{
+    HandlerCall* call = (HandlerCall*)work;
+    DPS_Subscription* sub = call->sub;
+    int wasFreed;
+
+    DPS_LockNode(sub->node);
+    wasFreed = (sub->flags & SUB_FLAG_WAS_FREED) != 0;
+    DPS_UnlockNode(sub->node);
+    if (!wasFreed) {
+        sub->handler(sub, call->copy, call->data, call->len);
+    }
+}
+
+static void HandlerCallDone(DPS_ExecutorWork* work)
+{
+    HandlerCall* call = (HandlerCall*)work;
+    DPS_Node* node = call->sub->node;
+
+    /*
+     * The receive buffer is shared with the node thread and the other
+     * handler calls for the publication so the reference must be
+     * released holding the node lock
+     */
+    DPS_LockNode(node);
+    if (call->copy) {
+        if (call->copy->rxBuf) {
+            DPS_NetRxBufferDecRef(call->copy->rxBuf);
+        }
+        DPS_ClearKeyId(&call->copy->sender.kid);
+        DPS_DestroyCopy(call->copy);
+    }
+    DPS_SubscriptionDecRef(call->sub);
+    DPS_UnlockNode(node);
+    free(call);
+}
+
+/*
+ * Queue a call to a subscription handler on the handler executor.
+ * The handler is called with a copy of the publication and the
+ * payload because the publication is updated and the payload freed
+ * once this returns.
+ *
+ * Must be called holding the node lock.
+ */
+static void QueueHandlerCall(DPS_PublishRequest* req, DPS_Subscription* sub, const uint8_t* data, size_t dataLen)
+{
+    DPS_Publication* pub = req->pub;
+    DPS_Node* node = pub->node;
+    HandlerCall* call;
+    DPS_Status ret;
+
+    call = calloc(1, sizeof(HandlerCall) + dataLen);
+    if (!call) {
+        DPS_ERRPRINT("Failed to queue handler call: %s\n", DPS_ErrTxt(DPS_ERR_RESOURCES));
+        return;
+    }
+    call->work.run = RunHandlerCall;
+    call->work.done = HandlerCallDone;
+    call->sub = sub;
+    DPS_SubscriptionIncRef(sub);
+    call->copy = DPS_CopyPublication(pub);
+    if (call->copy) {
+        call->copy->sequenceNum = req->sequenceNum;
+        /*
+         * The copy must not refer to the sender key id or receive
+         * buffer of the publication
+         */
+        if (!DPS_CopyKeyId(&call->copy->sender.kid, &pub->sender.kid)) {
+            call->copy->sender.kid.id = NULL;
+            call->copy->sender.kid.len = 0;
+            ret = DPS_ERR_RESOURCES;
+            goto ErrExit;
+        }
+        call->copy->rxBuf = pub->rxBuf;
+        if (call->copy->rxBuf) {
+            DPS_NetRxBufferIncRef(call->copy->rxBuf);
+        }
+    } else {
+        ret = DPS_ERR_RESOURCES;
+        goto ErrExit;
+    }
+    if (dataLen) {
+        memcpy_s(call->data, dataLen, data, dataLen);
+    }
+    call->len = dataLen;
+
+    ret = DPS_ExecutorQueue(node->handlerExecutor, &sub->strand, &call->work);
+    if (ret == DPS_OK) {
+        return;
+    }
+    DPS_DBGPRINT("Handler call was dropped: %s\n", DPS_ErrTxt(ret));
+    /*
+     * HandlerCallDone() locks the node so the lock is held recursively
+     */
+    HandlerCallDone(&call->work);
+    return;
+
+ErrExit:
+    DPS_ERRPRINT("Failed to queue handler call: %s\n", DPS_ErrTxt(ret));
+    HandlerCallDone(&call->work);
+}
+
 DPS_Status DPS_CallPubHandlers(DPS_PublishRequest* req)
 {
     DPS_Publication* pub = req->pub;
     DPS_Node* node = pub->node;
     DPS_Status ret = DPS_OK;
+    DPS_Subscription** candidates = NULL;
+    size_t numCandidates = 0;
     DPS_Subscription* sub;
-    DPS_Subscription* nextSub;
+    DPS_Subscription* nextSub = NULL;
+    int scanAll = DPS_FALSE;
+    size_t i;
     DPS_TxBuffer plainTextBuf;
-    int match;
+    uint32_t generation = 0;
     uint8_t* data = NULL;
     size_t dataLen = 0;
     int needsDecrypt = DPS_TRUE;
@@ -658,12 +1287,42 @@ DPS_Status DPS_CallPubHandlers(DPS_PublishRequest* req)
     }
 
     DPS_TxBufferClear(&plainTextBuf);
+    /*
+     * The index only returns subscriptions whose bloom filters are
+     * included in the publication bloom filter
+     */
+    ret = DPS_GetSubscriptionCandidates(node, pub->bf, &candidates, &numCandidates);
+    if (ret != DPS_OK) {
+        /*
+         * Fall back to checking every subscription, this does not
+         * allocate
+         */
+        DPS_ERRPRINT("Failed to get subscription candidates, checking all subscriptions: %s\n",
+                     DPS_ErrTxt(ret));
+        scanAll = DPS_TRUE;
+        nextSub = node->subscriptions;
+        ret = DPS_OK;
+    }
     /*
      * Iterate over the candidates and check that the pub strings are a match
      */
-    for (sub = node->subscriptions; sub != NULL; sub = nextSub) {
-        nextSub = sub->next;
-        DPS_SubscriptionIncRef(sub);
+    for (i = 0; scanAll ? (nextSub != NULL) : (i < numCandidates); ++i) {
+        if (scanAll) {
+            sub = nextSub;
+            nextSub = sub->next;
+            if (!DPS_BitVectorIncludes(pub->bf, sub->bf)) {
+                continue;
+            }
+            DPS_SubscriptionIncRef(sub);
+        } else {
+            sub = candidates[i];
+        }
+        if (sub->flags & SUB_FLAG_WAS_FREED) {
+            /*
+             * The subscription was freed from a handler called earlier
+             */
+            goto Next;
+        }
         if ((pub->flags & PUB_FLAG_EXPIRED) && ((sub->flags & SUB_FLAG_EXPIRED) == 0)) {
             /*
              * We don't call local handlers for expired publications
@@ -671,15 +1330,24 @@ DPS_Status DPS_CallPubHandlers(DPS_PublishRequest* req)
              */
             goto Next;
         }
-        if (!DPS_BitVectorIncludes(pub->bf, sub->bf)) {
-            goto Next;
-        }
         if (needsDecrypt) {
             DPS_UnlockNode(node);
             ret = DecryptAndParsePub(req, &plainTextBuf, &data, &dataLen);
             DPS_LockNode(node);
             if (ret == DPS_OK) {
                 needsDecrypt = DPS_FALSE;
+                /*
+                 * Match the publication topics against the topics of
+                 * all the subscriptions in one pass
+                 */
+                ret = DPS_MatchSubscriptionTopics(node, pub->topics, pub->numTopics, &generation);
+                if (ret != DPS_OK) {
+                    ret = DPS_OK;
+                    if (scanAll) {
+                        DPS_SubscriptionDecRef(sub);
+                    }
+                    break;
+                }
             } else {
                 if (ret == DPS_ERR_SECURITY) {
                     /*
@@ -688,19 +1356,19 @@ DPS_Status DPS_CallPubHandlers(DPS_PublishRequest* req)
                      */
                     ret = DPS_OK;
                 }
-                DPS_SubscriptionDecRef(sub);
+                if (scanAll) {
+                    DPS_SubscriptionDecRef(sub);
+                }
                 break;
             }
         }
-        ret = DPS_MatchTopicList(pub->topics, pub->numTopics, sub->topics,
-                                 sub->numTopics, node->separators, DPS_FALSE, &match);
-        if (ret != DPS_OK) {
-            ret = DPS_OK;
-            goto Next;
-        }
-        if (match) {
+        if (DPS_SubscriptionTopicsMatched(sub, generation)) {
             DPS_DBGPRINT("Matched subscription\n");
             UpdatePubHistory(req);
+            if (node->handlerExecutor) {
+                QueueHandlerCall(req, sub, data, dataLen);
+                goto Next;
+            }
             DPS_UnlockNode(node);
             if ((pub->flags & PUB_FLAG_LOCAL) == 0) {
                 sub->handler(sub, pub, data, dataLen);
@@ -726,8 +1394,14 @@ DPS_Status DPS_CallPubHandlers(DPS_PublishRequest* req)
             DPS_LockNode(node);
         }
     Next:
-        DPS_SubscriptionDecRef(sub);
+        if (scanAll) {
+            DPS_SubscriptionDecRef(sub);
+        }
+    }
+    for (i = 0; i < numCandidates; ++i) {
+        DPS_SubscriptionDecRef(candidates[i]);
     }
+    free(candidates);
     DPS_DestroyPublication(copy, NULL);
     pub->rxBuf = NULL;
     DPS_TxBufferFree(&plainTextBuf);
@@ -738,56 +1412,215 @@ DPS_Status DPS_CallPubHandlers(DPS_PublishRequest* req)
 
 static DPS_Publication* LookupRetained(DPS_Node* node, DPS_UUID* pubId)
 {
-    DPS_Publication* pub = NULL;
+    return DPS_FindPublication(node, pubId, PUB_FLAG_RETAINED, PUB_FLAG_RETAINED);
+}
 
-    for (pub = node->publications; pub != NULL; pub = pub->next) {
-        if ((pub->flags & PUB_FLAG_RETAINED) && (DPS_UUIDCompare(&pub->pubId, pubId) == 0)) {
-            break;
+static DPS_Publication* LookupPublication(DPS_Node* node, DPS_UUID* pubId)
+{
+    return DPS_FindPublication(node, pubId, PUB_FLAG_LOCAL, 0);
+}
+
+/*
+ * Apply a received publication to the publication it belongs to, call
+ * the matching subscription handlers, and queue it for forwarding.
+ *
+ * Must be called holding the node lock.
+ */
+static DPS_Status ReceivePub(DPS_PublishRequest* req, int16_t ttl, int ackRequested,
+                             const DPS_NodeAddress* senderAddr, DPS_BitVector** bf, int callHandlers)
+{
+    DPS_Publication* pub = req->pub;
+    DPS_Node* node = pub->node;
+    DPS_Status ret;
+
+    pub->sequenceNum = req->sequenceNum;
+    pub->ackRequested = ackRequested;
+    pub->senderAddr = *senderAddr;
+    /*
+     * The topics array has pointers into pub->encryptedBuf which are now invalid
+     */
+    FreeTopics(pub);
+    /*
+     * A negative TTL is a forced expiration
+     */
+    if (ttl < 0) {
+        /*
+         * We only expect negative TTL's for retained publications
+         */
+        if (!(pub->flags & PUB_FLAG_RETAINED)) {
+            return DPS_ERR_INVALID;
         }
+        pub->flags |= PUB_FLAG_EXPIRED;
+    } else if (ttl == 0) {
+        pub->flags &= ~PUB_FLAG_RETAINED;
+    } else {
+        pub->flags |= PUB_FLAG_RETAINED;
     }
-    return pub;
+    pub->ttl = ttl;
+    if (pub->flags & PUB_FLAG_EXPIRED) {
+        ttl = 0;
+    }
+    /*
+     * Take the bloom filter that was deserialized before the node
+     * lock was acquired
+     */
+    DPS_BitVectorFree(pub->bf);
+    pub->bf = *bf;
+    *bf = NULL;
+    DPS_ClearRemoteMatches(pub);
+    if (callHandlers) {
+        ret = DPS_CallPubHandlers(req);
+        if (ret != DPS_OK) {
+            return ret;
+        }
+    }
+    req->ttl = ttl;
+    req->expires = uv_now(node->loop) + DPS_SECS_TO_MS(ttl);
+    UpdatePubHistory(req);
+    DPS_QueuePushBack(&pub->sendQueue, &req->queue);
+    ++req->refCount;
+    DPS_ReadyPub(node, pub);
+    uv_async_send(&node->pubsAsync);
+    return DPS_OK;
 }
 
-static DPS_Publication* LookupPublication(DPS_Node* node, DPS_UUID* pubId)
+/*
+ * Receive the publications at the front of the receive queue that are
+ * no longer waiting for decryption. If the node is stopping or the
+ * publication was freed the publications are dropped instead.
+ *
+ * Must be called holding the node lock.
+ */
+static void DeliverReceivedPubs(DPS_Publication* pub)
 {
-    DPS_Publication* pub = NULL;
+    DPS_Node* node = pub->node;
+    DPS_PublishRequest* req;
+    DPS_PublishRequest* next;
+    PubCrypto* crypto;
+    int drop;
+    DPS_Status ret;
 
-    for (pub = node->publications; pub != NULL; pub = pub->next) {
-        if (((pub->flags & PUB_FLAG_LOCAL) == 0) && (DPS_UUIDCompare(&pub->pubId, pubId) == 0)) {
+    DPS_PublicationIncRef(pub);
+    for (req = (DPS_PublishRequest*)DPS_QueueFront(&pub->receiveQueue);
+         req != (DPS_PublishRequest*)&pub->receiveQueue; req = next) {
+        next = (DPS_PublishRequest*)req->queue.next;
+        crypto = req->crypto;
+        drop = (node->state != DPS_NODE_RUNNING) || (pub->flags & PUB_FLAG_WAS_FREED);
+        if (crypto->state != PUB_CRYPTO_DONE) {
+            if (drop) {
+                continue;
+            }
             break;
         }
+        DPS_QueueRemove(&req->queue);
+        if (drop) {
+            ret = DPS_ERR_STOPPING;
+        } else {
+            ret = ReceivePub(req, crypto->ttl, crypto->ackRequested, &crypto->senderAddr, &crypto->bf,
+                             DPS_TRUE);
+        }
+        if (ret != DPS_OK) {
+            req->status = ret;
+            if (!drop) {
+                FreePublication(node, pub);
+                DPS_UpdatePubHistory(&node->history, &pub->pubId, req->sequenceNum, crypto->ackRequested,
+                                     crypto->ttl < 0 ? 0 : crypto->ttl, req->hopCount, &crypto->senderAddr);
+            }
+            DPS_DestroyPublishRequest(req);
+        }
+        /*
+         * Release the reference held by the receive queue
+         */
+        DPS_PublicationDecRef(pub);
     }
-    return pub;
+    DPS_PublicationDecRef(pub);
 }
 
-DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buf, int multicast)
+/*
+ * Queue the decryption of a received publication on the thread pool
+ * when there is a subscription the publication may match. A
+ * publication is also queued, without decryption, behind earlier
+ * publications that are still being decrypted so that publications
+ * are received in sequence number order.
+ *
+ * Must be called holding the node lock.
+ *
+ * @param req the received publication
+ * @param hdr the decoded header of the received publication, the
+ *            bloom filter is taken from the header if the request is
+ *            queued
+ * @param candidate DPS_TRUE if there may be a subscription that matches
+ * @param senderAddr the address of the sender
+ * @param queued returns DPS_TRUE if the request was queued, in which
+ *               case the request owns the caller's reference to the
+ *               publication
+ *
+ * @return DPS_OK or an error if the request could not be processed
+ */
+static DPS_Status QueueDecryptPub(DPS_PublishRequest* req, DPS_PubHeader* hdr, int candidate,
+                                  const DPS_NodeAddress* senderAddr, int* queued)
+{
+    DPS_Publication* pub = req->pub;
+    DPS_Node* node = pub->node;
+    PubCrypto* crypto;
+    DPS_RxBuffer cipherTextBuf;
+    uint8_t type;
+    uint64_t tag;
+
+    *queued = DPS_FALSE;
+    crypto = calloc(1, sizeof(PubCrypto));
+    if (!crypto) {
+        return DPS_ERR_RESOURCES;
+    }
+    crypto->req = req;
+    crypto->ttl = hdr->ttl;
+    crypto->ackRequested = hdr->ackRequested;
+    crypto->senderAddr = *senderAddr;
+    crypto->state = PUB_CRYPTO_DONE;
+    req->crypto = crypto;
+    /*
+     * Only COSE objects need decrypting, and only if there is a
+     * subscription that may match
+     */
+    DPS_TxBufferToRx(&req->bufs[1], &cipherTextBuf);
+    if ((CBOR_Peek(&cipherTextBuf, &type, &tag) == DPS_OK) && (type == CBOR_TAG) &&
+        ((tag == COSE_TAG_ENCRYPT0) || (tag == COSE_TAG_ENCRYPT) || (tag == COSE_TAG_SIGN1)) && candidate) {
+        crypto->work.data = crypto;
+        crypto->decrypt = DPS_TRUE;
+        crypto->state = PUB_CRYPTO_RUNNING;
+        if (uv_queue_work(node->loop, &crypto->work, RunPubCrypto, PubCryptoDone)) {
+            DPS_WARNPRINT("Failed to queue decryption, decrypting inline\n");
+            crypto->decrypt = DPS_FALSE;
+            crypto->state = PUB_CRYPTO_DONE;
+        }
+    }
+    if (crypto->decrypt || !DPS_QueueEmpty(&pub->receiveQueue)) {
+        crypto->bf = hdr->bf;
+        hdr->bf = NULL;
+        DPS_QueuePushBack(&pub->receiveQueue, &req->queue);
+        *queued = DPS_TRUE;
+    }
+    return DPS_OK;
+}
+
+/*
+ * Decode the fields of a publication that precede the payload. The
+ * receive buffer is left at the start of the payload.
+ */
+static DPS_Status DecodeHeader(DPS_RxBuffer* rxBuf, DPS_PubHeader* hdr)
 {
     static const int32_t UnprotectedKeys[] = { DPS_CBOR_KEY_TTL, DPS_CBOR_KEY_HOP_COUNT };
     static const int32_t UnprotectedOptKeys[] = { DPS_CBOR_KEY_PORT, DPS_CBOR_KEY_PATH };
     static const int32_t ProtectedKeys[] = { DPS_CBOR_KEY_TTL, DPS_CBOR_KEY_PUB_ID, DPS_CBOR_KEY_SEQ_NUM,
                                              DPS_CBOR_KEY_ACK_REQ, DPS_CBOR_KEY_BLOOM_FILTER };
-    DPS_RxBuffer* rxBuf = (DPS_RxBuffer*)buf;
+    static const int32_t ProtectedOptKeys[] = { DPS_CBOR_KEY_BLOOM_HASH };
     DPS_Status ret;
-    uint16_t port = 0;
-    DPS_Publication* pub = NULL;
-    DPS_PublishRequest* req = NULL;
-    DPS_UUID pubId;
-    DPS_RxBuffer bfBuf;
-    uint8_t* protectedPtr;
     CBOR_MapState mapState;
-    uint32_t sequenceNum;
-    int16_t ttl;
     int16_t baseTTL;
-    uint16_t hopCount;
-    int ackRequested;
     size_t len;
-    char* path = NULL;
-    size_t pathLen;
-    uint16_t keysMask;
+    uint8_t bloomHash = DPS_BloomHashSha2;
 
-    DPS_DBGTRACE();
-
-    CBOR_Dump("Pub in", rxBuf->rxPos, DPS_RxBufferAvail(rxBuf));
+    memset(hdr, 0, sizeof(DPS_PubHeader));
     /*
      * Parse keys from unprotected map
      */
@@ -796,7 +1629,6 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
     if (ret != DPS_OK) {
         return ret;
     }
-    keysMask = 0;
     while (!DPS_ParseMapDone(&mapState)) {
         int32_t key;
         ret = DPS_ParseMapNext(&mapState, &key);
@@ -805,21 +1637,21 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
         }
         switch (key) {
         case DPS_CBOR_KEY_PORT:
-            keysMask |= (1 << key);
-            ret = CBOR_DecodeUint16(rxBuf, &port);
+            hdr->keysMask |= (1 << key);
+            ret = CBOR_DecodeUint16(rxBuf, &hdr->port);
             break;
         case DPS_CBOR_KEY_TTL:
-            ret = CBOR_DecodeInt16(rxBuf, &ttl);
+            ret = CBOR_DecodeInt16(rxBuf, &hdr->ttl);
             break;
         case DPS_CBOR_KEY_PATH:
-            keysMask |= (1 << key);
-            ret = CBOR_DecodeString(rxBuf, &path, &pathLen);
-            if ((ret == DPS_OK) && (pathLen >= DPS_NODE_ADDRESS_PATH_MAX)) {
+            hdr->keysMask |= (1 << key);
+            ret = CBOR_DecodeString(rxBuf, &hdr->path, &hdr->pathLen);
+            if ((ret == DPS_OK) && (hdr->pathLen >= DPS_NODE_ADDRESS_PATH_MAX)) {
                 ret = DPS_ERR_INVALID;
             }
             break;
         case DPS_CBOR_KEY_HOP_COUNT:
-            ret = CBOR_DecodeUint16(rxBuf, &hopCount);
+            ret = CBOR_DecodeUint16(rxBuf, &hdr->hopCount);
             break;
         }
         if (ret != DPS_OK) {
@@ -829,18 +1661,19 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
     if (ret != DPS_OK) {
         return ret;
     }
-    if ((keysMask & ((1 << DPS_CBOR_KEY_PORT) | (1 << DPS_CBOR_KEY_PATH))) == 0) {
+    if ((hdr->keysMask & ((1 << DPS_CBOR_KEY_PORT) | (1 << DPS_CBOR_KEY_PATH))) == 0) {
         DPS_WARNPRINT("Missing required key\n");
         return DPS_ERR_INVALID;
     }
     /*
      * Start of publication protected map
      */
-    protectedPtr = rxBuf->rxPos;
+    hdr->protectedPtr = rxBuf->rxPos;
     /*
      * Parse keys from protected map
      */
-    ret = DPS_ParseMapInit(&mapState, rxBuf, ProtectedKeys, A_SIZEOF(ProtectedKeys), NULL, 0);
+    ret = DPS_ParseMapInit(&mapState, rxBuf, ProtectedKeys, A_SIZEOF(ProtectedKeys),
+                           ProtectedOptKeys, A_SIZEOF(ProtectedOptKeys));
     if (ret != DPS_OK) {
         return ret;
     }
@@ -860,23 +1693,23 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
              * Validate the current TTL against the base TTL
              */
             if (ret == DPS_OK) {
-                if (((baseTTL < 0) && (ttl >= 0)) || (ttl > baseTTL)) {
-                    DPS_ERRPRINT("TTL inconsistency - ttl=%d, baseTTL=%d\n", ttl, baseTTL);
+                if (((baseTTL < 0) && (hdr->ttl >= 0)) || (hdr->ttl > baseTTL)) {
+                    DPS_ERRPRINT("TTL inconsistency - ttl=%d, baseTTL=%d\n", hdr->ttl, baseTTL);
                     ret = DPS_ERR_INVALID;
                 }
             }
             break;
         case DPS_CBOR_KEY_PUB_ID:
-            ret = CBOR_DecodeUUID(rxBuf, &pubId);
+            ret = CBOR_DecodeUUID(rxBuf, &hdr->pubId);
             break;
         case DPS_CBOR_KEY_SEQ_NUM:
-            ret = CBOR_DecodeUint32(rxBuf, &sequenceNum);
-            if ((ret == DPS_OK) && (sequenceNum == 0)) {
+            ret = CBOR_DecodeUint32(rxBuf, &hdr->sequenceNum);
+            if ((ret == DPS_OK) && (hdr->sequenceNum == 0)) {
                 ret = DPS_ERR_INVALID;
             }
             break;
         case DPS_CBOR_KEY_ACK_REQ:
-            ret = CBOR_DecodeBoolean(rxBuf, &ackRequested);
+            ret = CBOR_DecodeBoolean(rxBuf, &hdr->ackRequested);
             break;
         case DPS_CBOR_KEY_BLOOM_FILTER:
             /*
@@ -884,9 +1717,12 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
              */
             ret = CBOR_Skip(rxBuf, NULL, &len);
             if (ret == DPS_OK) {
-                DPS_RxBufferInit(&bfBuf, rxBuf->rxPos - len, len);
+                DPS_RxBufferInit(&hdr->bfBuf, rxBuf->rxPos - len, len);
             }
             break;
+        case DPS_CBOR_KEY_BLOOM_HASH:
+            ret = CBOR_DecodeUint8(rxBuf, &bloomHash);
+            break;
         }
         if (ret != DPS_OK) {
             break;
@@ -895,14 +1731,112 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
     if (ret != DPS_OK) {
         return ret;
     }
+    hdr->payloadPtr = rxBuf->rxPos;
+    /*
+     * Publications are not retransmitted so it is safe to drop them.
+     * Links to nodes using a different hash are refused when the
+     * subscriptions are exchanged, so only multicast publications
+     * should get here.
+     */
+    if (bloomHash != DPS_GetBloomHash()) {
+        DPS_WARNPRINT("Bloom filter hash %d does not match %d\n", bloomHash, DPS_GetBloomHash());
+        return DPS_ERR_INCOMPATIBLE;
+    }
+    return DPS_OK;
+}
+
+static DPS_Status DecodeBloomFilter(DPS_PubHeader* hdr)
+{
+    if (hdr->bf) {
+        return DPS_OK;
+    }
+    hdr->bf = DPS_BitVectorAlloc();
+    if (!hdr->bf) {
+        return DPS_ERR_RESOURCES;
+    }
+    return DPS_BitVectorDeserialize(hdr->bf, &hdr->bfBuf);
+}
+
+/*
+ * Returns DPS_TRUE if there may be a local subscription that matches
+ * the publication. The check made before the node lock was acquired
+ * is used if no subscriptions have been indexed since.
+ *
+ * Must be called holding the node lock.
+ */
+static int HasCandidate(DPS_Node* node, DPS_PubHeader* hdr)
+{
+    if (hdr->checked && (hdr->subsSequence == node->subIndex.sequence)) {
+        return hdr->candidate;
+    }
+    return DPS_HasSubscriptionCandidate(node, hdr->bf);
+}
+
+DPS_Status DPS_PreDecodePublication(DPS_Node* node, DPS_RxBuffer* rxBuf, DPS_PubHeader* hdr)
+{
+    DPS_Status ret;
+
+    ret = DecodeHeader(rxBuf, hdr);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    /*
+     * The history has its own lock, the check is made again holding
+     * the node lock when the publication is received
+     */
+    if (DPS_PublicationIsStale(&node->history, &hdr->pubId, hdr->sequenceNum)) {
+        DPS_DBGPRINT("Publication %s/%d is stale\n", DPS_UUIDToString(&hdr->pubId), hdr->sequenceNum);
+        return DPS_ERR_STALE;
+    }
+    ret = DecodeBloomFilter(hdr);
+    if (ret != DPS_OK) {
+        DPS_ReleasePubHeader(hdr);
+        return ret;
+    }
+    hdr->candidate = DPS_CheckSubscriptionCandidate(node, hdr->bf, &hdr->subsSequence);
+    hdr->checked = DPS_TRUE;
+    return DPS_OK;
+}
+
+void DPS_ReleasePubHeader(DPS_PubHeader* hdr)
+{
+    DPS_BitVectorFree(hdr->bf);
+    hdr->bf = NULL;
+}
+
+DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buf, int multicast,
+                                 DPS_PubHeader* hdr)
+{
+    DPS_RxBuffer* rxBuf = (DPS_RxBuffer*)buf;
+    DPS_Status ret;
+    DPS_Publication* pub = NULL;
+    DPS_PublishRequest* req = NULL;
+    DPS_PubHeader decoded;
+    int candidate;
+
+    DPS_DBGTRACE();
+
+    if (hdr) {
+        /*
+         * The header was decoded on a receive thread
+         */
+        rxBuf->rxPos = hdr->payloadPtr;
+    } else {
+        CBOR_Dump("Pub in", rxBuf->rxPos, DPS_RxBufferAvail(rxBuf));
+        ret = DecodeHeader(rxBuf, &decoded);
+        if (ret != DPS_OK) {
+            return ret;
+        }
+        hdr = &decoded;
+    }
     /*
      * Record which port the sender is listening on
      */
-    if (keysMask & (1 << DPS_CBOR_KEY_PORT)) {
-        DPS_EndpointSetPort(ep, port);
+    if (hdr->keysMask & (1 << DPS_CBOR_KEY_PORT)) {
+        DPS_EndpointSetPort(ep, hdr->port);
     } else {
-        assert(keysMask & (1 << DPS_CBOR_KEY_PATH));
-        DPS_EndpointSetPath(ep, path, pathLen);
+        assert(hdr->keysMask & (1 << DPS_CBOR_KEY_PATH));
+        DPS_EndpointSetPath(ep, hdr->path, hdr->pathLen);
     }
 
     DPS_LockNode(node);
@@ -913,14 +1847,14 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
      * it: the node lock will get released when we issue callbacks
      * into the application for crypto or subscription handlers below.
      */
-    pub = LookupRetained(node, &pubId);
+    pub = LookupRetained(node, &hdr->pubId);
     if (pub) {
         /*
          * Retained publications can only be updated with newer revisions
          */
-        if (sequenceNum <= pub->sequenceNum) {
-            DPS_DBGPRINT("Publication %s/%d is stale (/%d already retained)\n", DPS_UUIDToString(&pubId),
-                         sequenceNum, pub->sequenceNum);
+        if (hdr->sequenceNum <= pub->sequenceNum) {
+            DPS_DBGPRINT("Publication %s/%d is stale (/%d already retained)\n", DPS_UUIDToString(&hdr->pubId),
+                         hdr->sequenceNum, pub->sequenceNum);
             ret = DPS_ERR_STALE;
             /*
              * Set pub to NULL here so we don't delete it during
@@ -932,7 +1866,7 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
         }
         DPS_PublicationIncRef(pub);
     } else {
-        if (ttl < 0) {
+        if (hdr->ttl < 0) {
             /*
              * We only expect negative TTL's for retained publications.
              *
@@ -942,7 +1876,7 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
              * publisher node is not sending bad data, so just drop
              * the pub.
              */
-            DPS_DBGPRINT("Ignoring expired pub %s/%d\n", DPS_UUIDToString(&pubId), sequenceNum);
+            DPS_DBGPRINT("Ignoring expired pub %s/%d\n", DPS_UUIDToString(&hdr->pubId), hdr->sequenceNum);
             ret = DPS_ERR_STALE;
             goto Exit;
         }
@@ -950,12 +1884,12 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
          * A stale publication is a publication that has the same or older sequence number than the
          * latest publication with the same pubId.
          */
-        if (DPS_PublicationIsStale(&node->history, &pubId, sequenceNum)) {
-            DPS_DBGPRINT("Publication %s/%d is stale\n", DPS_UUIDToString(&pubId), sequenceNum);
+        if (DPS_PublicationIsStale(&node->history, &hdr->pubId, hdr->sequenceNum)) {
+            DPS_DBGPRINT("Publication %s/%d is stale\n", DPS_UUIDToString(&hdr->pubId), hdr->sequenceNum);
             ret = DPS_ERR_STALE;
             goto Exit;
         }
-        pub = LookupPublication(node, &pubId);
+        pub = LookupPublication(node, &hdr->pubId);
         if (pub) {
             DPS_PublicationIncRef(pub);
         } else {
@@ -966,28 +1900,44 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
             }
             pub->node = node;
             DPS_QueueInit(&pub->sendQueue);
+            DPS_QueueInit(&pub->reorderQueue);
+            DPS_QueueInit(&pub->receiveQueue);
             DPS_QueueInit(&pub->retainedQueue);
+            DPS_QueueInit(&pub->freeRequests);
+            DPS_QueueInit(&pub->ready);
             DPS_PublicationIncRef(pub);
             pub->bf = DPS_BitVectorAlloc();
             if (!pub->bf) {
                 ret = DPS_ERR_RESOURCES;
                 goto Exit;
             }
-            memcpy_s(&pub->pubId, sizeof(pub->pubId), &pubId, sizeof(DPS_UUID));
+            memcpy_s(&pub->pubId, sizeof(pub->pubId), &hdr->pubId, sizeof(DPS_UUID));
             /*
              * Link in the pub
              */
-            pub->next = node->publications;
-            node->publications = pub;
+            ret = LinkPublication(node, pub);
+            if (ret != DPS_OK) {
+                goto Exit;
+            }
         }
     }
-    pub->sequenceNum = sequenceNum;
-    pub->ackRequested = ackRequested;
-    pub->senderAddr = ep->addr;
     /*
-     * The topics array has pointers into pub->encryptedBuf which are now invalid
+     * Publications waiting for decryption are ahead of this one
      */
-    FreeTopics(pub);
+    if (!DPS_QueueEmpty(&pub->receiveQueue)) {
+        DPS_PublishRequest* pending = (DPS_PublishRequest*)DPS_QueueBack(&pub->receiveQueue);
+        if (hdr->sequenceNum <= pending->sequenceNum) {
+            DPS_DBGPRINT("Publication %s/%d is stale (/%d pending)\n", DPS_UUIDToString(&hdr->pubId),
+                         hdr->sequenceNum, pending->sequenceNum);
+            ret = DPS_ERR_STALE;
+            /*
+             * As above, drop the stale revision not the publication
+             */
+            DPS_PublicationDecRef(pub);
+            pub = NULL;
+            goto Exit;
+        }
+    }
     /*
      * Allocate the publish request for handling and forwarding
      *
@@ -1000,57 +1950,45 @@ DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxB
         goto Exit;
     }
     req->status = DPS_ERR_NO_ROUTE;
-    req->sequenceNum = sequenceNum;
-    req->hopCount = hopCount + 1;
+    req->sequenceNum = hdr->sequenceNum;
+    req->hopCount = hdr->hopCount + 1;
     req->rxBuf = buf;
     DPS_NetRxBufferIncRef(buf);
-    DPS_TxBufferInit(&req->bufs[0], protectedPtr, rxBuf->rxPos - protectedPtr);
+    DPS_TxBufferInit(&req->bufs[0], hdr->protectedPtr, rxBuf->rxPos - hdr->protectedPtr);
     req->bufs[0].txPos = req->bufs[0].eob;
     DPS_TxBufferInit(&req->bufs[1], rxBuf->rxPos, DPS_RxBufferAvail(rxBuf));
     req->bufs[1].txPos = req->bufs[1].eob;
-    /*
-     * A negative TTL is a forced expiration
-     */
-    if (ttl < 0) {
-        /*
-         * We only expect negative TTL's for retained publications
-         */
-        if (!(pub->flags & PUB_FLAG_RETAINED)) {
-            ret = DPS_ERR_INVALID;
+    ret = DecodeBloomFilter(hdr);
+    if (ret != DPS_OK) {
+        goto Exit;
+    }
+    if (node->cryptoOffload) {
+        int queued;
+        ret = QueueDecryptPub(req, hdr, HasCandidate(node, hdr), &ep->addr, &queued);
+        if (ret != DPS_OK) {
+            goto Exit;
+        }
+        if (queued) {
+            /*
+             * The request and the publication reference now belong
+             * to the receive queue
+             */
+            pub = NULL;
             goto Exit;
         }
-        pub->flags |= PUB_FLAG_EXPIRED;
-    } else if (ttl == 0) {
-        pub->flags &= ~PUB_FLAG_RETAINED;
-    } else {
-        pub->flags |= PUB_FLAG_RETAINED;
-    }
-    pub->ttl = ttl;
-    if (pub->flags & PUB_FLAG_EXPIRED) {
-        ttl = 0;
     }
     /*
-     * Now we can deserialize the bloom filter
+     * Skip the subscription handlers if the check made on the receive
+     * thread found no candidates
      */
-    ret = DPS_BitVectorDeserialize(pub->bf, &bfBuf);
-    if (ret != DPS_OK) {
-        goto Exit;
-    }
-    ret = DPS_CallPubHandlers(req);
-    if (ret != DPS_OK) {
-        goto Exit;
-    }
-    req->ttl = ttl;
-    req->expires = uv_now(node->loop) + DPS_SECS_TO_MS(ttl);
-    UpdatePubHistory(req);
-    DPS_QueuePushBack(&pub->sendQueue, &req->queue);
-    ++req->refCount;
-    uv_async_send(&node->pubsAsync);
-    ret = DPS_OK;
+    candidate = !hdr->checked || HasCandidate(node, hdr);
+    ret = ReceivePub(req, hdr->ttl, hdr->ackRequested, &ep->addr, &hdr->bf, candidate);
 
 Exit:
     if (ret == DPS_OK) {
-        DPS_PublicationDecRef(pub);
+        if (pub) {
+            DPS_PublicationDecRef(pub);
+        }
     } else {
         if (req) {
             assert(pub);
@@ -1064,15 +2002,15 @@ Exit:
          * Update the history since we may have received the shortest
          * path out of order
          */
-        DPS_UpdatePubHistory(&node->history, &pubId, sequenceNum, ackRequested, ttl < 0 ? 0 : ttl,
-                             hopCount + 1, &ep->addr);
+        DPS_UpdatePubHistory(&node->history, &hdr->pubId, hdr->sequenceNum, hdr->ackRequested,
+                             hdr->ttl < 0 ? 0 : hdr->ttl, hdr->hopCount + 1, &ep->addr);
     }
     DPS_UnlockNode(node);
+    DPS_ReleasePubHeader(hdr);
     return ret;
 }
 
-static void SendComplete(DPS_PublishRequest* req, DPS_NetEndpoint* ep, uv_buf_t* bufs, size_t numBufs,
-                         DPS_Status status)
+static void SendComplete(DPS_PublishRequest* req, DPS_NetEndpoint* ep, DPS_Status status)
 {
     DPS_Publication* pub = req->pub;
     DPS_Node* node = pub->node;
@@ -1086,22 +2024,33 @@ static void SendComplete(DPS_PublishRequest* req, DPS_NetEndpoint* ep, uv_buf_t*
         req->status = status;
     }
     /*
-     * Only the first buffer belongs to us
+     * The unprotected map is released with its DPS_PubSend and the
+     * other buffers belong to the request
      */
-    if (numBufs > 0) {
-        numBufs = 1;
+    DPS_SendComplete(node, ep ? &ep->addr : NULL, NULL, 0, status);
+}
+
+/*
+ * Must be called holding the node lock
+ */
+static void ReleasePubSend(DPS_Node* node, DPS_PubSend* send)
+{
+    assert(send->refCount > 0);
+    if (--send->refCount == 0) {
+        DPS_SlabFree(&node->pubSends, send);
     }
-    DPS_SendComplete(node, ep ? &ep->addr : NULL, bufs, numBufs, status);
 }
 
 static void OnNetSendComplete(DPS_Node* node, void* appCtx, DPS_NetEndpoint* ep, uv_buf_t* bufs,
                               size_t numBufs, DPS_Status status)
 {
-    DPS_PublishRequest* req = appCtx;
+    DPS_PubSend* send = appCtx;
+    DPS_PublishRequest* req = send->req;
     DPS_Publication* pub = req->pub;
 
     DPS_LockNode(node);
-    SendComplete(req, ep, bufs, numBufs, status);
+    SendComplete(req, ep, status);
+    ReleasePubSend(node, send);
     DPS_PublishCompletion(req);
     DPS_PublicationDecRef(pub);
     DPS_UnlockNode(node);
@@ -1110,51 +2059,51 @@ static void OnNetSendComplete(DPS_Node* node, void* appCtx, DPS_NetEndpoint* ep,
 static void OnMulticastSendComplete(DPS_MulticastSender* sender, void* appCtx, uv_buf_t* bufs,
                                     size_t numBufs, DPS_Status status)
 {
-    DPS_PublishRequest* req = appCtx;
+    DPS_PubSend* send = appCtx;
+    DPS_PublishRequest* req = send->req;
     DPS_Publication* pub = req->pub;
     DPS_Node* node = pub->node;
 
     DPS_LockNode(node);
-    SendComplete(req, NULL, bufs, numBufs, status);
+    SendComplete(req, NULL, status);
+    ReleasePubSend(node, send);
     DPS_PublishCompletion(req);
     DPS_PublicationDecRef(pub);
     DPS_UnlockNode(node);
 }
 
-DPS_Status DPS_SendPublication(DPS_PublishRequest* req, DPS_Publication* pub, RemoteNode* remote)
+/*
+ * Returns DPS_FALSE if a retained publication expired before it could
+ * be sent
+ */
+static int GetSendTTL(DPS_PublishRequest* req, DPS_Publication* pub, int16_t* ttl)
 {
-    DPS_Node* node = pub->node;
-    DPS_Status ret;
-    DPS_TxBuffer buf;
-    size_t len;
-    int16_t ttl = 0;
-    size_t i;
-
-    DPS_DBGTRACE();
-
-    if (!node->netCtx) {
-        return DPS_ERR_NETWORK;
-    }
-
+    *ttl = 0;
     if (pub->flags & PUB_FLAG_RETAINED) {
         if (pub->flags & PUB_FLAG_EXPIRED) {
-            ttl = -1;
+            *ttl = -1;
         } else {
-            ttl = REQ_TTL(req);
+            *ttl = REQ_TTL(req);
             /*
              * It is possible that a retained publication has expired between
              * being marked to send and getting to this point; if so we
              * silently ignore the publication.
              */
-            if (ttl <= 0) {
-                ++req->refCount;
-                SendComplete(req, NULL, NULL, 0, DPS_OK);
-                return DPS_OK;
+            if (*ttl <= 0) {
+                return DPS_FALSE;
             }
         }
     }
+    return DPS_TRUE;
+}
 
-    len = CBOR_SIZEOF_ARRAY(5) +
+/*
+ * Returns the size of the unprotected map or 0 if the node address
+ * type is not supported
+ */
+static size_t UnprotectedSize(DPS_Node* node)
+{
+    size_t len = CBOR_SIZEOF_ARRAY(5) +
         CBOR_SIZEOF(uint8_t) +
         CBOR_SIZEOF(uint8_t) +
         CBOR_SIZEOF_MAP(3) + 3 * CBOR_SIZEOF(uint8_t) +
@@ -1170,33 +2119,37 @@ DPS_Status DPS_SendPublication(DPS_PublishRequest* req, DPS_Publication* pub, Re
         len += CBOR_SIZEOF_STRING(node->addr.u.path); /* path */
         break;
     default:
-        return DPS_ERR_INVALID;
-    }
-    ret = DPS_TxBufferInit(&buf, NULL, len);
-    if (ret == DPS_OK) {
-        ret = CBOR_EncodeArray(&buf, 5);
+        return 0;
     }
+    return len;
+}
+
+static DPS_Status EncodeUnprotected(DPS_Node* node, DPS_PublishRequest* req, int16_t ttl, DPS_TxBuffer* buf)
+{
+    DPS_Status ret;
+
+    ret = CBOR_EncodeArray(buf, 5);
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeUint8(&buf, DPS_MSG_VERSION);
+        ret = CBOR_EncodeUint8(buf, DPS_MSG_VERSION);
     }
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeUint8(&buf, DPS_MSG_TYPE_PUB);
+        ret = CBOR_EncodeUint8(buf, DPS_MSG_TYPE_PUB);
     }
     /*
      * Encode the unprotected map
      */
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeMap(&buf, 3);
+        ret = CBOR_EncodeMap(buf, 3);
     }
     switch (node->addr.type) {
     case DPS_DTLS:
     case DPS_TCP:
     case DPS_UDP:
         if (ret == DPS_OK) {
-            ret = CBOR_EncodeUint8(&buf, DPS_CBOR_KEY_PORT);
+            ret = CBOR_EncodeUint8(buf, DPS_CBOR_KEY_PORT);
         }
         if (ret == DPS_OK) {
-            ret = CBOR_EncodeUint16(&buf,
+            ret = CBOR_EncodeUint16(buf,
                                     DPS_NetAddrPort((const struct sockaddr*)&node->addr.u.inaddr));
         }
         break;
@@ -1204,94 +2157,286 @@ DPS_Status DPS_SendPublication(DPS_PublishRequest* req, DPS_Publication* pub, Re
         break;
     }
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeUint8(&buf, DPS_CBOR_KEY_TTL);
+        ret = CBOR_EncodeUint8(buf, DPS_CBOR_KEY_TTL);
     }
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeInt16(&buf, ttl);
+        ret = CBOR_EncodeInt16(buf, ttl);
     }
     switch (node->addr.type) {
     case DPS_PIPE:
         if (ret == DPS_OK) {
-            ret = CBOR_EncodeUint8(&buf, DPS_CBOR_KEY_PATH);
+            ret = CBOR_EncodeUint8(buf, DPS_CBOR_KEY_PATH);
         }
         if (ret == DPS_OK) {
-            ret = CBOR_EncodeString(&buf, node->addr.u.path);
+            ret = CBOR_EncodeString(buf, node->addr.u.path);
         }
         break;
     default:
         break;
     }
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeUint8(&buf, DPS_CBOR_KEY_HOP_COUNT);
+        ret = CBOR_EncodeUint8(buf, DPS_CBOR_KEY_HOP_COUNT);
     }
     if (ret == DPS_OK) {
-        ret = CBOR_EncodeUint16(&buf, req->hopCount);
+        ret = CBOR_EncodeUint16(buf, req->hopCount);
+    }
+    return ret;
+}
+
+/*
+ * Get the unprotected map for sending a request. The map is encoded
+ * the first time the request is sent with a ttl and is shared with the
+ * later sends until the ttl changes, the sends that are still using a
+ * map encoded with an earlier ttl keep it alive. Must be called holding
+ * the node lock.
+ */
+static DPS_Status GetPubSend(DPS_Node* node, DPS_PublishRequest* req, int16_t ttl, DPS_PubSend** send)
+{
+    DPS_PubSend* s;
+    DPS_Status ret;
+    size_t len;
+
+    if (req->send && (req->send->ttl == ttl)) {
+        *send = req->send;
+        return DPS_OK;
+    }
+    len = UnprotectedSize(node);
+    if (!len) {
+        return DPS_ERR_INVALID;
+    }
+    assert(len <= PUB_UNPROTECTED_MAX);
+    s = DPS_SlabAlloc(&node->pubSends);
+    if (!s) {
+        return DPS_ERR_RESOURCES;
+    }
+    s->req = req;
+    s->ttl = ttl;
+    DPS_TxBufferInit(&s->buf, s->storage, len);
+    ret = EncodeUnprotected(node, req, ttl, &s->buf);
+    if (ret != DPS_OK) {
+        DPS_SlabFree(&node->pubSends, s);
+        return ret;
     }
     /*
-     * Protected and encrypted maps are already serialized
+     * The request holds a reference until it is destroyed or the map
+     * is replaced
      */
-    if (ret == DPS_OK) {
-        uv_buf_t bufs[1 + NUM_INTERNAL_PUB_BUFS + DPS_BUFS_MAX];
-        bufs[0] = uv_buf_init((char*)buf.base, DPS_TxBufferUsed(&buf));
-        for (i = 0; i < req->numBufs; ++i) {
-            bufs[1 + i] = uv_buf_init((char*)req->bufs[i].base, DPS_TxBufferUsed(&req->bufs[i]));
-        }
+    s->refCount = 1;
+    if (req->send) {
+        ReleasePubSend(node, req->send);
+    }
+    req->send = s;
+    *send = s;
+    return DPS_OK;
+}
+
+/*
+ * The unprotected map followed by the protected and encrypted maps
+ * which are already serialized
+ */
+static size_t PubSendBufs(DPS_PubSend* send, uv_buf_t* bufs)
+{
+    DPS_PublishRequest* req = send->req;
+    size_t i;
+
+    bufs[0] = uv_buf_init((char*)send->buf.base, DPS_TxBufferUsed(&send->buf));
+    for (i = 0; i < req->numBufs; ++i) {
+        bufs[1 + i] = uv_buf_init((char*)req->bufs[i].base, DPS_TxBufferUsed(&req->bufs[i]));
+    }
+    return 1 + req->numBufs;
+}
+
+DPS_Status DPS_SendPublication(DPS_PublishRequest* req, DPS_Publication* pub, RemoteNode* remote)
+{
+    DPS_Node* node = pub->node;
+    uv_buf_t bufs[1 + NUM_INTERNAL_PUB_BUFS + DPS_BUFS_MAX];
+    DPS_PubSend* send;
+    DPS_Status ret;
+    size_t numBufs;
+    int16_t ttl;
+
+    DPS_DBGTRACE();
+
+    if (!node->netCtx) {
+        return DPS_ERR_NETWORK;
+    }
+    if (!GetSendTTL(req, pub, &ttl)) {
         ++req->refCount;
-        if (remote == DPS_LoopbackNode) {
-            ret = DPS_LoopbackSend(node, bufs, 1 + req->numBufs);
-            SendComplete(req, NULL, bufs, 1 + req->numBufs, ret);
-        } else if (remote) {
-            ret = DPS_NetSend(node, req, &remote->ep, bufs, 1 + req->numBufs, OnNetSendComplete);
-            if (ret == DPS_OK) {
-                /*
-                 * Prevent the publication from being freed until the send completes.
-                 */
-                DPS_PublicationIncRef(pub);
-                /*
-                 * TODO Disabling the below - it has two undesirable consequences:
-                 *   1. It screws up the hop count logic.
-                 *   2. It results in a large amount of history state when there are
-                 *      a lot of links present.
-                 * The original problem is now back - when a new link is created,
-                 * the entire network receives any retained publications, not only
-                 * the new link.
-                 */
+        SendComplete(req, NULL, DPS_OK);
+        return DPS_OK;
+    }
+    ret = GetPubSend(node, req, ttl, &send);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    numBufs = PubSendBufs(send, bufs);
+    ++send->refCount;
+    ++req->refCount;
+    if (remote == DPS_LoopbackNode) {
+        ret = DPS_LoopbackSend(node, bufs, numBufs);
+        SendComplete(req, NULL, ret);
+        ReleasePubSend(node, send);
+    } else if (remote) {
+        ret = DPS_NetSend(node, send, &remote->ep, bufs, numBufs, OnNetSendComplete);
+        if (ret == DPS_OK) {
+            /*
+             * Prevent the publication from being freed until the send completes.
+             */
+            DPS_PublicationIncRef(pub);
+            /*
+             * TODO Disabling the below - it has two undesirable consequences:
+             *   1. It screws up the hop count logic.
+             *   2. It results in a large amount of history state when there are
+             *      a lot of links present.
+             * The original problem is now back - when a new link is created,
+             * the entire network receives any retained publications, not only
+             * the new link.
+             */
 #if 0
-                /*
-                 * Update history to prevent retained publications from being resent.
-                 */
-                DPS_UpdatePubHistory(&node->history, &pub->pubId, req->sequenceNum,
-                                     pub->ackRequested, REQ_TTL(req), req->hopCount, &remote->ep.addr);
+            /*
+             * Update history to prevent retained publications from being resent.
+             */
+            DPS_UpdatePubHistory(&node->history, &pub->pubId, req->sequenceNum,
+                                 pub->ackRequested, REQ_TTL(req), req->hopCount, &remote->ep.addr);
 #endif
-            } else {
-                SendComplete(req, &remote->ep, bufs, 1 + req->numBufs, ret);
-            }
         } else {
-            ret = DPS_MulticastSend(node->mcastSender, req, bufs, 1 + req->numBufs, OnMulticastSendComplete);
-            if (ret == DPS_OK) {
-                DPS_PublicationIncRef(pub);
-            } else {
-                DPS_WARNPRINT("DPS_MulticastSend failed - %s\n", DPS_ErrTxt(ret));
-                if (ret == DPS_ERR_NO_ROUTE) {
-                    /*
-                     * Rewrite the error to make DPS_SendPublication a no-op when
-                     * there are no multicast interfaces available.
-                     */
-                    ret = DPS_OK;
-                }
-                SendComplete(req, NULL, bufs, 1 + req->numBufs, ret);
+            SendComplete(req, &remote->ep, ret);
+            ReleasePubSend(node, send);
+        }
+    } else {
+        ret = DPS_MulticastSend(node->mcastSender, send, bufs, numBufs, OnMulticastSendComplete);
+        if (ret == DPS_OK) {
+            DPS_PublicationIncRef(pub);
+        } else {
+            DPS_WARNPRINT("DPS_MulticastSend failed - %s\n", DPS_ErrTxt(ret));
+            if (ret == DPS_ERR_NO_ROUTE) {
+                /*
+                 * Rewrite the error to make DPS_SendPublication a no-op when
+                 * there are no multicast interfaces available.
+                 */
+                ret = DPS_OK;
             }
+            SendComplete(req, NULL, ret);
+            ReleasePubSend(node, send);
+        }
+    }
+    return ret;
+}
+
+DPS_Status DPS_SendPublicationMany(DPS_PublishRequest* req, DPS_Publication* pub, DPS_NetEndpoint** eps,
+                                   size_t numEps)
+{
+    DPS_Node* node = pub->node;
+    uv_buf_t bufs[1 + NUM_INTERNAL_PUB_BUFS + DPS_BUFS_MAX];
+    DPS_PubSend* send;
+    DPS_Status ret;
+    size_t numBufs;
+    int16_t ttl;
+    size_t i;
+
+    DPS_DBGTRACE();
+
+    if (!node->netCtx) {
+        return DPS_ERR_NETWORK;
+    }
+    if (!numEps) {
+        return DPS_OK;
+    }
+    if (!GetSendTTL(req, pub, &ttl)) {
+        ++req->refCount;
+        SendComplete(req, NULL, DPS_OK);
+        return DPS_OK;
+    }
+    ret = GetPubSend(node, req, ttl, &send);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    numBufs = PubSendBufs(send, bufs);
+    /*
+     * The send complete callback may be called before DPS_NetSendMany
+     * returns so the references must be held first
+     */
+    send->refCount += numEps;
+    req->refCount += numEps;
+    for (i = 0; i < numEps; ++i) {
+        DPS_PublicationIncRef(pub);
+    }
+    ret = DPS_NetSendMany(node, send, eps, numEps, bufs, numBufs, OnNetSendComplete);
+    if (ret != DPS_OK) {
+        send->refCount -= numEps;
+        req->refCount -= numEps;
+        for (i = 0; i < numEps; ++i) {
+            DPS_PublicationDecRef(pub);
         }
+    }
+    return ret;
+}
+
+/*
+ * Returns the number of entries in the protected map
+ */
+static uint8_t ProtectedMapEntries(void)
+{
+    /*
+     * The Bloom filter hash is only sent if it is not the default
+     */
+    return (DPS_GetBloomHash() != DPS_BloomHashSha2) ? 6 : 5;
+}
+
+static size_t ProtectedSize(DPS_Publication* pub, uint8_t numMapEntries)
+{
+    return CBOR_SIZEOF_MAP(numMapEntries) + numMapEntries * CBOR_SIZEOF(uint8_t) +
+        CBOR_SIZEOF_BYTES(sizeof(DPS_UUID)) +
+        CBOR_SIZEOF(uint32_t) +
+        CBOR_SIZEOF_BOOLEAN() +
+        CBOR_SIZEOF_BYTES(DPS_TxBufferUsed(&pub->bfBuf)) +
+        CBOR_SIZEOF(int16_t) +
+        CBOR_SIZEOF(uint8_t);
+}
+
+static size_t EncryptedHeaderSize(DPS_Publication* pub, size_t dataLen)
+{
+    return CBOR_SIZEOF_MAP(2) + 2 * CBOR_SIZEOF(uint8_t) +
+        DPS_TxBufferUsed(&pub->topicsBuf) +
+        CBOR_SIZEOF_LEN(dataLen);
+}
+
+/*
+ * Returns the storage needed for the fields DPS_SerializePub()
+ * encodes, only local publications are serialized from a request
+ */
+static size_t ArenaSize(DPS_Publication* pub)
+{
+    if (pub->flags & PUB_FLAG_LOCAL) {
+        return ProtectedSize(pub, ProtectedMapEntries()) + EncryptedHeaderSize(pub, SIZE_MAX);
     } else {
-        DPS_TxBufferFree(&buf);
+        return 0;
+    }
+}
+
+/*
+ * Returns storage for a serialized field from the request or NULL
+ * if there is not enough left
+ */
+static uint8_t* ArenaAlloc(DPS_PublishRequest* req, size_t* used, size_t len)
+{
+    uint8_t* arena = (uint8_t*)&req->bufs[req->maxBufs];
+
+    if ((req->arenaSize - *used) < len) {
+        return NULL;
     }
-    return ret;
+    arena += *used;
+    *used += len;
+    return arena;
 }
 
 DPS_PublishRequest* DPS_CreatePublishRequest(DPS_Publication* pub, size_t numBufs, DPS_PublishBufsComplete cb,
                                              void* data)
 {
+    DPS_Node* node = pub->node;
     DPS_PublishRequest* req = NULL;
+    size_t arenaSize = ArenaSize(pub);
+    size_t maxBufs;
 
     /*
      * Reserve additional buffers for the authenticated fields,
@@ -1299,9 +2444,32 @@ DPS_PublishRequest* DPS_CreatePublishRequest(DPS_Publication* pub, size_t numBuf
      * footers.
      */
     numBufs += NUM_INTERNAL_PUB_BUFS;
-    req = calloc(1, sizeof(DPS_PublishRequest) + ((numBufs - 1) * sizeof(DPS_TxBuffer)));
-    if (!req) {
-        return NULL;
+    /*
+     * Publishers call this off the node thread, they are counted on
+     * the publication so it is not released while the free requests
+     * are accessed
+     */
+    uv_mutex_lock(&node->pubLock);
+    if (!DPS_QueueEmpty(&pub->freeRequests)) {
+        req = (DPS_PublishRequest*)DPS_QueueFront(&pub->freeRequests);
+        DPS_QueueRemove(&req->queue);
+        --pub->numFreeRequests;
+    }
+    uv_mutex_unlock(&node->pubLock);
+    if (req && ((req->maxBufs < numBufs) || (req->arenaSize < arenaSize))) {
+        free(req);
+        req = NULL;
+    }
+    if (req) {
+        maxBufs = req->maxBufs;
+        arenaSize = req->arenaSize;
+        memset(req, 0, sizeof(DPS_PublishRequest) + ((maxBufs - 1) * sizeof(DPS_TxBuffer)));
+    } else {
+        maxBufs = numBufs;
+        req = calloc(1, sizeof(DPS_PublishRequest) + ((maxBufs - 1) * sizeof(DPS_TxBuffer)) + arenaSize);
+        if (!req) {
+            return NULL;
+        }
     }
     req->pub = pub;
     req->completeCB = cb;
@@ -1309,6 +2477,8 @@ DPS_PublishRequest* DPS_CreatePublishRequest(DPS_Publication* pub, size_t numBuf
     req->status = DPS_ERR_NO_ROUTE;
     req->rxBuf = NULL;
     req->numBufs = numBufs;
+    req->maxBufs = maxBufs;
+    req->arenaSize = arenaSize;
     return req;
 }
 
@@ -1346,7 +2516,11 @@ void DPS_ExpirePub(DPS_Node* node, DPS_Publication* pub)
                  DPS_UUIDToString(&pub->pubId));
     if (pub->flags & PUB_FLAG_LOCAL) {
         pub->flags |= PUB_FLAG_EXPIRED;
-    } else {
+    } else if (DPS_QueueEmpty(&pub->receiveQueue)) {
+        /*
+         * Publications waiting for decryption keep the publication
+         * alive, it is expired again once they have been sent
+         */
         FreePublication(node, pub);
     }
 }
@@ -1375,7 +2549,11 @@ DPS_Publication* DPS_CreatePublication(DPS_Node* node)
     DPS_UnlockNode(node);
     DPS_GenerateUUID(&pub->pubId);
     DPS_QueueInit(&pub->sendQueue);
+    DPS_QueueInit(&pub->reorderQueue);
+    DPS_QueueInit(&pub->receiveQueue);
     DPS_QueueInit(&pub->retainedQueue);
+    DPS_QueueInit(&pub->freeRequests);
+    DPS_QueueInit(&pub->ready);
     return pub;
 }
 
@@ -1405,7 +2583,7 @@ DPS_Publication* DPS_CopyPublication(const DPS_Publication* pub)
         goto Exit;
     }
     copy->flags = PUB_FLAG_IS_COPY;
-    copy->sequenceNum = pub->sequenceNum;
+    copy->sequenceNum = ATOMIC_LOAD_32(&pub->sequenceNum);
     copy->ttl = pub->ttl;
     copy->ackRequested = pub->ackRequested;
     copy->handler = pub->handler;
@@ -1545,10 +2723,10 @@ DPS_Status DPS_InitPublication(DPS_Publication* pub,
 
     if (ret == DPS_OK) {
         DPS_LockNode(node);
-        pub->next = node->publications;
-        node->publications = pub;
+        ret = LinkPublication(node, pub);
         DPS_UnlockNode(node);
-    } else {
+    }
+    if (ret != DPS_OK) {
         DPS_TxBufferFree(&pub->bfBuf);
         DPS_TxBufferFree(&pub->topicsBuf);
         FreeTopics(pub);
@@ -1622,12 +2800,50 @@ int DPS_PublicationIsEncrypted(const DPS_Publication* pub)
     return pub && pub->recipients;
 }
 
-DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, size_t numBufs, int16_t ttl)
+/*
+ * Encrypt or sign a serialized publication. This may be called on any
+ * thread without holding the node lock.
+ */
+static DPS_Status ProtectPub(DPS_PublishRequest* req, const uint8_t nonce[COSE_NONCE_LEN])
+{
+    DPS_Publication* pub = req->pub;
+    DPS_Node* node = pub->node;
+    DPS_RxBuffer aadBuf;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_TxBufferToRx(&req->bufs[0], &aadBuf);
+    if (pub->recipientsCount) {
+        ret = COSE_Encrypt(COSE_ALG_A256GCM, nonce, node->signer.alg ? &node->signer : NULL,
+                           pub->recipients, pub->recipientsCount, &aadBuf, &req->bufs[1],
+                           &req->bufs[2], req->numBufs - 3, &req->bufs[req->numBufs - 1],
+                           node->keyStore);
+    } else {
+        ret = COSE_Sign(&node->signer, &aadBuf, &req->bufs[1], &req->bufs[2], req->numBufs - 3,
+                        &req->bufs[req->numBufs - 1], node->keyStore);
+    }
+    if (ret == DPS_OK) {
+        DPS_DBGPRINT("Publication was COSE serialized\n");
+        CBOR_Dump("aad", aadBuf.base, DPS_RxBufferAvail(&aadBuf));
+        for (i = 3; i < (req->numBufs - 3); ++i) {
+            CBOR_Dump("cryptText", req->bufs[i].base, DPS_TxBufferUsed(&req->bufs[i]));
+        }
+    } else {
+        DPS_WARNPRINT("COSE_Serialize failed: %s\n", DPS_ErrTxt(ret));
+    }
+    return ret;
+}
+
+DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, size_t numBufs, int16_t ttl,
+                            const uint8_t* pubNonce)
 {
     DPS_Publication* pub = req->pub;
     DPS_Node* node = pub->node;
     size_t bfLen = DPS_TxBufferUsed(&pub->bfBuf);
     size_t topicsLen = DPS_TxBufferUsed(&pub->topicsBuf);
+    uint8_t bloomHash = (uint8_t)DPS_GetBloomHash();
+    uint8_t numMapEntries = ProtectedMapEntries();
+    size_t arenaUsed = 0;
     size_t dataLen;
     DPS_Status ret;
     size_t len;
@@ -1638,17 +2854,12 @@ DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, siz
     /*
      * Encode the protected map
      */
-    len = CBOR_SIZEOF_MAP(5) + 5 * CBOR_SIZEOF(uint8_t) +
-        CBOR_SIZEOF_BYTES(sizeof(DPS_UUID)) +
-        CBOR_SIZEOF(uint32_t) +
-        CBOR_SIZEOF_BOOLEAN() +
-        CBOR_SIZEOF_BYTES(bfLen) +
-        CBOR_SIZEOF(int16_t);
-    ret = DPS_TxBufferInit(&req->bufs[0], NULL, len);
+    len = ProtectedSize(pub, numMapEntries);
+    ret = DPS_TxBufferInit(&req->bufs[0], ArenaAlloc(req, &arenaUsed, len), len);
     if (ret != DPS_OK) {
         return DPS_ERR_RESOURCES;
     }
-    ret = CBOR_EncodeMap(&req->bufs[0], 5);
+    ret = CBOR_EncodeMap(&req->bufs[0], numMapEntries);
     if (ret == DPS_OK) {
         ret = CBOR_EncodeUint8(&req->bufs[0], DPS_CBOR_KEY_TTL);
     }
@@ -1679,6 +2890,14 @@ DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, siz
     if (ret == DPS_OK) {
         ret = CBOR_Copy(&req->bufs[0], pub->bfBuf.base, bfLen);
     }
+    if (bloomHash != DPS_BloomHashSha2) {
+        if (ret == DPS_OK) {
+            ret = CBOR_EncodeUint8(&req->bufs[0], DPS_CBOR_KEY_BLOOM_HASH);
+        }
+        if (ret == DPS_OK) {
+            ret = CBOR_EncodeUint8(&req->bufs[0], bloomHash);
+        }
+    }
     /*
      * Encode the encrypted map
      */
@@ -1688,10 +2907,8 @@ DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, siz
         dataLen += bufs[i].len;
     }
     if (ret == DPS_OK) {
-        len = CBOR_SIZEOF_MAP(2) + 2 * CBOR_SIZEOF(uint8_t) +
-            topicsLen +
-            CBOR_SIZEOF_LEN(dataLen);
-        ret = DPS_TxBufferInit(&req->bufs[2], NULL, len);
+        len = EncryptedHeaderSize(pub, dataLen);
+        ret = DPS_TxBufferInit(&req->bufs[2], ArenaAlloc(req, &arenaUsed, len), len);
     }
     if (ret == DPS_OK) {
         ret = CBOR_EncodeMap(&req->bufs[2], 2);
@@ -1716,46 +2933,215 @@ DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, siz
     DPS_TxBufferClear(&req->bufs[req->numBufs - 1]);
     if (ret == DPS_OK) {
         if (pub->recipientsCount || node->signer.alg) {
-            DPS_RxBuffer aadBuf;
             uint8_t nonce[COSE_NONCE_LEN];
 
-            DPS_UnlockNode(node);
-            DPS_TxBufferToRx(&req->bufs[0], &aadBuf);
-            if (pub->recipientsCount) {
+            if (pub->recipientsCount && pubNonce) {
+                memcpy_s(nonce, sizeof(nonce), pubNonce, COSE_NONCE_LEN);
+            } else if (pub->recipientsCount) {
+                uv_mutex_lock(&node->pubLock);
                 ret = DPS_MakeNonce(&pub->pubId, req->sequenceNum, DPS_MSG_TYPE_PUB,
                                     pub->recipients[0].alg, node->rbg, nonce);
-                if (ret == DPS_OK) {
-                    ret = COSE_Encrypt(COSE_ALG_A256GCM, nonce, node->signer.alg ? &node->signer : NULL,
-                                       pub->recipients, pub->recipientsCount, &aadBuf, &req->bufs[1],
-                                       &req->bufs[2], req->numBufs - 3, &req->bufs[req->numBufs - 1],
-                                       node->keyStore);
-                }
-            } else {
-                ret = COSE_Sign(&node->signer, &aadBuf, &req->bufs[1], &req->bufs[2], req->numBufs - 3,
-                                &req->bufs[req->numBufs - 1], node->keyStore);
+                uv_mutex_unlock(&node->pubLock);
             }
-            DPS_LockNode(node);
-            if (ret == DPS_OK) {
-                DPS_DBGPRINT("Publication was COSE serialized\n");
-                CBOR_Dump("aad", aadBuf.base, DPS_RxBufferAvail(&aadBuf));
-                for (i = 3; i < (req->numBufs - 3); ++i) {
-                    CBOR_Dump("cryptText", req->bufs[i].base, DPS_TxBufferUsed(&req->bufs[i]));
+            if ((ret == DPS_OK) && node->cryptoOffload) {
+                /*
+                 * The COSE serialization is started from SendPubs()
+                 */
+                req->crypto = calloc(1, sizeof(PubCrypto));
+                if (req->crypto) {
+                    req->crypto->req = req;
+                    memcpy_s(req->crypto->nonce, sizeof(req->crypto->nonce), nonce, sizeof(nonce));
+                } else {
+                    ret = DPS_ERR_RESOURCES;
                 }
-            } else {
-                DPS_WARNPRINT("COSE_Serialize failed: %s\n", DPS_ErrTxt(ret));
+            } else if (ret == DPS_OK) {
+                ret = ProtectPub(req, nonce);
             }
         }
     }
     if (ret != DPS_OK) {
-        DPS_TxBufferFree(&req->bufs[0]);
-        DPS_TxBufferFree(&req->bufs[1]);
-        DPS_TxBufferFree(&req->bufs[2]);
-        DPS_TxBufferFree(&req->bufs[req->numBufs - 1]);
+        FreeSerializedBufs(req);
+    }
+    return ret;
+}
+
+static void RunPubCrypto(uv_work_t* work)
+{
+    PubCrypto* crypto = work->data;
+    DPS_PublishRequest* req = crypto->req;
+
+    if (crypto->decrypt) {
+        crypto->status = DecryptPub(req, req->pub->node->keyStore, &crypto->recipient, &crypto->sender,
+                                    &crypto->plainTextBuf, &crypto->encryptedBuf, &crypto->aliased);
+    } else {
+        crypto->status = ProtectPub(req, crypto->nonce);
+    }
+}
+
+static void PubCryptoDone(uv_work_t* work, int status)
+{
+    PubCrypto* crypto = work->data;
+    DPS_Publication* pub = crypto->req->pub;
+    DPS_Node* node = pub->node;
+
+    DPS_LockNode(node);
+    crypto->state = PUB_CRYPTO_DONE;
+    if (status) {
+        crypto->status = DPS_ERR_FAILURE;
+    }
+    if (crypto->decrypt) {
+        DeliverReceivedPubs(pub);
+    } else {
+        if (node->state == DPS_NODE_RUNNING) {
+            uv_async_send(&node->pubsAsync);
+        }
+        DPS_PublicationDecRef(pub);
+    }
+    DPS_UnlockNode(node);
+}
+
+void DPS_QueuePublishRequests(DPS_Node* node)
+{
+    DPS_Queue submitted;
+    DPS_Publication* pub;
+    DPS_PublishRequest* req;
+    DPS_PublishRequest* prev;
+
+    DPS_QueueInit(&submitted);
+    DPS_MpscQueueDrain(&node->publishQueue, &submitted);
+    while (!DPS_QueueEmpty(&submitted)) {
+        req = (DPS_PublishRequest*)DPS_QueueFront(&submitted);
+        DPS_QueueRemove(&req->queue);
+        pub = req->pub;
+        if (pub->flags & PUB_FLAG_WAS_FREED) {
+            /*
+             * There are no more requests to send so the sequence
+             * number order does not matter
+             */
+            if (!req->discard) {
+                req->status = DPS_ERR_WRITE;
+            }
+            DPS_PublishCompletion(req);
+            ReleasePublisher(pub);
+            continue;
+        }
+        /*
+         * Concurrent publishers may submit requests out of sequence
+         * number order, insert the request after the last request with
+         * a lower sequence number. This is almost always the back of
+         * the queue. The comparison allows for the sequence number
+         * wrapping.
+         */
+        for (prev = (DPS_PublishRequest*)DPS_QueueBack(&pub->reorderQueue);
+             prev != (DPS_PublishRequest*)&pub->reorderQueue; prev = (DPS_PublishRequest*)prev->queue.prev) {
+            if ((int32_t)(req->sequenceNum - prev->sequenceNum) > 0) {
+                break;
+            }
+        }
+        DPS_QueuePushBack((DPS_Queue*)prev->queue.next, &req->queue);
+        /*
+         * Move requests to the send queue until there is a gap in the
+         * sequence numbers
+         */
+        while (!DPS_QueueEmpty(&pub->reorderQueue)) {
+            req = (DPS_PublishRequest*)DPS_QueueFront(&pub->reorderQueue);
+            if (req->sequenceNum != (pub->queuedSequenceNum + 1)) {
+                break;
+            }
+            DPS_QueueRemove(&req->queue);
+            pub->queuedSequenceNum = req->sequenceNum;
+            if (req->discard) {
+                DPS_PublishCompletion(req);
+            } else {
+                DPS_QueuePushBack(&pub->sendQueue, &req->queue);
+                ++req->refCount;
+                DPS_ReadyPub(node, pub);
+            }
+        }
+        ReleasePublisher(pub);
+    }
+}
+
+void DPS_StartPubCrypto(DPS_Publication* pub)
+{
+    DPS_Node* node = pub->node;
+    DPS_PublishRequest* req;
+    PubCrypto* crypto;
+
+    for (req = (DPS_PublishRequest*)DPS_QueueFront(&pub->sendQueue);
+         req != (DPS_PublishRequest*)&pub->sendQueue; req = (DPS_PublishRequest*)req->queue.next) {
+        crypto = req->crypto;
+        if (!crypto || (crypto->state != PUB_CRYPTO_PENDING)) {
+            continue;
+        }
+        crypto->work.data = crypto;
+        crypto->state = PUB_CRYPTO_RUNNING;
+        if (uv_queue_work(node->loop, &crypto->work, RunPubCrypto, PubCryptoDone)) {
+            crypto->state = PUB_CRYPTO_DONE;
+            crypto->status = DPS_ERR_FAILURE;
+            continue;
+        }
         /*
-         * Any additional buffers belong to the application
+         * The reference keeps the send queue from being flushed while
+         * the request is being serialized
          */
+        DPS_PublicationIncRef(pub);
     }
-    return ret;
+}
+
+DPS_Status DPS_PublishRequestReady(DPS_PublishRequest* req)
+{
+    PubCrypto* crypto = req->crypto;
+
+    if (!crypto || crypto->decrypt) {
+        return DPS_OK;
+    }
+    if (crypto->state != PUB_CRYPTO_DONE) {
+        return DPS_ERR_BUSY;
+    }
+    return crypto->status;
+}
+
+/*
+ * Check the TTL of a local publish request and assign the request the
+ * next sequence number of the publication
+ */
+static DPS_Status PreparePublishRequest(DPS_PublishRequest* req, const DPS_Buffer* bufs, int16_t ttl)
+{
+    DPS_Publication* pub = req->pub;
+
+    /*
+     * Do some sanity checks for retained publication cancellation
+     */
+    if (ttl < 0) {
+        if (bufs) {
+            DPS_ERRPRINT("Payload not permitted when canceling a retained publication\n");
+            return DPS_ERR_INVALID;
+        }
+        if (!ATOMIC_XCHG_32(&pub->retainRequested, DPS_FALSE)) {
+            DPS_ERRPRINT("Negative ttl only valid for retained publications\n");
+            return DPS_ERR_INVALID;
+        }
+        ttl = 0;
+        req->expire = DPS_TRUE;
+    } else {
+        ATOMIC_XCHG_32(&pub->retainRequested, (ttl > 0));
+    }
+    req->ttl = ttl;
+    req->sequenceNum = ATOMIC_INC_32(&pub->sequenceNum);
+    return DPS_OK;
+}
+
+/*
+ * A request that failed after it was assigned a sequence number is
+ * still queued so that the requests with higher sequence numbers are
+ * not held back waiting for it. It is completed with the error status
+ * when it is taken off the publish queue.
+ */
+static void DiscardPublishRequest(DPS_PublishRequest* req, DPS_Status status)
+{
+    req->discard = DPS_TRUE;
+    req->status = status;
 }
 
 DPS_Status DPS_PublishBufs(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs, int16_t ttl,
@@ -1780,68 +3166,235 @@ DPS_Status DPS_PublishBufs(DPS_Publication* pub, const DPS_Buffer* bufs, size_t
         return DPS_ERR_NOT_STARTED;
     }
     /*
-     * Check publication is listed and is local
+     * Check publication is listed and is local. The publisher keeps the
+     * publication from being released until the request is taken off
+     * the publish queue.
      */
-    if (!IsValidPub(pub) || !(pub->flags & PUB_FLAG_LOCAL)) {
+    uv_mutex_lock(&node->pubLock);
+    if (!AddPublisher(pub)) {
+        uv_mutex_unlock(&node->pubLock);
         return DPS_ERR_MISSING;
     }
+    uv_mutex_unlock(&node->pubLock);
 
     req = DPS_CreatePublishRequest(pub, numBufs, cb, data);
     if (!req) {
-        ret = DPS_ERR_RESOURCES;
-        goto Exit;
+        ReleasePublisher(pub);
+        return DPS_ERR_RESOURCES;
     }
     /*
-     * Prevent publication from being destroyed while we are using it.
-     * Note that we add a reference to keep the publication alive when
-     * we release the node lock for serialization.  The release is
-     * necessary as the serialization calls the application's crypto
-     * handlers.
+     * The node lock is not acquired here so publishing does not wait
+     * for the node thread. The request is serialized and pushed onto
+     * the node's publish queue, SendPubs() moves it to the send queue
+     * in sequence number order and updates the retained and expired
+     * flags of the publication when the request is taken off the send
+     * queue.
      */
-    DPS_LockNode(node);
-    DPS_PublicationIncRef(pub);
+    ret = PreparePublishRequest(req, bufs, ttl);
+    if (ret != DPS_OK) {
+        DPS_DestroyPublishRequest(req);
+        ReleasePublisher(pub);
+        return ret;
+    }
     /*
-     * Do some sanity checks for retained publication cancellation
+     * Serialize the publication
      */
-    if (ttl < 0) {
-        if (!(pub->flags & PUB_FLAG_RETAINED)) {
-            DPS_ERRPRINT("Negative ttl only valid for retained publications\n");
-            ret = DPS_ERR_INVALID;
-            goto Exit;
+    ret = DPS_SerializePub(req, bufs, numBufs, req->ttl, NULL);
+    if (ret != DPS_OK) {
+        /*
+         * The error is returned here so the callback is not called
+         */
+        DiscardPublishRequest(req, ret);
+        req->completeCB = NULL;
+    }
+    if (DPS_MpscQueuePush(&node->publishQueue, &req->queue)) {
+        uv_async_send(&node->pubsAsync);
+    }
+    return ret;
+}
+
+/*
+ * State of an entry in a batch passed to DPS_PublishBatch()
+ */
+typedef struct _PublishBatchEntryState {
+    struct _PublishBatch* batch;
+    DPS_PublishBatchEntry* entry;
+    DPS_PublishRequest* req;
+    int isPublisher;
+    uint8_t nonce[COSE_NONCE_LEN];
+} PublishBatchEntryState;
+
+typedef struct _PublishBatch {
+    DPS_PublishBatchEntry* entries;
+    size_t numEntries;
+    size_t pending;             /* Queued entries not yet complete, protected by the node lock */
+    DPS_PublishBatchComplete cb;
+    void* data;
+    PublishBatchEntryState state[1];
+} PublishBatch;
+
+/*
+ * Called holding the node lock when a queued entry of a batch completes
+ */
+static void PublishBatchEntryComplete(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs,
+                                      DPS_Status status, void* data)
+{
+    PublishBatchEntryState* state = (PublishBatchEntryState*)data;
+    PublishBatch* batch = state->batch;
+
+    state->entry->status = status;
+    assert(batch->pending > 0);
+    if (--batch->pending == 0) {
+        if (batch->cb) {
+            batch->cb(batch->entries, batch->numEntries, batch->data);
         }
-        if (bufs) {
-            DPS_ERRPRINT("Payload not permitted when canceling a retained publication\n");
-            ret = DPS_ERR_INVALID;
-            goto Exit;
+        free(batch);
+    }
+}
+
+DPS_Status DPS_PublishBatch(DPS_PublishBatchEntry* entries, size_t numEntries, DPS_PublishBatchComplete cb,
+                            void* data)
+{
+    DPS_Status ret;
+    DPS_Node* node;
+    DPS_Publication* pub;
+    DPS_Publication* validPub = NULL;
+    DPS_PublishBatchEntry* entry;
+    DPS_PublishRequest* req;
+    PublishBatch* batch;
+    PublishBatchEntryState* state;
+    DPS_Queue queue;
+    size_t i;
+
+    DPS_DBGTRACE();
+
+    if (!entries) {
+        return DPS_ERR_NULL;
+    }
+    if (!numEntries) {
+        return DPS_ERR_ARGS;
+    }
+    node = entries[0].pub ? entries[0].pub->node : NULL;
+    for (i = 0; i < numEntries; ++i) {
+        if (!entries[i].pub) {
+            return DPS_ERR_NULL;
         }
-        ttl = 0;
-        pub->flags |= PUB_FLAG_EXPIRED;
-    } else if (ttl == 0) {
-        pub->flags &= ~PUB_FLAG_RETAINED;
-        pub->flags &= ~PUB_FLAG_EXPIRED;
-    } else if (ttl > 0) {
-        pub->flags |= PUB_FLAG_RETAINED;
-        pub->flags &= ~PUB_FLAG_EXPIRED;
+        if (entries[i].pub->node != node) {
+            return DPS_ERR_ARGS;
+        }
+    }
+    if (!node) {
+        return DPS_ERR_NOT_INITIALIZED;
     }
-    pub->ttl = req->ttl = ttl;
-    req->sequenceNum = ++pub->sequenceNum;
+    if (!node->loop) {
+        return DPS_ERR_NOT_STARTED;
+    }
+    batch = calloc(1, sizeof(PublishBatch) + ((numEntries - 1) * sizeof(PublishBatchEntryState)));
+    if (!batch) {
+        return DPS_ERR_RESOURCES;
+    }
+    batch->entries = entries;
+    batch->numEntries = numEntries;
+    batch->cb = cb;
+    batch->data = data;
     /*
-     * Serialize the publication
+     * Check the publications, each entry keeps its publication from
+     * being released until the request is taken off the publish queue
      */
-    ret = DPS_SerializePub(req, bufs, numBufs, ttl);
-    if (ret != DPS_OK) {
-        goto Exit;
+    uv_mutex_lock(&node->pubLock);
+    for (i = 0; i < numEntries; ++i) {
+        entry = &entries[i];
+        state = &batch->state[i];
+        state->batch = batch;
+        state->entry = entry;
+        if ((!entry->bufs && entry->numBufs) || (entry->numBufs > DPS_BUFS_MAX)) {
+            entry->status = DPS_ERR_ARGS;
+            continue;
+        }
+        if (entry->pub == validPub) {
+            ++validPub->numPublishers;
+        } else if (AddPublisher(entry->pub)) {
+            validPub = entry->pub;
+        } else {
+            entry->status = DPS_ERR_MISSING;
+            continue;
+        }
+        state->isPublisher = DPS_TRUE;
+        entry->status = DPS_OK;
     }
-    DPS_QueuePushBack(&pub->sendQueue, &req->queue);
-    ++req->refCount;
-    uv_async_send(&node->pubsAsync);
-Exit:
-    DPS_PublicationDecRef(pub);
-    DPS_UnlockNode(node);
-    if (ret != DPS_OK) {
-        DPS_DestroyPublishRequest(req);
+    uv_mutex_unlock(&node->pubLock);
+    /*
+     * Allocate the requests before acquiring the publish lock again
+     */
+    for (i = 0; i < numEntries; ++i) {
+        state = &batch->state[i];
+        if (state->isPublisher) {
+            state->req = DPS_CreatePublishRequest(state->entry->pub, state->entry->numBufs,
+                                                  PublishBatchEntryComplete, state);
+            if (!state->req) {
+                state->entry->status = DPS_ERR_RESOURCES;
+            }
+        }
     }
-    return ret;
+    /*
+     * Assign the sequence numbers and make the nonces acquiring the
+     * publish lock once for the whole batch
+     */
+    uv_mutex_lock(&node->pubLock);
+    for (i = 0; i < numEntries; ++i) {
+        state = &batch->state[i];
+        req = state->req;
+        if (!req) {
+            continue;
+        }
+        entry = state->entry;
+        pub = entry->pub;
+        entry->status = PreparePublishRequest(req, entry->bufs, entry->ttl);
+        if ((entry->status == DPS_OK) && pub->recipientsCount) {
+            ret = DPS_MakeNonce(&pub->pubId, req->sequenceNum, DPS_MSG_TYPE_PUB, pub->recipients[0].alg,
+                                node->rbg, state->nonce);
+            if (ret != DPS_OK) {
+                DiscardPublishRequest(req, ret);
+            }
+        }
+    }
+    uv_mutex_unlock(&node->pubLock);
+    /*
+     * Serialize the requests and queue them together
+     */
+    DPS_QueueInit(&queue);
+    for (i = 0; i < numEntries; ++i) {
+        state = &batch->state[i];
+        req = state->req;
+        entry = state->entry;
+        if (!req || (entry->status != DPS_OK)) {
+            if (req) {
+                DPS_DestroyPublishRequest(req);
+                state->req = NULL;
+            }
+            if (state->isPublisher) {
+                ReleasePublisher(entry->pub);
+            }
+            continue;
+        }
+        if (!req->discard) {
+            ret = DPS_SerializePub(req, entry->bufs, entry->numBufs, req->ttl, state->nonce);
+            if (ret != DPS_OK) {
+                DiscardPublishRequest(req, ret);
+            }
+        }
+        DPS_QueuePushBack(&queue, &req->queue);
+        ++batch->pending;
+    }
+    if (!batch->pending) {
+        ret = entries[0].status;
+        free(batch);
+        return ret;
+    }
+    if (DPS_MpscQueuePushAll(&node->publishQueue, &queue)) {
+        uv_async_send(&node->pubsAsync);
+    }
+    return DPS_OK;
 }
 
 static void PublishComplete(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs, DPS_Status status,
@@ -1921,12 +3474,12 @@ DPS_Publication* DPS_LookupAckHandler(DPS_Node* node, const DPS_UUID* pubId, uin
 {
     DPS_Publication* pub;
 
-    for (pub = node->publications; pub != NULL; pub = pub->next) {
-        if (pub->handler && (DPS_UUIDCompare(&pub->pubId, pubId) == 0)) {
-            if (sequenceNum <= pub->sequenceNum) {
-                return pub;
-            }
-        }
+    /*
+     * Only local publications have an ack handler
+     */
+    pub = DPS_FindPublication(node, pubId, PUB_FLAG_LOCAL, PUB_FLAG_LOCAL);
+    if (pub && pub->handler && (sequenceNum <= ATOMIC_LOAD_32(&pub->sequenceNum))) {
+        return pub;
     }
     return NULL;
 }
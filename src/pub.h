@@ -31,6 +31,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <dps/private/dps.h>
+#include <dps/private/cbor.h>
 #include "node.h"
 #include "queue.h"
 
@@ -49,6 +50,15 @@ extern "C" {
 
 typedef struct _DPS_PublishRequest DPS_PublishRequest;
 
+/**
+ * The cached result of matching a publication against the interests of a remote node
+ */
+typedef struct _RemoteMatch {
+    RemoteNode* remote;             /**< The remote node */
+    uint32_t revision;              /**< The remote's inbound revision when the match was computed */
+    int match;                      /**< TRUE if the publication matched the remote's interests */
+} RemoteMatch;
+
 /**
  * Notes on the use of the DPS_Publication fields:
  *
@@ -83,13 +93,29 @@ typedef struct _DPS_Publication {
         DPS_NodeAddress senderAddr; /**< For linking - then next-hop sender address */
     } ack;                          /**< For ack messages */
     DPS_Queue sendQueue;            /**< Publication send requests */
+    DPS_Queue reorderQueue;         /**< Local publish requests waiting for a lower sequence number to be queued */
     DPS_Queue retainedQueue;        /**< The retained publication send requests */
+    DPS_Queue receiveQueue;         /**< Received publication requests waiting for offloaded decryption */
+    DPS_Queue freeRequests;         /**< Completed requests kept for reuse, protected by the node's pubLock */
+    size_t numFreeRequests;         /**< Number of requests in freeRequests */
+    DPS_Queue ready;                /**< Link in the node's queue of publications with requests to send */
+    uint8_t isReady;                /**< TRUE if the publication is in the node's ready queue */
+    size_t expiryIndex;             /**< Position plus one in the node's expiry heap, zero if not in the heap */
+    uint64_t expiryTime;            /**< The time the publication is ordered by in the node's expiry heap */
     DPS_NetRxBuffer* rxBuf;         /**< For publication or ack handlers - the receive buffer being handled */
+    struct {
+        RemoteMatch* entries;       /**< Match results indexed by position in the remote node list */
+        size_t cap;                 /**< Capacity of the entries array */
+        uint32_t generation;        /**< Remote node list generation the entries are valid for */
+    } remoteMatch;                  /**< Cached results of matching against the remote nodes */
 
     uint8_t flags;                  /**< Internal state flags */
     uint32_t refCount;              /**< Ref count to prevent publication from being free while a send is in progress */
-    uint32_t sequenceNum;           /**< Sequence number for this publication */
+    uint32_t numPublishers;         /**< Publish requests not yet taken off the node's publish queue, protected by the node's pubLock */
+    uint32_t sequenceNum;           /**< Sequence number for this publication, updated atomically if local */
+    uint32_t queuedSequenceNum;     /**< Sequence number of the last local publish request moved to the send queue */
     int16_t ttl;                    /**< Copy of publish request time to live */
+    uint32_t retainRequested;       /**< TRUE if the last publish request had a non-zero TTL, updated atomically */
 
     DPS_OnPublicationDestroyed onDestroyed; /**< Optional on destroyed callback */
 
@@ -108,6 +134,63 @@ typedef struct _DPS_Publication {
  */
 void DPS_UpdatePubs(DPS_Node* node);
 
+/**
+ * Check if a publication matches the interests of a remote node.
+ *
+ * The result is cached in the publication and is recomputed when the
+ * remote's inbound revision changes or remote nodes are added,
+ * removed, or reordered.
+ *
+ * @param node       The local node
+ * @param pub        The publication
+ * @param remote     The remote node, must have inbound interests
+ * @param pos        The position of the remote in the node's remote node list
+ *
+ * @return DPS_TRUE if the publication matches the remote's interests
+ */
+int DPS_PublicationMatchesRemote(DPS_Node* node, DPS_Publication* pub, RemoteNode* remote, size_t pos);
+
+/**
+ * Get the counters for the cached results of matching publications
+ * against the remote nodes
+ *
+ * @param node       The local node
+ * @param hits       Returns the number of matches found in the cache
+ * @param misses     Returns the number of matches that were computed
+ */
+void DPS_RemoteMatchStats(DPS_Node* node, uint64_t* hits, uint64_t* misses);
+
+/**
+ * Discard the cached results of matching a publication against the
+ * remote nodes, called when the publication's bloom filter changes.
+ *
+ * @param pub        The publication
+ */
+void DPS_ClearRemoteMatches(DPS_Publication* pub);
+
+/**
+ * The fields of a received publication that precede the payload and
+ * the results of the checks that can be made without the node lock
+ */
+struct _DPS_PubHeader {
+    int16_t ttl;                /**< Remaining time-to-live in seconds */
+    uint16_t hopCount;          /**< Number of hops the publication has taken */
+    uint16_t keysMask;          /**< Optional keys present in the unprotected map */
+    uint16_t port;              /**< Port the sender is listening on */
+    char* path;                 /**< Path the sender is listening on, in the receive buffer */
+    size_t pathLen;             /**< Length of the path */
+    DPS_UUID pubId;             /**< The publication ID */
+    uint32_t sequenceNum;       /**< The publication sequence number */
+    int ackRequested;           /**< DPS_TRUE if an acknowledgement was requested */
+    uint8_t* protectedPtr;      /**< Start of the protected map in the receive buffer */
+    uint8_t* payloadPtr;        /**< End of the protected map in the receive buffer */
+    DPS_RxBuffer bfBuf;         /**< The serialized bloom filter */
+    DPS_BitVector* bf;          /**< The deserialized bloom filter or NULL */
+    int checked;                /**< DPS_TRUE if the subscriptions were checked for candidates */
+    int candidate;              /**< DPS_TRUE if there was a candidate subscription */
+    uint32_t subsSequence;      /**< Sequence number of the subscription index when checked */
+};
+
 /**
  * Decode and process a received publication
  *
@@ -115,10 +198,41 @@ void DPS_UpdatePubs(DPS_Node* node);
  * @param ep         The endpoint the publication was received on
  * @param buffer     The encoded publication
  * @param multicast  DPS_TRUE if publication was multicast, DPS_FALSE if unicast
+ * @param hdr        The header returned from DPS_PreDecodePublication(),
+ *                   released before returning, or NULL to decode the
+ *                   header from the buffer
  *
  * @return DPS_OK if decoding and processing is successful, an error otherwise
  */
-DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buffer, int multicast);
+DPS_Status DPS_DecodePublication(DPS_Node* node, DPS_NetEndpoint* ep, DPS_NetRxBuffer* buffer, int multicast,
+                                 DPS_PubHeader* hdr);
+
+/**
+ * Decode the header and the bloom filter of a received publication,
+ * drop it if it is stale, and check for candidate subscriptions.
+ *
+ * The node state is not modified and the node lock is not acquired so
+ * this may be called from any thread while the node is running.
+ *
+ * @param node       The local node
+ * @param rxBuf      The encoded publication following the message type
+ * @param hdr        Returns the decoded header, must be released with
+ *                   DPS_ReleasePubHeader()
+ *
+ * @return
+ * - DPS_OK if the header was decoded
+ * - DPS_ERR_STALE if the publication is stale
+ * - Other error codes if the header could not be decoded, nothing needs
+ *   to be released
+ */
+DPS_Status DPS_PreDecodePublication(DPS_Node* node, DPS_RxBuffer* rxBuf, DPS_PubHeader* hdr);
+
+/**
+ * Release the resources held by a publication header
+ *
+ * @param hdr        The header
+ */
+void DPS_ReleasePubHeader(DPS_PubHeader* hdr);
 
 /**
  * A request to DPS_Publish()
@@ -129,13 +243,19 @@ typedef struct _DPS_PublishRequest {
     DPS_PublishBufsComplete completeCB; /**< The completion callback */
     void* data;                         /**< Context pointer */
     int16_t ttl;                        /**< Time to live in seconds - maximum TTL is about 9 hours */
+    uint8_t expire;                     /**< TRUE if the request expires a retained publication */
+    uint8_t discard;                    /**< TRUE if the request failed after it was given a sequence number, it only fills its place in the sequence */
     uint64_t expires;                   /**< Time (in milliseconds) that this publication expires */
     uint16_t hopCount;                  /**< The current hop count of the publication */
     DPS_Status status;                  /**< Result of the publish */
     size_t refCount;                    /**< Prevent request from being freed while in use */
     uint32_t sequenceNum;               /**< Sequence number for this request */
     DPS_NetRxBuffer* rxBuf;             /**< The fields may be aliased to a received message */
+    struct _PubCrypto* crypto;          /**< Offloaded COSE serialization or decryption, NULL if not offloaded */
+    struct _DPS_PubSend* send;          /**< The unprotected map shared by the sends of the request, NULL if not sent */
     size_t numBufs;                     /**< Number of buffers */
+    size_t maxBufs;                     /**< Capacity of the buffers array */
+    size_t arenaSize;                   /**< Size of the storage for the serialized fields following the buffers array */
     /**
      * Publication fields.
      *
@@ -153,9 +273,39 @@ typedef struct _DPS_PublishRequest {
     DPS_TxBuffer bufs[1];
 } DPS_PublishRequest;
 
+/**
+ * Maximum size of the serialized unprotected map of a publication
+ */
+#define PUB_UNPROTECTED_MAX (CBOR_SIZEOF_ARRAY(5) +                            \
+                             2 * CBOR_SIZEOF(uint8_t) +                        \
+                             CBOR_SIZEOF_MAP(3) + 3 * CBOR_SIZEOF(uint8_t) +   \
+                             CBOR_SIZEOF(int16_t) +                            \
+                             CBOR_SIZEOF(uint16_t) +                           \
+                             CBOR_SIZEOF_STRING_AND_LENGTH(DPS_NODE_ADDRESS_PATH_MAX))
+
+/**
+ * The unprotected map sent with a publish request. It is encoded once
+ * for each ttl the request is sent with and shared by the loopback,
+ * multicast, and unicast sends. These are allocated from the node's
+ * pubSends slab holding the node lock.
+ */
+typedef struct _DPS_PubSend {
+    DPS_PublishRequest* req;                /**< The publish request */
+    size_t refCount;                        /**< The request's reference plus the sends that have not completed */
+    int16_t ttl;                            /**< The ttl the map was encoded with */
+    DPS_TxBuffer buf;                       /**< The serialized unprotected map */
+    uint8_t storage[PUB_UNPROTECTED_MAX];   /**< Storage for buf */
+} DPS_PubSend;
+
+#define PUB_SENDS_PER_BLOCK 32 /**< Number of DPS_PubSend items the node's slab allocates at a time */
+
 /**
  * Creates a request to DPS_Publish()
  *
+ * A request completed earlier for the same publication is reused when
+ * it is large enough, otherwise the request and the storage for its
+ * serialized fields are allocated together.
+ *
  * @param pub The publication
  * @param numBufs The number of payload buffers.  Note that this number does not include non-payload buffers,
  *                those are added internally.
@@ -168,7 +318,8 @@ DPS_PublishRequest* DPS_CreatePublishRequest(DPS_Publication* pub, size_t numBuf
                                              void* data);
 
 /**
- * Frees resources associated with a publish request
+ * Frees resources associated with a publish request. The request
+ * may be kept by its publication for reuse.
  *
  * @param req A previously created request.
   */
@@ -186,6 +337,20 @@ void DPS_DestroyPublishRequest(DPS_PublishRequest* req);
  */
 DPS_Status DPS_SendPublication(DPS_PublishRequest* req, DPS_Publication* pub, RemoteNode* remote);
 
+/**
+ * Send a publication to a number of remote subscriber nodes. The
+ * serialized publication is shared by all of the sends.
+ *
+ * @param req            The publication send request
+ * @param pub            The publication to send
+ * @param eps            The endpoints of the remote nodes
+ * @param numEps         The number of endpoints
+ *
+ * @return DPS_OK if sending is successful, an error otherwise
+ */
+DPS_Status DPS_SendPublicationMany(DPS_PublishRequest* req, DPS_Publication* pub, DPS_NetEndpoint** eps,
+                                   size_t numEps);
+
 /**
  * Serialize the body and payload sections of a publication
  *
@@ -196,10 +361,12 @@ DPS_Status DPS_SendPublication(DPS_PublishRequest* req, DPS_Publication* pub, Re
  * @param bufs Optional payload buffers
  * @param numBufs The number of buffers
  * @param ttl The time-to-live of the publication
+ * @param pubNonce The nonce to use if the publication has recipients, NULL to make one
  *
  * @return DPS_OK if the serialization is successful, an error otherwise
  */
-DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, size_t numBufs, int16_t ttl);
+DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, size_t numBufs, int16_t ttl,
+                            const uint8_t* pubNonce);
 
 /**
  * Complete the request if finished.
@@ -208,6 +375,35 @@ DPS_Status DPS_SerializePub(DPS_PublishRequest* req, const DPS_Buffer* bufs, siz
  */
 void DPS_PublishCompletion(DPS_PublishRequest* req);
 
+/**
+ * Move the publish requests submitted by application threads to the
+ * send queues of their publications in sequence number order. Must be
+ * called holding the node lock.
+ *
+ * @param node The node
+ */
+void DPS_QueuePublishRequests(DPS_Node* node);
+
+/**
+ * Start the offloaded COSE serialization of the requests in the send
+ * queue of a publication. Must be called on the node's thread.
+ *
+ * @param pub The publication
+ */
+void DPS_StartPubCrypto(DPS_Publication* pub);
+
+/**
+ * Check if a publish request is ready to be sent.
+ *
+ * @param req The publish request
+ *
+ * @return
+ * - DPS_OK if the request is ready to be sent
+ * - DPS_ERR_BUSY if offloaded COSE serialization has not completed
+ * - Other error if COSE serialization failed
+ */
+DPS_Status DPS_PublishRequestReady(DPS_PublishRequest* req);
+
 /**
  * When a ttl expires retained publications are freed, local
  * publications are disabled by clearing the PUBLISH flag.
@@ -217,6 +413,49 @@ void DPS_PublishCompletion(DPS_PublishRequest* req);
  */
 void DPS_ExpirePub(DPS_Node* node, DPS_Publication* pub);
 
+/**
+ * Queue a publication to be visited the next time publications are
+ * sent. Must be called holding the node lock after a request is
+ * put on the send queue of the publication.
+ *
+ * @param node The node
+ * @param pub The publication
+ */
+void DPS_ReadyPub(DPS_Node* node, DPS_Publication* pub);
+
+/**
+ * Update the position of a publication in the expiry heap of the
+ * node. Must be called holding the node lock after the retained queue
+ * of the publication is changed. The heap is left alone if the expiry
+ * time of the first retained request has not changed.
+ *
+ * @param node The node
+ * @param pub The publication
+ */
+void DPS_ScheduleExpiry(DPS_Node* node, DPS_Publication* pub);
+
+/**
+ * Remove the publication whose retained request expires first from
+ * the expiry heap of the node if the request has expired. The caller
+ * is expected to take the request off the retained queue and then
+ * call DPS_ScheduleExpiry().
+ *
+ * @param node The node
+ * @param now The current time in milliseconds
+ *
+ * @return The publication or NULL if no retained request has expired
+ */
+DPS_Publication* DPS_PopExpiredPub(DPS_Node* node, uint64_t now);
+
+/**
+ * Get the time the first retained request of the node expires
+ *
+ * @param node The node
+ *
+ * @return The expiry time in milliseconds or UINT64_MAX if there are no retained requests
+ */
+uint64_t DPS_NextExpiry(DPS_Node* node);
+
 /**
  * Free a publication
  *
@@ -226,6 +465,20 @@ void DPS_ExpirePub(DPS_Node* node, DPS_Publication* pub);
  */
 DPS_Publication* DPS_FreePublication(DPS_Publication* pub);
 
+/**
+ * Find a publication by pubId.
+ *
+ * Must be called holding the node lock.
+ *
+ * @param node   The node
+ * @param pubId  The publication ID
+ * @param mask   The publication flags to compare
+ * @param flags  The required value of the flags selected by mask
+ *
+ * @return The publication or NULL if there is no matching publication
+ */
+DPS_Publication* DPS_FindPublication(DPS_Node* node, const DPS_UUID* pubId, uint8_t mask, uint8_t flags);
+
 /**
  * Free publications of node
  *
@@ -260,6 +513,18 @@ void DPS_PublicationIncRef(DPS_Publication* pub);
  */
 void DPS_PublicationDecRef(DPS_Publication* pub);
 
+/**
+ * Check if a freed publication can be released. A publication cannot
+ * be released while it has a non-zero ref count or while there are
+ * publish requests for it that have not been taken off the node's
+ * publish queue.
+ *
+ * @param pub The publication
+ *
+ * @return DPS_TRUE if the publication can be released
+ */
+int DPS_PublicationCanRelease(DPS_Publication* pub);
+
 /**
  * Check if there is a local subscription for this publication
  *
@@ -19,6 +19,8 @@
  *
  *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
  */
+#include <stddef.h>
+#include "compat.h"
 #include "queue.h"
 
 void DPS_QueueInit(DPS_Queue* queue)
@@ -55,3 +57,81 @@ void DPS_QueueRemove(DPS_Queue* item)
     ((DPS_Queue*)item->prev)->next = item->next;
     ((DPS_Queue*)item->next)->prev = item->prev;
 }
+
+void DPS_MpscQueueInit(DPS_MpscQueue* queue)
+{
+    queue->head = NULL;
+}
+
+int DPS_MpscQueuePush(DPS_MpscQueue* queue, DPS_Queue* item)
+{
+    DPS_Queue* head = ATOMIC_LOAD_PTR(&queue->head);
+    DPS_Queue* prev;
+
+    for (;;) {
+        item->next = head;
+        prev = ATOMIC_CAS_PTR(&queue->head, head, item);
+        if (prev == head) {
+            break;
+        }
+        head = prev;
+    }
+    return head == NULL;
+}
+
+int DPS_MpscQueuePushAll(DPS_MpscQueue* queue, DPS_Queue* items)
+{
+    DPS_Queue* first;
+    DPS_Queue* last = NULL;
+    DPS_Queue* item;
+    DPS_Queue* head;
+    DPS_Queue* prev;
+
+    if (DPS_QueueEmpty(items)) {
+        return 0;
+    }
+    /*
+     * Link the items most recent first, the same as pushing them one
+     * at a time
+     */
+    first = DPS_QueueFront(items);
+    while (!DPS_QueueEmpty(items)) {
+        item = DPS_QueueFront(items);
+        DPS_QueueRemove(item);
+        item->next = last;
+        last = item;
+    }
+    head = ATOMIC_LOAD_PTR(&queue->head);
+    for (;;) {
+        first->next = head;
+        prev = ATOMIC_CAS_PTR(&queue->head, head, last);
+        if (prev == head) {
+            break;
+        }
+        head = prev;
+    }
+    return head == NULL;
+}
+
+void DPS_MpscQueueDrain(DPS_MpscQueue* queue, DPS_Queue* items)
+{
+    DPS_Queue* item = ATOMIC_XCHG_PTR(&queue->head, NULL);
+    DPS_Queue* fifo = NULL;
+    DPS_Queue* next;
+
+    /*
+     * Items are pushed onto the front so reverse them to get them
+     * back in the order they were pushed
+     */
+    while (item) {
+        next = item->next;
+        item->next = fifo;
+        fifo = item;
+        item = next;
+    }
+    while (fifo) {
+        next = fifo->next;
+        DPS_QueuePushBack(items, fifo);
+        fifo = next;
+    }
+}
@@ -89,6 +89,57 @@ void DPS_QueuePushBack(DPS_Queue* queue, DPS_Queue* item);
  */
 void DPS_QueueRemove(DPS_Queue* item);
 
+/**
+ * Lock-free queue for passing items from any number of threads to a
+ * single consumer thread. Items are linked through the next field of
+ * their generic queue item.
+ */
+typedef struct _DPS_MpscQueue {
+    DPS_Queue* head;            /**< The most recently pushed item */
+} DPS_MpscQueue;
+
+/**
+ * Initializes a multi-producer single-consumer queue
+ *
+ * @param queue the queue
+ */
+void DPS_MpscQueueInit(DPS_MpscQueue* queue);
+
+/**
+ * Pushes an item onto the queue, may be called from any thread.
+ *
+ * @param queue the queue
+ * @param item the item, must not be in any other queue
+ *
+ * @return non-zero if the queue was empty, the producer that pushes
+ *         onto an empty queue is responsible for waking the consumer
+ */
+int DPS_MpscQueuePush(DPS_MpscQueue* queue, DPS_Queue* item);
+
+/**
+ * Pushes all the items in a generic queue onto the queue with a single
+ * atomic operation, may be called from any thread. The items are
+ * drained in the order they were in the generic queue.
+ *
+ * @param queue the queue
+ * @param items the generic queue of items, empty on return
+ *
+ * @return non-zero if the queue was empty and items were pushed, the
+ *         producer that pushes onto an empty queue is responsible for
+ *         waking the consumer
+ */
+int DPS_MpscQueuePushAll(DPS_MpscQueue* queue, DPS_Queue* items);
+
+/**
+ * Removes all items from the queue and pushes them onto the back of a
+ * generic queue in the order they were pushed. Only one thread may be
+ * draining the queue at a time.
+ *
+ * @param queue the queue
+ * @param items the generic queue the items are moved to
+ */
+void DPS_MpscQueueDrain(DPS_MpscQueue* queue, DPS_Queue* items);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,99 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+
+/*
+ * Items and the block header are aligned for any of the types the
+ * items may contain
+ */
+#define SLAB_ALIGN  16
+
+#define SLAB_ROUND_UP(n)  (((n) + (SLAB_ALIGN - 1)) & ~(size_t)(SLAB_ALIGN - 1))
+
+void DPS_SlabInit(DPS_Slab* slab, size_t itemSize, size_t itemsPerBlock)
+{
+    if (itemSize < sizeof(void*)) {
+        itemSize = sizeof(void*);
+    }
+    slab->itemSize = SLAB_ROUND_UP(itemSize);
+    slab->itemsPerBlock = itemsPerBlock ? itemsPerBlock : 1;
+    slab->freeItems = NULL;
+    slab->blocks = NULL;
+}
+
+static int SlabGrow(DPS_Slab* slab)
+{
+    uint8_t* block = malloc(SLAB_ROUND_UP(sizeof(void*)) + slab->itemsPerBlock * slab->itemSize);
+    uint8_t* item;
+    size_t i;
+
+    if (!block) {
+        return 0;
+    }
+    *(void**)block = slab->blocks;
+    slab->blocks = block;
+    /*
+     * Thread the items onto the free list in address order
+     */
+    item = block + SLAB_ROUND_UP(sizeof(void*)) + slab->itemsPerBlock * slab->itemSize;
+    for (i = 0; i < slab->itemsPerBlock; ++i) {
+        item -= slab->itemSize;
+        *(void**)item = slab->freeItems;
+        slab->freeItems = item;
+    }
+    return 1;
+}
+
+void* DPS_SlabAlloc(DPS_Slab* slab)
+{
+    void* item;
+
+    if (!slab->freeItems && !SlabGrow(slab)) {
+        return NULL;
+    }
+    item = slab->freeItems;
+    slab->freeItems = *(void**)item;
+    memset(item, 0, slab->itemSize);
+    return item;
+}
+
+void DPS_SlabFree(DPS_Slab* slab, void* item)
+{
+    if (item) {
+        *(void**)item = slab->freeItems;
+        slab->freeItems = item;
+    }
+}
+
+void DPS_SlabDestroy(DPS_Slab* slab)
+{
+    while (slab->blocks) {
+        void* block = slab->blocks;
+        slab->blocks = *(void**)block;
+        free(block);
+    }
+    slab->freeItems = NULL;
+}
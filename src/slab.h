@@ -0,0 +1,89 @@
+/**
+ * @file
+ * Fixed size item allocator
+ */
+
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#ifndef _DPS_SLAB_H
+#define _DPS_SLAB_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocates items of a fixed size from blocks of memory that are
+ * only released when the slab is destroyed. Freed items are reused by
+ * later allocations.
+ *
+ * A slab is not thread safe, the caller must serialize access.
+ */
+typedef struct _DPS_Slab {
+    size_t itemSize;            /**< Size of an item rounded up for alignment */
+    size_t itemsPerBlock;       /**< Number of items in each block */
+    void* freeItems;            /**< Free items linked through their first word */
+    void* blocks;               /**< Allocated blocks linked through their first word */
+} DPS_Slab;
+
+/**
+ * Initialize a slab
+ *
+ * @param slab           The slab
+ * @param itemSize       The size of an item
+ * @param itemsPerBlock  The number of items to allocate at a time
+ */
+void DPS_SlabInit(DPS_Slab* slab, size_t itemSize, size_t itemsPerBlock);
+
+/**
+ * Allocate a zero filled item
+ *
+ * @param slab  The slab
+ *
+ * @return The item or NULL if a block could not be allocated
+ */
+void* DPS_SlabAlloc(DPS_Slab* slab);
+
+/**
+ * Return an item to the slab
+ *
+ * @param slab  The slab
+ * @param item  The item, may be NULL
+ */
+void DPS_SlabFree(DPS_Slab* slab, void* item);
+
+/**
+ * Release the memory of all blocks. Items allocated from the slab
+ * must not be used after this is called.
+ *
+ * @param slab  The slab
+ */
+void DPS_SlabDestroy(DPS_Slab* slab);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -67,6 +67,7 @@ DPS_DEBUG_CONTROL(DPS_DEBUG_ON);
 #define DPS_SUB_FLAG_UNLINK_IND  0x04      /* Indicates remote is unlinking */
 #define DPS_SUB_FLAG_MUTE_IND    0x08      /* Indicates link has been muted */
 #define DPS_SUB_FLAG_UNMUTE_REQ  0x10      /* Remote is requesting to unmute */
+#define DPS_SUB_FLAG_REJECT_IND  0x20      /* Indicates the subscription was refused */
 
 static int IsValidSub(const DPS_Subscription* sub)
 {
@@ -130,6 +131,7 @@ DPS_Subscription* DPS_FreeSubscription(DPS_Subscription* sub)
     }
     DPS_BitVectorFree(sub->bf);
     DPS_BitVectorFree(sub->needs);
+    free(sub->topicEntries);
     while (sub->numTopics) {
         free(sub->topics[--sub->numTopics]);
     }
@@ -137,6 +139,69 @@ DPS_Subscription* DPS_FreeSubscription(DPS_Subscription* sub)
     return next;
 }
 
+static void RemoveTopics(DPS_Node* node, DPS_Subscription* sub)
+{
+    size_t i;
+
+    if (sub->topicEntries) {
+        for (i = 0; i < sub->numTopics; ++i) {
+            DPS_TopicTrieRemove(node->topicTrie, sub->topicEntries[i]);
+            sub->topicEntries[i] = NULL;
+        }
+    }
+}
+
+static DPS_Status InsertTopics(DPS_Node* node, DPS_Subscription* sub)
+{
+    DPS_Status ret = DPS_OK;
+    size_t i;
+
+    if (!node->topicTrie) {
+        node->topicTrie = DPS_TopicTrieAlloc(node->separators);
+        if (!node->topicTrie) {
+            return DPS_ERR_RESOURCES;
+        }
+    }
+    sub->topicEntries = calloc(sub->numTopics, sizeof(DPS_TopicTrieEntry*));
+    if (!sub->topicEntries) {
+        return DPS_ERR_RESOURCES;
+    }
+    for (i = 0; i < sub->numTopics; ++i) {
+        ret = DPS_TopicTrieInsert(node->topicTrie, sub->topics[i], sub, &sub->topicEntries[i]);
+        if (ret != DPS_OK) {
+            RemoveTopics(node, sub);
+            break;
+        }
+    }
+    return ret;
+}
+
+static void OnTopicMatch(void* data, uint32_t generation)
+{
+    DPS_Subscription* sub = data;
+
+    if (sub->matchGeneration != generation) {
+        sub->matchGeneration = generation;
+        sub->numMatched = 0;
+    }
+    ++sub->numMatched;
+}
+
+DPS_Status DPS_MatchSubscriptionTopics(DPS_Node* node, char* const* topics, size_t numTopics,
+                                       uint32_t* generation)
+{
+    if (!node->topicTrie) {
+        *generation = 0;
+        return DPS_OK;
+    }
+    return DPS_TopicTrieMatch(node->topicTrie, topics, numTopics, OnTopicMatch, generation);
+}
+
+int DPS_SubscriptionTopicsMatched(const DPS_Subscription* sub, uint32_t generation)
+{
+    return generation && (sub->matchGeneration == generation) && (sub->numMatched == sub->numTopics);
+}
+
 static DPS_Subscription* FreeSubscription(DPS_Subscription* sub)
 {
     DPS_Node* node = sub->node;
@@ -164,6 +229,8 @@ static DPS_Subscription* FreeSubscription(DPS_Subscription* sub)
          * This removes this subscription's contributions to the interests and needs
          */
         if (unlinked) {
+            DPS_UnindexSubscription(node, sub);
+            RemoveTopics(node, sub);
             if (DPS_CountVectorDel(node->interests, sub->bf) != DPS_OK) {
                 assert(!"Count error");
             }
@@ -203,6 +270,214 @@ void DPS_FreeSubscriptions(DPS_Node* node)
     }
 }
 
+static void FreeIndex(SubscriptionIndex* index)
+{
+    free(index->buckets);
+    free(index->counts);
+    index->buckets = NULL;
+    index->counts = NULL;
+    index->len = 0;
+    index->unkeyed = NULL;
+}
+
+static DPS_Status IndexSubscription(SubscriptionIndex* index, DPS_Subscription* sub)
+{
+    size_t len = DPS_BitVectorLen(sub->bf);
+    size_t bit;
+
+    if (!index->buckets) {
+        index->buckets = calloc(len, sizeof(DPS_Subscription*));
+        index->counts = calloc(len, sizeof(uint32_t));
+        if (!index->buckets || !index->counts) {
+            FreeIndex(index);
+            return DPS_ERR_RESOURCES;
+        }
+        index->len = len;
+    }
+    assert(index->len == len);
+    /*
+     * Key the subscription on the bit with the fewest subscriptions
+     * to keep the buckets short
+     */
+    sub->indexKey = len;
+    for (bit = DPS_BitVectorNextSetBit(sub->bf, 0); bit < len; bit = DPS_BitVectorNextSetBit(sub->bf, bit + 1)) {
+        if ((sub->indexKey == len) || (index->counts[bit] < index->counts[sub->indexKey])) {
+            sub->indexKey = bit;
+            if (index->counts[bit] == 0) {
+                break;
+            }
+        }
+    }
+    sub->indexSequence = ++index->sequence;
+    if (sub->indexKey == len) {
+        sub->nextInIndex = index->unkeyed;
+        index->unkeyed = sub;
+    } else {
+        sub->nextInIndex = index->buckets[sub->indexKey];
+        index->buckets[sub->indexKey] = sub;
+        ++index->counts[sub->indexKey];
+    }
+    return DPS_OK;
+}
+
+DPS_Status DPS_IndexSubscription(DPS_Node* node, DPS_Subscription* sub)
+{
+    DPS_Status ret;
+
+    uv_rwlock_wrlock(&node->subIndex.lock);
+    ret = IndexSubscription(&node->subIndex, sub);
+    uv_rwlock_wrunlock(&node->subIndex.lock);
+    return ret;
+}
+
+void DPS_UnindexSubscription(DPS_Node* node, DPS_Subscription* sub)
+{
+    SubscriptionIndex* index = &node->subIndex;
+    DPS_Subscription** link;
+
+    uv_rwlock_wrlock(&index->lock);
+    if (!index->buckets) {
+        uv_rwlock_wrunlock(&index->lock);
+        return;
+    }
+    if (sub->indexKey < index->len) {
+        link = &index->buckets[sub->indexKey];
+    } else {
+        link = &index->unkeyed;
+    }
+    while (*link && (*link != sub)) {
+        link = &(*link)->nextInIndex;
+    }
+    if (*link) {
+        *link = sub->nextInIndex;
+        sub->nextInIndex = NULL;
+        if (sub->indexKey < index->len) {
+            assert(index->counts[sub->indexKey] > 0);
+            --index->counts[sub->indexKey];
+        }
+    }
+    uv_rwlock_wrunlock(&index->lock);
+}
+
+void DPS_FreeSubscriptionIndex(DPS_Node* node)
+{
+    uv_rwlock_wrlock(&node->subIndex.lock);
+    FreeIndex(&node->subIndex);
+    uv_rwlock_wrunlock(&node->subIndex.lock);
+}
+
+static DPS_Status AddCandidates(DPS_Subscription* sub, DPS_BitVector* bf,
+                                DPS_Subscription*** candidates, size_t* num, size_t* max)
+{
+    for (; sub; sub = sub->nextInIndex) {
+        if (!DPS_BitVectorIncludes(bf, sub->bf)) {
+            continue;
+        }
+        if (*num == *max) {
+            size_t newMax = *max ? 2 * *max : 8;
+            DPS_Subscription** newCandidates = realloc(*candidates, newMax * sizeof(DPS_Subscription*));
+            if (!newCandidates) {
+                return DPS_ERR_RESOURCES;
+            }
+            *candidates = newCandidates;
+            *max = newMax;
+        }
+        DPS_SubscriptionIncRef(sub);
+        (*candidates)[(*num)++] = sub;
+    }
+    return DPS_OK;
+}
+
+static int CompareIndexSequence(const void* a, const void* b)
+{
+    const DPS_Subscription* subA = *(const DPS_Subscription**)a;
+    const DPS_Subscription* subB = *(const DPS_Subscription**)b;
+    int32_t diff = (int32_t)(subB->indexSequence - subA->indexSequence);
+
+    /*
+     * Most recent first, the same order as the subscription list
+     */
+    return (diff > 0) - (diff < 0);
+}
+
+DPS_Status DPS_GetSubscriptionCandidates(DPS_Node* node, DPS_BitVector* bf,
+                                         DPS_Subscription*** candidates, size_t* numCandidates)
+{
+    SubscriptionIndex* index = &node->subIndex;
+    DPS_Status ret = DPS_OK;
+    size_t max = 0;
+    size_t bit;
+
+    *candidates = NULL;
+    *numCandidates = 0;
+    if (!index->buckets) {
+        return DPS_OK;
+    }
+    assert(index->len == DPS_BitVectorLen(bf));
+    for (bit = DPS_BitVectorNextSetBit(bf, 0); bit < index->len; bit = DPS_BitVectorNextSetBit(bf, bit + 1)) {
+        ret = AddCandidates(index->buckets[bit], bf, candidates, numCandidates, &max);
+        if (ret != DPS_OK) {
+            goto ErrExit;
+        }
+    }
+    ret = AddCandidates(index->unkeyed, bf, candidates, numCandidates, &max);
+    if (ret != DPS_OK) {
+        goto ErrExit;
+    }
+    if (*numCandidates > 1) {
+        qsort(*candidates, *numCandidates, sizeof(DPS_Subscription*), CompareIndexSequence);
+    }
+    return DPS_OK;
+
+ErrExit:
+    while (*numCandidates) {
+        DPS_SubscriptionDecRef((*candidates)[--(*numCandidates)]);
+    }
+    free(*candidates);
+    *candidates = NULL;
+    return ret;
+}
+
+static int HasCandidate(SubscriptionIndex* index, DPS_BitVector* bf)
+{
+    DPS_Subscription* sub;
+    size_t bit;
+
+    if (!index->buckets) {
+        return DPS_FALSE;
+    }
+    assert(index->len == DPS_BitVectorLen(bf));
+    for (bit = DPS_BitVectorNextSetBit(bf, 0); bit < index->len; bit = DPS_BitVectorNextSetBit(bf, bit + 1)) {
+        for (sub = index->buckets[bit]; sub; sub = sub->nextInIndex) {
+            if (DPS_BitVectorIncludes(bf, sub->bf)) {
+                return DPS_TRUE;
+            }
+        }
+    }
+    for (sub = index->unkeyed; sub; sub = sub->nextInIndex) {
+        if (DPS_BitVectorIncludes(bf, sub->bf)) {
+            return DPS_TRUE;
+        }
+    }
+    return DPS_FALSE;
+}
+
+int DPS_HasSubscriptionCandidate(DPS_Node* node, DPS_BitVector* bf)
+{
+    return HasCandidate(&node->subIndex, bf);
+}
+
+int DPS_CheckSubscriptionCandidate(DPS_Node* node, DPS_BitVector* bf, uint32_t* sequence)
+{
+    int candidate;
+
+    uv_rwlock_rdlock(&node->subIndex.lock);
+    candidate = HasCandidate(&node->subIndex, bf);
+    *sequence = node->subIndex.sequence;
+    uv_rwlock_rdunlock(&node->subIndex.lock);
+    return candidate;
+}
+
 DPS_Subscription* DPS_CreateSubscription(DPS_Node* node, const char** topics, size_t numTopics)
 {
     size_t i;
@@ -227,6 +502,7 @@ DPS_Subscription* DPS_CreateSubscription(DPS_Node* node, const char** topics, si
     }
     sub->node = node;
     sub->flags |= SUB_FLAG_SERIALIZE;
+    DPS_ExecutorStrandInit(&sub->strand);
     return sub;
 }
 
@@ -266,6 +542,7 @@ DPS_Status DPS_SendSubscription(DPS_Node* node, RemoteNode* remote)
     size_t len;
     uint8_t flags = DPS_SUB_FLAG_SAK_REQ;
     uint8_t numMapEntries = remote->state == REMOTE_UNLINKING ? 4 : 6;
+    uint8_t bloomHash = (uint8_t)DPS_GetBloomHash();
 
     DPS_DBGTRACEA("To %s rev# %d %s\n", DESCRIBE(remote), remote->outbound.revision, RemoteStateTxt(remote));
 
@@ -287,6 +564,13 @@ DPS_Status DPS_SendSubscription(DPS_Node* node, RemoteNode* remote)
            CBOR_SIZEOF(uint32_t) +              /* seq_num */
            CBOR_SIZEOF_BYTES(sizeof(DPS_UUID)); /* mesh id */
 
+    /*
+     * The Bloom filter hash is only sent if it is not the default
+     */
+    if (bloomHash != DPS_BloomHashSha2) {
+        ++numMapEntries;
+        len += CBOR_SIZEOF(uint8_t) + CBOR_SIZEOF(uint8_t);
+    }
     switch (node->addr.type) {
     case DPS_DTLS:
     case DPS_TCP:
@@ -400,6 +684,14 @@ DPS_Status DPS_SendSubscription(DPS_Node* node, RemoteNode* remote)
     default:
         break;
     }
+    if (bloomHash != DPS_BloomHashSha2) {
+        if (ret == DPS_OK) {
+            ret = CBOR_EncodeUint8(&buf, DPS_CBOR_KEY_BLOOM_HASH);
+        }
+        if (ret == DPS_OK) {
+            ret = CBOR_EncodeUint8(&buf, bloomHash);
+        }
+    }
     /*
      * Encode the (empty) protected map
      */
@@ -446,13 +738,14 @@ DPS_Status DPS_SendSubscription(DPS_Node* node, RemoteNode* remote)
     return ret;
 }
 
-DPS_Status DPS_SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int collision)
+static DPS_Status SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int collision, int reject)
 {
     DPS_Status ret;
     DPS_TxBuffer buf;
     DPS_BitVector* interests;
     size_t len;
     uint8_t numMapEntries = 5;
+    uint8_t bloomHash = (uint8_t)DPS_GetBloomHash();
     uint8_t flags = 0;
 
     DPS_DBGTRACEA("To %s %s rev# %d ack-rev# %d%s\n", DESCRIBE(remote), RemoteStateTxt(remote),
@@ -473,6 +766,9 @@ DPS_Status DPS_SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int colli
     if (remote->state == REMOTE_MUTED) {
         flags |= DPS_SUB_FLAG_MUTE_IND;
     }
+    if (reject) {
+        flags |= DPS_SUB_FLAG_REJECT_IND;
+    }
     /*
      * As soon as we send the SAK we are unmuted
      */
@@ -497,6 +793,13 @@ DPS_Status DPS_SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int colli
         CBOR_SIZEOF(uint32_t) +              /* ack_seq_num */
         CBOR_SIZEOF_BYTES(sizeof(DPS_UUID)); /* mesh id */
 
+    /*
+     * The Bloom filter hash is only sent if it is not the default
+     */
+    if (bloomHash != DPS_BloomHashSha2) {
+        ++numMapEntries;
+        len += CBOR_SIZEOF(uint8_t) + CBOR_SIZEOF(uint8_t);
+    }
     switch (node->addr.type) {
     case DPS_DTLS:
     case DPS_TCP:
@@ -604,6 +907,14 @@ DPS_Status DPS_SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int colli
     default:
         break;
     }
+    if (bloomHash != DPS_BloomHashSha2) {
+        if (ret == DPS_OK) {
+            ret = CBOR_EncodeUint8(&buf, DPS_CBOR_KEY_BLOOM_HASH);
+        }
+        if (ret == DPS_OK) {
+            ret = CBOR_EncodeUint8(&buf, bloomHash);
+        }
+    }
     /*
      * Encode the (empty) protected map
      */
@@ -654,6 +965,11 @@ DPS_Status DPS_SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int colli
     return ret;
 }
 
+DPS_Status DPS_SendSubscriptionAck(DPS_Node* node, RemoteNode* remote, int collision)
+{
+    return SendSubscriptionAck(node, remote, collision, DPS_FALSE);
+}
+
 /*
  * Update the interests for a remote node
  */
@@ -706,6 +1022,51 @@ static DPS_Status UnlinkRemote(DPS_Node* node, DPS_NodeAddress* addr, uint32_t r
     }
 }
 
+/*
+ * The interests in a SUB cannot be used if they were computed with a
+ * different Bloom filter hash. Rather than dropping the SUB, which
+ * would cause the remote to keep resending it, a SAK is sent back
+ * telling the remote the subscription was refused.
+ */
+static DPS_Status RejectSubscription(DPS_Node* node, DPS_NetEndpoint* ep, uint32_t revision)
+{
+    RemoteNode* remote;
+    DPS_Status ret;
+
+    DPS_DBGPRINT("Rejecting subscription from %s\n", DPS_NodeAddrToString(&ep->addr));
+    ret = DPS_AddRemoteNode(node, &ep->addr, ep->cn, &remote);
+    if ((ret != DPS_OK) && (ret != DPS_ERR_EXISTS)) {
+        return ret;
+    }
+    remote->outbound.sendInterests = DPS_FALSE;
+    remote->inbound.revision = revision;
+    SendSubscriptionAck(node, remote, DPS_FALSE, DPS_TRUE);
+    /*
+     * Clear so delete doesn't report a surprise link loss.
+     */
+    remote->outbound.linkRequested = DPS_FALSE;
+    DPS_DeleteRemoteNode(node, remote);
+    /*
+     * Evaluate impact of losing the remote's interests
+     */
+    DPS_UpdateSubs(node, SubsSendNow);
+    return DPS_OK;
+}
+
+/*
+ * Called when the remote refused our subscription, this fails the link
+ */
+static void SubscriptionRejected(DPS_Node* node, RemoteNode* remote)
+{
+    DPS_ERRPRINT("Subscription refused by %s, Bloom filter hash does not match\n", DESCRIBE(remote));
+    if (remote->completion) {
+        DPS_RemoteCompletion(remote->completion, DPS_ERR_INCOMPATIBLE);
+    } else {
+        DPS_DeleteRemoteNode(node, remote);
+    }
+    DPS_UpdateSubs(node, SubsSendNow);
+}
+
 /*
  * Each node has a randomly allocated mesh id that is used to detect loops in the mesh.
  *
@@ -744,7 +1105,8 @@ static DPS_Status DecodeSubscription(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Ne
     /* All subscription messages require these keys */
     static const int32_t ReqKeys[] = { DPS_CBOR_KEY_SEQ_NUM, DPS_CBOR_KEY_SUB_FLAGS, DPS_CBOR_KEY_MESH_ID };
     /* These keys are optional depending on message specifics */
-    static const int32_t OptKeys[] = { DPS_CBOR_KEY_PORT, DPS_CBOR_KEY_NEEDS, DPS_CBOR_KEY_INTERESTS, DPS_CBOR_KEY_ACK_SEQ_NUM, DPS_CBOR_KEY_PATH };
+    static const int32_t OptKeys[] = { DPS_CBOR_KEY_PORT, DPS_CBOR_KEY_NEEDS, DPS_CBOR_KEY_INTERESTS, DPS_CBOR_KEY_ACK_SEQ_NUM, DPS_CBOR_KEY_PATH,
+                                       DPS_CBOR_KEY_BLOOM_HASH };
     /* These keys are required for full subscriptions */
     static const int32_t OptKeysMask = (1 << DPS_CBOR_KEY_NEEDS) | (1 << DPS_CBOR_KEY_INTERESTS);
     DPS_RxBuffer* rxBuf = (DPS_RxBuffer*)buf;
@@ -762,6 +1124,7 @@ static DPS_Status DecodeSubscription(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Ne
     int collision = DPS_FALSE;
     char* path = NULL;
     size_t pathLen = 0;
+    uint8_t bloomHash = DPS_BloomHashSha2;
 
     CBOR_Dump("SUB in", rxBuf->rxPos, DPS_RxBufferAvail(rxBuf));
     /*
@@ -834,6 +1197,9 @@ static DPS_Status DecodeSubscription(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Ne
                 ret = DPS_ERR_INVALID;
             }
             break;
+        case DPS_CBOR_KEY_BLOOM_HASH:
+            ret = CBOR_DecodeUint8(rxBuf, &bloomHash);
+            break;
         }
         if (ret != DPS_OK) {
             break;
@@ -875,6 +1241,10 @@ static DPS_Status DecodeSubscription(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Ne
         if (!remote) {
             DPS_WARNPRINT("Got SAK from unknown remote %s\n", DPS_NodeAddrToString(&ep->addr));
             ret = DPS_ERR_MISSING;
+        } else if ((flags & DPS_SUB_FLAG_REJECT_IND) || (bloomHash != DPS_GetBloomHash())) {
+            SubscriptionRejected(node, remote);
+            remote = NULL;
+            ret = DPS_ERR_INCOMPATIBLE;
         }
     } else {
         DPS_DBGPRINT("SUB inbound interests[%d] from %s: %s%s\n", revision,
@@ -884,6 +1254,15 @@ static DPS_Status DecodeSubscription(DPS_Node* node, DPS_NetEndpoint* ep, DPS_Ne
             ret = UnlinkRemote(node, &ep->addr, revision);
             goto DiscardAndExit;
         }
+        if (bloomHash != DPS_GetBloomHash()) {
+            DPS_WARNPRINT("Bloom filter hash %d from %s does not match %d\n", bloomHash,
+                          DPS_NodeAddrToString(&ep->addr), DPS_GetBloomHash());
+            ret = RejectSubscription(node, ep, revision);
+            if (ret == DPS_OK) {
+                ret = DPS_ERR_INCOMPATIBLE;
+            }
+            goto DiscardAndExit;
+        }
         ret = DPS_AddRemoteNode(node, &ep->addr, ep->cn, &remote);
         if (ret == DPS_ERR_EXISTS) {
             if (remote->outbound.sakPending) {
@@ -1119,6 +1498,17 @@ DPS_Status DPS_Subscribe(DPS_Subscription* sub, DPS_PublicationHandler handler)
      * Protect the node while we update it
      */
     DPS_LockNode(node);
+    ret = InsertTopics(node, sub);
+    if (ret == DPS_OK) {
+        ret = DPS_IndexSubscription(node, sub);
+        if (ret != DPS_OK) {
+            RemoveTopics(node, sub);
+        }
+    }
+    if (ret != DPS_OK) {
+        DPS_UnlockNode(node);
+        return ret;
+    }
     sub->next = node->subscriptions;
     node->subscriptions = sub;
     ret = DPS_CountVectorAdd(node->interests, sub->bf);
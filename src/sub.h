@@ -69,6 +69,13 @@ typedef struct _DPS_Subscription {
     uint8_t flags;                  /**< Internal state flags */
     DPS_OnSubscriptionDestroyed onDestroyed; /**< Optional on destroyed callback */
     DPS_Subscription* next; /**< Next subscription in list */
+    DPS_Subscription* nextInIndex; /**< Next subscription in the same index bucket */
+    size_t indexKey;        /**< Index bucket this subscription is keyed on */
+    uint32_t indexSequence; /**< Order the subscription was added to the index */
+    DPS_TopicTrieEntry** topicEntries; /**< Entries for the topics in the node's topic trie */
+    uint32_t matchGeneration; /**< Generation of the last topic trie match */
+    size_t numMatched;      /**< Number of topics matched in the last topic trie match */
+    DPS_ExecutorStrand strand; /**< Orders the calls to the handler when handlers are run on worker threads */
     size_t numTopics;       /**< Number of subscription topics */
     char* topics[1];        /**< Subscription topics */
 } DPS_Subscription;
@@ -105,6 +112,103 @@ void DPS_SubscriptionIncRef(DPS_Subscription* sub);
  */
 void DPS_SubscriptionDecRef(DPS_Subscription* sub);
 
+/**
+ * Add a subscription to the node's subscription index
+ *
+ * @param node The node
+ * @param sub  The subscription, the bloom filter must already be computed
+ *
+ * @return DPS_OK if successful, an error otherwise
+ */
+DPS_Status DPS_IndexSubscription(DPS_Node* node, DPS_Subscription* sub);
+
+/**
+ * Remove a subscription from the node's subscription index
+ *
+ * @param node The node
+ * @param sub  The subscription
+ */
+void DPS_UnindexSubscription(DPS_Node* node, DPS_Subscription* sub);
+
+/**
+ * Free the node's subscription index
+ *
+ * @param node The node
+ */
+void DPS_FreeSubscriptionIndex(DPS_Node* node);
+
+/**
+ * Get the local subscriptions that are candidates for matching a
+ * publication. A candidate's bloom filter is included in the
+ * publication bloom filter, the topics must still be matched.
+ *
+ * The candidates are returned in the same order as the node's
+ * subscription list, each candidate has had its ref count
+ * incremented.
+ *
+ * @param node           The node
+ * @param bf             The publication bloom filter
+ * @param candidates     Returns an array of candidates that must be
+ *                       freed by the caller
+ * @param numCandidates  Returns the number of candidates
+ *
+ * @return DPS_OK if successful, an error otherwise
+ */
+DPS_Status DPS_GetSubscriptionCandidates(DPS_Node* node, DPS_BitVector* bf,
+                                         DPS_Subscription*** candidates, size_t* numCandidates);
+
+/**
+ * Check if there is any local subscription that is a candidate for
+ * matching a publication.
+ *
+ * @param node The node
+ * @param bf   The publication bloom filter
+ *
+ * @return DPS_TRUE if there is a candidate, DPS_FALSE otherwise
+ */
+int DPS_HasSubscriptionCandidate(DPS_Node* node, DPS_BitVector* bf);
+
+/**
+ * Check if there is any local subscription that is a candidate for
+ * matching a publication without holding the node lock.
+ *
+ * This may be called from any thread while the node is running.
+ *
+ * @param node      The node
+ * @param bf        The publication bloom filter
+ * @param sequence  Returns the sequence number of the last subscription
+ *                  indexed, if it has not changed when the result is
+ *                  used then no candidates have been added since
+ *
+ * @return DPS_TRUE if there is a candidate, DPS_FALSE otherwise
+ */
+int DPS_CheckSubscriptionCandidate(DPS_Node* node, DPS_BitVector* bf, uint32_t* sequence);
+
+/**
+ * Match publication topics against the topics of all local
+ * subscriptions using the node's topic trie.
+ *
+ * @param node        The node
+ * @param topics      The publication topics
+ * @param numTopics   The number of publication topics
+ * @param generation  Returns the generation of the match for passing to
+ *                    DPS_SubscriptionTopicsMatched()
+ *
+ * @return DPS_OK if successful, an error otherwise
+ */
+DPS_Status DPS_MatchSubscriptionTopics(DPS_Node* node, char* const* topics, size_t numTopics,
+                                       uint32_t* generation);
+
+/**
+ * Check if all the topics of a subscription were matched
+ *
+ * @param sub         The subscription
+ * @param generation  The generation returned from DPS_MatchSubscriptionTopics()
+ *
+ * @return DPS_TRUE if the subscription matched, DPS_FALSE otherwise
+ */
+int DPS_SubscriptionTopicsMatched(const DPS_Subscription* sub, uint32_t generation);
+
 /**
  * Send a subscription (SUB) to a remote node
  *
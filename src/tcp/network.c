@@ -228,7 +228,7 @@ static void OnData(uv_stream_t* socket, ssize_t nread, const uv_buf_t* buf)
         DPS_RxBufferInit(&lenBuf, cn->lenBuf, cn->readLen);
         ret = CBOR_DecodeUint32(&lenBuf, &msgLen);
         if (ret == DPS_OK) {
-            cn->msgBuf = DPS_CreateNetRxBuffer(msgLen);
+            cn->msgBuf = DPS_CreatePooledNetRxBuffer(cn->node->rxPool, msgLen);
             if (cn->msgBuf) {
                 /*
                  * Copy message bytes if any
@@ -439,6 +439,11 @@ DPS_NodeAddress* DPS_NetGetListenAddress(DPS_NodeAddress* addr, DPS_NetContext*
     return addr;
 }
 
+void DPS_NetGetReceiveThreadStats(DPS_NetContext* netCtx, DPS_ReceiveThreadStats* stats)
+{
+    memzero_s(stats, sizeof(DPS_ReceiveThreadStats));
+}
+
 void DPS_NetStop(DPS_NetContext* netCtx)
 {
     if (netCtx) {
@@ -612,6 +617,24 @@ ErrExit:
     return DPS_ERR_NETWORK;
 }
 
+DPS_Status DPS_NetSendMany(DPS_Node* node, void* appCtx, DPS_NetEndpoint** eps, size_t numEps,
+                           uv_buf_t* bufs, size_t numBufs, DPS_NetSendComplete sendCompleteCB)
+{
+    DPS_Status ret;
+    size_t i;
+
+    /*
+     * Each endpoint has its own connection so the sends are made one at a time
+     */
+    for (i = 0; i < numEps; ++i) {
+        ret = DPS_NetSend(node, appCtx, eps[i], bufs, numBufs, sendCompleteCB);
+        if (ret != DPS_OK) {
+            sendCompleteCB(node, appCtx, eps[i], bufs, numBufs, ret);
+        }
+    }
+    return DPS_OK;
+}
+
 void DPS_NetConnectionIncRef(DPS_NetConnection* cn)
 {
     if (cn) {
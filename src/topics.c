@@ -291,6 +291,365 @@ DPS_Status DPS_MatchTopicList(char* const* pubs, size_t numPubs, char* const* su
     return ret;
 }
 
+/*
+ * A trie node is a topic prefix ending at a segment boundary. The
+ * key is the segment together with the separator that precedes it,
+ * wildcard segments are keyed in the same way so "+" and "/+" are
+ * both valid keys.
+ */
+typedef struct _TrieNode {
+    struct _TrieNode* parent;         /* Parent node or NULL for the root */
+    struct _TrieNode* next;           /* Next node in the hash chain */
+    DPS_TopicTrieEntry* entries;      /* Topics that end at this node */
+    size_t numChildren;               /* Number of child nodes */
+    size_t numWildcards;              /* Number of child nodes that are wildcards */
+    uint32_t hash;                    /* Hash of parent and key */
+    size_t keyLen;                    /* Length of the key */
+    char key[1];                      /* The key, not NUL terminated */
+} TrieNode;
+
+struct _DPS_TopicTrieEntry {
+    TrieNode* node;                   /* The node the topic ends at */
+    DPS_TopicTrieEntry* next;         /* Next entry for the same topic */
+    void* data;                       /* Data passed to the match handler */
+    uint32_t generation;              /* Last match the entry was reported in */
+};
+
+struct _DPS_TopicTrie {
+    char separators[13];              /* Topic separators */
+    TrieNode root;                    /* The root node, matches the empty prefix */
+    TrieNode** buckets;               /* Hash table of child nodes */
+    size_t numBuckets;                /* Number of buckets, a power of two */
+    size_t numNodes;                  /* Number of nodes in the hash table */
+    uint32_t generation;              /* Incremented on each match */
+    DPS_TopicTrieMatchHandler handler;/* Handler for the current match */
+};
+
+#define TRIE_MIN_BUCKETS 64
+
+static uint32_t TrieHash(const TrieNode* parent, const char* key, size_t keyLen)
+{
+    /*
+     * FNV-1a over the parent address and the key
+     */
+    uint32_t hash = 2166136261u;
+    uintptr_t p = (uintptr_t)parent;
+    size_t i;
+
+    for (i = 0; i < sizeof(p); ++i) {
+        hash = (hash ^ (uint8_t)(p >> (8 * i))) * 16777619u;
+    }
+    for (i = 0; i < keyLen; ++i) {
+        hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static TrieNode* TrieLookup(const DPS_TopicTrie* trie, const TrieNode* parent, const char* key, size_t keyLen)
+{
+    uint32_t hash;
+    TrieNode* node;
+
+    if (!parent->numChildren) {
+        return NULL;
+    }
+    hash = TrieHash(parent, key, keyLen);
+    for (node = trie->buckets[hash & (trie->numBuckets - 1)]; node; node = node->next) {
+        if (node->hash == hash && node->parent == parent && node->keyLen == keyLen &&
+            memcmp(node->key, key, keyLen) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static DPS_Status TrieGrow(DPS_TopicTrie* trie)
+{
+    size_t numBuckets = trie->numBuckets ? 2 * trie->numBuckets : TRIE_MIN_BUCKETS;
+    TrieNode** buckets = calloc(numBuckets, sizeof(TrieNode*));
+    size_t i;
+
+    if (!buckets) {
+        return DPS_ERR_RESOURCES;
+    }
+    for (i = 0; i < trie->numBuckets; ++i) {
+        while (trie->buckets[i]) {
+            TrieNode* node = trie->buckets[i];
+            trie->buckets[i] = node->next;
+            node->next = buckets[node->hash & (numBuckets - 1)];
+            buckets[node->hash & (numBuckets - 1)] = node;
+        }
+    }
+    free(trie->buckets);
+    trie->buckets = buckets;
+    trie->numBuckets = numBuckets;
+    return DPS_OK;
+}
+
+static int IsWildcardKey(const char* key, size_t keyLen)
+{
+    return ANY_WILDC(key[keyLen - 1]) && (keyLen == 1 || keyLen == 2);
+}
+
+static TrieNode* TrieAddChild(DPS_TopicTrie* trie, TrieNode* parent, const char* key, size_t keyLen)
+{
+    TrieNode* node = TrieLookup(trie, parent, key, keyLen);
+    size_t i;
+
+    if (node) {
+        return node;
+    }
+    if (trie->numNodes >= trie->numBuckets) {
+        if (TrieGrow(trie) != DPS_OK) {
+            return NULL;
+        }
+    }
+    node = calloc(1, sizeof(TrieNode) + keyLen);
+    if (!node) {
+        return NULL;
+    }
+    node->parent = parent;
+    node->hash = TrieHash(parent, key, keyLen);
+    node->keyLen = keyLen;
+    memcpy(node->key, key, keyLen);
+    i = node->hash & (trie->numBuckets - 1);
+    node->next = trie->buckets[i];
+    trie->buckets[i] = node;
+    ++trie->numNodes;
+    ++parent->numChildren;
+    if (IsWildcardKey(key, keyLen)) {
+        ++parent->numWildcards;
+    }
+    return node;
+}
+
+/*
+ * Remove nodes that no longer lead to any topics
+ */
+static void TriePrune(DPS_TopicTrie* trie, TrieNode* node)
+{
+    while (node != &trie->root && !node->entries && !node->numChildren) {
+        TrieNode* parent = node->parent;
+        TrieNode** link = &trie->buckets[node->hash & (trie->numBuckets - 1)];
+
+        while (*link != node) {
+            link = &(*link)->next;
+        }
+        *link = node->next;
+        --trie->numNodes;
+        --parent->numChildren;
+        if (IsWildcardKey(node->key, node->keyLen)) {
+            --parent->numWildcards;
+        }
+        free(node);
+        node = parent;
+    }
+}
+
+DPS_TopicTrie* DPS_TopicTrieAlloc(const char* separators)
+{
+    DPS_TopicTrie* trie;
+
+    if (!separators || !*separators) {
+        return NULL;
+    }
+    trie = calloc(1, sizeof(DPS_TopicTrie));
+    if (!trie) {
+        return NULL;
+    }
+    if (strncpy_s(trie->separators, sizeof(trie->separators), separators, sizeof(trie->separators) - 1) != EOK) {
+        free(trie);
+        return NULL;
+    }
+    return trie;
+}
+
+void DPS_TopicTrieFree(DPS_TopicTrie* trie)
+{
+    size_t i;
+
+    if (!trie) {
+        return;
+    }
+    for (i = 0; i < trie->numBuckets; ++i) {
+        while (trie->buckets[i]) {
+            TrieNode* node = trie->buckets[i];
+            trie->buckets[i] = node->next;
+            while (node->entries) {
+                DPS_TopicTrieEntry* entry = node->entries;
+                node->entries = entry->next;
+                free(entry);
+            }
+            free(node);
+        }
+    }
+    while (trie->root.entries) {
+        DPS_TopicTrieEntry* entry = trie->root.entries;
+        trie->root.entries = entry->next;
+        free(entry);
+    }
+    free(trie->buckets);
+    free(trie);
+}
+
+DPS_Status DPS_TopicTrieInsert(DPS_TopicTrie* trie, const char* topic, void* data, DPS_TopicTrieEntry** entry)
+{
+    DPS_Status ret;
+    TrieNode* node;
+    const char* key = topic;
+    const char* wc;
+    size_t tlen;
+
+    if (!trie || !topic || !entry) {
+        return DPS_ERR_NULL;
+    }
+    node = &trie->root;
+    tlen = strnlen_s(topic, DPS_MAX_TOPIC_STRLEN + 1);
+    if (tlen == 0 || tlen > DPS_MAX_TOPIC_STRLEN || strchr(trie->separators, topic[0])) {
+        return DPS_ERR_INVALID;
+    }
+    ret = CheckWildcarding(topic, trie->separators, DPS_SubTopic, &wc);
+    if (ret != DPS_OK) {
+        return ret;
+    }
+    *entry = calloc(1, sizeof(DPS_TopicTrieEntry));
+    if (!*entry) {
+        return DPS_ERR_RESOURCES;
+    }
+    /*
+     * The first key is the first segment, each following key is a
+     * separator and the segment after it
+     */
+    while (*key) {
+        const char* end = key + (key == topic ? 0 : 1);
+        TrieNode* child;
+
+        end += strcspn(end, trie->separators);
+        child = TrieAddChild(trie, node, key, end - key);
+        if (!child) {
+            TriePrune(trie, node);
+            free(*entry);
+            *entry = NULL;
+            return DPS_ERR_RESOURCES;
+        }
+        node = child;
+        key = end;
+    }
+    (*entry)->node = node;
+    (*entry)->data = data;
+    (*entry)->generation = trie->generation;
+    (*entry)->next = node->entries;
+    node->entries = *entry;
+    return DPS_OK;
+}
+
+void DPS_TopicTrieRemove(DPS_TopicTrie* trie, DPS_TopicTrieEntry* entry)
+{
+    DPS_TopicTrieEntry** link;
+
+    if (!trie || !entry) {
+        return;
+    }
+    for (link = &entry->node->entries; *link; link = &(*link)->next) {
+        if (*link == entry) {
+            *link = entry->next;
+            break;
+        }
+    }
+    TriePrune(trie, entry->node);
+    free(entry);
+}
+
+static void TrieReport(DPS_TopicTrie* trie, TrieNode* node)
+{
+    DPS_TopicTrieEntry* entry;
+
+    for (entry = node->entries; entry; entry = entry->next) {
+        if (entry->generation != trie->generation) {
+            entry->generation = trie->generation;
+            trie->handler(entry->data, trie->generation);
+        }
+    }
+}
+
+/*
+ * Match the remainder of a publication topic starting at the key
+ * beginning at tp. This follows the same rules as DPS_MatchTopicString().
+ */
+static void TrieMatch(DPS_TopicTrie* trie, TrieNode* node, const char* topic, const char* tp)
+{
+    const char* seg;
+    size_t segLen;
+    TrieNode* child;
+
+    if (!*tp) {
+        TrieReport(trie, node);
+        return;
+    }
+    seg = tp + (tp == topic ? 0 : 1);
+    segLen = strcspn(seg, trie->separators);
+    child = TrieLookup(trie, node, tp, seg + segLen - tp);
+    if (child) {
+        TrieMatch(trie, child, topic, seg + segLen);
+    }
+    if (node->numWildcards) {
+        char wc[2];
+        size_t len = seg - tp;
+
+        wc[0] = tp[0];
+        wc[len] = INFIX_WILDC;
+        child = TrieLookup(trie, node, wc, len + 1);
+        if (child) {
+            TrieMatch(trie, child, topic, seg + segLen);
+        }
+        /*
+         * A final wildcard matches one or more segments
+         */
+        if (segLen) {
+            wc[len] = FINAL_WILDC;
+            child = TrieLookup(trie, node, wc, len + 1);
+            if (child) {
+                TrieReport(trie, child);
+            }
+        }
+    }
+}
+
+DPS_Status DPS_TopicTrieMatch(DPS_TopicTrie* trie, char* const* pubs, size_t numPubs,
+                              DPS_TopicTrieMatchHandler handler, uint32_t* generation)
+{
+    DPS_Status ret;
+    const char* wc;
+    size_t i;
+
+    if (!trie || !pubs || !handler) {
+        return DPS_ERR_NULL;
+    }
+    if (++trie->generation == 0) {
+        ++trie->generation;
+    }
+    trie->handler = handler;
+    for (i = 0; i < numPubs; ++i) {
+        /*
+         * An invalid topic cannot match any subscription
+         */
+        if (!pubs[i] || !*pubs[i]) {
+            continue;
+        }
+        ret = CheckWildcarding(pubs[i], trie->separators, DPS_PubTopic, &wc);
+        if (ret != DPS_OK) {
+            DPS_ERRPRINT("Invalid use of wildcard in PUB topic string\n");
+            continue;
+        }
+        TrieMatch(trie, &trie->root, pubs[i], pubs[i]);
+    }
+    trie->handler = NULL;
+    if (generation) {
+        *generation = trie->generation;
+    }
+    return DPS_OK;
+}
+
 #ifdef DPS_DEBUG
 void DPS_DumpTopics(const char** topics, size_t numTopics)
 {
@@ -107,6 +107,82 @@ DPS_Status DPS_MatchTopicString(const char* pubTopic, const char* subTopic, cons
  */
 DPS_Status DPS_MatchTopicList(char* const* pubs, size_t numPubs, char* const* subs, size_t numSubs, const char* separators, int noWild, int* match);
 
+/**
+ * Opaque type for a trie of subscription topics.
+ *
+ * The topics are split into segments and shared prefixes are stored
+ * once so matching a publication walks each publication topic once
+ * instead of comparing it against every subscription topic.
+ */
+typedef struct _DPS_TopicTrie DPS_TopicTrie;
+
+/**
+ * Opaque type for a topic inserted in a trie
+ */
+typedef struct _DPS_TopicTrieEntry DPS_TopicTrieEntry;
+
+/**
+ * Function prototype for reporting a topic that matched a publication
+ *
+ * @param data        The data the topic was inserted with
+ * @param generation  The generation of the match, this is different for
+ *                    each call to DPS_TopicTrieMatch()
+ */
+typedef void (*DPS_TopicTrieMatchHandler)(void* data, uint32_t generation);
+
+/**
+ * Allocate an empty topic trie
+ *
+ * @param separators  The separator characters for the topics
+ *
+ * @return The trie or NULL if the allocation failed
+ */
+DPS_TopicTrie* DPS_TopicTrieAlloc(const char* separators);
+
+/**
+ * Free a topic trie and all topics inserted in it
+ *
+ * @param trie  The trie
+ */
+void DPS_TopicTrieFree(DPS_TopicTrie* trie);
+
+/**
+ * Insert a subscription topic in a trie. The same topic may be
+ * inserted more than once.
+ *
+ * @param trie   The trie
+ * @param topic  The subscription topic, this may include wildcards
+ * @param data   Data to pass to the match handler
+ * @param entry  Returns the inserted entry for removing the topic
+ *
+ * @return DPS_OK or an error
+ */
+DPS_Status DPS_TopicTrieInsert(DPS_TopicTrie* trie, const char* topic, void* data, DPS_TopicTrieEntry** entry);
+
+/**
+ * Remove a topic from a trie
+ *
+ * @param trie   The trie
+ * @param entry  The entry returned from DPS_TopicTrieInsert()
+ */
+void DPS_TopicTrieRemove(DPS_TopicTrie* trie, DPS_TopicTrieEntry* entry);
+
+/**
+ * Find the subscription topics that match any of the publication
+ * topics. The matching rules are the same as DPS_MatchTopicString().
+ * The handler is called once for each matching entry.
+ *
+ * @param trie        The trie
+ * @param pubs        The array of publication topics
+ * @param numPubs     Size of the pubs array
+ * @param handler     Function called for each matching entry
+ * @param generation  Optionally returns the generation passed to the handler
+ *
+ * @return DPS_OK or an error
+ */
+DPS_Status DPS_TopicTrieMatch(DPS_TopicTrie* trie, char* const* pubs, size_t numPubs,
+                              DPS_TopicTrieMatchHandler handler, uint32_t* generation);
+
 /**
  * Print out all topics 'A' to 'Z' that match the given bit vector.
  * This is useful for debugging DPS routing issues.
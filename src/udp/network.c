@@ -20,14 +20,27 @@
  *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* sendmmsg and recvmmsg */
+#endif
+
 #include <assert.h>
+#include <errno.h>
 #include <safe_lib.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dps/dbg.h>
 #include <dps/dps.h>
 #include <dps/private/network.h>
+#include "../compat.h"
 #include "../node.h"
+#include "../pub.h"
+#include "../slab.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#define DPS_HAVE_MMSG
+#endif
 
 /*
  * Debug control for this module
@@ -36,96 +49,658 @@ DPS_DEBUG_CONTROL(DPS_DEBUG_OFF);
 
 #define MAX_READ_LEN   65536
 
+/*
+ * Maximum number of datagrams waiting to be handed off from the
+ * receive threads to the node's thread
+ */
+#define MAX_RX_QUEUED  1024
+
+/*
+ * Maximum number of datagrams passed to a single sendmmsg call
+ */
+#define MAX_SENDMMSG  64
+
+/*
+ * Number of datagrams read by a single recvmmsg call, each one is
+ * read into its own MAX_READ_LEN slot of the socket's landing area
+ */
+#ifdef DPS_HAVE_MMSG
+#define RECV_BATCH    16
+#else
+#define RECV_BATCH    1
+#endif
+
+/*
+ * Maximum number of recvmmsg calls made each time the socket is
+ * readable so one socket cannot starve the loop
+ */
+#define MAX_RECV_BATCHES  4
+
+typedef struct _RxThread {
+    DPS_NetContext* netCtx;
+    uv_loop_t loop;
+    uv_udp_t rxSocket;
+    uint8_t* landing;               /* Datagrams are read here before being copied to a pooled buffer */
+    DPS_NetRxBufferCache rxCache;   /* Receive buffer cache of the receive thread */
+    uv_async_t stopAsync;
+    uv_thread_t thread;
+    uint32_t received;              /* Datagrams handed off to the node's thread, updated atomically */
+    uint32_t decoded;               /* Publications decoded before the hand off, updated atomically */
+    uint32_t dropped;               /* Stale publications dropped, updated atomically */
+} RxThread;
+
+typedef struct _RxData {
+    DPS_Queue queue;                /* Link in the network context rxQueue, must be first */
+    DPS_NetEndpoint ep;
+    DPS_NetRxBuffer* buf;
+    int decoded;                    /* TRUE if hdr was decoded on the receive thread */
+    DPS_PubHeader hdr;
+} RxData;
+
 struct _DPS_NetContext {
     uv_udp_t rxSocket;
+    uint8_t* landing;               /* Datagrams are read here before being copied to a pooled buffer */
     DPS_Node* node;
     DPS_OnReceive receiveCB;
+    int numHandles;                 /* Number of handles on the node's loop that are not closed */
+    uv_async_t rxAsync;             /* Signals the node's thread that data was received on a receive thread */
+    uv_mutex_t rxLock;              /* Protects rxQueue and numRxQueued */
+    DPS_Queue rxQueue;              /* Datagrams received on the receive threads */
+    DPS_Slab rxData;                /* RxData allocator, protected by rxLock */
+    size_t numRxQueued;
+    size_t numRxThreads;
+    RxThread* rxThreads;
+    uv_async_t txAsync;             /* Signals that sends made without a libuv request have completed */
+    DPS_Queue txDone;               /* Sends waiting for the send complete callbacks to be called */
 };
 
 static void AllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* uvBuf)
 {
-    DPS_NetRxBuffer* buf = DPS_CreateNetRxBuffer(suggestedSize);
-    if (buf) {
-        uvBuf->base = (char*)buf->rx.base;
-        uvBuf->len = DPS_RxBufferAvail(&buf->rx);
-    } else {
-        uvBuf->base = NULL;
-        uvBuf->len = 0;
-    }
+    DPS_NetContext* netCtx = (DPS_NetContext*)handle->data;
+    *uvBuf = uv_buf_init((char*)netCtx->landing, MAX_READ_LEN);
 }
 
-static void RxHandleClosed(uv_handle_t* handle)
+static void AllocThreadBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* uvBuf)
 {
-    DPS_DBGPRINT("Closed Rx handle %p\n", handle);
-    free(handle->data);
+    RxThread* rxThread = (RxThread*)handle->data;
+    *uvBuf = uv_buf_init((char*)rxThread->landing, MAX_READ_LEN);
 }
 
-static void OnData(uv_udp_t* socket, ssize_t nread, const uv_buf_t* uvBuf, const struct sockaddr* addr,
-                   unsigned flags)
+static void FreeNetContext(DPS_NetContext* netCtx)
 {
-    DPS_NetContext* netCtx = (DPS_NetContext*)socket->data;
-    DPS_NetRxBuffer* buf = NULL;
-    DPS_NetEndpoint ep;
+    DPS_SlabDestroy(&netCtx->rxData);
+    free(netCtx->landing);
+    free(netCtx->rxThreads);
+    free(netCtx);
+}
 
-    DPS_DBGTRACEA("socket=%p,nread=%d,uvBuf={base=%p,len=%d},addr=%p,flags=0x%x\n", socket, nread,
-                  uvBuf->base, uvBuf->len, addr, flags);
+static void RxHandleClosed(uv_handle_t* handle)
+{
+    DPS_NetContext* netCtx = (DPS_NetContext*)handle->data;
+
+    DPS_DBGPRINT("Closed Rx handle %p\n", handle);
+    if (--netCtx->numHandles == 0) {
+        FreeNetContext(netCtx);
+    }
+}
 
-    if (!uvBuf) {
+/*
+ * Returns DPS_TRUE if there is received data to pass to the receive
+ * callback
+ */
+static int IsRxData(ssize_t nread, const uv_buf_t* uvBuf, const struct sockaddr* addr, unsigned flags)
+{
+    if (!uvBuf || !uvBuf->base) {
         DPS_WARNPRINT("OnData no buffer\n");
-        goto Exit;
+        return DPS_FALSE;
     }
-    buf = DPS_UvToNetRxBuffer(uvBuf);
     if (nread < 0) {
         DPS_WARNPRINT("OnData error %s\n", uv_err_name((int)nread));
-        goto Exit;
+        return DPS_FALSE;
     }
-    buf->rx.eod = &buf->rx.base[nread];
     if (!nread) {
-        goto Exit;
+        return DPS_FALSE;
     }
     if (flags & UV_UDP_PARTIAL) {
         DPS_WARNPRINT("Dropping partial message, read buffer too small\n");
-        goto Exit;
+        return DPS_FALSE;
     }
     if (!addr) {
         DPS_WARNPRINT("OnData no address\n");
-        goto Exit;
+        return DPS_FALSE;
+    }
+    return DPS_TRUE;
+}
+
+/*
+ * Returns the data checked by IsRxData() copied to a buffer that fits
+ * it or NULL if there is no buffer
+ */
+static DPS_NetRxBuffer* GetRxBuffer(DPS_NetRxBufferPool* pool, ssize_t nread, const uv_buf_t* uvBuf,
+                                    const struct sockaddr* addr, DPS_NetEndpoint* ep)
+{
+    DPS_NetRxBuffer* buf = NULL;
+
+    buf = DPS_CreatePooledNetRxBuffer(pool, nread);
+    if (!buf) {
+        DPS_WARNPRINT("Dropping message, no receive buffer\n");
+        return NULL;
+    }
+    memcpy_s(buf->rx.base, nread, uvBuf->base, nread);
+    ep->cn = NULL;
+    DPS_NetSetAddr(&ep->addr, DPS_UDP, addr);
+    return buf;
+}
+
+#ifdef DPS_HAVE_MMSG
+/*
+ * Reads the datagrams waiting on a socket in batches and passes each
+ * one to the callback
+ */
+static void RecvBatch(uv_udp_t* socket, uint8_t* landing, uv_udp_recv_cb cb)
+{
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iovs[RECV_BATCH];
+    struct sockaddr_storage addrs[RECV_BATCH];
+    uv_os_fd_t fd;
+    uv_buf_t uvBuf;
+    size_t batch;
+    int ret;
+    int i;
+
+    if (uv_fileno((uv_handle_t*)socket, &fd)) {
+        return;
+    }
+    for (batch = 0; batch < MAX_RECV_BATCHES; ++batch) {
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < RECV_BATCH; ++i) {
+            iovs[i].iov_base = landing + i * MAX_READ_LEN;
+            iovs[i].iov_len = MAX_READ_LEN;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        do {
+            ret = recvmmsg(fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+        } while ((ret < 0) && (errno == EINTR));
+        if (ret <= 0) {
+            break;
+        }
+        for (i = 0; i < ret; ++i) {
+            unsigned flags = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? UV_UDP_PARTIAL : 0;
+            uvBuf = uv_buf_init((char*)iovs[i].iov_base, msgs[i].msg_len);
+            cb(socket, msgs[i].msg_len, &uvBuf, (const struct sockaddr*)&addrs[i], flags);
+        }
+        /*
+         * Stop when the socket is drained or was closed by a callback
+         */
+        if ((ret < RECV_BATCH) || uv_is_closing((uv_handle_t*)socket)) {
+            break;
+        }
+    }
+}
+#endif
+
+static void NodeData(uv_udp_t* socket, ssize_t nread, const uv_buf_t* uvBuf, const struct sockaddr* addr,
+                     unsigned flags)
+{
+    DPS_NetContext* netCtx = (DPS_NetContext*)socket->data;
+    DPS_NetRxBuffer* buf = NULL;
+    DPS_NetEndpoint ep;
+
+    if (!IsRxData(nread, uvBuf, addr, flags)) {
+        return;
+    }
+    buf = GetRxBuffer(netCtx->node->rxPool, nread, uvBuf, addr, &ep);
+    if (buf) {
+        netCtx->receiveCB(netCtx->node, &ep, DPS_OK, buf);
+        DPS_NetRxBufferDecRef(buf);
+    }
+}
+
+static void OnData(uv_udp_t* socket, ssize_t nread, const uv_buf_t* uvBuf, const struct sockaddr* addr,
+                   unsigned flags)
+{
+    DPS_NetContext* netCtx = (DPS_NetContext*)socket->data;
+
+    DPS_DBGTRACEA("socket=%p,nread=%d,uvBuf={base=%p,len=%d},addr=%p,flags=0x%x\n", socket, nread,
+                  uvBuf->base, uvBuf->len, addr, flags);
+
+    NodeData(socket, nread, uvBuf, addr, flags);
+#ifdef DPS_HAVE_MMSG
+    /*
+     * Read whatever else arrived with a single system call
+     */
+    if ((nread > 0) && !uv_is_closing((uv_handle_t*)socket)) {
+        RecvBatch(socket, netCtx->landing, NodeData);
+    }
+#endif
+}
+
+/*
+ * Called on a receive thread
+ */
+static void ThreadData(uv_udp_t* socket, ssize_t nread, const uv_buf_t* uvBuf, const struct sockaddr* addr,
+                       unsigned flags)
+{
+    RxThread* rxThread = (RxThread*)socket->data;
+    DPS_NetContext* netCtx = rxThread->netCtx;
+    DPS_NetRxBuffer* buf = NULL;
+    RxData* data = NULL;
+    DPS_NetEndpoint ep;
+    DPS_PubHeader hdr;
+    DPS_Status ret;
+
+    if (!IsRxData(nread, uvBuf, addr, flags)) {
+        return;
+    }
+    buf = GetRxBuffer(netCtx->node->rxPool, nread, uvBuf, addr, &ep);
+    if (!buf) {
+        return;
+    }
+    /*
+     * Decode publications as far as possible without the node lock
+     * so the node's thread is left with updating the node state.
+     * Duplicate publications are common in a mesh, drop them here
+     * rather than on the node's thread.
+     */
+    ret = DPS_PreDecodeRequest(netCtx->node, buf, &hdr);
+    if (ret == DPS_ERR_STALE) {
+        ATOMIC_INC_32(&rxThread->dropped);
+        DPS_NetRxBufferDecRef(buf);
+        return;
+    }
+    uv_mutex_lock(&netCtx->rxLock);
+    if (netCtx->numRxQueued < MAX_RX_QUEUED) {
+        data = DPS_SlabAlloc(&netCtx->rxData);
+    }
+    if (data) {
+        data->ep = ep;
+        data->buf = buf;
+        data->decoded = (ret == DPS_OK);
+        if (data->decoded) {
+            data->hdr = hdr;
+        }
+        DPS_QueuePushBack(&netCtx->rxQueue, &data->queue);
+        ++netCtx->numRxQueued;
+        buf = NULL;
+    }
+    uv_mutex_unlock(&netCtx->rxLock);
+    if (data) {
+        ATOMIC_INC_32(&rxThread->received);
+        if (ret == DPS_OK) {
+            ATOMIC_INC_32(&rxThread->decoded);
+        }
+        uv_async_send(&netCtx->rxAsync);
+    } else {
+        DPS_WARNPRINT("Dropping message, receive queue is full\n");
+        if (ret == DPS_OK) {
+            DPS_ReleasePubHeader(&hdr);
+        }
     }
-    ep.cn = NULL;
-    DPS_NetSetAddr(&ep.addr, DPS_UDP, addr);
-    netCtx->receiveCB(netCtx->node, &ep, DPS_OK, buf);
-Exit:
     DPS_NetRxBufferDecRef(buf);
 }
 
+/*
+ * Called on a receive thread
+ */
+static void OnThreadData(uv_udp_t* socket, ssize_t nread, const uv_buf_t* uvBuf, const struct sockaddr* addr,
+                         unsigned flags)
+{
+    RxThread* rxThread = (RxThread*)socket->data;
+
+    DPS_DBGTRACEA("socket=%p,nread=%d,uvBuf={base=%p,len=%d},addr=%p,flags=0x%x\n", socket, nread,
+                  uvBuf->base, uvBuf->len, addr, flags);
+
+    ThreadData(socket, nread, uvBuf, addr, flags);
+#ifdef DPS_HAVE_MMSG
+    if ((nread > 0) && !uv_is_closing((uv_handle_t*)socket)) {
+        RecvBatch(socket, rxThread->landing, ThreadData);
+    }
+#endif
+}
+
+/*
+ * Called on the node's thread to process the data received on the
+ * receive threads
+ */
+static void RxTask(uv_async_t* handle)
+{
+    DPS_NetContext* netCtx = (DPS_NetContext*)handle->data;
+    DPS_Queue rxQueue;
+    DPS_Queue done;
+
+    DPS_DBGTRACE();
+
+    DPS_QueueInit(&rxQueue);
+    DPS_QueueInit(&done);
+    uv_mutex_lock(&netCtx->rxLock);
+    while (!DPS_QueueEmpty(&netCtx->rxQueue)) {
+        RxData* data = (RxData*)DPS_QueueFront(&netCtx->rxQueue);
+        DPS_QueueRemove(&data->queue);
+        DPS_QueuePushBack(&rxQueue, &data->queue);
+    }
+    netCtx->numRxQueued = 0;
+    uv_mutex_unlock(&netCtx->rxLock);
+    while (!DPS_QueueEmpty(&rxQueue)) {
+        RxData* data = (RxData*)DPS_QueueFront(&rxQueue);
+        DPS_QueueRemove(&data->queue);
+        DPS_ReceiveDecodedRequest(netCtx->node, &data->ep, data->buf, data->decoded ? &data->hdr : NULL);
+        DPS_NetRxBufferDecRef(data->buf);
+        DPS_QueuePushBack(&done, &data->queue);
+    }
+    /*
+     * Return the processed data to the allocator with a single lock
+     */
+    uv_mutex_lock(&netCtx->rxLock);
+    while (!DPS_QueueEmpty(&done)) {
+        RxData* data = (RxData*)DPS_QueueFront(&done);
+        DPS_QueueRemove(&data->queue);
+        DPS_SlabFree(&netCtx->rxData, data);
+    }
+    uv_mutex_unlock(&netCtx->rxLock);
+}
+
+typedef struct _NetSendMany NetSendMany;
+
+typedef struct _SendTo {
+    NetSendMany* many;
+    DPS_NetEndpoint peerEp;
+    struct sockaddr_storage inaddr;
+    uv_udp_send_t sendReq;
+    int status;
+} SendTo;
+
+struct _NetSendMany {
+    DPS_Queue queue;                /* Link in the network context txDone queue, must be first */
+    DPS_Node* node;
+    void* appCtx;
+    DPS_NetSendComplete onSendComplete;
+    size_t pending;                 /* Number of sends that have not completed */
+    uv_buf_t* bufs;
+    size_t numBufs;
+    size_t numSends;
+    SendTo sends[1];
+};
+
+static void SendManyComplete(NetSendMany* many)
+{
+    size_t i;
+
+    for (i = 0; i < many->numSends; ++i) {
+        SendTo* send = &many->sends[i];
+        DPS_Status dpsRet = DPS_OK;
+        if (send->status) {
+            DPS_WARNPRINT("OnSendComplete status=%s\n", uv_err_name(send->status));
+            dpsRet = DPS_ERR_NETWORK;
+        }
+        many->onSendComplete(many->node, many->appCtx, &send->peerEp, many->bufs, many->numBufs, dpsRet);
+    }
+    free(many);
+}
+
+static void OnSendToComplete(uv_udp_send_t* req, int status)
+{
+    SendTo* send = (SendTo*)req->data;
+    NetSendMany* many = send->many;
+
+    send->status = status;
+    if (--many->pending == 0) {
+        SendManyComplete(many);
+    }
+}
+
+/*
+ * Called on the node's thread to call the send complete callbacks of
+ * the sends that did not need a libuv request
+ */
+static void TxTask(uv_async_t* handle)
+{
+    DPS_NetContext* netCtx = (DPS_NetContext*)handle->data;
+    DPS_Queue txDone;
+
+    DPS_DBGTRACE();
+
+    DPS_QueueInit(&txDone);
+    while (!DPS_QueueEmpty(&netCtx->txDone)) {
+        NetSendMany* many = (NetSendMany*)DPS_QueueFront(&netCtx->txDone);
+        DPS_QueueRemove(&many->queue);
+        DPS_QueuePushBack(&txDone, &many->queue);
+    }
+    while (!DPS_QueueEmpty(&txDone)) {
+        NetSendMany* many = (NetSendMany*)DPS_QueueFront(&txDone);
+        DPS_QueueRemove(&many->queue);
+        SendManyComplete(many);
+    }
+}
+
+static void TxHandleClosed(uv_handle_t* handle)
+{
+    /*
+     * The async callback will not be called once the handle is closed
+     */
+    TxTask((uv_async_t*)handle);
+    RxHandleClosed(handle);
+}
+
+static void RxThreadStop(uv_async_t* handle)
+{
+    RxThread* rxThread = (RxThread*)handle->data;
+
+    uv_udp_recv_stop(&rxThread->rxSocket);
+    uv_close((uv_handle_t*)&rxThread->rxSocket, NULL);
+    uv_close((uv_handle_t*)&rxThread->stopAsync, NULL);
+}
+
+static void RxThreadRun(void* arg)
+{
+    RxThread* rxThread = (RxThread*)arg;
+
+    DPS_AttachNetRxBufferCache(rxThread->netCtx->node->rxPool, &rxThread->rxCache);
+    uv_run(&rxThread->loop, UV_RUN_DEFAULT);
+    DPS_DetachNetRxBufferCache(&rxThread->rxCache);
+    if (uv_loop_close(&rxThread->loop)) {
+        DPS_ERRPRINT("Failed to close receive thread loop\n");
+    }
+}
+
+/*
+ * Allow the receive thread sockets to share the port, this must be
+ * called before the socket is bound
+ */
+static int SetReusePort(uv_udp_t* socket)
+{
+    int ret = UV_ENOTSUP;
+#ifdef SO_REUSEPORT
+    uv_os_fd_t fd;
+    int yes = 1;
+
+    ret = uv_fileno((uv_handle_t*)socket, &fd);
+    if (!ret && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes))) {
+        ret = uv_translate_sys_error(errno);
+    }
+#endif
+    return ret;
+}
+
+static void StopRxThreads(DPS_NetContext* netCtx)
+{
+    size_t i;
+
+    for (i = 0; i < netCtx->numRxThreads; ++i) {
+        RxThread* rxThread = &netCtx->rxThreads[i];
+        uv_async_send(&rxThread->stopAsync);
+        uv_thread_join(&rxThread->thread);
+        free(rxThread->landing);
+    }
+    netCtx->numRxThreads = 0;
+    /*
+     * The receive threads are gone so the lock is no longer needed to
+     * free the data that was not processed
+     */
+    while (!DPS_QueueEmpty(&netCtx->rxQueue)) {
+        RxData* data = (RxData*)DPS_QueueFront(&netCtx->rxQueue);
+        DPS_QueueRemove(&data->queue);
+        DPS_NetRxBufferDecRef(data->buf);
+        DPS_SlabFree(&netCtx->rxData, data);
+    }
+    netCtx->numRxQueued = 0;
+}
+
+static int StartRxThread(DPS_NetContext* netCtx, RxThread* rxThread, const struct sockaddr* sa)
+{
+    int ret;
+
+    rxThread->netCtx = netCtx;
+    rxThread->landing = malloc(RECV_BATCH * MAX_READ_LEN);
+    if (!rxThread->landing) {
+        return UV_ENOMEM;
+    }
+    ret = uv_loop_init(&rxThread->loop);
+    if (ret) {
+        free(rxThread->landing);
+        return ret;
+    }
+    rxThread->stopAsync.data = rxThread;
+    ret = uv_async_init(&rxThread->loop, &rxThread->stopAsync, RxThreadStop);
+    if (ret) {
+        goto ErrExit;
+    }
+    rxThread->rxSocket.data = rxThread;
+    ret = uv_udp_init_ex(&rxThread->loop, &rxThread->rxSocket, sa->sa_family);
+    if (ret) {
+        uv_close((uv_handle_t*)&rxThread->stopAsync, NULL);
+        goto ErrExit;
+    }
+    ret = SetReusePort(&rxThread->rxSocket);
+    if (!ret) {
+        ret = uv_udp_bind(&rxThread->rxSocket, sa, 0);
+    }
+    if (!ret) {
+        ret = uv_udp_recv_start(&rxThread->rxSocket, AllocThreadBuffer, OnThreadData);
+    }
+    if (ret) {
+        uv_close((uv_handle_t*)&rxThread->rxSocket, NULL);
+        uv_close((uv_handle_t*)&rxThread->stopAsync, NULL);
+        goto ErrExit;
+    }
+    ret = uv_thread_create(&rxThread->thread, RxThreadRun, rxThread);
+    if (ret) {
+        RxThreadStop(&rxThread->stopAsync);
+        goto ErrExit;
+    }
+    return 0;
+
+ErrExit:
+    /*
+     * Run the loop to complete closing the handles
+     */
+    uv_run(&rxThread->loop, UV_RUN_DEFAULT);
+    uv_loop_close(&rxThread->loop);
+    free(rxThread->landing);
+    return ret;
+}
+
+static int StartRxThreads(DPS_NetContext* netCtx, size_t numThreads)
+{
+    struct sockaddr_storage addr;
+    int len = sizeof(addr);
+    int ret;
+    size_t i;
+
+    /*
+     * Bind the receive thread sockets to the port the node's socket
+     * was bound to in case an ephemeral port was requested
+     */
+    ret = uv_udp_getsockname(&netCtx->rxSocket, (struct sockaddr*)&addr, &len);
+    if (ret) {
+        return ret;
+    }
+    netCtx->rxThreads = calloc(numThreads, sizeof(RxThread));
+    if (!netCtx->rxThreads) {
+        return UV_ENOMEM;
+    }
+    for (i = 0; i < numThreads; ++i) {
+        ret = StartRxThread(netCtx, &netCtx->rxThreads[i], (struct sockaddr*)&addr);
+        if (ret) {
+            StopRxThreads(netCtx);
+            return ret;
+        }
+        ++netCtx->numRxThreads;
+    }
+    return 0;
+}
+
 DPS_NetContext* DPS_NetStart(DPS_Node* node, const DPS_NodeAddress* addr, DPS_OnReceive cb)
 {
     int ret;
     DPS_NetContext* netCtx;
     struct sockaddr* sa;
     DPS_NodeAddress any;
+    size_t numRxThreads = node->rxThreads;
 
+#ifndef SO_REUSEPORT
+    if (numRxThreads) {
+        DPS_WARNPRINT("Receive threads are not supported on this platform\n");
+        numRxThreads = 0;
+    }
+#endif
+    if (addr) {
+        sa = (struct sockaddr*)&addr->u.inaddr;
+    } else {
+        if (!DPS_SetAddress(&any, "[::]:0")) {
+            return NULL;
+        }
+        sa = (struct sockaddr*)&any.u.inaddr;
+    }
     netCtx = calloc(1, sizeof(DPS_NetContext));
     if (!netCtx) {
         return NULL;
     }
-    ret = uv_udp_init(node->loop, &netCtx->rxSocket);
+    DPS_QueueInit(&netCtx->rxQueue);
+    DPS_QueueInit(&netCtx->txDone);
+    DPS_SlabInit(&netCtx->rxData, sizeof(RxData), MAX_RX_QUEUED / 16);
+    netCtx->landing = malloc(RECV_BATCH * MAX_READ_LEN);
+    if (!netCtx->landing) {
+        FreeNetContext(netCtx);
+        return NULL;
+    }
+    ret = uv_mutex_init(&netCtx->rxLock);
+    if (ret) {
+        DPS_ERRPRINT("uv_mutex_init error=%s\n", uv_err_name(ret));
+        FreeNetContext(netCtx);
+        return NULL;
+    }
+    ret = uv_udp_init_ex(node->loop, &netCtx->rxSocket, sa->sa_family);
     if (ret) {
         DPS_ERRPRINT("uv_udp_init error=%s\n", uv_err_name(ret));
-        free(netCtx);
+        uv_mutex_destroy(&netCtx->rxLock);
+        FreeNetContext(netCtx);
         return NULL;
     }
     netCtx->node = node;
     netCtx->receiveCB = cb;
-    if (addr) {
-        sa = (struct sockaddr*)&addr->u.inaddr;
-    } else {
-        if (!DPS_SetAddress(&any, "[::]:0")) {
+    netCtx->rxSocket.data = netCtx;
+    ++netCtx->numHandles;
+    netCtx->rxAsync.data = netCtx;
+    ret = uv_async_init(node->loop, &netCtx->rxAsync, RxTask);
+    if (ret) {
+        goto ErrorExit;
+    }
+    ++netCtx->numHandles;
+    netCtx->txAsync.data = netCtx;
+    ret = uv_async_init(node->loop, &netCtx->txAsync, TxTask);
+    if (ret) {
+        goto ErrorExit;
+    }
+    ++netCtx->numHandles;
+    if (numRxThreads) {
+        ret = SetReusePort(&netCtx->rxSocket);
+        if (ret) {
             goto ErrorExit;
         }
-        sa = (struct sockaddr*)&any.u.inaddr;
     }
-    netCtx->rxSocket.data = netCtx;
     ret = uv_udp_bind(&netCtx->rxSocket, sa, 0);
     if (ret) {
         goto ErrorExit;
@@ -134,12 +709,18 @@ DPS_NetContext* DPS_NetStart(DPS_Node* node, const DPS_NodeAddress* addr, DPS_On
     if (ret) {
         goto ErrorExit;
     }
+    if (numRxThreads) {
+        ret = StartRxThreads(netCtx, numRxThreads);
+        if (ret) {
+            goto ErrorExit;
+        }
+    }
     return netCtx;
 
 ErrorExit:
 
     DPS_ERRPRINT("Failed to start net netCtx: error=%s\n", uv_err_name(ret));
-    uv_close((uv_handle_t*)&netCtx->rxSocket, RxHandleClosed);
+    DPS_NetStop(netCtx);
     return NULL;
 }
 
@@ -162,11 +743,35 @@ DPS_NodeAddress* DPS_NetGetListenAddress(DPS_NodeAddress* addr, DPS_NetContext*
     return addr;
 }
 
+void DPS_NetGetReceiveThreadStats(DPS_NetContext* netCtx, DPS_ReceiveThreadStats* stats)
+{
+    size_t i;
+
+    memzero_s(stats, sizeof(DPS_ReceiveThreadStats));
+    if (!netCtx) {
+        return;
+    }
+    stats->numThreads = netCtx->numRxThreads;
+    for (i = 0; i < netCtx->numRxThreads; ++i) {
+        stats->received += ATOMIC_LOAD_32(&netCtx->rxThreads[i].received);
+        stats->decoded += ATOMIC_LOAD_32(&netCtx->rxThreads[i].decoded);
+        stats->dropped += ATOMIC_LOAD_32(&netCtx->rxThreads[i].dropped);
+    }
+}
+
 void DPS_NetStop(DPS_NetContext* netCtx)
 {
     if (netCtx) {
+        StopRxThreads(netCtx);
+        uv_mutex_destroy(&netCtx->rxLock);
         uv_udp_recv_stop(&netCtx->rxSocket);
         uv_close((uv_handle_t*)&netCtx->rxSocket, RxHandleClosed);
+        if (netCtx->numHandles > 1) {
+            uv_close((uv_handle_t*)&netCtx->rxAsync, RxHandleClosed);
+        }
+        if (netCtx->numHandles > 2) {
+            uv_close((uv_handle_t*)&netCtx->txAsync, TxHandleClosed);
+        }
     }
 }
 
@@ -241,6 +846,132 @@ DPS_Status DPS_NetSend(DPS_Node* node, void* appCtx, DPS_NetEndpoint* ep, uv_buf
     return DPS_OK;
 }
 
+#ifdef DPS_HAVE_MMSG
+/*
+ * Returns the number of sends that were made, the remaining sends are
+ * left for libuv
+ */
+static size_t SendMmsg(DPS_NetContext* netCtx, NetSendMany* many)
+{
+    struct mmsghdr msgs[MAX_SENDMMSG];
+    uv_os_fd_t fd;
+    size_t sent = 0;
+    size_t i;
+    size_t n;
+    int ret;
+
+    if (uv_fileno((uv_handle_t*)&netCtx->rxSocket, &fd)) {
+        return 0;
+    }
+    while (sent < many->numSends) {
+        n = many->numSends - sent;
+        if (n > MAX_SENDMMSG) {
+            n = MAX_SENDMMSG;
+        }
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+        for (i = 0; i < n; ++i) {
+            SendTo* send = &many->sends[sent + i];
+            msgs[i].msg_hdr.msg_name = &send->inaddr;
+            if (send->inaddr.ss_family == AF_INET6) {
+                msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+            } else {
+                msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            }
+            /*
+             * uv_buf_t is compatible with struct iovec on unix
+             */
+            msgs[i].msg_hdr.msg_iov = (struct iovec*)many->bufs;
+            msgs[i].msg_hdr.msg_iovlen = many->numBufs;
+        }
+        do {
+            ret = sendmmsg(fd, msgs, (unsigned int)n, 0);
+        } while ((ret < 0) && (errno == EINTR));
+        /*
+         * On an error, including the socket buffer being full, libuv
+         * takes over and reports the status of each of the remaining
+         * sends
+         */
+        if (ret <= 0) {
+            break;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+#endif
+
+DPS_Status DPS_NetSendMany(DPS_Node* node, void* appCtx, DPS_NetEndpoint** eps, size_t numEps,
+                           uv_buf_t* bufs, size_t numBufs, DPS_NetSendComplete sendCompleteCB)
+{
+    DPS_NetContext* netCtx = node->netCtx;
+    NetSendMany* many;
+    SendTo* send;
+    size_t sent = 0;
+    size_t i;
+    int ret;
+
+    DPS_DBGTRACEA("node=%p,appCtx=%p,eps=%p,numEps=%zu,bufs=%p,numBufs=%zu,sendCompleteCB=%p\n",
+                  node, appCtx, eps, numEps, bufs, numBufs, sendCompleteCB);
+
+    if (!numEps) {
+        return DPS_OK;
+    }
+    /*
+     * The buffers are copied after the sends so the callbacks have
+     * them after the caller's array is gone
+     */
+    many = malloc(sizeof(NetSendMany) + (numEps - 1) * sizeof(SendTo) + numBufs * sizeof(uv_buf_t));
+    if (!many) {
+        return DPS_ERR_RESOURCES;
+    }
+    many->node = node;
+    many->appCtx = appCtx;
+    many->onSendComplete = sendCompleteCB;
+    many->pending = numEps;
+    many->bufs = (uv_buf_t*)&many->sends[numEps];
+    memcpy_s(many->bufs, numBufs * sizeof(uv_buf_t), bufs, numBufs * sizeof(uv_buf_t));
+    many->numBufs = numBufs;
+    many->numSends = numEps;
+    for (i = 0; i < numEps; ++i) {
+        send = &many->sends[i];
+        send->many = many;
+        send->peerEp = *eps[i];
+        memcpy_s(&send->inaddr, sizeof(send->inaddr), &eps[i]->addr.u.inaddr, sizeof(eps[i]->addr.u.inaddr));
+        DPS_MapAddrToV6((struct sockaddr*)&send->inaddr);
+        send->sendReq.data = send;
+        send->status = 0;
+    }
+#ifdef DPS_HAVE_MMSG
+    /*
+     * Sending directly while libuv has queued sends would reorder the
+     * datagrams
+     */
+    if (!netCtx->rxSocket.send_queue_count) {
+        sent = SendMmsg(netCtx, many);
+    }
+#endif
+    DPS_DBGPRINT("DPS_NetSendMany sent %zu of %zu directly\n", sent, numEps);
+    many->pending -= sent;
+    for (i = sent; i < numEps; ++i) {
+        send = &many->sends[i];
+        ret = uv_udp_send(&send->sendReq, &netCtx->rxSocket, many->bufs, (uint32_t)numBufs,
+                          (const struct sockaddr*)&send->inaddr, OnSendToComplete);
+        if (ret) {
+            DPS_ERRPRINT("DPS_NetSendMany status=%s\n", uv_err_name(ret));
+            send->status = ret;
+            --many->pending;
+        }
+    }
+    /*
+     * The send complete callbacks are always called from the loop
+     */
+    if (!many->pending) {
+        DPS_QueuePushBack(&netCtx->txDone, &many->queue);
+        uv_async_send(&netCtx->txAsync);
+    }
+    return DPS_OK;
+}
+
 void DPS_NetConnectionIncRef(DPS_NetConnection* cn)
 {
     /* No-op for udp */
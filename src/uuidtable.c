@@ -0,0 +1,145 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <dps/dps.h>
+#include "uuidtable.h"
+
+#define UUID_TABLE_MIN_SLOTS  64
+
+uint32_t DPS_UUIDHash(const DPS_UUID* id)
+{
+    uint64_t h = (id->val64[0] ^ id->val64[1]) * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(h >> 32);
+}
+
+void DPS_UUIDTableInit(DPS_UUIDTable* table)
+{
+    table->slots = NULL;
+    table->numSlots = 0;
+    table->count = 0;
+}
+
+void DPS_UUIDTableFree(DPS_UUIDTable* table)
+{
+    free(table->slots);
+    DPS_UUIDTableInit(table);
+}
+
+static DPS_Status Grow(DPS_UUIDTable* table)
+{
+    size_t numSlots = table->numSlots ? 2 * table->numSlots : UUID_TABLE_MIN_SLOTS;
+    DPS_UUIDSlot* slots = calloc(numSlots, sizeof(DPS_UUIDSlot));
+    size_t i;
+    size_t j;
+
+    if (!slots) {
+        return DPS_ERR_RESOURCES;
+    }
+    for (i = 0; i < table->numSlots; ++i) {
+        if (table->slots[i].item) {
+            for (j = table->slots[i].hash & (numSlots - 1); slots[j].item; j = (j + 1) & (numSlots - 1)) {
+            }
+            slots[j] = table->slots[i];
+        }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->numSlots = numSlots;
+    return DPS_OK;
+}
+
+DPS_Status DPS_UUIDTableInsert(DPS_UUIDTable* table, uint32_t hash, void* item)
+{
+    size_t mask;
+    size_t i;
+
+    if ((2 * (table->count + 1) > table->numSlots) && (Grow(table) != DPS_OK) &&
+        ((table->count + 1) >= table->numSlots)) {
+        return DPS_ERR_RESOURCES;
+    }
+    mask = table->numSlots - 1;
+    for (i = hash & mask; table->slots[i].item; i = (i + 1) & mask) {
+    }
+    table->slots[i].hash = hash;
+    table->slots[i].item = item;
+    ++table->count;
+    return DPS_OK;
+}
+
+int DPS_UUIDTableRemove(DPS_UUIDTable* table, uint32_t hash, const void* item)
+{
+    DPS_UUIDSlot* slots = table->slots;
+    size_t mask;
+    size_t home;
+    size_t i;
+    size_t j;
+
+    if (!table->count) {
+        return DPS_FALSE;
+    }
+    mask = table->numSlots - 1;
+    for (i = hash & mask; slots[i].item != item; i = (i + 1) & mask) {
+        if (!slots[i].item) {
+            return DPS_FALSE;
+        }
+    }
+    slots[i].item = NULL;
+    --table->count;
+    /*
+     * Shift later entries in the probe sequence back into the hole so
+     * that lookups can stop at the first empty slot
+     */
+    for (j = (i + 1) & mask; slots[j].item; j = (j + 1) & mask) {
+        home = slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            slots[j].item = NULL;
+            i = j;
+        }
+    }
+    return DPS_TRUE;
+}
+
+void* DPS_UUIDTableFirst(const DPS_UUIDTable* table, uint32_t hash, size_t* pos)
+{
+    if (!table->count) {
+        return NULL;
+    }
+    *pos = (hash - 1) & (table->numSlots - 1);
+    return DPS_UUIDTableNext(table, hash, pos);
+}
+
+void* DPS_UUIDTableNext(const DPS_UUIDTable* table, uint32_t hash, size_t* pos)
+{
+    size_t mask = table->numSlots - 1;
+    size_t i;
+
+    for (i = (*pos + 1) & mask; table->slots[i].item; i = (i + 1) & mask) {
+        if (table->slots[i].hash == hash) {
+            *pos = i;
+            return table->slots[i].item;
+        }
+    }
+    return NULL;
+}
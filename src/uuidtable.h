@@ -0,0 +1,132 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#ifndef _DPS_UUIDTABLE_H
+#define _DPS_UUIDTABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <dps/err.h>
+#include <dps/uuid.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A slot in a UUID table
+ */
+typedef struct _DPS_UUIDSlot {
+    uint32_t hash;              /**< Hash of the UUID of the item */
+    void* item;                 /**< The item or NULL if the slot is empty */
+} DPS_UUIDSlot;
+
+/**
+ * An open addressing hash table with linear probing of items keyed on
+ * a UUID. The table only holds the hash of the UUID so the caller
+ * compares the UUIDs of the items found with DPS_UUIDTableFirst() and
+ * DPS_UUIDTableNext(). The same UUID may be added more than once.
+ *
+ * A table is not thread safe, the caller must serialize access.
+ */
+typedef struct _DPS_UUIDTable {
+    DPS_UUIDSlot* slots;        /**< The slots */
+    size_t numSlots;            /**< Number of slots, a power of two */
+    size_t count;               /**< Number of items in the table */
+} DPS_UUIDTable;
+
+/**
+ * Hash a UUID
+ *
+ * @param id  The UUID
+ *
+ * @return The hash
+ */
+uint32_t DPS_UUIDHash(const DPS_UUID* id);
+
+/**
+ * Initialize an empty table
+ *
+ * @param table  The table
+ */
+void DPS_UUIDTableInit(DPS_UUIDTable* table);
+
+/**
+ * Free the slots of a table, the items are not freed
+ *
+ * @param table  The table
+ */
+void DPS_UUIDTableFree(DPS_UUIDTable* table);
+
+/**
+ * Add an item to a table. The table grows to keep the load factor at
+ * or below one half but carries on with a fuller table if it cannot
+ * grow.
+ *
+ * @param table  The table
+ * @param hash   The hash of the UUID of the item
+ * @param item   The item
+ *
+ * @return DPS_OK if the item was added, DPS_ERR_RESOURCES if the
+ *         table is full and could not grow
+ */
+DPS_Status DPS_UUIDTableInsert(DPS_UUIDTable* table, uint32_t hash, void* item);
+
+/**
+ * Remove an item from a table
+ *
+ * @param table  The table
+ * @param hash   The hash of the UUID of the item
+ * @param item   The item
+ *
+ * @return DPS_TRUE if the item was removed, DPS_FALSE if it was not in the table
+ */
+int DPS_UUIDTableRemove(DPS_UUIDTable* table, uint32_t hash, const void* item);
+
+/**
+ * Get the first item in a table with a hash
+ *
+ * @param table  The table
+ * @param hash   The hash of the UUID to look up
+ * @param pos    Returns the position to pass to DPS_UUIDTableNext()
+ *
+ * @return The item or NULL if there are no items with the hash
+ */
+void* DPS_UUIDTableFirst(const DPS_UUIDTable* table, uint32_t hash, size_t* pos);
+
+/**
+ * Get the next item in a table with a hash
+ *
+ * @param table  The table
+ * @param hash   The hash of the UUID to look up
+ * @param pos    The position returned by DPS_UUIDTableFirst() or a
+ *               previous call, returns the position of the item
+ *
+ * @return The item or NULL if there are no more items with the hash
+ */
+void* DPS_UUIDTableNext(const DPS_UUIDTable* table, uint32_t hash, size_t* pos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
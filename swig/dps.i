@@ -34,6 +34,9 @@
 %ignore DPS_GetKeyStoreData;
 %ignore DPS_GetLoop;
 %ignore DPS_GetNodeData;
+%ignore DPS_GetNodeHistoryStats;
+%ignore DPS_GetNodeReceiveThreadStats;
+%ignore DPS_GetNodeRxBufferPoolStats;
 %ignore DPS_GetPublicationData;
 %ignore DPS_GetSubscriptionData;
 %ignore DPS_JSON2CBOR;
@@ -42,6 +45,7 @@
 %ignore DPS_NodeAddrToString;
 %ignore DPS_PublicationGetNumTopics;
 %ignore DPS_PublicationGetTopic;
+%ignore DPS_PublishBatch;
 %ignore DPS_PublishBufs;
 %ignore DPS_SetKeyStoreData;
 %ignore DPS_SetNodeData;
@@ -51,8 +55,12 @@
 %ignore DPS_SubscriptionGetTopic;
 %ignore DPS_UUIDToString;
 %ignore _DPS_Buffer;
+%ignore _DPS_HistoryStats;
 %ignore _DPS_Key;
 %ignore _DPS_KeyId;
+%ignore _DPS_PublishBatchEntry;
+%ignore _DPS_ReceiveThreadStats;
+%ignore _DPS_RxBufferPoolStats;
 
 /*
  * Declarations that are not relevant
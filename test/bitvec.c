@@ -0,0 +1,389 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2018 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include "test.h"
+#include "bitvec.h"
+#include "topics.h"
+
+/*
+ * Checks the bit vector operations against a byte-at-a-time reference
+ * implementation. The lengths are chosen so that the vectorized kernels
+ * are exercised with and without a partially filled final register.
+ */
+
+#define MAX_BYTES  (8192 / 8)
+
+static const size_t BitLens[] = { 64, 128, 192, 256, 320, 448, 512, 576, 1024, 1088, 8192 };
+
+static int Bits(uint8_t b)
+{
+    int n = 0;
+    while (b) {
+        n += b & 1;
+        b >>= 1;
+    }
+    return n;
+}
+
+/*
+ * Random data with a density that varies from empty to saturated,
+ * a negative density is the number of bits to set.
+ */
+static void RandBytes(uint8_t* data, size_t len, int density)
+{
+    size_t i;
+    int j;
+
+    if (density < 0) {
+        memset(data, 0, len);
+        for (j = 0; j < -density; ++j) {
+            i = rand() % (len * 8);
+            data[i / 8] |= 1 << (i % 8);
+        }
+        return;
+    }
+    for (i = 0; i < len; ++i) {
+        uint8_t b = 0;
+        for (j = 0; j < 8; ++j) {
+            if ((rand() % 16) < density) {
+                b |= 1 << j;
+            }
+        }
+        data[i] = b;
+    }
+}
+
+static DPS_BitVector* MakeBV(uint8_t* data, size_t len)
+{
+    DPS_BitVector* bv = DPS_BitVectorAlloc();
+    ASSERT(bv);
+    ASSERT(DPS_BitVectorSet(bv, data, len) == DPS_OK);
+    return bv;
+}
+
+/*
+ * A deserialized bit vector is held in the sparse form if only a few
+ * bits are set so this mixes sparse and dense operands.
+ */
+static DPS_BitVector* MakeAnyBV(uint8_t* data, size_t len)
+{
+    DPS_BitVector* bv = MakeBV(data, len);
+    DPS_TxBuffer txBuf;
+    DPS_RxBuffer rxBuf;
+    DPS_Status ret;
+
+    if (rand() & 1) {
+        ret = DPS_TxBufferInit(&txBuf, NULL, DPS_BitVectorSerializeMaxSize(bv));
+        ASSERT(ret == DPS_OK);
+        ret = DPS_BitVectorSerialize(bv, &txBuf);
+        ASSERT(ret == DPS_OK);
+        DPS_TxBufferToRx(&txBuf, &rxBuf);
+        DPS_BitVectorClear(bv);
+        ret = DPS_BitVectorDeserialize(bv, &rxBuf);
+        ASSERT(ret == DPS_OK);
+        DPS_TxBufferFree(&txBuf);
+    }
+    return bv;
+}
+
+static void CheckEquals(DPS_BitVector* bv, uint8_t* data, size_t len)
+{
+    DPS_BitVector* ref = MakeBV(data, len);
+    ASSERT(DPS_BitVectorEquals(bv, ref));
+    DPS_BitVectorFree(ref);
+}
+
+static void TestOps(size_t bitLen, int d1, int d2)
+{
+    static uint8_t a[MAX_BYTES];
+    static uint8_t b[MAX_BYTES];
+    static uint8_t r[MAX_BYTES];
+    size_t len = bitLen / 8;
+    DPS_BitVector* bv1;
+    DPS_BitVector* bv2;
+    DPS_BitVector* bvOut;
+    size_t pop1 = 0;
+    int includes = DPS_TRUE;
+    int equal = DPS_TRUE;
+    int anyA = DPS_FALSE;
+    int anyR;
+    size_t i;
+
+    RandBytes(a, len, d1);
+    RandBytes(b, len, d2);
+    /*
+     * Make b a subset of a half of the time
+     */
+    if (rand() & 1) {
+        for (i = 0; i < len; ++i) {
+            b[i] &= a[i];
+        }
+    }
+    for (i = 0; i < len; ++i) {
+        pop1 += Bits(a[i]);
+        anyA |= (a[i] != 0);
+        if ((a[i] & b[i]) != b[i]) {
+            includes = DPS_FALSE;
+        }
+        if (a[i] != b[i]) {
+            equal = DPS_FALSE;
+        }
+    }
+    bv1 = MakeAnyBV(a, len);
+    bv2 = MakeAnyBV(b, len);
+    bvOut = DPS_BitVectorAlloc();
+    ASSERT(bvOut);
+
+    ASSERT(DPS_BitVectorPopCount(bv1) == pop1);
+    ASSERT(DPS_BitVectorIsClear(bv1) == !pop1);
+    ASSERT(DPS_BitVectorEquals(bv1, bv2) == equal);
+    ASSERT(DPS_BitVectorIncludes(bv1, bv2) == (includes && anyA));
+    for (i = DPS_BitVectorNextSetBit(bv1, 0); i < bitLen; i = DPS_BitVectorNextSetBit(bv1, i + 1)) {
+        ASSERT(a[i / 8] & (1 << (i % 8)));
+        --pop1;
+    }
+    ASSERT(pop1 == 0);
+
+    anyR = DPS_FALSE;
+    for (i = 0; i < len; ++i) {
+        r[i] = a[i] & b[i];
+        anyR |= (r[i] != 0);
+    }
+    ASSERT(DPS_BitVectorIntersection(bvOut, bv1, bv2) == DPS_OK);
+    CheckEquals(bvOut, r, len);
+    ASSERT(DPS_BitVectorIsClear(bvOut) == !anyR);
+    /*
+     * In place
+     */
+    ASSERT(DPS_BitVectorIntersection(bv2, bv1, bv2) == DPS_OK);
+    CheckEquals(bv2, r, len);
+    DPS_BitVectorFree(bv2);
+    bv2 = MakeAnyBV(b, len);
+
+    anyR = DPS_FALSE;
+    for (i = 0; i < len; ++i) {
+        r[i] = a[i] ^ b[i];
+        anyR |= (r[i] != 0);
+    }
+    DPS_BitVectorFree(bv1);
+    DPS_BitVectorFree(bv2);
+    bv1 = MakeAnyBV(a, len);
+    bv2 = MakeAnyBV(b, len);
+    ASSERT(DPS_BitVectorXor(bvOut, bv1, bv2, &equal) == DPS_OK);
+    CheckEquals(bvOut, r, len);
+    ASSERT(equal == !anyR);
+
+    for (i = 0; i < len; ++i) {
+        r[i] = a[i] | b[i];
+    }
+    ASSERT(DPS_BitVectorUnion(bv1, bv2) == DPS_OK);
+    CheckEquals(bv1, r, len);
+    ASSERT(DPS_BitVectorEquals(bv1, bv1));
+    pop1 = DPS_BitVectorPopCount(bv1);
+    ASSERT(DPS_BitVectorIncludes(bv1, bv2) == (pop1 != 0));
+
+    DPS_BitVectorFree(bvOut);
+    DPS_BitVectorFree(bv1);
+    DPS_BitVectorFree(bv2);
+}
+
+static void TestFuzzyHash(size_t bitLen, int density)
+{
+    static uint8_t a[MAX_BYTES];
+    size_t len = bitLen / 8;
+    DPS_BitVector* bv;
+    DPS_BitVector* fh;
+    DPS_BitVector* fhRef;
+    size_t pop = 0;
+    size_t i;
+
+    RandBytes(a, len, density);
+    for (i = 0; i < len; ++i) {
+        pop += Bits(a[i]);
+    }
+    bv = MakeAnyBV(a, len);
+    fh = DPS_BitVectorAllocFH();
+    ASSERT(DPS_BitVectorFuzzyHash(fh, bv) == DPS_OK);
+    ASSERT(DPS_BitVectorPopCount(bv) == pop);
+    ASSERT(DPS_BitVectorIsClear(fh) == !pop);
+    /*
+     * The fuzzy hash of a superset must include the fuzzy hash of a subset
+     */
+    for (i = 0; i < len; ++i) {
+        a[i] &= (uint8_t)rand();
+    }
+    DPS_BitVectorFree(bv);
+    bv = MakeAnyBV(a, len);
+    fhRef = DPS_BitVectorAllocFH();
+    ASSERT(DPS_BitVectorFuzzyHash(fhRef, bv) == DPS_OK);
+    if (!DPS_BitVectorIsClear(fhRef)) {
+        ASSERT(DPS_BitVectorIncludes(fh, fhRef));
+    }
+    DPS_BitVectorFree(fhRef);
+    DPS_BitVectorFree(fh);
+    DPS_BitVectorFree(bv);
+}
+
+static void TestBloomCache(void)
+{
+    static const char* topics[] = { "a/b/c/d/e/f", "x/y/z" };
+    char longTopic[512];
+    DPS_BitVector* bv1 = DPS_BitVectorAlloc();
+    DPS_BitVector* bv2 = DPS_BitVectorAlloc();
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prevHits;
+    uint64_t prevMisses;
+    size_t i;
+
+    memset(longTopic, 'x', sizeof(longTopic) - 1);
+    longTopic[sizeof(longTopic) - 1] = 0;
+
+    for (i = 0; i < A_SIZEOF(topics); ++i) {
+        ASSERT(DPS_AddTopic(bv1, topics[i], "/", DPS_PubTopic) == DPS_OK);
+    }
+    ASSERT(DPS_AddTopic(bv1, longTopic, "/", DPS_PubTopic) == DPS_OK);
+    DPS_BloomCacheStats(&prevHits, &prevMisses);
+    /*
+     * Adding the same topics again must find all the hashes in the
+     * cache, except for the topic that is too long to cache
+     */
+    for (i = 0; i < A_SIZEOF(topics); ++i) {
+        ASSERT(DPS_AddTopic(bv2, topics[i], "/", DPS_PubTopic) == DPS_OK);
+    }
+    ASSERT(DPS_AddTopic(bv2, longTopic, "/", DPS_PubTopic) == DPS_OK);
+    DPS_BloomCacheStats(&hits, &misses);
+    ASSERT(DPS_BitVectorEquals(bv1, bv2));
+    ASSERT(hits > prevHits);
+    ASSERT(misses == prevMisses);
+    for (i = 0; i < A_SIZEOF(topics); ++i) {
+        ASSERT(DPS_BitVectorBloomTest(bv2, (const uint8_t*)topics[i], strlen(topics[i])));
+    }
+    DPS_BitVectorFree(bv1);
+    DPS_BitVectorFree(bv2);
+}
+
+static void TestBloomHash(void)
+{
+    static const char* topics[] = { "a/b/c/d/e/f", "x/y/z" };
+    DPS_BitVector* sha2 = DPS_BitVectorAlloc();
+    DPS_BitVector* fast = DPS_BitVectorAlloc();
+    DPS_BitVector* bv = DPS_BitVectorAlloc();
+    size_t i;
+
+    ASSERT(DPS_GetBloomHash() == DPS_BloomHashSha2);
+    ASSERT(DPS_ConfigureBloomHash((DPS_BloomHash)-1) == DPS_ERR_ARGS);
+    for (i = 0; i < A_SIZEOF(topics); ++i) {
+        ASSERT(DPS_AddTopic(sha2, topics[i], "/", DPS_PubTopic) == DPS_OK);
+    }
+    ASSERT(DPS_ConfigureBloomHash(DPS_BloomHashFast) == DPS_OK);
+    for (i = 0; i < A_SIZEOF(topics); ++i) {
+        ASSERT(DPS_AddTopic(fast, topics[i], "/", DPS_PubTopic) == DPS_OK);
+        ASSERT(DPS_BitVectorBloomTest(fast, (const uint8_t*)topics[i], strlen(topics[i])));
+    }
+    ASSERT(!DPS_BitVectorEquals(sha2, fast));
+    /*
+     * The cached hashes must not be shared between the hash functions
+     */
+    ASSERT(DPS_ConfigureBloomHash(DPS_BloomHashSha2) == DPS_OK);
+    for (i = 0; i < A_SIZEOF(topics); ++i) {
+        ASSERT(DPS_AddTopic(bv, topics[i], "/", DPS_PubTopic) == DPS_OK);
+    }
+    ASSERT(DPS_BitVectorEquals(sha2, bv));
+    DPS_BitVectorFree(sha2);
+    DPS_BitVectorFree(fast);
+    DPS_BitVectorFree(bv);
+}
+
+/*
+ * Runs the operations with every compiled set of kernels the CPU
+ * supports so the vectorized kernels are checked against the same
+ * reference as the generic kernels
+ */
+static void TestKernels(const char* name)
+{
+    size_t i;
+    int d1;
+    int d2;
+    int n;
+
+    DPS_PRINT("Testing %s kernels\n", name);
+    srand(1);
+    for (i = 0; i < A_SIZEOF(BitLens); ++i) {
+        ASSERT(DPS_Configure(BitLens[i], 4) == DPS_OK);
+        for (d1 = 0; d1 <= 16; d1 += 4) {
+            for (d2 = 0; d2 <= 16; d2 += 4) {
+                for (n = 0; n < 8; ++n) {
+                    TestOps(BitLens[i], d1, d2);
+                }
+            }
+            TestFuzzyHash(BitLens[i], d1);
+        }
+        /*
+         * Only a few bits set
+         */
+        for (d1 = -1; d1 >= -64; d1 *= 2) {
+            for (d2 = -1; d2 >= -64; d2 *= 2) {
+                for (n = 0; n < 8; ++n) {
+                    TestOps(BitLens[i], d1, d2);
+                    TestOps(BitLens[i], d1, 4);
+                    TestOps(BitLens[i], 4, d2);
+                }
+            }
+            TestFuzzyHash(BitLens[i], d1);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* name;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_Debug = DPS_FALSE;
+    for (i = 1; i < (size_t)argc; ++i) {
+        if (!strcmp(argv[i], "-d")) {
+            DPS_Debug = DPS_TRUE;
+        }
+    }
+    ASSERT(DPS_BitVectorUseKernels("unknown") == DPS_ERR_MISSING);
+    for (i = 0; (name = DPS_BitVectorKernelsName(i)) != NULL; ++i) {
+        ret = DPS_BitVectorUseKernels(name);
+        if (ret == DPS_ERR_NOT_IMPLEMENTED) {
+            DPS_PRINT("Skipping %s kernels, not supported by the CPU\n", name);
+            continue;
+        }
+        ASSERT(ret == DPS_OK);
+        TestKernels(name);
+    }
+    /*
+     * The generic kernels are always compiled and supported
+     */
+    ASSERT(i > 0);
+    ASSERT(DPS_BitVectorUseKernels(DPS_BitVectorKernelsName(0)) == DPS_OK);
+    ASSERT(DPS_Configure(8192, 4) == DPS_OK);
+    TestBloomCache();
+    TestBloomHash();
+    DPS_PRINT("Passed\n");
+    return EXIT_SUCCESS;
+}
@@ -81,6 +81,178 @@ static void TestDel(DPS_CountVector* cv, uint8_t n)
     DPS_BitVectorFree(bv);
 }
 
+static void TestExcluding(DPS_CountVector* cv, uint8_t n)
+{
+    DPS_BitVector* bv = DPS_BitVectorAlloc();
+    DPS_BitVector* bvU;
+    DPS_BitVector* bvI;
+    DPS_BitVector* bvUX;
+    DPS_BitVector* bvIX;
+    DPS_Status ret;
+
+    DPS_PRINT("Excluding %02x\n", n);
+    SetBits(bv, n);
+    ret = DPS_CountVectorAdd(cv, bv);
+    ASSERT(ret == DPS_OK);
+    bvUX = DPS_CountVectorToUnionExcluding(cv, bv);
+    bvIX = DPS_CountVectorToIntersectionExcluding(cv, bv);
+    ret = DPS_CountVectorDel(cv, bv);
+    ASSERT(ret == DPS_OK);
+    bvU = DPS_CountVectorToUnion(cv);
+    bvI = DPS_CountVectorToIntersection(cv);
+    ASSERT(DPS_BitVectorEquals(bvU, bvUX));
+    ASSERT(DPS_BitVectorEquals(bvI, bvIX));
+
+    DPS_BitVectorFree(bvIX);
+    DPS_BitVectorFree(bvUX);
+    DPS_BitVectorFree(bvI);
+    DPS_BitVectorFree(bvU);
+    DPS_BitVectorFree(bv);
+}
+
+/*
+ * Randomly add and delete entries checking the union and intersection
+ * against the values computed directly from the entries
+ */
+static void TestRandom(void)
+{
+    DPS_CountVector* cv = DPS_CountVectorAlloc();
+    DPS_BitVector* entries[16] = { NULL };
+    uint8_t bits[16];
+    DPS_BitVector* bvU;
+    DPS_BitVector* bvI;
+    DPS_BitVector* ref;
+    DPS_Status ret;
+    int numEntries = 0;
+    int i;
+    int j;
+
+    DPS_PRINT("Random\n");
+    ref = DPS_BitVectorAlloc();
+    for (i = 0; i < 1000; ++i) {
+        uint8_t un = 0;
+        uint8_t in = 0xFF;
+        if (numEntries < 16 && (numEntries == 0 || (rand() & 1))) {
+            bits[numEntries] = (uint8_t)(rand() | rand());
+            entries[numEntries] = DPS_BitVectorAlloc();
+            SetBits(entries[numEntries], bits[numEntries]);
+            ret = DPS_CountVectorAdd(cv, entries[numEntries]);
+            ASSERT(ret == DPS_OK);
+            ++numEntries;
+        } else {
+            j = rand() % numEntries;
+            ret = DPS_CountVectorDel(cv, entries[j]);
+            ASSERT(ret == DPS_OK);
+            DPS_BitVectorFree(entries[j]);
+            --numEntries;
+            entries[j] = entries[numEntries];
+            bits[j] = bits[numEntries];
+        }
+        for (j = 0; j < numEntries; ++j) {
+            un |= bits[j];
+            in &= bits[j];
+        }
+        if (!numEntries) {
+            in = 0;
+        }
+        bvU = DPS_CountVectorToUnion(cv);
+        SetBits(ref, un);
+        ASSERT(DPS_BitVectorEquals(bvU, ref));
+        bvI = DPS_CountVectorToIntersection(cv);
+        SetBits(ref, in);
+        ASSERT(DPS_BitVectorEquals(bvI, ref));
+        DPS_BitVectorFree(bvI);
+        DPS_BitVectorFree(bvU);
+    }
+    for (j = 0; j < numEntries; ++j) {
+        ret = DPS_CountVectorDel(cv, entries[j]);
+        ASSERT(ret == DPS_OK);
+        DPS_BitVectorFree(entries[j]);
+    }
+    DPS_BitVectorFree(ref);
+    DPS_CountVectorFree(cv);
+}
+
+/*
+ * Randomly changes the entries of a count vector and checks that
+ * bringing the union excluding each entry up to date gives the same
+ * result as computing it from scratch. Each entry is only brought up to
+ * date some of the time so the updates span several revisions.
+ */
+static void TestUpdateExcluding(void)
+{
+    DPS_CountVector* cv;
+    DPS_BitVector* entries[8] = { NULL };
+    DPS_BitVector* outbound[8];
+    uint32_t revisions[8];
+    DPS_BitVector* delta;
+    DPS_BitVector* prev;
+    DPS_BitVector* ref;
+    DPS_Status ret;
+    int same;
+    int i;
+    int j;
+    int k;
+
+    DPS_PRINT("Update excluding\n");
+    DPS_Configure(1024, 4);
+    cv = DPS_CountVectorAlloc();
+    delta = DPS_BitVectorAlloc();
+    prev = DPS_BitVectorAlloc();
+    for (j = 0; j < 8; ++j) {
+        outbound[j] = DPS_CountVectorToUnion(cv);
+        revisions[j] = DPS_CountVectorRevision(cv);
+    }
+    for (i = 0; i < 1000; ++i) {
+        j = rand() % 8;
+        if (entries[j]) {
+            ret = DPS_CountVectorDel(cv, entries[j]);
+            ASSERT(ret == DPS_OK);
+            DPS_BitVectorFree(entries[j]);
+            entries[j] = NULL;
+        }
+        if (rand() % 4) {
+            entries[j] = DPS_BitVectorAlloc();
+            for (k = rand() % 8; k >= 0; --k) {
+                int topic = rand() % 64;
+                DPS_BitVectorBloomInsert(entries[j], (const uint8_t*)&topic, sizeof(topic));
+            }
+            ret = DPS_CountVectorAdd(cv, entries[j]);
+            ASSERT(ret == DPS_OK);
+        }
+        for (j = 0; j < 8; ++j) {
+            if (rand() & 1) {
+                continue;
+            }
+            DPS_BitVectorDup(prev, outbound[j]);
+            ret = DPS_CountVectorUpdateUnionExcluding(cv, entries[j], revisions[j], outbound[j], delta, &same);
+            ASSERT(ret == DPS_OK);
+            revisions[j] = DPS_CountVectorRevision(cv);
+            if (entries[j]) {
+                ref = DPS_CountVectorToUnionExcluding(cv, entries[j]);
+            } else {
+                ref = DPS_CountVectorToUnion(cv);
+            }
+            ASSERT(DPS_BitVectorEquals(outbound[j], ref));
+            DPS_BitVectorXor(ref, prev, outbound[j], NULL);
+            ASSERT(DPS_BitVectorEquals(delta, ref));
+            ASSERT(same == DPS_BitVectorEquals(prev, outbound[j]));
+            DPS_BitVectorFree(ref);
+        }
+    }
+    for (j = 0; j < 8; ++j) {
+        if (entries[j]) {
+            ret = DPS_CountVectorDel(cv, entries[j]);
+            ASSERT(ret == DPS_OK);
+            DPS_BitVectorFree(entries[j]);
+        }
+        DPS_BitVectorFree(outbound[j]);
+    }
+    DPS_BitVectorFree(prev);
+    DPS_BitVectorFree(delta);
+    DPS_CountVectorFree(cv);
+}
+
 int main(int argc, char** argv)
 {
     DPS_CountVector* cv;
@@ -108,7 +280,16 @@ int main(int argc, char** argv)
     TestAdd(cv, 0x01);
     TestAdd(cv, 0x03);
 
+    TestExcluding(cv, 0x01);
+    TestExcluding(cv, 0x03);
+    TestExcluding(cv, 0x80);
+    TestExcluding(cv, 0xFF);
+    TestExcluding(cv, 0x00);
+
     DPS_CountVectorFree(cv);
 
+    TestRandom();
+    TestUpdateExcluding();
+
     return EXIT_SUCCESS;
 }
@@ -42,6 +42,7 @@ int main(int argc, char** argv)
     DPS_UUID uuid[NUM_PUBS];
     DPS_NodeAddress addr;
     DPS_NodeAddress* addrPtr;
+    DPS_HistoryStats stats;
 
     DPS_Debug = DPS_FALSE;
     for (i = 1; i < argc; ++i) {
@@ -72,6 +73,7 @@ int main(int argc, char** argv)
 
     history.loop = uv_default_loop();
     uv_mutex_init(&history.lock);
+    DPS_HistoryInit(&history);
 
 #ifdef READABLE_UUIDS
     /*
@@ -176,6 +178,49 @@ int main(int argc, char** argv)
             }
         }
     }
+    DPS_HistoryGetStats(&history, &stats);
+    if (stats.expired != NUM_PUBS - ((NUM_PUBS / 3) - (NUM_PUBS / 4))) {
+        DPS_PRINT("Unexpected history stats\n");
+        return EXIT_FAILURE;
+    }
+    /*
+     * Bound the size of the history
+     */
+    DPS_PRINT("Evict least recently updated entries\n");
+    DPS_HistoryFree(&history);
+    history.maxCount = NUM_PUBS / 2;
+    for (i = 0; i < NUM_PUBS / 2; ++i) {
+        DPS_UpdatePubHistory(&history, &uuid[i], 1, DPS_TRUE, 0, 1, &addr);
+    }
+    /*
+     * Update the oldest entries so they are the most recently updated
+     */
+    for (i = 0; i < NUM_PUBS / 4; ++i) {
+        DPS_UpdatePubHistory(&history, &uuid[i], 2, DPS_TRUE, 0, 1, &addr);
+    }
+    for (i = NUM_PUBS / 2; i < (3 * NUM_PUBS) / 4; ++i) {
+        DPS_UpdatePubHistory(&history, &uuid[i], 1, DPS_TRUE, 0, 1, &addr);
+    }
+    for (i = 0; i < (3 * NUM_PUBS) / 4; ++i) {
+        DPS_Status ret = DPS_LookupPublisherForAck(&history, &uuid[i], &sn, &addrPtr);
+        if (i >= NUM_PUBS / 4 &&  i < NUM_PUBS / 2) {
+            if (ret != DPS_ERR_MISSING) {
+                DPS_PRINT("Pub history was not evicted\n");
+                return EXIT_FAILURE;
+            }
+        } else {
+            if (ret != DPS_OK) {
+                DPS_PRINT("Pub history is missing\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    DPS_HistoryGetStats(&history, &stats);
+    if ((stats.count != NUM_PUBS / 2) || (stats.maxCount != NUM_PUBS / 2) ||
+        (stats.inserted != (3 * NUM_PUBS) / 4) || (stats.evicted != NUM_PUBS / 4) || stats.expired) {
+        DPS_PRINT("Unexpected history stats\n");
+        return EXIT_FAILURE;
+    }
     DPS_HistoryFree(&history);
 
     DPS_PRINT("Unit test passed\n");
@@ -23,6 +23,7 @@
 #include "test.h"
 #include "keys.h"
 #include "node.h"
+#include "bitvec.h"
 
 #define A_SIZEOF(a)  (sizeof(a) / sizeof((a)[0]))
 
@@ -239,6 +240,56 @@ static void TestLinkUnlink(void)
     DestroyKeyStore(keyStore);
 }
 
+#define NUM_LINKED_NODES 40
+
+static void TestLinkMany(void)
+{
+    DPS_MemoryKeyStore* keyStore = NULL;
+    DPS_Node* hub = NULL;
+    DPS_Node* nodes[NUM_LINKED_NODES];
+    DPS_NodeAddress* addrs[NUM_LINKED_NODES];
+    DPS_Status ret;
+    size_t i;
+
+    keyStore = CreateKeyStore();
+    hub = CreateNode(keyStore);
+    /*
+     * Enough links to grow the hub's remote node table a few times
+     */
+    for (i = 0; i < NUM_LINKED_NODES; ++i) {
+        nodes[i] = CreateNode(keyStore);
+        addrs[i] = DPS_CreateAddress();
+        ret = DPS_LinkTo(hub, DPS_GetListenAddressString(nodes[i]), addrs[i]);
+        ASSERT(ret == DPS_OK);
+    }
+    for (i = 0; i < NUM_LINKED_NODES; ++i) {
+        ret = DPS_LinkTo(hub, DPS_GetListenAddressString(nodes[i]), addrs[i]);
+        ASSERT(ret == DPS_ERR_EXISTS);
+    }
+    /*
+     * Unlink half of the nodes and link them again
+     */
+    for (i = 0; i < NUM_LINKED_NODES; i += 2) {
+        ret = DPS_UnlinkFrom(hub, addrs[i]);
+        ASSERT(ret == DPS_OK);
+    }
+    for (i = 0; i < NUM_LINKED_NODES; i += 2) {
+        ret = DPS_LinkTo(hub, DPS_GetListenAddressString(nodes[i]), addrs[i]);
+        ASSERT(ret == DPS_OK);
+    }
+    for (i = 0; i < NUM_LINKED_NODES; ++i) {
+        ret = DPS_LinkTo(hub, DPS_GetListenAddressString(nodes[i]), addrs[i]);
+        ASSERT(ret == DPS_ERR_EXISTS);
+    }
+
+    DestroyNode(hub);
+    for (i = 0; i < NUM_LINKED_NODES; ++i) {
+        DPS_DestroyAddress(addrs[i]);
+        DestroyNode(nodes[i]);
+    }
+    DestroyKeyStore(keyStore);
+}
+
 static void OnLink(DPS_Node* node, const DPS_NodeAddress* addr, DPS_Status status, void* data)
 {
 }
@@ -496,6 +547,76 @@ static void TestMutualShutdown(void)
     DestroyKeyStore(keyStore);
 }
 
+static void OnLinkComplete(DPS_Node* node, const DPS_NodeAddress* addr, DPS_Status status, void* data)
+{
+    DPS_SignalEvent((DPS_Event*)data, status);
+}
+
+static int SubscriptionSent(DPS_Node* node, const DPS_NodeAddress* addr)
+{
+    RemoteNode* remote;
+    int sent;
+
+    DPS_LockNode(node);
+    remote = DPS_LookupRemoteNode(node, addr);
+    sent = remote && remote->outbound.sakPending;
+    DPS_UnlockNode(node);
+    return sent;
+}
+
+static void TestBloomHashMismatch(void)
+{
+    DPS_MemoryKeyStore* keyStore = NULL;
+    DPS_Node* a = NULL;
+    DPS_Node* b = NULL;
+    DPS_NodeAddress* addr = NULL;
+    DPS_Event* event = NULL;
+    DPS_Status ret;
+
+    keyStore = CreateKeyStore();
+    a = CreateNode(keyStore);
+    b = CreateNode(keyStore);
+
+    addr = GetListenAddress(b);
+    ASSERT(addr);
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    /*
+     * The Bloom filter hash is a system wide setting so b is held
+     * locked while a sends its subscription using the fast hash, b
+     * then decodes the subscription using the default hash.
+     */
+    DPS_LockNode(b);
+    ret = DPS_ConfigureBloomHash(DPS_BloomHashFast);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_LinkRemoteAddr(a, addr, OnLinkComplete, event);
+    ASSERT(ret == DPS_OK);
+    while (!SubscriptionSent(a, addr)) {
+        SLEEP(1);
+    }
+    ret = DPS_ConfigureBloomHash(DPS_BloomHashSha2);
+    ASSERT(ret == DPS_OK);
+    DPS_UnlockNode(b);
+    /*
+     * The link must fail promptly rather than after the subscription
+     * has been resent up to the retry limit
+     */
+    ret = DPS_TimedWaitForEvent(event, 1000);
+    ASSERT(ret == DPS_ERR_INCOMPATIBLE);
+    DPS_LockNode(a);
+    ASSERT(!a->remoteNodes);
+    DPS_UnlockNode(a);
+    DPS_LockNode(b);
+    ASSERT(!b->remoteNodes);
+    DPS_UnlockNode(b);
+
+    DPS_DestroyEvent(event);
+    DPS_DestroyAddress(addr);
+    DestroyNode(b);
+    DestroyNode(a);
+    DestroyKeyStore(keyStore);
+}
+
 #if defined(DPS_USE_DTLS)
 static void TestPSKFailure(void)
 {
@@ -957,6 +1078,7 @@ int main(int argc, char** argv)
 
     TestRemoteLinkedAlready();
     TestLinkUnlink();
+    TestLinkMany();
     TestUnlinkWhileLinkInProgress();
     TestLinkShutdown();
     TestShutdownWhenNoLinks();
@@ -964,6 +1086,7 @@ int main(int argc, char** argv)
     TestShutdownWhileIncomingLinkInProgress();
     TestDestroyShutdown();
     TestMutualShutdown();
+    TestBloomHashMismatch();
 #if defined(DPS_USE_DTLS)
     TestPSKFailure();
     TestCertificateMissing();
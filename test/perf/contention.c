@@ -0,0 +1,289 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include <safe_lib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include <dps/dbg.h>
+#include <dps/dps.h>
+#include <dps/event.h>
+#include "../test.h"
+
+/*
+ * Benchmark for lock contention between application threads calling
+ * DPS_Publish() and the node thread sending the publications to a
+ * number of linked remote nodes. Each publisher thread publishes on
+ * its own publication and the time spent in each DPS_Publish() call
+ * is measured. With a batch size greater than one the publications are
+ * published with DPS_PublishBatch() and the time spent in each call is
+ * measured.
+ */
+
+#define MAX_THREADS  64
+#define MAX_REMOTES  64
+
+static const char* topic = "dps/contention";
+
+typedef struct _Publisher {
+    uv_thread_t thread;
+    DPS_Publication* pub;
+    uint8_t* payload;
+    int payloadSize;
+    int numPubs;
+    int batchSize;
+    int failures;
+    uint64_t minNs;
+    uint64_t maxNs;
+    uint64_t sumNs;
+} Publisher;
+
+static void OnNodeDestroyed(DPS_Node* node, void* data)
+{
+    DPS_SignalEvent((DPS_Event*)data, DPS_OK);
+}
+
+static void OnPub(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+}
+
+static void PublishBatchComplete(DPS_PublishBatchEntry* entries, size_t numEntries, void* data)
+{
+    free(entries);
+}
+
+static DPS_Status PublishBatch(Publisher* publisher, int numEntries)
+{
+    DPS_PublishBatchEntry* entries;
+    int i;
+
+    /*
+     * The entries must remain valid until the batch completes
+     */
+    entries = calloc(numEntries, sizeof(DPS_PublishBatchEntry) + sizeof(DPS_Buffer));
+    if (!entries) {
+        return DPS_ERR_RESOURCES;
+    }
+    for (i = 0; i < numEntries; ++i) {
+        DPS_Buffer* buf = (DPS_Buffer*)&entries[numEntries] + i;
+        buf->base = publisher->payload;
+        buf->len = publisher->payloadSize;
+        entries[i].pub = publisher->pub;
+        entries[i].bufs = publisher->payloadSize ? buf : NULL;
+        entries[i].numBufs = publisher->payloadSize ? 1 : 0;
+    }
+    return DPS_PublishBatch(entries, numEntries, PublishBatchComplete, NULL);
+}
+
+static void PublishThread(void* arg)
+{
+    Publisher* publisher = (Publisher*)arg;
+    uint64_t start;
+    uint64_t elapsed;
+    DPS_Status ret;
+    int n;
+    int i;
+
+    publisher->minNs = UINT64_MAX;
+    for (i = 0; i < publisher->numPubs; i += n) {
+        n = publisher->batchSize;
+        if (n > (publisher->numPubs - i)) {
+            n = publisher->numPubs - i;
+        }
+        start = uv_hrtime();
+        if (publisher->batchSize > 1) {
+            ret = PublishBatch(publisher, n);
+        } else {
+            ret = DPS_Publish(publisher->pub, publisher->payload, publisher->payloadSize, 0);
+        }
+        if (ret != DPS_OK) {
+            publisher->failures += n;
+        }
+        elapsed = uv_hrtime() - start;
+        if (elapsed < publisher->minNs) {
+            publisher->minNs = elapsed;
+        }
+        if (elapsed > publisher->maxNs) {
+            publisher->maxNs = elapsed;
+        }
+        publisher->sumNs += elapsed;
+    }
+}
+
+static void DestroyNode(DPS_Node* node)
+{
+    DPS_Event* event = DPS_CreateEvent();
+    if (event) {
+        if (DPS_DestroyNode(node, OnNodeDestroyed, event) == DPS_OK) {
+            DPS_WaitForEvent(event);
+        }
+        DPS_DestroyEvent(event);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    char** arg = argv + 1;
+    int numThreads = 4;
+    int numRemotes = 4;
+    int numPubs = 10000;
+    int payloadSize = 0;
+    int batchSize = 1;
+    DPS_Node* node = NULL;
+    DPS_Node* remotes[MAX_REMOTES] = { NULL };
+    DPS_Subscription* subs[MAX_REMOTES] = { NULL };
+    Publisher publishers[MAX_THREADS];
+    uint64_t start;
+    uint64_t elapsed;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t maxNs = 0;
+    uint64_t sumNs = 0;
+    int failures = 0;
+    DPS_Status ret;
+    int i;
+
+    DPS_Debug = DPS_FALSE;
+    while (--argc) {
+        if (strcmp(*arg, "-d") == 0) {
+            ++arg;
+            DPS_Debug = DPS_TRUE;
+            continue;
+        }
+        if (IntArg("-t", &arg, &argc, &numThreads, 1, MAX_THREADS)) {
+            continue;
+        }
+        if (IntArg("-r", &arg, &argc, &numRemotes, 0, MAX_REMOTES)) {
+            continue;
+        }
+        if (IntArg("-n", &arg, &argc, &numPubs, 1, 1000000)) {
+            continue;
+        }
+        if (IntArg("-s", &arg, &argc, &payloadSize, 0, UINT16_MAX)) {
+            continue;
+        }
+        if (IntArg("-b", &arg, &argc, &batchSize, 1, 100000)) {
+            continue;
+        }
+        goto Usage;
+    }
+
+    node = DPS_CreateNode("/", NULL, NULL);
+    ret = DPS_StartNode(node, DPS_MCAST_PUB_DISABLED, NULL);
+    if (ret != DPS_OK) {
+        DPS_ERRPRINT("DPS_StartNode failed: %s\n", DPS_ErrTxt(ret));
+        return 1;
+    }
+    /*
+     * The remote nodes subscribe to the topic so every publication is
+     * forwarded to all of them by the node thread
+     */
+    for (i = 0; i < numRemotes; ++i) {
+        remotes[i] = DPS_CreateNode("/", NULL, NULL);
+        ret = DPS_StartNode(remotes[i], DPS_MCAST_PUB_DISABLED, NULL);
+        if (ret != DPS_OK) {
+            DPS_ERRPRINT("DPS_StartNode failed: %s\n", DPS_ErrTxt(ret));
+            return 1;
+        }
+        subs[i] = DPS_CreateSubscription(remotes[i], &topic, 1);
+        ret = DPS_Subscribe(subs[i], OnPub);
+        if (ret != DPS_OK) {
+            DPS_ERRPRINT("DPS_Subscribe failed: %s\n", DPS_ErrTxt(ret));
+            return 1;
+        }
+        ret = DPS_LinkTo(remotes[i], DPS_GetListenAddressString(node), NULL);
+        if (ret != DPS_OK) {
+            DPS_ERRPRINT("DPS_LinkTo failed: %s\n", DPS_ErrTxt(ret));
+            return 1;
+        }
+    }
+    /*
+     * Give the subscriptions time to propagate to the publishing node
+     */
+    SLEEP(1000);
+
+    memset(publishers, 0, sizeof(publishers));
+    for (i = 0; i < numThreads; ++i) {
+        publishers[i].pub = DPS_CreatePublication(node);
+        ret = DPS_InitPublication(publishers[i].pub, &topic, 1, DPS_FALSE, NULL);
+        if (ret != DPS_OK) {
+            DPS_ERRPRINT("DPS_InitPublication failed: %s\n", DPS_ErrTxt(ret));
+            return 1;
+        }
+        if (payloadSize) {
+            publishers[i].payload = calloc(1, payloadSize);
+        }
+        publishers[i].payloadSize = payloadSize;
+        publishers[i].numPubs = numPubs;
+        publishers[i].batchSize = batchSize;
+    }
+    start = uv_hrtime();
+    for (i = 0; i < numThreads; ++i) {
+        if (uv_thread_create(&publishers[i].thread, PublishThread, &publishers[i])) {
+            DPS_ERRPRINT("Failed to create publisher thread\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < numThreads; ++i) {
+        uv_thread_join(&publishers[i].thread);
+    }
+    elapsed = uv_hrtime() - start;
+
+    for (i = 0; i < numThreads; ++i) {
+        if (publishers[i].minNs < minNs) {
+            minNs = publishers[i].minNs;
+        }
+        if (publishers[i].maxNs > maxNs) {
+            maxNs = publishers[i].maxNs;
+        }
+        sumNs += publishers[i].sumNs;
+        failures += publishers[i].failures;
+    }
+    printf("Threads %d, remotes %d, pubs per thread %d, payload size %d, batch size %d, failures %d\n",
+           numThreads, numRemotes, numPubs, payloadSize, batchSize, failures);
+    printf("Publish call min %uuS, max %uuS, avg per pub %.2fuS, throughput %.0f pubs/s\n",
+           (unsigned)(minNs / 1000), (unsigned)(maxNs / 1000),
+           (double)sumNs / (1000.0 * numThreads * numPubs),
+           (double)numThreads * numPubs * 1000000000.0 / (double)elapsed);
+
+    for (i = 0; i < numThreads; ++i) {
+        DPS_DestroyPublication(publishers[i].pub, NULL);
+        free(publishers[i].payload);
+    }
+    for (i = 0; i < numRemotes; ++i) {
+        DPS_DestroySubscription(subs[i], NULL);
+        DestroyNode(remotes[i]);
+    }
+    DestroyNode(node);
+    return 0;
+
+Usage:
+    DPS_PRINT("Usage %s [-d] [-t <threads>] [-r <remotes>] [-n <count>] [-s <size>] [-b <batch>]\n", argv[0]);
+    DPS_PRINT("       -d: Enable debug ouput if built for debug.\n");
+    DPS_PRINT("       -t: Number of publishing threads.\n");
+    DPS_PRINT("       -r: Number of remote nodes subscribing to the publications.\n");
+    DPS_PRINT("       -n: Number of publications to send from each thread.\n");
+    DPS_PRINT("       -s: Size of PUB payload.\n");
+    DPS_PRINT("       -b: Number of publications per DPS_PublishBatch() call, 1 to call DPS_Publish().\n");
+    return 1;
+}
@@ -0,0 +1,185 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2018 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include <safe_lib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dps/dbg.h>
+#include <dps/dps.h>
+#include "../test.h"
+#include "bitvec.h"
+
+/*
+ * Microbenchmark for the count vector operations. The count vector is
+ * preloaded with a number of entries and then the time taken to add
+ * and delete a bit vector, and to compute the union and intersection,
+ * is measured for sparse and dense bit vectors.
+ */
+
+#ifdef DPS_BIT_SLICED_COUNTER
+static const char* representation = "bit-sliced";
+#else
+static const char* representation = "per-bit";
+#endif
+
+#ifdef _WIN32
+static int ElapsedMicroseconds(void)
+{
+    static LARGE_INTEGER freq = { 0 };
+    static LARGE_INTEGER prev;
+    LARGE_INTEGER now;
+    LONGLONG elapsed;
+
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    elapsed = now.QuadPart - prev.QuadPart;
+    prev.QuadPart = now.QuadPart;
+    return (int)(elapsed * 1000000 / freq.QuadPart);
+}
+#else
+static int ElapsedMicroseconds(void)
+{
+    static struct timespec prev;
+    uint64_t elapsed;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - prev.tv_sec) * 1000000000ull + (now.tv_nsec - prev.tv_nsec);
+    prev = now;
+    return (int)(elapsed / 1000);
+}
+#endif
+
+/*
+ * Populate a bit vector by inserting 8192 / sparsity random values
+ */
+static DPS_BitVector* RandomBitVector(int sparsity)
+{
+    DPS_BitVector* bv = DPS_BitVectorAlloc();
+    uint8_t buf[8];
+    int i;
+
+    ASSERT(bv);
+    for (i = 0; i < 8192 / sparsity; ++i) {
+        int j;
+        for (j = 0; j < (int)sizeof(buf); ++j) {
+            buf[j] = (uint8_t)rand();
+        }
+        DPS_BitVectorBloomInsert(bv, buf, sizeof(buf));
+    }
+    return bv;
+}
+
+static void Benchmark(const char* name, int sparsity, int numEntries, int iterations)
+{
+    DPS_CountVector* cv = DPS_CountVectorAlloc();
+    DPS_BitVector** entries;
+    DPS_BitVector* bv;
+    DPS_Status ret;
+    int addDelTime;
+    int unionTime;
+    int intersectionTime;
+    int i;
+
+    ASSERT(cv);
+    entries = calloc(numEntries, sizeof(DPS_BitVector*));
+    ASSERT(entries);
+    for (i = 0; i < numEntries; ++i) {
+        entries[i] = RandomBitVector(sparsity);
+        ret = DPS_CountVectorAdd(cv, entries[i]);
+        ASSERT(ret == DPS_OK);
+    }
+    bv = RandomBitVector(sparsity);
+
+    ElapsedMicroseconds();
+    for (i = 0; i < iterations; ++i) {
+        ret = DPS_CountVectorAdd(cv, bv);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_CountVectorDel(cv, bv);
+        ASSERT(ret == DPS_OK);
+    }
+    addDelTime = ElapsedMicroseconds();
+    for (i = 0; i < iterations; ++i) {
+        DPS_BitVectorFree(DPS_CountVectorToUnion(cv));
+    }
+    unionTime = ElapsedMicroseconds();
+    for (i = 0; i < iterations; ++i) {
+        DPS_BitVectorFree(DPS_CountVectorToIntersection(cv));
+    }
+    intersectionTime = ElapsedMicroseconds();
+
+    printf("%-8s %5.1f%% load  add+del %8.3fuS  union %8.3fuS  intersection %8.3fuS\n",
+           name, DPS_BitVectorLoadFactor(bv),
+           (double)addDelTime / iterations,
+           (double)unionTime / iterations,
+           (double)intersectionTime / iterations);
+
+    DPS_BitVectorFree(bv);
+    for (i = 0; i < numEntries; ++i) {
+        ret = DPS_CountVectorDel(cv, entries[i]);
+        ASSERT(ret == DPS_OK);
+        DPS_BitVectorFree(entries[i]);
+    }
+    free(entries);
+    DPS_CountVectorFree(cv);
+}
+
+int main(int argc, char** argv)
+{
+    char** arg = argv + 1;
+    int numEntries = 100;
+    int iterations = 10000;
+
+    DPS_Debug = DPS_FALSE;
+    while (--argc) {
+        if (strcmp(*arg, "-d") == 0) {
+            ++arg;
+            DPS_Debug = DPS_TRUE;
+            continue;
+        }
+        if (IntArg("-e", &arg, &argc, &numEntries, 0, 10000)) {
+            continue;
+        }
+        if (IntArg("-n", &arg, &argc, &iterations, 1, 10000000)) {
+            continue;
+        }
+        goto Usage;
+    }
+    srand(1);
+    printf("Count vector %s counters, %d entries, %d iterations\n", representation, numEntries, iterations);
+    Benchmark("sparse", 512, numEntries, iterations);
+    Benchmark("medium", 32, numEntries, iterations);
+    Benchmark("dense", 2, numEntries, iterations);
+    return 0;
+
+Usage:
+    DPS_PRINT("Usage %s [-d] [-e <entries>] [-n <iterations>]\n", argv[0]);
+    DPS_PRINT("       -d: Enable debug ouput if built for debug.\n");
+    DPS_PRINT("       -e: Number of entries to preload in the count vector.\n");
+    DPS_PRINT("       -n: Number of iterations for each measurement.\n");
+    return 1;
+}
@@ -0,0 +1,239 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#include <safe_lib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include <dps/dbg.h>
+#include <dps/dps.h>
+#include "../test.h"
+#include "queue.h"
+
+/*
+ * Microbenchmark for submitting items from application threads to a
+ * libuv loop thread. The mutex protected queue the node used for
+ * requests and publications is compared with the lock-free
+ * multi-producer single-consumer queue. The consumer drains the queue
+ * from an async callback and checks that the items from each producer
+ * arrive in the order they were pushed.
+ */
+
+#define MAX_THREADS  64
+
+typedef struct _Item {
+    DPS_Queue queue;
+    int producer;
+    int seq;
+} Item;
+
+typedef struct _Consumer Consumer;
+
+typedef struct _Producer {
+    uv_thread_t thread;
+    Consumer* consumer;
+    Item* items;
+    int id;
+    uint64_t sumNs;
+} Producer;
+
+struct _Consumer {
+    int mpsc;
+    uv_loop_t loop;
+    uv_async_t async;
+    uv_mutex_t mutex;
+    DPS_Queue queue;
+    DPS_MpscQueue mpscQueue;
+    int numThreads;
+    int numItems;
+    int received;
+    int drains;
+    int errors;
+    int next[MAX_THREADS];
+    Producer producers[MAX_THREADS];
+};
+
+static void Push(Consumer* consumer, Item* item)
+{
+    if (consumer->mpsc) {
+        if (DPS_MpscQueuePush(&consumer->mpscQueue, &item->queue)) {
+            uv_async_send(&consumer->async);
+        }
+    } else {
+        uv_mutex_lock(&consumer->mutex);
+        DPS_QueuePushBack(&consumer->queue, &item->queue);
+        uv_async_send(&consumer->async);
+        uv_mutex_unlock(&consumer->mutex);
+    }
+}
+
+static void ProducerThread(void* arg)
+{
+    Producer* producer = (Producer*)arg;
+    Consumer* consumer = producer->consumer;
+    uint64_t start;
+    int i;
+
+    for (i = 0; i < consumer->numItems; ++i) {
+        Item* item = &producer->items[i];
+        item->producer = producer->id;
+        item->seq = i;
+        start = uv_hrtime();
+        Push(consumer, item);
+        producer->sumNs += uv_hrtime() - start;
+    }
+}
+
+static void Consume(Consumer* consumer, Item* item)
+{
+    if (item->seq != consumer->next[item->producer]) {
+        ++consumer->errors;
+    }
+    consumer->next[item->producer] = item->seq + 1;
+    ++consumer->received;
+}
+
+static void OnAsync(uv_async_t* handle)
+{
+    Consumer* consumer = (Consumer*)handle->data;
+    DPS_Queue items;
+    Item* item;
+
+    DPS_QueueInit(&items);
+    if (consumer->mpsc) {
+        DPS_MpscQueueDrain(&consumer->mpscQueue, &items);
+    } else {
+        /*
+         * Take the whole batch while holding the mutex
+         */
+        uv_mutex_lock(&consumer->mutex);
+        while (!DPS_QueueEmpty(&consumer->queue)) {
+            item = (Item*)DPS_QueueFront(&consumer->queue);
+            DPS_QueueRemove(&item->queue);
+            DPS_QueuePushBack(&items, &item->queue);
+        }
+        uv_mutex_unlock(&consumer->mutex);
+    }
+    ++consumer->drains;
+    while (!DPS_QueueEmpty(&items)) {
+        item = (Item*)DPS_QueueFront(&items);
+        DPS_QueueRemove(&item->queue);
+        Consume(consumer, item);
+    }
+    if (consumer->received == (consumer->numThreads * consumer->numItems)) {
+        uv_close((uv_handle_t*)handle, NULL);
+    }
+}
+
+static int Run(int mpsc, int numThreads, int numItems)
+{
+    Consumer* consumer;
+    uint64_t start;
+    uint64_t elapsed;
+    uint64_t sumNs = 0;
+    int total = numThreads * numItems;
+    int errors;
+    int i;
+
+    consumer = calloc(1, sizeof(Consumer));
+    if (!consumer) {
+        return 1;
+    }
+    consumer->mpsc = mpsc;
+    consumer->numThreads = numThreads;
+    consumer->numItems = numItems;
+    uv_loop_init(&consumer->loop);
+    uv_async_init(&consumer->loop, &consumer->async, OnAsync);
+    consumer->async.data = consumer;
+    uv_mutex_init(&consumer->mutex);
+    DPS_QueueInit(&consumer->queue);
+    DPS_MpscQueueInit(&consumer->mpscQueue);
+    for (i = 0; i < numThreads; ++i) {
+        consumer->producers[i].consumer = consumer;
+        consumer->producers[i].id = i;
+        consumer->producers[i].items = calloc(numItems, sizeof(Item));
+        if (!consumer->producers[i].items) {
+            return 1;
+        }
+    }
+    start = uv_hrtime();
+    for (i = 0; i < numThreads; ++i) {
+        if (uv_thread_create(&consumer->producers[i].thread, ProducerThread, &consumer->producers[i])) {
+            DPS_ERRPRINT("Failed to create producer thread\n");
+            return 1;
+        }
+    }
+    uv_run(&consumer->loop, UV_RUN_DEFAULT);
+    elapsed = uv_hrtime() - start;
+    for (i = 0; i < numThreads; ++i) {
+        uv_thread_join(&consumer->producers[i].thread);
+        sumNs += consumer->producers[i].sumNs;
+        free(consumer->producers[i].items);
+    }
+    printf("%-6s %d items in %.2fmS, push avg %.0fnS, throughput %.0f items/s, %d drains, %d order errors\n",
+           mpsc ? "mpsc" : "mutex", consumer->received, (double)elapsed / 1000000.0,
+           (double)sumNs / (double)total, (double)total * 1000000000.0 / (double)elapsed,
+           consumer->drains, consumer->errors);
+    errors = consumer->errors || (consumer->received != total);
+    uv_mutex_destroy(&consumer->mutex);
+    uv_loop_close(&consumer->loop);
+    free(consumer);
+    return errors;
+}
+
+int main(int argc, char** argv)
+{
+    char** arg = argv + 1;
+    int numThreads = 4;
+    int numItems = 1000000;
+    int errors = 0;
+
+    DPS_Debug = DPS_FALSE;
+    while (--argc) {
+        if (strcmp(*arg, "-d") == 0) {
+            ++arg;
+            DPS_Debug = DPS_TRUE;
+            continue;
+        }
+        if (IntArg("-t", &arg, &argc, &numThreads, 1, MAX_THREADS)) {
+            continue;
+        }
+        if (IntArg("-n", &arg, &argc, &numItems, 1, 100000000)) {
+            continue;
+        }
+        goto Usage;
+    }
+
+    printf("Threads %d, items per thread %d\n", numThreads, numItems);
+    errors += Run(DPS_FALSE, numThreads, numItems);
+    errors += Run(DPS_TRUE, numThreads, numItems);
+    return errors ? 1 : 0;
+
+Usage:
+    DPS_PRINT("Usage %s [-d] [-t <threads>] [-n <count>]\n", argv[0]);
+    DPS_PRINT("       -d: Enable debug ouput if built for debug.\n");
+    DPS_PRINT("       -t: Number of producer threads.\n");
+    DPS_PRINT("       -n: Number of items to push from each thread.\n");
+    return 1;
+}
@@ -20,8 +20,10 @@
 *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 */
 
+#include <uv.h>
 #include "test.h"
 #include "keys.h"
+#include "pub.h"
 
 #define A_SIZEOF(a)  (sizeof(a) / sizeof((a)[0]))
 
@@ -164,6 +166,85 @@ static void TestLoopbackAckLargeMessage(DPS_Node* node, DPS_MemoryKeyStore* keyS
     DPS_DestroyPublication(pub, NULL);
 }
 
+#define NUM_ACKED_PUBS 200
+
+typedef struct _ManyAcks {
+    DPS_Event* event;
+    size_t expected;
+    size_t numAcks;
+} ManyAcks;
+
+static void ManyAcksHandler(DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    ManyAcks* acks = (ManyAcks*)DPS_GetPublicationData(pub);
+    if (++acks->numAcks == acks->expected) {
+        DPS_SignalEvent(acks->event, DPS_OK);
+    }
+}
+
+static void ManyAcksPublicationHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    DPS_Status ret = DPS_AckPublication(pub, NULL, 0);
+    ASSERT(ret == DPS_OK);
+}
+
+/*
+ * Acks are matched to the local publications by pubId, so this grows
+ * the publication index and removes entries from the middle of it
+ */
+static void TestManyPublicationAcks(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    DPS_Publication* pubs[NUM_ACKED_PUBS];
+    DPS_Subscription* sub = NULL;
+    ManyAcks acks;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    acks.event = DPS_CreateEvent();
+    ASSERT(acks.event);
+    for (i = 0; i < NUM_ACKED_PUBS; ++i) {
+        pubs[i] = CreatePublication(node, topics, numTopics, ManyAcksHandler);
+        ret = DPS_SetPublicationData(pubs[i], &acks);
+        ASSERT(ret == DPS_OK);
+    }
+    sub = DPS_CreateSubscription(node, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_Subscribe(sub, ManyAcksPublicationHandler);
+    ASSERT(ret == DPS_OK);
+
+    acks.numAcks = 0;
+    acks.expected = NUM_ACKED_PUBS;
+    for (i = 0; i < NUM_ACKED_PUBS; ++i) {
+        ret = DPS_Publish(pubs[i], NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+    }
+    ret = DPS_TimedWaitForEvent(acks.event, 10000);
+    ASSERT(ret == DPS_OK);
+
+    for (i = 0; i < NUM_ACKED_PUBS; i += 2) {
+        DPS_DestroyPublication(pubs[i], NULL);
+        pubs[i] = NULL;
+    }
+    acks.numAcks = 0;
+    acks.expected = NUM_ACKED_PUBS / 2;
+    for (i = 1; i < NUM_ACKED_PUBS; i += 2) {
+        ret = DPS_Publish(pubs[i], NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+    }
+    ret = DPS_TimedWaitForEvent(acks.event, 10000);
+    ASSERT(ret == DPS_OK);
+
+    DPS_DestroySubscription(sub, NULL);
+    for (i = 1; i < NUM_ACKED_PUBS; i += 2) {
+        DPS_DestroyPublication(pubs[i], NULL);
+    }
+    DPS_DestroyEvent(acks.event);
+}
+
 #define HISTORY_CAP 10
 
 static DPS_Publication* pubs[HISTORY_CAP + 1];
@@ -467,6 +548,94 @@ static void TestRetainedExpired(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
     DPS_DestroyEvent(event);
 }
 
+#define NUM_EXPIRING_PUBS 3
+
+typedef struct _ExpiryOrder {
+    DPS_Event* event;
+    DPS_Publication* pubs[NUM_EXPIRING_PUBS];
+    size_t order[NUM_EXPIRING_PUBS];
+    size_t numExpired;
+} ExpiryOrder;
+
+static void ExpiryOrderHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    ExpiryOrder* eo = (ExpiryOrder*)DPS_GetSubscriptionData(sub);
+    size_t i;
+
+    if (DPS_PublicationGetTTL(pub) >= 0) {
+        return;
+    }
+    for (i = 0; i < NUM_EXPIRING_PUBS; ++i) {
+        if (DPS_UUIDCompare(DPS_PublicationGetUUID(pub), DPS_PublicationGetUUID(eo->pubs[i])) == 0) {
+            ASSERT(eo->numExpired < NUM_EXPIRING_PUBS);
+            eo->order[eo->numExpired++] = i;
+        }
+    }
+    if (eo->numExpired == NUM_EXPIRING_PUBS) {
+        DPS_SignalEvent(eo->event, DPS_OK);
+    }
+}
+
+/*
+ * Publications retained later with a shorter TTL expire first on the
+ * subscriber node
+ */
+static void TestRetainedExpiryOrder(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    DPS_Event* event = NULL;
+    DPS_Node* subNode = NULL;
+    DPS_Subscription* sub = NULL;
+    ExpiryOrder eo;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(subNode);
+    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_ENABLE_RECV, NULL);
+    ASSERT(ret == DPS_OK);
+
+    memset(&eo, 0, sizeof(eo));
+    eo.event = DPS_CreateEvent();
+    ASSERT(eo.event);
+    sub = DPS_CreateSubscription(subNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &eo);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_SubscribeExpired(sub, DPS_TRUE);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, ExpiryOrderHandler);
+    ASSERT(ret == DPS_OK);
+
+    for (i = 0; i < NUM_EXPIRING_PUBS; ++i) {
+        eo.pubs[i] = CreatePublication(node, topics, numTopics, NULL);
+    }
+    for (i = 0; i < NUM_EXPIRING_PUBS; ++i) {
+        ret = DPS_Publish(eo.pubs[i], NULL, 0, (int16_t)(NUM_EXPIRING_PUBS - i));
+        ASSERT(ret == DPS_OK);
+        SLEEP(100);
+    }
+    ret = DPS_TimedWaitForEvent(eo.event, 10000);
+    ASSERT(ret == DPS_OK);
+    for (i = 0; i < NUM_EXPIRING_PUBS; ++i) {
+        ASSERT(eo.order[i] == (NUM_EXPIRING_PUBS - 1 - i));
+    }
+
+    DPS_DestroySubscription(sub, NULL);
+    for (i = 0; i < NUM_EXPIRING_PUBS; ++i) {
+        DPS_DestroyPublication(eo.pubs[i], NULL);
+    }
+    DPS_DestroyEvent(eo.event);
+    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(event);
+}
+
 static void RetainedLoopbackMessageHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
 {
     DPS_Event* event = (DPS_Event*)DPS_GetSubscriptionData(sub);
@@ -553,95 +722,941 @@ static void TestSequenceNumbers(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
     DPS_DestroyPublication(pub, NULL);
 }
 
+#define NUM_CONCURRENT_PUBLISHERS 4
+#define NUM_CONCURRENT_PUBS       1000
+
+typedef struct _ConcurrentPublish {
+    DPS_Publication* pub;
+    DPS_Event* event;
+    uint32_t expectedSequenceNum;
+    size_t numReceived;
+} ConcurrentPublish;
+
+static void ConcurrentPublishHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    ConcurrentPublish* cp = (ConcurrentPublish*)DPS_GetSubscriptionData(sub);
+    uint32_t sequenceNum = DPS_PublicationGetSequenceNum(pub);
+
+    /*
+     * Publications from concurrent publishers are delivered in
+     * sequence number order without gaps
+     */
+    ASSERT(sequenceNum == cp->expectedSequenceNum);
+    ++cp->expectedSequenceNum;
+    if (++cp->numReceived == (NUM_CONCURRENT_PUBLISHERS * NUM_CONCURRENT_PUBS)) {
+        DPS_SignalEvent(cp->event, DPS_OK);
+    }
+}
+
+static void ConcurrentPublishThread(void* arg)
+{
+    ConcurrentPublish* cp = (ConcurrentPublish*)arg;
+    DPS_Status ret;
+    size_t i;
+
+    for (i = 0; i < NUM_CONCURRENT_PUBS; ++i) {
+        ret = DPS_Publish(cp->pub, NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+    }
+}
+
+static void TestConcurrentPublish(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    uv_thread_t threads[NUM_CONCURRENT_PUBLISHERS];
+    ConcurrentPublish cp;
+    DPS_Subscription* sub = NULL;
+    DPS_Status ret;
+    int err;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    cp.event = DPS_CreateEvent();
+    ASSERT(cp.event);
+    cp.pub = CreatePublication(node, topics, numTopics, NULL);
+    cp.expectedSequenceNum = DPS_PublicationGetSequenceNum(cp.pub) + 1;
+    cp.numReceived = 0;
+    sub = DPS_CreateSubscription(node, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &cp);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, ConcurrentPublishHandler);
+    ASSERT(ret == DPS_OK);
+
+    for (i = 0; i < A_SIZEOF(threads); ++i) {
+        err = uv_thread_create(&threads[i], ConcurrentPublishThread, &cp);
+        ASSERT(err == 0);
+    }
+    for (i = 0; i < A_SIZEOF(threads); ++i) {
+        uv_thread_join(&threads[i]);
+    }
+    ret = DPS_TimedWaitForEvent(cp.event, 10000);
+    ASSERT(ret == DPS_OK);
+    ASSERT(DPS_PublicationGetSequenceNum(cp.pub) == cp.expectedSequenceNum - 1);
+
+    DPS_DestroySubscription(sub, NULL);
+    DPS_DestroyPublication(cp.pub, NULL);
+    DPS_DestroyEvent(cp.event);
+}
+
 static void PublishBufsComplete(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs,
                                  DPS_Status status, void* data)
 {
     DPS_SignalEvent((DPS_Event*)data, status);
 }
 
-static void TestPublishNoRoutes(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+#define NUM_BATCH_PUBS     2
+#define NUM_BATCH_ENTRIES  64
+
+typedef struct _PublishBatchData {
+    DPS_Publication* pubs[NUM_BATCH_PUBS];
+    uint32_t expectedSequenceNum[NUM_BATCH_PUBS];
+    size_t numReceived;
+    DPS_Event* receivedEvent;
+    DPS_Event* completeEvent;
+} PublishBatchData;
+
+static void PublishBatchHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    PublishBatchData* pbd = (PublishBatchData*)DPS_GetSubscriptionData(sub);
+    uint32_t sequenceNum = DPS_PublicationGetSequenceNum(pub);
+    size_t i;
+
+    for (i = 0; i < NUM_BATCH_PUBS; ++i) {
+        if (!DPS_UUIDCompare(DPS_PublicationGetUUID(pub), DPS_PublicationGetUUID(pbd->pubs[i]))) {
+            break;
+        }
+    }
+    ASSERT(i < NUM_BATCH_PUBS);
+    ASSERT(sequenceNum == pbd->expectedSequenceNum[i]);
+    ASSERT(len == sizeof(sequenceNum));
+    ASSERT(memcmp(payload, &sequenceNum, len) == 0);
+    ++pbd->expectedSequenceNum[i];
+    if (++pbd->numReceived == NUM_BATCH_ENTRIES) {
+        DPS_SignalEvent(pbd->receivedEvent, DPS_OK);
+    }
+}
+
+static void PublishBatchComplete(DPS_PublishBatchEntry* entries, size_t numEntries, void* data)
+{
+    PublishBatchData* pbd = (PublishBatchData*)data;
+    DPS_Status ret = DPS_OK;
+    size_t i;
+
+    for (i = 0; i < numEntries; ++i) {
+        if (entries[i].status != DPS_OK) {
+            ret = entries[i].status;
+        }
+    }
+    DPS_SignalEvent(pbd->completeEvent, ret);
+}
+
+static void TestPublishBatch(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
 {
     static const char* topics[] = { __FUNCTION__ };
     static const size_t numTopics = 1;
-    DPS_Event* event = NULL;
-    DPS_Node* pubNode = NULL;
-    DPS_Publication* pub = NULL;
+    DPS_PublishBatchEntry entries[NUM_BATCH_ENTRIES + 1];
+    uint32_t sequenceNums[NUM_BATCH_ENTRIES];
+    DPS_Buffer bufs[NUM_BATCH_ENTRIES];
+    PublishBatchData pbd;
+    DPS_Node* otherNode = NULL;
+    DPS_Publication* otherPub = NULL;
+    DPS_Subscription* sub = NULL;
     DPS_Status ret;
+    size_t i;
 
     DPS_PRINT("%s\n", __FUNCTION__);
 
-    event = DPS_CreateEvent();
-    ASSERT(event);
+    memset(&pbd, 0, sizeof(pbd));
+    pbd.receivedEvent = DPS_CreateEvent();
+    ASSERT(pbd.receivedEvent);
+    pbd.completeEvent = DPS_CreateEvent();
+    ASSERT(pbd.completeEvent);
+    for (i = 0; i < NUM_BATCH_PUBS; ++i) {
+        pbd.pubs[i] = CreatePublication(node, topics, numTopics, NULL);
+        pbd.expectedSequenceNum[i] = DPS_PublicationGetSequenceNum(pbd.pubs[i]) + 1;
+    }
+    sub = DPS_CreateSubscription(node, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &pbd);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, PublishBatchHandler);
+    ASSERT(ret == DPS_OK);
 
     /*
-     * Create a node with multicast disabled and no subscribers.  This
-     * will result in no routes for the publication to be delivered
-     * to.
+     * Invalid arguments
      */
-    pubNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
-    ASSERT(pubNode);
-    ret = DPS_StartNode(pubNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ret = DPS_PublishBatch(NULL, 1, PublishBatchComplete, &pbd);
+    ASSERT(ret == DPS_ERR_NULL);
+    ret = DPS_PublishBatch(entries, 0, PublishBatchComplete, &pbd);
+    ASSERT(ret == DPS_ERR_ARGS);
+    otherNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(otherNode);
+    ret = DPS_StartNode(otherNode, DPS_MCAST_PUB_DISABLED, NULL);
     ASSERT(ret == DPS_OK);
+    otherPub = CreatePublication(otherNode, topics, numTopics, NULL);
+    memset(entries, 0, sizeof(entries));
+    entries[0].pub = pbd.pubs[0];
+    entries[1].pub = otherPub;
+    ret = DPS_PublishBatch(entries, 2, PublishBatchComplete, &pbd);
+    ASSERT(ret == DPS_ERR_ARGS);
+    /*
+     * None of the entries can be queued
+     */
+    entries[0].ttl = -1;
+    ret = DPS_PublishBatch(entries, 1, PublishBatchComplete, &pbd);
+    ASSERT(ret == DPS_ERR_INVALID);
+    ASSERT(entries[0].status == DPS_ERR_INVALID);
 
-    pub = CreatePublication(pubNode, topics, numTopics, NULL);
-    ret = DPS_PublishBufs(pub, NULL, 0, 0, PublishBufsComplete, event);
+    /*
+     * Entries for the publications are interleaved, the last entry
+     * cannot be queued and does not stop the others from being sent
+     */
+    for (i = 0; i < NUM_BATCH_ENTRIES; ++i) {
+        DPS_Publication* pub = pbd.pubs[i % NUM_BATCH_PUBS];
+        sequenceNums[i] = pbd.expectedSequenceNum[i % NUM_BATCH_PUBS] + (uint32_t)(i / NUM_BATCH_PUBS);
+        bufs[i].base = (uint8_t*)&sequenceNums[i];
+        bufs[i].len = sizeof(sequenceNums[i]);
+        entries[i].pub = pub;
+        entries[i].bufs = &bufs[i];
+        entries[i].numBufs = 1;
+        entries[i].ttl = 0;
+    }
+    entries[NUM_BATCH_ENTRIES].pub = pbd.pubs[0];
+    entries[NUM_BATCH_ENTRIES].bufs = NULL;
+    entries[NUM_BATCH_ENTRIES].numBufs = 1;
+    ret = DPS_PublishBatch(entries, A_SIZEOF(entries), PublishBatchComplete, &pbd);
     ASSERT(ret == DPS_OK);
-    ret = DPS_WaitForEvent(event);
+    ret = DPS_TimedWaitForEvent(pbd.receivedEvent, 10000);
     ASSERT(ret == DPS_OK);
+    ret = DPS_TimedWaitForEvent(pbd.completeEvent, 10000);
+    ASSERT(ret == DPS_ERR_ARGS);
+    for (i = 0; i < NUM_BATCH_ENTRIES; ++i) {
+        ASSERT(entries[i].status == DPS_OK);
+    }
+    ASSERT(entries[NUM_BATCH_ENTRIES].status == DPS_ERR_ARGS);
+    for (i = 0; i < NUM_BATCH_PUBS; ++i) {
+        ASSERT(DPS_PublicationGetSequenceNum(pbd.pubs[i]) == pbd.expectedSequenceNum[i] - 1);
+    }
 
-    DPS_DestroyPublication(pub, NULL);
-    DPS_DestroyNode(pubNode, OnNodeDestroyed, event);
-    DPS_WaitForEvent(event);
-    DPS_DestroyEvent(event);
+    DPS_DestroySubscription(sub, NULL);
+    for (i = 0; i < NUM_BATCH_PUBS; ++i) {
+        DPS_DestroyPublication(pbd.pubs[i], NULL);
+    }
+    DPS_DestroyPublication(otherPub, NULL);
+    DPS_DestroyNode(otherNode, OnNodeDestroyed, pbd.completeEvent);
+    DPS_WaitForEvent(pbd.completeEvent);
+    DPS_DestroyEvent(pbd.receivedEvent);
+    DPS_DestroyEvent(pbd.completeEvent);
 }
 
-static void PublishHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+#define NUM_DESTROY_ROUNDS      20
+#define NUM_DESTROY_PUBLISHERS  3
+#define NUM_DESTROY_BATCH       4
+#define NUM_DESTROY_PUBS        100000
+
+typedef struct _PublishDestroy {
+    DPS_Publication* pub;
+    DPS_Event* destroyedEvent;
+    DPS_Event* batchEvent;
+    size_t numComplete;     /* Updated on the node thread */
+    volatile size_t numAccepted[NUM_DESTROY_PUBLISHERS];
+} PublishDestroy;
+
+typedef struct _PublishDestroyThread {
+    PublishDestroy* pd;
+    size_t index;
+} PublishDestroyThread;
+
+static void PublishDestroyBufsComplete(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs,
+                                       DPS_Status status, void* data)
 {
-    DPS_Event* event = (DPS_Event*)DPS_GetSubscriptionData(sub);
-    DPS_SignalEvent(event, DPS_OK);
+    ++((PublishDestroy*)data)->numComplete;
 }
 
-static void TestRemoveSubId(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+static void PublishDestroyBatchComplete(DPS_PublishBatchEntry* entries, size_t numEntries, void* data)
+{
+    PublishDestroy* pd = (PublishDestroy*)data;
+
+    ++pd->numComplete;
+    DPS_SignalEvent(pd->batchEvent, DPS_OK);
+}
+
+static void PublishDestroyOnDestroyed(DPS_Publication* pub)
+{
+    DPS_SignalEvent(((PublishDestroy*)DPS_GetPublicationData(pub))->destroyedEvent, DPS_OK);
+}
+
+static void PublishDestroyPublisher(void* arg)
+{
+    PublishDestroyThread* pdt = (PublishDestroyThread*)arg;
+    PublishDestroy* pd = pdt->pd;
+    DPS_PublishBatchEntry entries[NUM_DESTROY_BATCH];
+    uint8_t payload[64] = { 0 };
+    DPS_Buffer buf = { payload, sizeof(payload) };
+    DPS_Status ret;
+    size_t n;
+    size_t i;
+
+    /*
+     * Publish until the publication is destroyed, the last thread
+     * publishes batches
+     */
+    for (n = 0; n < NUM_DESTROY_PUBS; ++n) {
+        if (pdt->index == (NUM_DESTROY_PUBLISHERS - 1)) {
+            memset(entries, 0, sizeof(entries));
+            for (i = 0; i < NUM_DESTROY_BATCH; ++i) {
+                entries[i].pub = pd->pub;
+                entries[i].bufs = &buf;
+                entries[i].numBufs = 1;
+            }
+            ret = DPS_PublishBatch(entries, NUM_DESTROY_BATCH, PublishDestroyBatchComplete, pd);
+            /*
+             * The entries are updated until the batch is complete
+             */
+            if (ret == DPS_OK) {
+                DPS_WaitForEvent(pd->batchEvent);
+            }
+        } else {
+            ret = DPS_PublishBufs(pd->pub, &buf, 1, 0, PublishDestroyBufsComplete, pd);
+        }
+        ASSERT((ret == DPS_OK) || (ret == DPS_ERR_MISSING));
+        if (ret != DPS_OK) {
+            break;
+        }
+        ++pd->numAccepted[pdt->index];
+    }
+}
+
+static void TestPublishWhileDestroying(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    uv_thread_t threads[NUM_DESTROY_PUBLISHERS];
+    PublishDestroyThread pdt[NUM_DESTROY_PUBLISHERS];
+    PublishDestroy pd;
+    DPS_Status ret;
+    size_t numAccepted;
+    size_t round;
+    size_t i;
+    int err;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    for (round = 0; round < NUM_DESTROY_ROUNDS; ++round) {
+        memset(&pd, 0, sizeof(pd));
+        pd.destroyedEvent = DPS_CreateEvent();
+        ASSERT(pd.destroyedEvent);
+        pd.batchEvent = DPS_CreateEvent();
+        ASSERT(pd.batchEvent);
+        pd.pub = CreatePublication(node, topics, numTopics, NULL);
+        ret = DPS_SetPublicationData(pd.pub, &pd);
+        ASSERT(ret == DPS_OK);
+
+        for (i = 0; i < NUM_DESTROY_PUBLISHERS; ++i) {
+            pdt[i].pd = &pd;
+            pdt[i].index = i;
+            err = uv_thread_create(&threads[i], PublishDestroyPublisher, &pdt[i]);
+            ASSERT(err == 0);
+        }
+        /*
+         * Destroy the publication while the threads are publishing
+         */
+        while (pd.numAccepted[0] < 100) {
+            SLEEP(0);
+        }
+        ret = DPS_DestroyPublication(pd.pub, PublishDestroyOnDestroyed);
+        ASSERT(ret == DPS_OK);
+        for (i = 0; i < NUM_DESTROY_PUBLISHERS; ++i) {
+            uv_thread_join(&threads[i]);
+        }
+        ret = DPS_TimedWaitForEvent(pd.destroyedEvent, 10000);
+        ASSERT(ret == DPS_OK);
+        /*
+         * Every accepted publish request was completed before the
+         * publication was released
+         */
+        numAccepted = 0;
+        for (i = 0; i < NUM_DESTROY_PUBLISHERS; ++i) {
+            numAccepted += pd.numAccepted[i];
+        }
+        ASSERT(pd.numComplete == numAccepted);
+
+        DPS_DestroyEvent(pd.destroyedEvent);
+        DPS_DestroyEvent(pd.batchEvent);
+    }
+}
+
+static void HistorySizeHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    DPS_SignalEvent((DPS_Event*)DPS_GetSubscriptionData(sub), DPS_OK);
+}
+
+#define HISTORY_SIZE 2
+
+static void TestHistorySize(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
 {
     static const char* topics[] = { __FUNCTION__ };
     static const size_t numTopics = 1;
-    DPS_Publication* pub = NULL;
     DPS_Event* event = NULL;
-    DPS_MemoryKeyStore* subKeyStore = NULL;
     DPS_Node* subNode = NULL;
     DPS_Subscription* sub = NULL;
+    DPS_Publication* pubs[2 * HISTORY_SIZE];
+    DPS_HistoryStats stats;
     DPS_Status ret;
+    size_t i;
 
     DPS_PRINT("%s\n", __FUNCTION__);
 
-    ret = DPS_SetContentKey(keyStore, &PskId[0], &Psk[0]);
-    ASSERT(ret == DPS_OK);
-    ret = DPS_SetContentKey(keyStore, &PskId[1], &Psk[1]);
-    ASSERT(ret == DPS_OK);
-
-    pub = CreatePublication(node, topics, numTopics, NULL);
+    ret = DPS_SetNodeHistorySize(NULL, HISTORY_SIZE);
+    ASSERT(ret == DPS_ERR_NULL);
+    ret = DPS_SetNodeHistorySize(node, HISTORY_SIZE);
+    ASSERT(ret == DPS_ERR_INVALID);
+    ret = DPS_GetNodeHistoryStats(node, NULL);
+    ASSERT(ret == DPS_ERR_NULL);
 
     event = DPS_CreateEvent();
     ASSERT(event);
-
-    subKeyStore = DPS_CreateMemoryKeyStore();
-    DPS_SetNetworkKey(subKeyStore, &NetworkKeyId, &NetworkKey);
-    ret = DPS_SetContentKey(subKeyStore, &PskId[0], &Psk[0]);
-    ASSERT(ret == DPS_OK);
-    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(subKeyStore), &PskId[0]);
+    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
     ASSERT(subNode);
-    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_ENABLE_RECV, NULL);
+    ret = DPS_SetNodeHistorySize(subNode, 0);
+    ASSERT(ret == DPS_ERR_ARGS);
+    ret = DPS_SetNodeHistorySize(subNode, HISTORY_SIZE);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_GetNodeHistoryStats(subNode, &stats);
+    ASSERT(ret == DPS_ERR_NOT_STARTED);
+    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_DISABLED, NULL);
     ASSERT(ret == DPS_OK);
 
     sub = DPS_CreateSubscription(subNode, topics, numTopics);
     ASSERT(sub);
     ret = DPS_SetSubscriptionData(sub, event);
     ASSERT(ret == DPS_OK);
-    ret = DPS_Subscribe(sub, PublishHandler);
+    ret = DPS_Subscribe(sub, HistorySizeHandler);
     ASSERT(ret == DPS_OK);
 
     /*
-     * Encrypt for two keys, then remove one of them.  If we only
+     * Loopback publications are recorded in the history of the node
+     */
+    for (i = 0; i < A_SIZEOF(pubs); ++i) {
+        pubs[i] = CreatePublication(subNode, topics, numTopics, NULL);
+        ret = DPS_Publish(pubs[i], NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_TimedWaitForEvent(event, 10000);
+        ASSERT(ret == DPS_OK);
+    }
+    ret = DPS_GetNodeHistoryStats(subNode, &stats);
+    ASSERT(ret == DPS_OK);
+    ASSERT(stats.maxCount == HISTORY_SIZE);
+    ASSERT(stats.count <= HISTORY_SIZE);
+    ASSERT(stats.inserted >= A_SIZEOF(pubs));
+    ASSERT(stats.evicted == (stats.inserted - stats.count - stats.expired));
+
+    DPS_DestroySubscription(sub, NULL);
+    for (i = 0; i < A_SIZEOF(pubs); ++i) {
+        DPS_DestroyPublication(pubs[i], NULL);
+    }
+    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(event);
+}
+
+#define NUM_FAN_OUT_NODES 8
+
+static void FanOutHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    DPS_SignalEvent((DPS_Event*)DPS_GetSubscriptionData(sub), DPS_OK);
+}
+
+static void TestPublishFanOut(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    DPS_Node* subNodes[NUM_FAN_OUT_NODES];
+    DPS_Subscription* subs[NUM_FAN_OUT_NODES];
+    DPS_Event* subEvents[NUM_FAN_OUT_NODES];
+    int received[NUM_FAN_OUT_NODES];
+    DPS_NodeAddress* addr = NULL;
+    DPS_Publication* pub = NULL;
+    DPS_Event* event = NULL;
+    DPS_Status ret;
+    size_t numReceived;
+    size_t i;
+    size_t j;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    addr = DPS_CreateAddress();
+    ASSERT(addr);
+
+    for (i = 0; i < NUM_FAN_OUT_NODES; ++i) {
+        subNodes[i] = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+        ASSERT(subNodes[i]);
+        ret = DPS_StartNode(subNodes[i], DPS_MCAST_PUB_DISABLED, NULL);
+        ASSERT(ret == DPS_OK);
+        subEvents[i] = DPS_CreateEvent();
+        ASSERT(subEvents[i]);
+        subs[i] = DPS_CreateSubscription(subNodes[i], topics, numTopics);
+        ASSERT(subs[i]);
+        ret = DPS_SetSubscriptionData(subs[i], subEvents[i]);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_Subscribe(subs[i], FanOutHandler);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_LinkTo(subNodes[i], DPS_GetListenAddressString(node), addr);
+        ASSERT(ret == DPS_OK);
+        received[i] = DPS_FALSE;
+    }
+
+    /*
+     * Keep publishing until the subscriptions have propagated to the
+     * publishing node, each publication is sent to all of the
+     * subscribers known at that time
+     */
+    pub = CreatePublication(node, topics, numTopics, NULL);
+    numReceived = 0;
+    for (j = 0; (j < 100) && (numReceived < NUM_FAN_OUT_NODES); ++j) {
+        ret = DPS_Publish(pub, NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+        for (i = 0; i < NUM_FAN_OUT_NODES; ++i) {
+            if (!received[i] && (DPS_TimedWaitForEvent(subEvents[i], 100) == DPS_OK)) {
+                received[i] = DPS_TRUE;
+                ++numReceived;
+            }
+        }
+    }
+    ASSERT(numReceived == NUM_FAN_OUT_NODES);
+
+    DPS_DestroyPublication(pub, NULL);
+    for (i = 0; i < NUM_FAN_OUT_NODES; ++i) {
+        DPS_DestroySubscription(subs[i], NULL);
+        DPS_DestroyNode(subNodes[i], OnNodeDestroyed, event);
+        DPS_WaitForEvent(event);
+        DPS_DestroyEvent(subEvents[i]);
+    }
+    DPS_DestroyAddress(addr);
+    DPS_DestroyEvent(event);
+}
+
+static void RxBufferPoolHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    DPS_SignalEvent((DPS_Event*)DPS_GetSubscriptionData(sub), DPS_OK);
+}
+
+/*
+ * Receives one message that fits within the ceiling of the pool and
+ * one that does not
+ */
+#define RX_POOL_MAX_BYTES 4096
+
+static void TestRxBufferPool(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    static uint8_t payload[2 * RX_POOL_MAX_BYTES];
+    DPS_RxBufferPoolStats stats;
+    DPS_Subscription* sub = NULL;
+    DPS_Publication* pub = NULL;
+    DPS_NodeAddress* addr = NULL;
+    DPS_Node* subNode = NULL;
+    DPS_Event* event = NULL;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    ret = DPS_SetNodeRxBufferPool(NULL, RX_POOL_MAX_BYTES);
+    ASSERT(ret == DPS_ERR_NULL);
+    ret = DPS_SetNodeRxBufferPool(node, RX_POOL_MAX_BYTES);
+    ASSERT(ret == DPS_ERR_INVALID);
+    ret = DPS_GetNodeRxBufferPoolStats(node, NULL);
+    ASSERT(ret == DPS_ERR_NULL);
+    ret = DPS_GetNodeRxBufferPoolStats(node, &stats);
+    ASSERT(ret == DPS_OK);
+    ASSERT(stats.maxBytes == DPS_RX_BUFFER_POOL_MAX_BYTES);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(subNode);
+    ret = DPS_GetNodeRxBufferPoolStats(subNode, &stats);
+    ASSERT(ret == DPS_ERR_NOT_STARTED);
+    ret = DPS_SetNodeRxBufferPool(subNode, RX_POOL_MAX_BYTES);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    sub = DPS_CreateSubscription(subNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, event);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, RxBufferPoolHandler);
+    ASSERT(ret == DPS_OK);
+    addr = DPS_CreateAddress();
+    ASSERT(addr);
+    ret = DPS_LinkTo(subNode, DPS_GetListenAddressString(node), addr);
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * Keep publishing until the subscription has propagated to the
+     * publishing node
+     */
+    pub = CreatePublication(node, topics, numTopics, NULL);
+    for (i = 0; i < 100; ++i) {
+        ret = DPS_Publish(pub, NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_TimedWaitForEvent(event, 100);
+        if (ret == DPS_OK) {
+            break;
+        }
+    }
+    ASSERT(ret == DPS_OK);
+    ret = DPS_GetNodeRxBufferPoolStats(subNode, &stats);
+    ASSERT(ret == DPS_OK);
+    ASSERT(stats.maxBytes == RX_POOL_MAX_BYTES);
+    ASSERT(stats.highWater > 0);
+    ASSERT(stats.bytes <= RX_POOL_MAX_BYTES);
+    ASSERT(stats.fallbacks == 0);
+
+    ret = DPS_Publish(pub, payload, sizeof(payload), 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_TimedWaitForEvent(event, 10000);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_GetNodeRxBufferPoolStats(subNode, &stats);
+    ASSERT(ret == DPS_OK);
+    ASSERT(stats.bytes <= RX_POOL_MAX_BYTES);
+    ASSERT(stats.highWater <= RX_POOL_MAX_BYTES);
+    ASSERT(stats.fallbacks > 0);
+
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroySubscription(sub, NULL);
+    DPS_DestroyAddress(addr);
+    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(event);
+}
+
+#define NUM_BURSTS          8
+#define NUM_BURST_PUBS      64
+#define BURST_PAYLOAD_LEN   1024
+
+typedef struct _ReceiveBurst {
+    DPS_Event* linkedEvent;
+    DPS_Event* burstEvent;
+    size_t numReceived;
+} ReceiveBurst;
+
+static void ReceiveBurstHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    ReceiveBurst* rb = (ReceiveBurst*)DPS_GetSubscriptionData(sub);
+
+    if (len != BURST_PAYLOAD_LEN) {
+        DPS_SignalEvent(rb->linkedEvent, DPS_OK);
+    } else if (++rb->numReceived == NUM_BURST_PUBS) {
+        DPS_SignalEvent(rb->burstEvent, DPS_OK);
+    }
+}
+
+/*
+ * Sends publications back to back so they are waiting together on the
+ * receiving socket
+ */
+static void TestReceiveBurst(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    static uint8_t payload[BURST_PAYLOAD_LEN];
+    DPS_RxBufferPoolStats stats;
+    ReceiveBurst rb;
+    DPS_Subscription* sub = NULL;
+    DPS_Publication* pub = NULL;
+    DPS_NodeAddress* addr = NULL;
+    DPS_Node* subNode = NULL;
+    DPS_Event* event = NULL;
+    DPS_Status ret;
+    size_t i;
+    size_t j;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    memset(&rb, 0, sizeof(rb));
+    rb.linkedEvent = DPS_CreateEvent();
+    ASSERT(rb.linkedEvent);
+    rb.burstEvent = DPS_CreateEvent();
+    ASSERT(rb.burstEvent);
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(subNode);
+    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    sub = DPS_CreateSubscription(subNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &rb);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, ReceiveBurstHandler);
+    ASSERT(ret == DPS_OK);
+    addr = DPS_CreateAddress();
+    ASSERT(addr);
+    ret = DPS_LinkTo(subNode, DPS_GetListenAddressString(node), addr);
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * Keep publishing until the subscription has propagated to the
+     * publishing node
+     */
+    pub = CreatePublication(node, topics, numTopics, NULL);
+    for (i = 0; i < 100; ++i) {
+        ret = DPS_Publish(pub, NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_TimedWaitForEvent(rb.linkedEvent, 100);
+        if (ret == DPS_OK) {
+            break;
+        }
+    }
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * Every publication of each burst arrives
+     */
+    for (j = 0; j < NUM_BURSTS; ++j) {
+        rb.numReceived = 0;
+        for (i = 0; i < NUM_BURST_PUBS; ++i) {
+            ret = DPS_Publish(pub, payload, sizeof(payload), 0);
+            ASSERT(ret == DPS_OK);
+        }
+        ret = DPS_TimedWaitForEvent(rb.burstEvent, 10000);
+        ASSERT(ret == DPS_OK);
+        ASSERT(rb.numReceived == NUM_BURST_PUBS);
+    }
+    /*
+     * The bursts were received into pooled buffers released by the
+     * earlier bursts rather than a new buffer for each publication
+     */
+    ret = DPS_GetNodeRxBufferPoolStats(subNode, &stats);
+    ASSERT(ret == DPS_OK);
+    ASSERT(stats.fallbacks == 0);
+    ASSERT(stats.highWater < (NUM_BURSTS / 2) * NUM_BURST_PUBS * sizeof(payload));
+
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroySubscription(sub, NULL);
+    DPS_DestroyAddress(addr);
+    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(event);
+    DPS_DestroyEvent(rb.linkedEvent);
+    DPS_DestroyEvent(rb.burstEvent);
+}
+
+static void RemoteMatchHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    DPS_SignalEvent((DPS_Event*)DPS_GetSubscriptionData(sub), DPS_OK);
+}
+
+/*
+ * Publishes until the subscription on the remote node receives the
+ * publication, the subscription may take a while to propagate
+ */
+static DPS_Status PublishUntilReceived(DPS_Publication* pub, DPS_Event* event)
+{
+    DPS_Status ret = DPS_ERR_TIMEOUT;
+    size_t i;
+
+    for (i = 0; i < 100; ++i) {
+        ret = DPS_Publish(pub, NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_TimedWaitForEvent(event, 100);
+        if (ret == DPS_OK) {
+            break;
+        }
+    }
+    return ret;
+}
+
+static void TestRemoteMatchCache(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topicsA[] = { "TestRemoteMatchCache/A" };
+    static const char* topicsB[] = { "TestRemoteMatchCache/B" };
+    DPS_Subscription* subA = NULL;
+    DPS_Subscription* subB = NULL;
+    DPS_Publication* pubA = NULL;
+    DPS_Publication* pubB = NULL;
+    DPS_NodeAddress* addr = NULL;
+    DPS_Node* subNode = NULL;
+    DPS_Event* eventA = NULL;
+    DPS_Event* eventB = NULL;
+    DPS_Event* event = NULL;
+    uint64_t prevHits;
+    uint64_t prevMisses;
+    uint64_t hits;
+    uint64_t misses;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    eventA = DPS_CreateEvent();
+    ASSERT(eventA);
+    eventB = DPS_CreateEvent();
+    ASSERT(eventB);
+    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(subNode);
+    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    subA = DPS_CreateSubscription(subNode, topicsA, A_SIZEOF(topicsA));
+    ASSERT(subA);
+    ret = DPS_SetSubscriptionData(subA, eventA);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(subA, RemoteMatchHandler);
+    ASSERT(ret == DPS_OK);
+    addr = DPS_CreateAddress();
+    ASSERT(addr);
+    ret = DPS_LinkTo(subNode, DPS_GetListenAddressString(node), addr);
+    ASSERT(ret == DPS_OK);
+
+    pubA = CreatePublication(node, topicsA, A_SIZEOF(topicsA), NULL);
+    pubB = CreatePublication(node, topicsB, A_SIZEOF(topicsB), NULL);
+    ret = PublishUntilReceived(pubA, eventA);
+    ASSERT(ret == DPS_OK);
+    /*
+     * Publishing again reuses the match against the remote node
+     */
+    DPS_RemoteMatchStats(node, &prevHits, &prevMisses);
+    for (i = 0; i < 4; ++i) {
+        ret = DPS_Publish(pubA, NULL, 0, 0);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_TimedWaitForEvent(eventA, 10000);
+        ASSERT(ret == DPS_OK);
+    }
+    DPS_RemoteMatchStats(node, &hits, &misses);
+    ASSERT(hits >= prevHits + 4);
+    ASSERT(misses == prevMisses);
+    /*
+     * The remote node does not match the publication until it
+     * subscribes, the cached result must not be used after that
+     */
+    ret = DPS_Publish(pubB, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    for (i = 0; (i < 100) && (misses == prevMisses); ++i) {
+        SLEEP(10);
+        DPS_RemoteMatchStats(node, &hits, &misses);
+    }
+    ASSERT(misses == prevMisses + 1);
+    ret = DPS_Publish(pubB, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_TimedWaitForEvent(eventB, 100);
+    ASSERT(ret == DPS_ERR_TIMEOUT);
+    subB = DPS_CreateSubscription(subNode, topicsB, A_SIZEOF(topicsB));
+    ASSERT(subB);
+    ret = DPS_SetSubscriptionData(subB, eventB);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(subB, RemoteMatchHandler);
+    ASSERT(ret == DPS_OK);
+    ret = PublishUntilReceived(pubB, eventB);
+    ASSERT(ret == DPS_OK);
+
+    DPS_DestroyPublication(pubA, NULL);
+    DPS_DestroyPublication(pubB, NULL);
+    DPS_DestroySubscription(subA, NULL);
+    DPS_DestroySubscription(subB, NULL);
+    DPS_DestroyAddress(addr);
+    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(event);
+    DPS_DestroyEvent(eventA);
+    DPS_DestroyEvent(eventB);
+}
+
+static void TestPublishNoRoutes(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    DPS_Event* event = NULL;
+    DPS_Node* pubNode = NULL;
+    DPS_Publication* pub = NULL;
+    DPS_Status ret;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+
+    /*
+     * Create a node with multicast disabled and no subscribers.  This
+     * will result in no routes for the publication to be delivered
+     * to.
+     */
+    pubNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(pubNode);
+    ret = DPS_StartNode(pubNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    pub = CreatePublication(pubNode, topics, numTopics, NULL);
+    ret = DPS_PublishBufs(pub, NULL, 0, 0, PublishBufsComplete, event);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_WaitForEvent(event);
+    ASSERT(ret == DPS_OK);
+
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroyNode(pubNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(event);
+}
+
+static void PublishHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    DPS_Event* event = (DPS_Event*)DPS_GetSubscriptionData(sub);
+    DPS_SignalEvent(event, DPS_OK);
+}
+
+static void TestRemoveSubId(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    DPS_Publication* pub = NULL;
+    DPS_Event* event = NULL;
+    DPS_MemoryKeyStore* subKeyStore = NULL;
+    DPS_Node* subNode = NULL;
+    DPS_Subscription* sub = NULL;
+    DPS_Status ret;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    ret = DPS_SetContentKey(keyStore, &PskId[0], &Psk[0]);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_SetContentKey(keyStore, &PskId[1], &Psk[1]);
+    ASSERT(ret == DPS_OK);
+
+    pub = CreatePublication(node, topics, numTopics, NULL);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+
+    subKeyStore = DPS_CreateMemoryKeyStore();
+    DPS_SetNetworkKey(subKeyStore, &NetworkKeyId, &NetworkKey);
+    ret = DPS_SetContentKey(subKeyStore, &PskId[0], &Psk[0]);
+    ASSERT(ret == DPS_OK);
+    subNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(subKeyStore), &PskId[0]);
+    ASSERT(subNode);
+    ret = DPS_StartNode(subNode, DPS_MCAST_PUB_ENABLE_RECV, NULL);
+    ASSERT(ret == DPS_OK);
+
+    sub = DPS_CreateSubscription(subNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, event);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, PublishHandler);
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * Encrypt for two keys, then remove one of them.  If we only
      * encrypted for one key, then removing it would result in an
      * unencrypted message which the sub will receive and decrypt: we
      * want to verify that a removed sub will not receive and decrypt
@@ -649,33 +1664,782 @@ static void TestRemoveSubId(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
      */
     ret = DPS_PublicationAddSubId(pub, &PskId[0]);
     ASSERT(ret == DPS_OK);
-    ret = DPS_PublicationAddSubId(pub, &PskId[1]);
+    ret = DPS_PublicationAddSubId(pub, &PskId[1]);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Publish(pub, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_WaitForEvent(event);
+    ASSERT(ret == DPS_OK);
+
+    DPS_PublicationRemoveSubId(pub, &PskId[0]);
+    ret = DPS_Publish(pub, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_TimedWaitForEvent(event, 1000);
+    ASSERT(ret != DPS_OK);
+
+    ret = DPS_PublicationAddSubId(pub, &PskId[0]);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Publish(pub, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_WaitForEvent(event);
+    ASSERT(ret == DPS_OK);
+
+    DPS_DestroySubscription(sub, NULL);
+    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyMemoryKeyStore(subKeyStore);
+    DPS_DestroyEvent(event);
+    DPS_DestroyPublication(pub, NULL);
+}
+
+#define NUM_LOOPBACK_SUBS 64
+
+typedef struct _LoopbackSubscriptions {
+    DPS_Event* event;
+    DPS_Subscription* subs[NUM_LOOPBACK_SUBS + 1];
+    size_t destroy;
+    size_t matched[NUM_LOOPBACK_SUBS + 1];
+    size_t numMatched;
+} LoopbackSubscriptions;
+
+static LoopbackSubscriptions loopbackSubs;
+
+static void LoopbackManySubscriptionsHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    size_t i = (size_t)(uintptr_t)DPS_GetSubscriptionData(sub);
+
+    ASSERT(loopbackSubs.numMatched < A_SIZEOF(loopbackSubs.matched));
+    loopbackSubs.matched[loopbackSubs.numMatched++] = i;
+    if (loopbackSubs.destroy && (i == NUM_LOOPBACK_SUBS)) {
+        DPS_DestroySubscription(loopbackSubs.subs[loopbackSubs.destroy], NULL);
+        loopbackSubs.subs[loopbackSubs.destroy] = NULL;
+    }
+    if (i == 5) {
+        DPS_SignalEvent(loopbackSubs.event, DPS_OK);
+    }
+}
+
+static void TestLoopbackManySubscriptions(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* pubTopics[] = { "TestLoopbackManySubscriptions/5", "TestLoopbackManySubscriptions/40" };
+    static const char* wildcard = "TestLoopbackManySubscriptions/+";
+    DPS_Publication* pub = NULL;
+    char topic[64];
+    const char* topics[1];
+    size_t i;
+    DPS_Status ret;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    memset(&loopbackSubs, 0, sizeof(loopbackSubs));
+    loopbackSubs.event = DPS_CreateEvent();
+    ASSERT(loopbackSubs.event);
+    /*
+     * The wildcard subscription is added last so it is called first
+     */
+    for (i = 0; i <= NUM_LOOPBACK_SUBS; ++i) {
+        if (i < NUM_LOOPBACK_SUBS) {
+            snprintf(topic, sizeof(topic), "TestLoopbackManySubscriptions/%zu", i);
+            topics[0] = topic;
+        } else {
+            topics[0] = wildcard;
+        }
+        loopbackSubs.subs[i] = DPS_CreateSubscription(node, topics, 1);
+        ASSERT(loopbackSubs.subs[i]);
+        ret = DPS_SetSubscriptionData(loopbackSubs.subs[i], (void*)(uintptr_t)i);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_Subscribe(loopbackSubs.subs[i], LoopbackManySubscriptionsHandler);
+        ASSERT(ret == DPS_OK);
+    }
+
+    pub = CreatePublication(node, pubTopics, A_SIZEOF(pubTopics), NULL);
+    ret = DPS_Publish(pub, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_WaitForEvent(loopbackSubs.event);
+    ASSERT(ret == DPS_OK);
+    ASSERT(loopbackSubs.numMatched == 3);
+    ASSERT(loopbackSubs.matched[0] == NUM_LOOPBACK_SUBS);
+    ASSERT(loopbackSubs.matched[1] == 40);
+    ASSERT(loopbackSubs.matched[2] == 5);
+
+    /*
+     * A subscription destroyed from a handler is not called
+     */
+    loopbackSubs.numMatched = 0;
+    loopbackSubs.destroy = 40;
+    ret = DPS_Publish(pub, NULL, 0, 0);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_WaitForEvent(loopbackSubs.event);
+    ASSERT(ret == DPS_OK);
+    ASSERT(loopbackSubs.numMatched == 2);
+    ASSERT(loopbackSubs.matched[0] == NUM_LOOPBACK_SUBS);
+    ASSERT(loopbackSubs.matched[1] == 5);
+
+    for (i = 0; i <= NUM_LOOPBACK_SUBS; ++i) {
+        if (loopbackSubs.subs[i]) {
+            DPS_DestroySubscription(loopbackSubs.subs[i], NULL);
+        }
+    }
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroyEvent(loopbackSubs.event);
+}
+
+#define NUM_HANDLER_THREAD_PUBS 200
+
+typedef struct _HandlerThreadsSubscription {
+    DPS_Event* event;
+    uint32_t expectedSequenceNum;
+    size_t numReceived;
+} HandlerThreadsSubscription;
+
+static void HandlerThreadsHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    HandlerThreadsSubscription* hts = (HandlerThreadsSubscription*)DPS_GetSubscriptionData(sub);
+    uint32_t sequenceNum = DPS_PublicationGetSequenceNum(pub);
+
+    /*
+     * Handlers for the same subscription are called one at a time in
+     * the order the publications were received
+     */
+    ASSERT(sequenceNum == hts->expectedSequenceNum);
+    ASSERT(len == sizeof(sequenceNum));
+    ASSERT(memcmp(payload, &sequenceNum, len) == 0);
+    ++hts->expectedSequenceNum;
+    if (++hts->numReceived == NUM_HANDLER_THREAD_PUBS) {
+        DPS_SignalEvent(hts->event, DPS_OK);
+    }
+}
+
+static void TestHandlerThreads(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    HandlerThreadsSubscription hts[2];
+    DPS_Subscription* subs[2];
+    DPS_Publication* pub = NULL;
+    DPS_Node* handlerNode = NULL;
+    DPS_Event* event = NULL;
+    uint32_t sequenceNum;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+
+    ret = DPS_SetNodeHandlerThreads(node, 2, 4, DPS_HANDLER_QUEUE_BLOCK);
+    ASSERT(ret == DPS_ERR_INVALID);
+
+    handlerNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(handlerNode);
+    ret = DPS_SetNodeHandlerThreads(handlerNode, 2, 0, DPS_HANDLER_QUEUE_BLOCK);
+    ASSERT(ret == DPS_ERR_ARGS);
+    ret = DPS_SetNodeHandlerThreads(handlerNode, 2, 4, DPS_HANDLER_QUEUE_BLOCK);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_StartNode(handlerNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    pub = CreatePublication(handlerNode, topics, numTopics, NULL);
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        hts[i].event = DPS_CreateEvent();
+        ASSERT(hts[i].event);
+        hts[i].expectedSequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+        hts[i].numReceived = 0;
+        subs[i] = DPS_CreateSubscription(handlerNode, topics, numTopics);
+        ASSERT(subs[i]);
+        ret = DPS_SetSubscriptionData(subs[i], &hts[i]);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_Subscribe(subs[i], HandlerThreadsHandler);
+        ASSERT(ret == DPS_OK);
+    }
+
+    for (i = 0; i < NUM_HANDLER_THREAD_PUBS; ++i) {
+        sequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+        ret = DPS_Publish(pub, (const uint8_t*)&sequenceNum, sizeof(sequenceNum), 0);
+        ASSERT(ret == DPS_OK);
+    }
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        ret = DPS_TimedWaitForEvent(hts[i].event, 10000);
+        ASSERT(ret == DPS_OK);
+        ASSERT(hts[i].numReceived == NUM_HANDLER_THREAD_PUBS);
+    }
+
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        DPS_DestroySubscription(subs[i], NULL);
+    }
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroyNode(handlerNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        DPS_DestroyEvent(hts[i].event);
+    }
+    DPS_DestroyEvent(event);
+}
+
+#define NUM_HANDLER_THREAD_RX_PUBS 100
+
+typedef struct _HandlerThreadsReceive {
+    DPS_Event* linkedEvent;
+    DPS_Event* event;
+    size_t numReceived;
+} HandlerThreadsReceive;
+
+#define HANDLER_THREADS_LINKED  SIZE_MAX
+
+static void HandlerThreadsReceiveHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    HandlerThreadsReceive* htr = (HandlerThreadsReceive*)DPS_GetSubscriptionData(sub);
+    size_t n;
+
+    ASSERT(len == sizeof(n));
+    memcpy(&n, payload, len);
+    if (n == HANDLER_THREADS_LINKED) {
+        DPS_SignalEvent(htr->linkedEvent, DPS_OK);
+    } else {
+        ASSERT(n == htr->numReceived);
+        ++htr->numReceived;
+        DPS_SignalEvent(htr->event, DPS_OK);
+    }
+}
+
+/*
+ * Publications received from a remote node share a receive buffer with
+ * the handler calls queued for them. The handler calls for each
+ * subscription complete on different handler threads.
+ */
+static void TestHandlerThreadsReceive(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    HandlerThreadsReceive htr[2];
+    DPS_Subscription* subs[2];
+    DPS_Publication* pub = NULL;
+    DPS_NodeAddress* addr = NULL;
+    DPS_Node* handlerNode = NULL;
+    DPS_Event* event = NULL;
+    DPS_Status ret;
+    size_t linked = HANDLER_THREADS_LINKED;
+    size_t n;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+
+    handlerNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(handlerNode);
+    ret = DPS_SetNodeHandlerThreads(handlerNode, 4, 16, DPS_HANDLER_QUEUE_BLOCK);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_StartNode(handlerNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        htr[i].linkedEvent = DPS_CreateEvent();
+        ASSERT(htr[i].linkedEvent);
+        htr[i].event = DPS_CreateEvent();
+        ASSERT(htr[i].event);
+        htr[i].numReceived = 0;
+        subs[i] = DPS_CreateSubscription(handlerNode, topics, numTopics);
+        ASSERT(subs[i]);
+        ret = DPS_SetSubscriptionData(subs[i], &htr[i]);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_Subscribe(subs[i], HandlerThreadsReceiveHandler);
+        ASSERT(ret == DPS_OK);
+    }
+
+    addr = DPS_CreateAddress();
+    ASSERT(addr);
+    ret = DPS_LinkTo(node, DPS_GetListenAddressString(handlerNode), addr);
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * Keep publishing until the subscriptions have propagated to the
+     * publishing node
+     */
+    pub = CreatePublication(node, topics, numTopics, NULL);
+    for (i = 0; i < 100; ++i) {
+        ret = DPS_Publish(pub, (const uint8_t*)&linked, sizeof(linked), 0);
+        ASSERT(ret == DPS_OK);
+        ret = DPS_TimedWaitForEvent(htr[0].linkedEvent, 100);
+        if (ret == DPS_OK) {
+            break;
+        }
+    }
+    ASSERT(ret == DPS_OK);
+    ret = DPS_TimedWaitForEvent(htr[1].linkedEvent, 10000);
+    ASSERT(ret == DPS_OK);
+    DPS_DestroyPublication(pub, NULL);
+
+    /*
+     * The handler node destroys each received publication while the
+     * handler calls for it may still be completing
+     */
+    for (n = 0; n < NUM_HANDLER_THREAD_RX_PUBS; ++n) {
+        pub = CreatePublication(node, topics, numTopics, NULL);
+        ret = DPS_Publish(pub, (const uint8_t*)&n, sizeof(n), 0);
+        ASSERT(ret == DPS_OK);
+        for (i = 0; i < A_SIZEOF(subs); ++i) {
+            ret = DPS_TimedWaitForEvent(htr[i].event, 10000);
+            ASSERT(ret == DPS_OK);
+        }
+        DPS_DestroyPublication(pub, NULL);
+    }
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        ASSERT(htr[i].numReceived == NUM_HANDLER_THREAD_RX_PUBS);
+    }
+
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        DPS_DestroySubscription(subs[i], NULL);
+    }
+    DPS_DestroyNode(handlerNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    for (i = 0; i < A_SIZEOF(subs); ++i) {
+        DPS_DestroyEvent(htr[i].linkedEvent);
+        DPS_DestroyEvent(htr[i].event);
+    }
+    DPS_DestroyAddress(addr);
+    DPS_DestroyEvent(event);
+}
+
+#define NUM_CRYPTO_OFFLOAD_PUBS 100
+
+typedef struct _CryptoOffloadSubscription {
+    DPS_Event* event;
+    uint32_t expectedSequenceNum;
+    size_t numReceived;
+} CryptoOffloadSubscription;
+
+static void CryptoOffloadHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    CryptoOffloadSubscription* cos = (CryptoOffloadSubscription*)DPS_GetSubscriptionData(sub);
+    uint32_t sequenceNum = DPS_PublicationGetSequenceNum(pub);
+
+    /*
+     * Publications are delivered in order even though they are
+     * encrypted and decrypted concurrently
+     */
+    ASSERT(sequenceNum == cos->expectedSequenceNum);
+    ASSERT(len == sizeof(sequenceNum));
+    ASSERT(memcmp(payload, &sequenceNum, len) == 0);
+    ++cos->expectedSequenceNum;
+    if (++cos->numReceived == NUM_CRYPTO_OFFLOAD_PUBS) {
+        DPS_SignalEvent(cos->event, DPS_OK);
+    }
+}
+
+static void TestCryptoOffload(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    CryptoOffloadSubscription cos;
+    DPS_Subscription* sub = NULL;
+    DPS_Publication* pub = NULL;
+    DPS_Node* cryptoNode = NULL;
+    DPS_Event* event = NULL;
+    uint32_t sequenceNum;
+    DPS_Status ret;
+    size_t i;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+
+    ret = DPS_SetNodeCryptoOffload(node, DPS_TRUE);
+    ASSERT(ret == DPS_ERR_INVALID);
+
+    ret = DPS_SetContentKey(keyStore, &PskId[0], &Psk[0]);
+    ASSERT(ret == DPS_OK);
+    cryptoNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(cryptoNode);
+    ret = DPS_SetNodeCryptoOffload(cryptoNode, DPS_TRUE);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_StartNode(cryptoNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    pub = CreatePublication(cryptoNode, topics, numTopics, NULL);
+    ret = DPS_PublicationAddSubId(pub, &PskId[0]);
+    ASSERT(ret == DPS_OK);
+
+    cos.event = DPS_CreateEvent();
+    ASSERT(cos.event);
+    cos.expectedSequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+    cos.numReceived = 0;
+    sub = DPS_CreateSubscription(cryptoNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &cos);
     ASSERT(ret == DPS_OK);
-    ret = DPS_Publish(pub, NULL, 0, 0);
+    ret = DPS_Subscribe(sub, CryptoOffloadHandler);
     ASSERT(ret == DPS_OK);
-    ret = DPS_WaitForEvent(event);
+
+    for (i = 0; i < NUM_CRYPTO_OFFLOAD_PUBS; ++i) {
+        sequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+        ret = DPS_Publish(pub, (const uint8_t*)&sequenceNum, sizeof(sequenceNum), 0);
+        ASSERT(ret == DPS_OK);
+    }
+    ret = DPS_TimedWaitForEvent(cos.event, 10000);
     ASSERT(ret == DPS_OK);
+    ASSERT(cos.numReceived == NUM_CRYPTO_OFFLOAD_PUBS);
 
-    DPS_PublicationRemoveSubId(pub, &PskId[0]);
-    ret = DPS_Publish(pub, NULL, 0, 0);
+    DPS_DestroySubscription(sub, NULL);
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroyNode(cryptoNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyEvent(cos.event);
+    DPS_DestroyEvent(event);
+}
+
+typedef struct _DecryptGate {
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    int closed;
+    size_t numDecrypts;
+} DecryptGate;
+
+static int SameKeyId(const DPS_KeyId* a, const DPS_KeyId* b)
+{
+    return (a->len == b->len) && !memcmp(a->id, b->id, a->len);
+}
+
+static DPS_Status DecryptGateKeyAndIdHandler(DPS_KeyStoreRequest* request)
+{
+    return DPS_SetKeyAndId(request, &NetworkKey, &NetworkKeyId);
+}
+
+static DPS_Status DecryptGateKeyHandler(DPS_KeyStoreRequest* request, const DPS_KeyId* keyId)
+{
+    DecryptGate* gate = (DecryptGate*)DPS_GetKeyStoreData(DPS_KeyStoreHandle(request));
+
+    if (SameKeyId(keyId, &NetworkKeyId)) {
+        return DPS_SetKey(request, &NetworkKey);
+    }
+    if (!SameKeyId(keyId, &PskId[0])) {
+        return DPS_ERR_MISSING;
+    }
+    /*
+     * This is called from the thread pool, the first decryption is
+     * held up until the gate is opened
+     */
+    uv_mutex_lock(&gate->mutex);
+    if (gate->numDecrypts++ == 0) {
+        uv_cond_broadcast(&gate->cond);
+        while (gate->closed) {
+            uv_cond_wait(&gate->cond, &gate->mutex);
+        }
+    } else {
+        uv_cond_broadcast(&gate->cond);
+    }
+    uv_mutex_unlock(&gate->mutex);
+    return DPS_SetKey(request, &Psk[0]);
+}
+
+static void WaitForDecrypts(DecryptGate* gate, size_t numDecrypts)
+{
+    int err = 0;
+
+    uv_mutex_lock(&gate->mutex);
+    while (!err && (gate->numDecrypts < numDecrypts)) {
+        err = uv_cond_timedwait(&gate->cond, &gate->mutex, 10000000000ull);
+    }
+    uv_mutex_unlock(&gate->mutex);
+    ASSERT(err == 0);
+}
+
+static void OpenDecryptGate(DecryptGate* gate)
+{
+    uv_mutex_lock(&gate->mutex);
+    gate->closed = DPS_FALSE;
+    uv_cond_broadcast(&gate->cond);
+    uv_mutex_unlock(&gate->mutex);
+}
+
+static void RetainedResendHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    if (DPS_PublicationGetTTL(pub) > 0) {
+        DPS_SignalEvent((DPS_Event*)DPS_GetSubscriptionData(sub), DPS_OK);
+    }
+}
+
+static void TestCryptoOffloadReceive(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const size_t numTopics = 1;
+    CryptoOffloadSubscription cos;
+    DecryptGate gate;
+    DPS_KeyStore* rxKeyStore = NULL;
+    DPS_Subscription* sub = NULL;
+    DPS_Subscription* obsSub = NULL;
+    DPS_Publication* pub = NULL;
+    DPS_NodeAddress* addr = NULL;
+    DPS_NodeAddress* obsAddr = NULL;
+    DPS_Node* rxNode = NULL;
+    DPS_Node* obsNode = NULL;
+    DPS_Event* obsEvent = NULL;
+    DPS_Event* event = NULL;
+    uint32_t sequenceNum;
+    DPS_Status ret;
+    size_t i;
+    int err;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    ret = DPS_SetContentKey(keyStore, &PskId[0], &Psk[0]);
     ASSERT(ret == DPS_OK);
-    ret = DPS_TimedWaitForEvent(event, 1000);
-    ASSERT(ret != DPS_OK);
 
+    err = uv_mutex_init(&gate.mutex);
+    ASSERT(err == 0);
+    err = uv_cond_init(&gate.cond);
+    ASSERT(err == 0);
+    gate.closed = DPS_TRUE;
+    gate.numDecrypts = 0;
+    rxKeyStore = DPS_CreateKeyStore(DecryptGateKeyAndIdHandler, DecryptGateKeyHandler, NULL, NULL);
+    ASSERT(rxKeyStore);
+    ret = DPS_SetKeyStoreData(rxKeyStore, &gate);
+    ASSERT(ret == DPS_OK);
+    rxNode = DPS_CreateNode("/.", rxKeyStore, NULL);
+    ASSERT(rxNode);
+    ret = DPS_SetNodeCryptoOffload(rxNode, DPS_TRUE);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_StartNode(rxNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+
+    cos.event = DPS_CreateEvent();
+    ASSERT(cos.event);
+    cos.numReceived = 0;
+    sub = DPS_CreateSubscription(rxNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &cos);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, CryptoOffloadHandler);
+    ASSERT(ret == DPS_OK);
+
+    addr = DPS_CreateAddress();
+    ASSERT(addr);
+    ret = DPS_LinkTo(node, DPS_GetListenAddressString(rxNode), addr);
+    ASSERT(ret == DPS_OK);
+
+    pub = CreatePublication(node, topics, numTopics, NULL);
     ret = DPS_PublicationAddSubId(pub, &PskId[0]);
     ASSERT(ret == DPS_OK);
-    ret = DPS_Publish(pub, NULL, 0, 0);
+    cos.expectedSequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+    /*
+     * The first publication is retained and its decryption is held
+     * up on the receiver
+     */
+    sequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+    ret = DPS_Publish(pub, (const uint8_t*)&sequenceNum, sizeof(sequenceNum), 10);
     ASSERT(ret == DPS_OK);
-    ret = DPS_WaitForEvent(event);
+    WaitForDecrypts(&gate, 1);
+    /*
+     * Linking another subscriber resends the retained publication,
+     * the receiver must drop the copy since the original is still
+     * waiting for decryption
+     */
+    obsEvent = DPS_CreateEvent();
+    ASSERT(obsEvent);
+    obsNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(obsNode);
+    ret = DPS_StartNode(obsNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+    obsSub = DPS_CreateSubscription(obsNode, topics, numTopics);
+    ASSERT(obsSub);
+    ret = DPS_SetSubscriptionData(obsSub, obsEvent);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(obsSub, RetainedResendHandler);
+    ASSERT(ret == DPS_OK);
+    obsAddr = DPS_CreateAddress();
+    ASSERT(obsAddr);
+    ret = DPS_LinkTo(obsNode, DPS_GetListenAddressString(node), obsAddr);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_TimedWaitForEvent(obsEvent, 10000);
+    ASSERT(ret == DPS_OK);
+    /*
+     * The rest of the burst is decrypted but must wait behind the
+     * first publication
+     */
+    for (i = 1; i < NUM_CRYPTO_OFFLOAD_PUBS; ++i) {
+        sequenceNum = DPS_PublicationGetSequenceNum(pub) + 1;
+        ret = DPS_Publish(pub, (const uint8_t*)&sequenceNum, sizeof(sequenceNum), 0);
+        ASSERT(ret == DPS_OK);
+    }
+    WaitForDecrypts(&gate, NUM_CRYPTO_OFFLOAD_PUBS);
+    ASSERT(cos.numReceived == 0);
+    OpenDecryptGate(&gate);
+    ret = DPS_TimedWaitForEvent(cos.event, 10000);
+    ASSERT(ret == DPS_OK);
+    ASSERT(cos.numReceived == NUM_CRYPTO_OFFLOAD_PUBS);
+    /*
+     * The resent copy of the first publication was not decrypted
+     */
+    ASSERT(gate.numDecrypts == NUM_CRYPTO_OFFLOAD_PUBS);
+
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroySubscription(obsSub, NULL);
+    DPS_DestroyNode(obsNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroySubscription(sub, NULL);
+    DPS_DestroyNode(rxNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
+    DPS_DestroyKeyStore(rxKeyStore);
+    uv_cond_destroy(&gate.cond);
+    uv_mutex_destroy(&gate.mutex);
+    DPS_DestroyAddress(obsAddr);
+    DPS_DestroyAddress(addr);
+    DPS_DestroyEvent(obsEvent);
+    DPS_DestroyEvent(cos.event);
+    DPS_DestroyEvent(event);
+}
+
+#if defined(DPS_USE_UDP)
+#define NUM_RECEIVE_THREADS             4
+#define NUM_RECEIVE_THREAD_PUBLISHERS   8
+
+typedef struct _ReceiveThreadsSubscription {
+    DPS_Event* event;
+    DPS_UUID pubId;
+} ReceiveThreadsSubscription;
+
+static void ReceiveThreadsHandler(DPS_Subscription* sub, const DPS_Publication* pub, uint8_t* payload, size_t len)
+{
+    ReceiveThreadsSubscription* rts = (ReceiveThreadsSubscription*)DPS_GetSubscriptionData(sub);
+
+    if (DPS_UUIDCompare(DPS_PublicationGetUUID(pub), &rts->pubId) == 0) {
+        DPS_SignalEvent(rts->event, DPS_OK);
+    }
+}
+
+static void TestReceiveThreads(DPS_Node* node, DPS_MemoryKeyStore* keyStore)
+{
+    static const char* topics[] = { __FUNCTION__ };
+    static const char* fwdTopics[] = { "ReceiveThreadsForwarded" };
+    static const size_t numTopics = 1;
+    ReceiveThreadsSubscription rts;
+    DPS_ReceiveThreadStats stats;
+    DPS_Subscription* sub = NULL;
+    DPS_Subscription* fwdSub = NULL;
+    DPS_NodeAddress* fwdAddr = NULL;
+    DPS_Node* rxNode = NULL;
+    DPS_Node* fwdNode = NULL;
+    DPS_Event* event = NULL;
+    DPS_Status ret;
+    size_t i;
+    size_t j;
+
+    DPS_PRINT("%s\n", __FUNCTION__);
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+
+    ret = DPS_SetNodeReceiveThreads(node, NUM_RECEIVE_THREADS);
+    ASSERT(ret == DPS_ERR_INVALID);
+
+    rxNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(rxNode);
+    ret = DPS_SetNodeReceiveThreads(rxNode, NUM_RECEIVE_THREADS);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_GetNodeReceiveThreadStats(rxNode, &stats);
+    ASSERT(ret == DPS_ERR_NOT_STARTED);
+    ret = DPS_StartNode(rxNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_GetNodeReceiveThreadStats(rxNode, NULL);
+    ASSERT(ret == DPS_ERR_NULL);
+    ret = DPS_GetNodeReceiveThreadStats(node, &stats);
     ASSERT(ret == DPS_OK);
+    ASSERT(stats.numThreads == 0);
 
+    rts.event = DPS_CreateEvent();
+    ASSERT(rts.event);
+    sub = DPS_CreateSubscription(rxNode, topics, numTopics);
+    ASSERT(sub);
+    ret = DPS_SetSubscriptionData(sub, &rts);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(sub, ReceiveThreadsHandler);
+    ASSERT(ret == DPS_OK);
+    /*
+     * The receive node has no local subscription to the forwarded
+     * topic so the handlers are skipped when the forwarded
+     * publications are decoded on a receive thread
+     */
+    fwdNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+    ASSERT(fwdNode);
+    ret = DPS_StartNode(fwdNode, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+    fwdSub = DPS_CreateSubscription(fwdNode, fwdTopics, numTopics);
+    ASSERT(fwdSub);
+    ret = DPS_SetSubscriptionData(fwdSub, &rts);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_Subscribe(fwdSub, ReceiveThreadsHandler);
+    ASSERT(ret == DPS_OK);
+    fwdAddr = DPS_CreateAddress();
+    ASSERT(fwdAddr);
+    ret = DPS_LinkTo(fwdNode, DPS_GetListenAddressString(rxNode), fwdAddr);
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * The kernel picks the receiving socket from the sender's address
+     * so publish from several nodes to exercise the receive threads,
+     * alternating between the local and the forwarded topic
+     */
+    for (i = 0; i < NUM_RECEIVE_THREAD_PUBLISHERS; ++i) {
+        DPS_Publication* pub = NULL;
+        DPS_NodeAddress* addr = NULL;
+        DPS_Node* pubNode = NULL;
+
+        pubNode = DPS_CreateNode("/.", DPS_MemoryKeyStoreHandle(keyStore), NULL);
+        ASSERT(pubNode);
+        ret = DPS_StartNode(pubNode, DPS_MCAST_PUB_DISABLED, NULL);
+        ASSERT(ret == DPS_OK);
+        addr = DPS_CreateAddress();
+        ASSERT(addr);
+        ret = DPS_LinkTo(pubNode, DPS_GetListenAddressString(rxNode), addr);
+        ASSERT(ret == DPS_OK);
+
+        pub = CreatePublication(pubNode, (i & 1) ? fwdTopics : topics, numTopics, NULL);
+        rts.pubId = *DPS_PublicationGetUUID(pub);
+        /*
+         * Keep publishing until the subscription has propagated to
+         * the publishing node
+         */
+        for (j = 0; j < 100; ++j) {
+            ret = DPS_Publish(pub, NULL, 0, 0);
+            ASSERT(ret == DPS_OK);
+            ret = DPS_TimedWaitForEvent(rts.event, 100);
+            if (ret == DPS_OK) {
+                break;
+            }
+        }
+        ASSERT(ret == DPS_OK);
+
+        DPS_DestroyPublication(pub, NULL);
+        DPS_DestroyAddress(addr);
+        DPS_DestroyNode(pubNode, OnNodeDestroyed, event);
+        DPS_WaitForEvent(event);
+    }
+    /*
+     * The traffic from at least one of the publishing nodes went to
+     * a receive thread
+     */
+    ret = DPS_GetNodeReceiveThreadStats(rxNode, &stats);
+    ASSERT(ret == DPS_OK);
+    ASSERT(stats.numThreads == NUM_RECEIVE_THREADS);
+    ASSERT(stats.received > 0);
+    ASSERT(stats.decoded > 0);
+
+    DPS_DestroySubscription(fwdSub, NULL);
+    DPS_DestroyAddress(fwdAddr);
+    DPS_DestroyNode(fwdNode, OnNodeDestroyed, event);
+    DPS_WaitForEvent(event);
     DPS_DestroySubscription(sub, NULL);
-    DPS_DestroyNode(subNode, OnNodeDestroyed, event);
+    DPS_DestroyNode(rxNode, OnNodeDestroyed, event);
     DPS_WaitForEvent(event);
-    DPS_DestroyMemoryKeyStore(subKeyStore);
+    DPS_DestroyEvent(rts.event);
     DPS_DestroyEvent(event);
-    DPS_DestroyPublication(pub, NULL);
 }
+#endif
 
 typedef void (*TEST)(DPS_Node*, DPS_MemoryKeyStore*);
 
@@ -685,6 +2449,8 @@ int main(int argc, char** argv)
         TestCreateDestroy,
         TestLoopbackLargeMessage,
         TestLoopbackAckLargeMessage,
+        TestManyPublicationAcks,
+        TestLoopbackManySubscriptions,
         TestDelayedAck,
         /*
          * Reliability is only expected for loopback and reliable
@@ -696,9 +2462,25 @@ int main(int argc, char** argv)
 #endif
         TestRetainedMessage,
         TestRetainedExpired,
+        TestRetainedExpiryOrder,
         TestSequenceNumbers,
+        TestConcurrentPublish,
+        TestPublishBatch,
+        TestPublishWhileDestroying,
+        TestHistorySize,
+        TestPublishFanOut,
+        TestRxBufferPool,
+        TestReceiveBurst,
+        TestRemoteMatchCache,
         TestPublishNoRoutes,
         TestRemoveSubId,
+        TestHandlerThreads,
+        TestHandlerThreadsReceive,
+        TestCryptoOffload,
+        TestCryptoOffloadReceive,
+#if defined(DPS_USE_UDP)
+        TestReceiveThreads,
+#endif
         NULL
     };
     TEST* test;
@@ -0,0 +1,203 @@
+/*
+ *******************************************************************
+ *
+ * Copyright 2019 Intel Corporation All rights reserved.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+/*
+ * Counts the heap allocations made while publishing
+ */
+#include "test.h"
+#include <dps/event.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_ALLOC_COUNT
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define NO_ALLOC_COUNT
+#endif
+#endif
+
+#if defined(__GLIBC__) && !defined(NO_ALLOC_COUNT)
+
+/*
+ * The allocation functions are replaced so the allocations made by
+ * the library on any thread are counted
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static volatile int counting = DPS_FALSE;
+static uint32_t numAllocs = 0;
+
+void* malloc(size_t size)
+{
+    if (counting) {
+        __sync_fetch_and_add(&numAllocs, 1);
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    if (counting) {
+        __sync_fetch_and_add(&numAllocs, 1);
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (counting) {
+        __sync_fetch_and_add(&numAllocs, 1);
+    }
+    return __libc_realloc(ptr, size);
+}
+
+static void StartCounting(void)
+{
+    numAllocs = 0;
+    __sync_synchronize();
+    counting = DPS_TRUE;
+}
+
+static uint32_t StopCounting(void)
+{
+    counting = DPS_FALSE;
+    __sync_synchronize();
+    return numAllocs;
+}
+
+#define NUM_WARMUP   8
+#define NUM_PUBS     100
+
+static void OnPublishComplete(DPS_Publication* pub, const DPS_Buffer* bufs, size_t numBufs, DPS_Status status,
+                              void* data)
+{
+    DPS_SignalEvent((DPS_Event*)data, status);
+}
+
+static void Publish(DPS_Publication* pub, DPS_Event* event, const DPS_Buffer* bufs, size_t numBufs)
+{
+    DPS_Status ret;
+
+    ret = DPS_PublishBufs(pub, bufs, numBufs, 0, OnPublishComplete, event);
+    ASSERT(ret == DPS_OK);
+    ret = DPS_WaitForEvent(event);
+    ASSERT(ret == DPS_OK);
+}
+
+int main(int argc, char** argv)
+{
+    static const char* topics[] = { "alloc/count" };
+    static uint8_t payload[256];
+    DPS_Buffer bufs[2] = { { payload, sizeof(payload) / 2 }, { payload + sizeof(payload) / 2, sizeof(payload) / 2 } };
+    DPS_Publication* pub = NULL;
+    DPS_Node* node = NULL;
+    DPS_Event* event = NULL;
+    DPS_Event* event2 = NULL;
+    DPS_Status ret;
+    uint32_t n;
+    int i;
+
+    DPS_Debug = DPS_FALSE;
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-d")) {
+            DPS_Debug = DPS_TRUE;
+        }
+    }
+
+    event = DPS_CreateEvent();
+    ASSERT(event);
+    event2 = DPS_CreateEvent();
+    ASSERT(event2);
+    node = DPS_CreateNode("/.", NULL, NULL);
+    ASSERT(node);
+    ret = DPS_StartNode(node, DPS_MCAST_PUB_DISABLED, NULL);
+    ASSERT(ret == DPS_OK);
+    pub = DPS_CreatePublication(node);
+    ASSERT(pub);
+    ret = DPS_InitPublication(pub, topics, 1, DPS_FALSE, NULL);
+    ASSERT(ret == DPS_OK);
+
+    /*
+     * The first publish allocates the request
+     */
+    StartCounting();
+    Publish(pub, event, bufs, 1);
+    n = StopCounting();
+    DPS_PRINT("First publish: %u allocations\n", n);
+    ASSERT(n <= 1);
+    /*
+     * The publish callback is called before the request is released
+     * so there can be two requests in use at once
+     */
+    for (i = 0; i < NUM_WARMUP; ++i) {
+        ret = DPS_PublishBufs(pub, bufs, 1, 0, OnPublishComplete, event2);
+        ASSERT(ret == DPS_OK);
+        Publish(pub, event, bufs, 1);
+        ret = DPS_WaitForEvent(event2);
+        ASSERT(ret == DPS_OK);
+    }
+    /*
+     * A steady state publisher reuses the completed requests
+     */
+    StartCounting();
+    for (i = 0; i < NUM_PUBS; ++i) {
+        Publish(pub, event, bufs, 1);
+    }
+    n = StopCounting();
+    DPS_PRINT("%d publishes: %u allocations\n", NUM_PUBS, n);
+    ASSERT(n == 0);
+    /*
+     * Publishing with fewer payload buffers reuses the larger requests
+     */
+    for (i = 0; i < NUM_WARMUP; ++i) {
+        ret = DPS_PublishBufs(pub, bufs, 2, 0, OnPublishComplete, event2);
+        ASSERT(ret == DPS_OK);
+        Publish(pub, event, bufs, 2);
+        ret = DPS_WaitForEvent(event2);
+        ASSERT(ret == DPS_OK);
+    }
+    StartCounting();
+    for (i = 0; i < NUM_PUBS; ++i) {
+        Publish(pub, event, bufs, 1 + (i & 1));
+    }
+    n = StopCounting();
+    DPS_PRINT("%d publishes of varying buffers: %u allocations\n", NUM_PUBS, n);
+    ASSERT(n == 0);
+
+    DPS_DestroyPublication(pub, NULL);
+    DPS_DestroyNode(node, NULL, NULL);
+    DPS_DestroyEvent(event2);
+    DPS_DestroyEvent(event);
+    DPS_PRINT("Passed\n");
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    DPS_PRINT("Skipped, allocations can only be counted with glibc and without sanitizers\n");
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -54,6 +54,36 @@ static int BloomMatch(char** pubs, size_t numPubs, char** subs, size_t numSubs,
     return cmp;
 }
 
+static void OnTrieMatch(void* data, uint32_t generation)
+{
+    ++(*(size_t*)data);
+}
+
+static int TrieMatch(char** pubs, size_t numPubs, char** subs, size_t numSubs, int noWildCard)
+{
+    DPS_TopicTrie* trie = DPS_TopicTrieAlloc(separators);
+    DPS_TopicTrieEntry* entry;
+    size_t numMatched = 0;
+    size_t i;
+    int match = DPS_FALSE;
+
+    ASSERT(trie);
+    for (i = 0; i < numSubs; ++i) {
+        if (noWildCard && subs[i][strcspn(subs[i], "+#")]) {
+            goto Exit;
+        }
+        if (DPS_TopicTrieInsert(trie, subs[i], &numMatched, &entry) != DPS_OK) {
+            goto Exit;
+        }
+    }
+    if (DPS_TopicTrieMatch(trie, pubs, numPubs, OnTrieMatch, NULL) == DPS_OK) {
+        match = (numMatched == numSubs);
+    }
+Exit:
+    DPS_TopicTrieFree(trie);
+    return match;
+}
+
 int main(int argc, char** argv)
 {
     char* pubs[MAX_TOPICS + 1];
@@ -119,6 +149,10 @@ int main(int argc, char** argv)
         DPS_PRINT("Error: %s\n", DPS_ErrTxt(ret));
         return EXIT_FAILURE;
     }
+    if (TrieMatch(pubs, numPubs, subs, numSubs, noWildCard) != match) {
+        DPS_PRINT("FAILURE: Different trie match\n");
+        return EXIT_FAILURE;
+    }
     if (match) {
         DPS_PRINT("Match\n");
     } else {
@@ -12,7 +12,8 @@ import sys
 timeout=300
 
 if 'FSAN' not in os.environ or os.environ['FSAN'] == 'no':
-    tests = [os.path.join('build', 'test', 'bin', 'cbortest'),
+    tests = [os.path.join('build', 'test', 'bin', 'bitvec'),
+             os.path.join('build', 'test', 'bin', 'cbortest'),
              os.path.join('build', 'test', 'bin', 'cosetest'),
              os.path.join('build', 'test', 'bin', 'countvec'),
              os.path.join('build', 'test', 'bin', 'hist_unit'),
@@ -20,6 +21,7 @@ if 'FSAN' not in os.environ or os.environ['FSAN'] == 'no':
              os.path.join('build', 'test', 'bin', 'link'),
              os.path.join('build', 'test', 'bin', 'packtest'),
              os.path.join('build', 'test', 'bin', 'publish'),
+             os.path.join('build', 'test', 'bin', 'publish_alloc'),
              os.path.join('build', 'test', 'bin', 'pubsub'),
              os.path.join('build', 'test', 'bin', 'uuid'),
              os.path.join('build', 'test', 'bin', 'rle_compression'),
@@ -15,3 +15,11 @@ topic_match('No match', '-p a/b/c -s +/y/#')
 topic_match('Match', '-p a/b/c -s +/+/#')
 topic_match('Match', '-p a/b/c -s +/+/+')
 topic_match('No match', '-p a/b/c -s +/+/+/#')
+topic_match('Match', '-p a/b/c -s #')
+topic_match('Match', '-p a/b/c -s a/#')
+topic_match('No match', '-p a -s a/#')
+topic_match('No match', '-p a/b/c -s a/+')
+topic_match('Match', '-p a.b/c -s a.+/c')
+topic_match('No match', '-p a.b/c -s a/b/c')
+topic_match('Match', '-p a/b/c -p 1/2/3 -s a/+/c 1/#')
+topic_match('No match', '-p a/b/c -p 1/2/3 -s a/+/c 2/#')